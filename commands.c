@@ -76,6 +76,7 @@ cmd_scrollback_up(struct terminal *term, int rows)
 
     selection_view_up(term, new_view);
     term->grid->view = new_view;
+    grid_thaw_view(term->grid, term->rows);
 
     if (diff >= 0 && diff < term->rows) {
         term_damage_scroll(term, DAMAGE_SCROLL_REVERSE_IN_VIEW, (struct scroll_region){0, term->rows}, diff);
@@ -150,6 +151,7 @@ cmd_scrollback_down(struct terminal *term, int rows)
 
     selection_view_down(term, new_view);
     term->grid->view = new_view;
+    grid_thaw_view(term->grid, term->rows);
 
     if (diff >= 0 && diff < term->rows) {
         term_damage_scroll(term, DAMAGE_SCROLL_IN_VIEW, (struct scroll_region){0, term->rows}, diff);
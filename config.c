@@ -141,6 +141,7 @@ static const char *const search_binding_action_map[] = {
     [BIND_ACTION_SEARCH_EXTEND_WORD_WS] = "extend-to-next-whitespace",
     [BIND_ACTION_SEARCH_CLIPBOARD_PASTE] = "clipboard-paste",
     [BIND_ACTION_SEARCH_PRIMARY_PASTE] = "primary-paste",
+    [BIND_ACTION_SEARCH_TOGGLE_REGEX] = "toggle-regex",
 };
 
 static const char *const url_binding_action_map[] = {
@@ -2223,6 +2224,9 @@ parse_section_tweak(struct context *ctx)
     else if (strcmp(key, "damage-whole-window") == 0)
         return value_to_bool(ctx, &conf->tweak.damage_whole_window);
 
+    else if (strcmp(key, "parser-threads") == 0)
+        return value_to_bool(ctx, &conf->tweak.parser_threads);
+
     else if (strcmp(key, "grapheme-shaping") == 0) {
         if (!value_to_bool(ctx, &conf->tweak.grapheme_shaping))
             return false;
@@ -2303,6 +2307,12 @@ parse_section_tweak(struct context *ctx)
         return true;
     }
 
+    else if (strcmp(key, "max-shm-cache-size-mb") == 0)
+        return value_to_uint32(ctx, 10, &conf->tweak.max_shm_cache_size_mb);
+
+    else if (strcmp(key, "cold-scrollback") == 0)
+        return value_to_uint32(ctx, 10, &conf->tweak.cold_scrollback);
+
     else if (strcmp(key, "box-drawing-base-thickness") == 0)
         return value_to_double(ctx, &conf->tweak.box_drawing_base_thickness);
 
@@ -2638,6 +2648,7 @@ add_default_search_bindings(struct config *conf)
         {BIND_ACTION_SEARCH_CLIPBOARD_PASTE, m_ctrl, {{XKB_KEY_v}}},
         {BIND_ACTION_SEARCH_CLIPBOARD_PASTE, m_ctrl, {{XKB_KEY_y}}},
         {BIND_ACTION_SEARCH_PRIMARY_PASTE, m_shift, {{XKB_KEY_Insert}}},
+        {BIND_ACTION_SEARCH_TOGGLE_REGEX, m_alt, {{XKB_KEY_r}}},
     };
 
     conf->bindings.search.count = ALEN(bindings);
@@ -2815,8 +2826,11 @@ config_load(struct config *conf, const char *conf_path,
             .delayed_render_lower_ns = 500000,         /* 0.5ms */
             .delayed_render_upper_ns = 16666666 / 2,   /* half a frame period (60Hz) */
             .max_shm_pool_size = 512 * 1024 * 1024,
+            .max_shm_cache_size_mb = 32,
+            .cold_scrollback = 1000,
             .render_timer = RENDER_TIMER_NONE,
             .damage_whole_window = false,
+            .parser_threads = false,
             .box_drawing_base_thickness = 0.04,
             .box_drawing_solid_shades = true,
             .font_monospace_warn = true,
@@ -268,6 +268,7 @@ struct config {
     struct {
         enum fcft_scaling_filter fcft_filter;
         bool overflowing_glyphs;
+        bool parser_threads;
         bool grapheme_shaping;
         enum {
             GRAPHEME_WIDTH_WCSWIDTH,
@@ -284,6 +285,8 @@ struct config {
         uint32_t delayed_render_lower_ns;
         uint32_t delayed_render_upper_ns;
         off_t max_shm_pool_size;
+        uint32_t max_shm_cache_size_mb;
+        uint32_t cold_scrollback;
         float box_drawing_base_thickness;
         bool box_drawing_solid_shades;
         bool font_monospace_warn;
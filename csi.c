@@ -17,6 +17,7 @@
 #include "config.h"
 #include "debug.h"
 #include "grid.h"
+#include "search.h"
 #include "selection.h"
 #include "sixel.h"
 #include "util.h"
@@ -508,6 +509,7 @@ decset_decrst(struct terminal *term, unsigned param, bool enable)
                 term_save_cursor(term);
 
             term->grid = &term->alt;
+            search_index_invalidate(term, 0, term->normal.num_rows);
 
             /* Cursor retains its position from the normal grid */
             term_cursor_to(
@@ -523,6 +525,7 @@ decset_decrst(struct terminal *term, unsigned param, bool enable)
             selection_cancel(term);
 
             term->grid = &term->normal;
+            search_index_invalidate(term, 0, term->normal.num_rows);
 
             /* Cursor retains its position from the alt grid */
             term_cursor_to(
@@ -1022,8 +1025,9 @@ csi_dispatch(struct terminal *term, uint8_t final)
                     &term->grid->cur_row->cells[term->grid->cursor.point.col + count],
                     remaining * sizeof(term->grid->cur_row->cells[0]));
 
-            for (size_t c = 0; c < remaining; c++)
-                term->grid->cur_row->cells[term->grid->cursor.point.col + c].attrs.clean = 0;
+            grid_row_dirty_cells(
+                term->grid->cur_row, term->grid->cursor.point.col,
+                term->grid->cursor.point.col + remaining);
             term->grid->cur_row->dirty = true;
 
             /* Erase the remainder of the line */
@@ -1050,8 +1054,9 @@ csi_dispatch(struct terminal *term, uint8_t final)
             memmove(&term->grid->cur_row->cells[term->grid->cursor.point.col + count],
                     &term->grid->cur_row->cells[term->grid->cursor.point.col],
                     remaining * sizeof(term->grid->cur_row->cells[0]));
-            for (size_t c = 0; c < remaining; c++)
-                term->grid->cur_row->cells[term->grid->cursor.point.col + count + c].attrs.clean = 0;
+            grid_row_dirty_cells(
+                term->grid->cur_row, term->grid->cursor.point.col + count,
+                term->grid->cursor.point.col + count + remaining);
             term->grid->cur_row->dirty = true;
 
             /* Erase (insert space characters) */
@@ -14,6 +14,7 @@ struct extraction_context {
     size_t newline_count;
     bool strip_trailing_empty;
     bool failed;
+    bool last_row_linebreak;
     const struct row *last_row;
     const struct cell *last_cell;
     enum selection_kind selection_kind;
@@ -145,6 +146,50 @@ out:
     return ret;
 }
 
+bool
+extract_flush(struct extraction_context *ctx, char **text, size_t *len)
+{
+    *text = NULL;
+    *len = 0;
+
+    if (ctx->failed)
+        return false;
+
+    /* Convert what we have this far, but keep pending newlines and
+     * empty cells, since we don’t know yet if they are trailing */
+    if (!ensure_size(ctx, 1)) {
+        ctx->failed = true;
+        return false;
+    }
+
+    ctx->buf[ctx->idx] = L'\0';
+
+    size_t _len = wcstombs(NULL, ctx->buf, 0);
+    if (_len == (size_t)-1) {
+        LOG_ERRNO("failed to convert text to UTF-8");
+        ctx->failed = true;
+        return false;
+    }
+
+    *text = malloc(_len + 1);
+    if (unlikely(*text == NULL)) {
+        LOG_ERRNO("malloc() failed");
+        ctx->failed = true;
+        return false;
+    }
+
+    wcstombs(*text, ctx->buf, _len + 1);
+    *len = _len;
+    ctx->idx = 0;
+    return true;
+}
+
+size_t
+extract_pending(const struct extraction_context *ctx)
+{
+    return ctx->idx;
+}
+
 bool
 extract_one(const struct terminal *term, const struct row *row,
             const struct cell *cell, int col, void *context)
@@ -158,7 +203,7 @@ extract_one(const struct terminal *term, const struct row *row,
         /* New row - determine if we should insert a newline or not */
 
         if (ctx->selection_kind != SELECTION_BLOCK) {
-            if (ctx->last_row->linebreak ||
+            if (ctx->last_row_linebreak ||
                 ctx->empty_count > 0 ||
                 cell->wc == 0)
             {
@@ -206,6 +251,7 @@ extract_one(const struct terminal *term, const struct row *row,
     if (cell->wc == 0) {
         ctx->empty_count++;
         ctx->last_row = row;
+        ctx->last_row_linebreak = row->linebreak;
         ctx->last_cell = cell;
         return true;
     }
@@ -255,6 +301,7 @@ extract_one(const struct terminal *term, const struct row *row,
     }
 
     ctx->last_row = row;
+    ctx->last_row_linebreak = row->linebreak;
     ctx->last_cell = cell;
     return true;
 
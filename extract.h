@@ -15,6 +15,17 @@ bool extract_one(
     const struct terminal *term, const struct row *row, const struct cell *cell,
     int col, void *context);
 
+/*
+ * Converts, and returns, the text extracted this far. The context
+ * remains valid, and more cells can be extracted. Use
+ * extract_finish() to retrieve the last part of the text.
+ */
+bool extract_flush(
+    struct extraction_context *context, char **text, size_t *len);
+
+/* Number of characters extracted since the last flush */
+size_t extract_pending(const struct extraction_context *context);
+
 bool extract_finish(
     struct extraction_context *context, char **text, size_t *len);
 bool extract_finish_wide(
@@ -7,6 +7,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <threads.h>
 
 #include <sys/epoll.h>
 
@@ -38,8 +39,21 @@ struct hook {
 
 typedef tll(struct hook) hooks_t;
 
+struct wait_hook {
+    fdm_wait_hook_t callback;
+    void *callback_data;
+};
+
 struct fdm {
     int epoll_fd;
+
+    /*
+     * Protects the FD lists, allowing FDs to be added, removed and
+     * modified from other threads (e.g. terminal parser threads)
+     * while we’re waiting for events. Hooks and signal handlers are
+     * main thread only.
+     */
+    mtx_t lock;
     bool is_polling;
     tll(struct fd_handler *) fds;
     tll(struct fd_handler *) deferred_delete;
@@ -50,6 +64,8 @@ struct fdm {
     hooks_t hooks_low;
     hooks_t hooks_normal;
     hooks_t hooks_high;
+
+    tll(struct wait_hook) wait_hooks;
 };
 
 static volatile sig_atomic_t got_signal = false;
@@ -98,7 +114,16 @@ fdm_init(void)
         .hooks_low = tll_init(),
         .hooks_normal = tll_init(),
         .hooks_high = tll_init(),
+        .wait_hooks = tll_init(),
     };
+
+    if (mtx_init(&fdm->lock, mtx_plain) != thrd_success) {
+        LOG_ERR("failed to instantiate FDM mutex");
+        free(sig_handlers);
+        free(fdm);
+        return NULL;
+    }
+
     return fdm;
 }
 
@@ -118,7 +143,8 @@ fdm_destroy(struct fdm *fdm)
 
     if (tll_length(fdm->hooks_low) > 0 ||
         tll_length(fdm->hooks_normal) > 0 ||
-        tll_length(fdm->hooks_high) > 0)
+        tll_length(fdm->hooks_high) > 0 ||
+        tll_length(fdm->wait_hooks) > 0)
     {
         LOG_WARN("hook list not empty");
     }
@@ -128,6 +154,7 @@ fdm_destroy(struct fdm *fdm)
     xassert(tll_length(fdm->hooks_low) == 0);
     xassert(tll_length(fdm->hooks_normal) == 0);
     xassert(tll_length(fdm->hooks_high) == 0);
+    xassert(tll_length(fdm->wait_hooks) == 0);
 
     sigprocmask(SIG_SETMASK, &fdm->sigmask, NULL);
     free(fdm->signal_handlers);
@@ -137,6 +164,8 @@ fdm_destroy(struct fdm *fdm)
     tll_free(fdm->hooks_low);
     tll_free(fdm->hooks_normal);
     tll_free(fdm->hooks_high);
+    tll_free(fdm->wait_hooks);
+    mtx_destroy(&fdm->lock);
     close(fdm->epoll_fd);
     free(fdm);
 
@@ -147,6 +176,14 @@ fdm_destroy(struct fdm *fdm)
 bool
 fdm_add(struct fdm *fdm, int fd, int events, fdm_fd_handler_t cb, void *data)
 {
+    struct fd_handler *handler = malloc(sizeof(*handler));
+    if (unlikely(handler == NULL)) {
+        LOG_ERRNO("malloc() failed");
+        return false;
+    }
+
+    mtx_lock(&fdm->lock);
+
 #if defined(_DEBUG)
     tll_foreach(fdm->fds, it) {
         if (it->item->fd == fd) {
@@ -155,12 +192,6 @@ fdm_add(struct fdm *fdm, int fd, int events, fdm_fd_handler_t cb, void *data)
     }
 #endif
 
-    struct fd_handler *handler = malloc(sizeof(*handler));
-    if (unlikely(handler == NULL)) {
-        LOG_ERRNO("malloc() failed");
-        return false;
-    }
-
     *handler = (struct fd_handler) {
         .fd = fd,
         .events = events,
@@ -180,9 +211,11 @@ fdm_add(struct fdm *fdm, int fd, int events, fdm_fd_handler_t cb, void *data)
         LOG_ERRNO("failed to register FD=%d with epoll", fd);
         free(handler);
         tll_pop_back(fdm->fds);
+        mtx_unlock(&fdm->lock);
         return false;
     }
 
+    mtx_unlock(&fdm->lock);
     return true;
 }
 
@@ -192,6 +225,8 @@ fdm_del_internal(struct fdm *fdm, int fd, bool close_fd)
     if (fd == -1)
         return true;
 
+    mtx_lock(&fdm->lock);
+
     tll_foreach(fdm->fds, it) {
         if (it->item->fd != fd)
             continue;
@@ -209,9 +244,12 @@ fdm_del_internal(struct fdm *fdm, int fd, bool close_fd)
             free(it->item);
 
         tll_remove(fdm->fds, it);
+        mtx_unlock(&fdm->lock);
         return true;
     }
 
+    mtx_unlock(&fdm->lock);
+
     LOG_ERR("no such FD: %d", fd);
     close(fd);
     return false;
@@ -253,13 +291,19 @@ event_modify(struct fdm *fdm, struct fd_handler *fd, int new_events)
 bool
 fdm_event_add(struct fdm *fdm, int fd, int events)
 {
+    mtx_lock(&fdm->lock);
+
     tll_foreach(fdm->fds, it) {
         if (it->item->fd != fd)
             continue;
 
-        return event_modify(fdm, it->item, it->item->events | events);
+        bool ret = event_modify(fdm, it->item, it->item->events | events);
+        mtx_unlock(&fdm->lock);
+        return ret;
     }
 
+    mtx_unlock(&fdm->lock);
+
     LOG_ERR("FD=%d not registered with the FDM", fd);
     return false;
 }
@@ -267,13 +311,19 @@ fdm_event_add(struct fdm *fdm, int fd, int events)
 bool
 fdm_event_del(struct fdm *fdm, int fd, int events)
 {
+    mtx_lock(&fdm->lock);
+
     tll_foreach(fdm->fds, it) {
         if (it->item->fd != fd)
             continue;
 
-        return event_modify(fdm, it->item, it->item->events & ~events);
+        bool ret = event_modify(fdm, it->item, it->item->events & ~events);
+        mtx_unlock(&fdm->lock);
+        return ret;
     }
 
+    mtx_unlock(&fdm->lock);
+
     LOG_ERR("FD=%d not registered with the FDM", fd);
     return false;
 }
@@ -327,6 +377,28 @@ fdm_hook_del(struct fdm *fdm, fdm_hook_t hook, enum fdm_hook_priority priority)
     return false;
 }
 
+bool
+fdm_wait_hook_add(struct fdm *fdm, fdm_wait_hook_t hook, void *data)
+{
+    tll_push_back(fdm->wait_hooks, ((struct wait_hook){hook, data}));
+    return true;
+}
+
+bool
+fdm_wait_hook_del(struct fdm *fdm, fdm_wait_hook_t hook, void *data)
+{
+    tll_foreach(fdm->wait_hooks, it) {
+        if (it->item.callback != hook || it->item.callback_data != data)
+            continue;
+
+        tll_remove(fdm->wait_hooks, it);
+        return true;
+    }
+
+    LOG_WARN("wait hook=0x%" PRIxPTR " not registered", (uintptr_t)hook);
+    return false;
+}
+
 static void
 signal_handler(int signo)
 {
@@ -422,13 +494,29 @@ fdm_poll(struct fdm *fdm)
         it->item.callback(fdm, it->item.callback_data);
     }
 
-    struct epoll_event events[tll_length(fdm->fds)];
+    /*
+     * From here on, FDs deleted by other threads (while we’re
+     * waiting), or by callbacks, are freed when we’re done
+     * dispatching events.
+     */
+    mtx_lock(&fdm->lock);
+    const size_t fd_count = tll_length(fdm->fds);
+    fdm->is_polling = true;
+    mtx_unlock(&fdm->lock);
+
+    struct epoll_event events[fd_count];
 
-    int r = epoll_pwait(
-        fdm->epoll_fd, events, tll_length(fdm->fds), -1, &fdm->sigmask);
+    tll_foreach(fdm->wait_hooks, it)
+        it->item.callback(fdm, true, it->item.callback_data);
 
+    int r = epoll_pwait(fdm->epoll_fd, events, fd_count, -1, &fdm->sigmask);
     int errno_copy = errno;
 
+    tll_foreach(fdm->wait_hooks, it)
+        it->item.callback(fdm, false, it->item.callback_data);
+
+    bool ret = true;
+
     if (unlikely(got_signal)) {
         got_signal = false;
 
@@ -438,23 +526,22 @@ fdm_poll(struct fdm *fdm)
                 struct sig_handler *handler = &fdm->signal_handlers[i];
 
                 xassert(handler->callback != NULL);
-                if (!handler->callback(fdm, i, handler->callback_data))
-                    return false;
+                if (!handler->callback(fdm, i, handler->callback_data)) {
+                    ret = false;
+                    goto out;
+                }
             }
         }
     }
 
     if (unlikely(r < 0)) {
-        if (errno_copy == EINTR)
-            return true;
-
-        LOG_ERRNO_P(errno_copy, "failed to epoll");
-        return false;
+        if (errno_copy != EINTR) {
+            LOG_ERRNO_P(errno_copy, "failed to epoll");
+            ret = false;
+        }
+        goto out;
     }
 
-    bool ret = true;
-
-    fdm->is_polling = true;
     for (int i = 0; i < r; i++) {
         struct fd_handler *fd = events[i].data.ptr;
         if (fd->deleted)
@@ -465,12 +552,16 @@ fdm_poll(struct fdm *fdm)
             break;
         }
     }
+
+out:
+    mtx_lock(&fdm->lock);
     fdm->is_polling = false;
 
     tll_foreach(fdm->deferred_delete, it) {
         free(it->item);
         tll_remove(fdm->deferred_delete, it);
     }
+    mtx_unlock(&fdm->lock);
 
     return ret;
 }
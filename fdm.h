@@ -7,6 +7,7 @@ struct fdm;
 typedef bool (*fdm_fd_handler_t)(struct fdm *fdm, int fd, int events, void *data);
 typedef bool (*fdm_signal_handler_t)(struct fdm *fdm, int signo, void *data);
 typedef void (*fdm_hook_t)(struct fdm *fdm, void *data);
+typedef void (*fdm_wait_hook_t)(struct fdm *fdm, bool waiting, void *data);
 
 enum fdm_hook_priority {
     FDM_HOOK_PRIORITY_LOW,
@@ -28,6 +29,17 @@ bool fdm_hook_add(struct fdm *fdm, fdm_hook_t hook, void *data,
                   enum fdm_hook_priority priority);
 bool fdm_hook_del(struct fdm *fdm, fdm_hook_t hook, enum fdm_hook_priority priority);
 
+/*
+ * Wait hooks are called with ‘waiting’ set to true immediately before
+ * fdm_poll() blocks waiting for events, and with ‘waiting’ set to
+ * false as soon as it wakes up.
+ *
+ * Unlike the other hooks, the same callback may be registered
+ * multiple times, with different ‘data’.
+ */
+bool fdm_wait_hook_add(struct fdm *fdm, fdm_wait_hook_t hook, void *data);
+bool fdm_wait_hook_del(struct fdm *fdm, fdm_wait_hook_t hook, void *data);
+
 bool fdm_signal_add(struct fdm *fdm, int signo, fdm_signal_handler_t handler, void *data);
 bool fdm_signal_del(struct fdm *fdm, int signo);
 
@@ -0,0 +1,302 @@
+#include "glyph-run-cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_MODULE "glyph-run-cache"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "debug.h"
+#include "macros.h"
+#include "xmalloc.h"
+
+#define BUCKET_COUNT 1024
+#define CANDIDATE_COUNT 1024
+#define MAX_SIZE (8 * 1024 * 1024)
+
+struct glyph_run {
+    uint64_t hash;
+    struct glyph_run_key key;
+    pixman_image_t *pix;
+    size_t size;
+
+    struct glyph_run *bucket_next;
+    struct glyph_run *lru_prev;
+    struct glyph_run *lru_next;
+
+    wchar_t text[];
+};
+
+bool
+glyph_run_cache_init(struct glyph_run_cache *cache)
+{
+    *cache = (struct glyph_run_cache){0};
+
+    if (mtx_init(&cache->lock, mtx_plain) != thrd_success) {
+        LOG_ERR("failed to instantiate glyph run cache mutex");
+        return false;
+    }
+
+    cache->buckets = xcalloc(BUCKET_COUNT, sizeof(cache->buckets[0]));
+    cache->candidates = xcalloc(CANDIDATE_COUNT, sizeof(cache->candidates[0]));
+    return true;
+}
+
+void
+glyph_run_cache_destroy(struct glyph_run_cache *cache)
+{
+    if (cache->buckets == NULL)
+        return;
+
+    glyph_run_cache_flush(cache);
+    free(cache->buckets);
+    free(cache->candidates);
+    mtx_destroy(&cache->lock);
+    cache->buckets = NULL;
+    cache->candidates = NULL;
+}
+
+static void
+lru_unlink(struct glyph_run_cache *cache, struct glyph_run *run)
+{
+    if (run->lru_prev != NULL)
+        run->lru_prev->lru_next = run->lru_next;
+    else
+        cache->lru_head = run->lru_next;
+
+    if (run->lru_next != NULL)
+        run->lru_next->lru_prev = run->lru_prev;
+    else
+        cache->lru_tail = run->lru_prev;
+
+    run->lru_prev = run->lru_next = NULL;
+}
+
+static void
+lru_push_front(struct glyph_run_cache *cache, struct glyph_run *run)
+{
+    run->lru_prev = NULL;
+    run->lru_next = cache->lru_head;
+
+    if (cache->lru_head != NULL)
+        cache->lru_head->lru_prev = run;
+    else
+        cache->lru_tail = run;
+
+    cache->lru_head = run;
+}
+
+static void
+run_destroy(struct glyph_run_cache *cache, struct glyph_run *run)
+{
+    struct glyph_run **link = &cache->buckets[run->hash % BUCKET_COUNT];
+    while (*link != run)
+        link = &(*link)->bucket_next;
+    *link = run->bucket_next;
+
+    lru_unlink(cache, run);
+
+    xassert(cache->size >= run->size);
+    cache->size -= run->size;
+
+    pixman_image_unref(run->pix);
+    free(run);
+}
+
+void
+glyph_run_cache_flush(struct glyph_run_cache *cache)
+{
+    if (cache->buckets == NULL)
+        return;
+
+    mtx_lock(&cache->lock);
+    while (cache->lru_head != NULL)
+        run_destroy(cache, cache->lru_head);
+    memset(cache->candidates, 0, CANDIDATE_COUNT * sizeof(cache->candidates[0]));
+    xassert(cache->size == 0);
+    mtx_unlock(&cache->lock);
+}
+
+uint64_t
+glyph_run_hash(const struct glyph_run_key *key, const wchar_t *text)
+{
+    /* FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    const uint8_t *p = (const uint8_t *)key;
+    for (size_t i = 0; i < sizeof(*key); i++)
+        hash = (hash ^ p[i]) * 0x100000001b3ull;
+
+    for (size_t i = 0; i < key->count; i++)
+        hash = (hash ^ (uint32_t)text[i]) * 0x100000001b3ull;
+
+    /* 0 marks an unused candidate slot */
+    return hash != 0 ? hash : 1;
+}
+
+static struct glyph_run *
+find(const struct glyph_run_cache *cache, const struct glyph_run_key *key,
+     const wchar_t *text, uint64_t hash)
+{
+    for (struct glyph_run *run = cache->buckets[hash % BUCKET_COUNT];
+         run != NULL;
+         run = run->bucket_next)
+    {
+        if (run->hash == hash &&
+            memcmp(&run->key, key, sizeof(*key)) == 0 &&
+            memcmp(run->text, text, key->count * sizeof(text[0])) == 0)
+        {
+            return run;
+        }
+    }
+
+    return NULL;
+}
+
+pixman_image_t *
+glyph_run_cache_lookup(struct glyph_run_cache *cache,
+                       const struct glyph_run_key *key,
+                       const wchar_t *text, uint64_t hash, bool *insert)
+{
+    pixman_image_t *pix = NULL;
+    *insert = false;
+
+    mtx_lock(&cache->lock);
+
+    struct glyph_run *run = find(cache, key, text, hash);
+    if (run != NULL) {
+        cache->hits++;
+
+        lru_unlink(cache, run);
+        lru_push_front(cache, run);
+
+        /* pixman’s reference counting isn’t thread safe; do it
+         * while holding the lock */
+        pix = pixman_image_ref(run->pix);
+    } else {
+        cache->misses++;
+
+        uint64_t *candidate = &cache->candidates[hash % CANDIDATE_COUNT];
+        if (*candidate == hash) {
+            *candidate = 0;
+            *insert = true;
+        } else
+            *candidate = hash;
+    }
+
+    mtx_unlock(&cache->lock);
+    return pix;
+}
+
+void
+glyph_run_cache_insert(struct glyph_run_cache *cache,
+                       const struct glyph_run_key *key,
+                       const wchar_t *text, uint64_t hash,
+                       pixman_image_t *pix)
+{
+    const size_t size =
+        pixman_image_get_stride(pix) * pixman_image_get_height(pix);
+
+    mtx_lock(&cache->lock);
+
+    if (size > MAX_SIZE / 4 || find(cache, key, text, hash) != NULL) {
+        /* Too large, or another thread beat us to it */
+        pixman_image_unref(pix);
+        mtx_unlock(&cache->lock);
+        return;
+    }
+
+    while (cache->size + size > MAX_SIZE && cache->lru_tail != NULL)
+        run_destroy(cache, cache->lru_tail);
+
+    struct glyph_run *run = xmalloc(
+        sizeof(*run) + key->count * sizeof(run->text[0]));
+
+    *run = (struct glyph_run){
+        .hash = hash,
+        .key = *key,
+        .pix = pix,
+        .size = size,
+    };
+    memcpy(run->text, text, key->count * sizeof(text[0]));
+
+    struct glyph_run **bucket = &cache->buckets[hash % BUCKET_COUNT];
+    run->bucket_next = *bucket;
+    *bucket = run;
+
+    lru_push_front(cache, run);
+    cache->size += size;
+
+    mtx_unlock(&cache->lock);
+}
+
+void
+glyph_run_cache_release(struct glyph_run_cache *cache, pixman_image_t *pix)
+{
+    mtx_lock(&cache->lock);
+    pixman_image_unref(pix);
+    mtx_unlock(&cache->lock);
+}
+
+void
+glyph_run_cache_stats(struct glyph_run_cache *cache,
+                      uint64_t *hits, uint64_t *misses)
+{
+    mtx_lock(&cache->lock);
+    *hits = cache->hits;
+    *misses = cache->misses;
+    cache->hits = cache->misses = 0;
+    mtx_unlock(&cache->lock);
+}
+
+UNITTEST
+{
+    struct glyph_run_cache cache;
+    xassert(glyph_run_cache_init(&cache));
+
+    const wchar_t text[] = L"foobar";
+    const struct glyph_run_key key = {
+        .fg = {.red = 0xffff, .green = 0xffff, .blue = 0xffff, .alpha = 0xffff},
+        .bg = {.alpha = 0xffff},
+        .cell_width = 8,
+        .cell_height = 16,
+        .count = 6,
+    };
+    const uint64_t hash = glyph_run_hash(&key, text);
+
+    /* First miss only marks the run as a candidate */
+    bool insert;
+    xassert(glyph_run_cache_lookup(&cache, &key, text, hash, &insert) == NULL);
+    xassert(!insert);
+
+    /* Second miss asks for it to be inserted */
+    xassert(glyph_run_cache_lookup(&cache, &key, text, hash, &insert) == NULL);
+    xassert(insert);
+
+    pixman_image_t *pix = pixman_image_create_bits(
+        PIXMAN_a8r8g8b8, 6 * 8, 16, NULL, 0);
+    glyph_run_cache_insert(&cache, &key, text, hash, pix);
+
+    pixman_image_t *hit = glyph_run_cache_lookup(
+        &cache, &key, text, hash, &insert);
+    xassert(hit == pix);
+    xassert(!insert);
+    glyph_run_cache_release(&cache, hit);
+
+    /* Different text, same key */
+    const wchar_t other[] = L"foobaz";
+    xassert(glyph_run_cache_lookup(
+                &cache, &key, other, glyph_run_hash(&key, other),
+                &insert) == NULL);
+
+    uint64_t hits, misses;
+    glyph_run_cache_stats(&cache, &hits, &misses);
+    xassert(hits == 1);
+    xassert(misses == 3);
+
+    glyph_run_cache_flush(&cache);
+    xassert(cache.size == 0);
+    xassert(glyph_run_cache_lookup(&cache, &key, text, hash, &insert) == NULL);
+
+    glyph_run_cache_destroy(&cache);
+}
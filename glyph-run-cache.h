@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+#include <threads.h>
+
+#include <pixman.h>
+
+/*
+ * Cache of pre-rendered “glyph runs”; runs of cells sharing colors,
+ * font and decorations, rendered to a single image.
+ *
+ * Repeated content (status lines, borders, box drawings etc) can then
+ * be rendered with a single blit, instead of a background fill plus
+ * one composite operation per glyph.
+ *
+ * Lookups and insertions are done by the render worker threads, and
+ * are thread safe.
+ */
+
+struct glyph_run_key {
+    pixman_color_t fg;
+    pixman_color_t bg;
+    const void *font;
+    uint16_t cell_width;
+    uint16_t cell_height;
+    uint16_t flags;
+    uint16_t count;     /* Number of columns in ‘text’ */
+};
+
+struct glyph_run;
+
+struct glyph_run_cache {
+    mtx_t lock;
+
+    struct glyph_run **buckets;
+    struct glyph_run *lru_head;  /* Most recently used */
+    struct glyph_run *lru_tail;  /* Least recently used */
+    size_t size;                 /* Bytes of pixel data */
+
+    /*
+     * Hashes of runs that have been looked up, but weren’t in the
+     * cache. A run is only rendered to, and inserted into, the cache
+     * the *second* time it misses; this keeps one-off content (e.g. a
+     * scrolling log) from thrashing the cache.
+     */
+    uint64_t *candidates;
+
+    uint64_t hits;
+    uint64_t misses;
+};
+
+bool glyph_run_cache_init(struct glyph_run_cache *cache);
+void glyph_run_cache_destroy(struct glyph_run_cache *cache);
+
+/* Drops all cached runs. Call when fonts or colors change */
+void glyph_run_cache_flush(struct glyph_run_cache *cache);
+
+uint64_t glyph_run_hash(const struct glyph_run_key *key, const wchar_t *text);
+
+/*
+ * Returns a referenced image on a hit; release it with
+ * glyph_run_cache_release(). On a miss, NULL is returned, and
+ * ‘insert’ indicates whether the caller should render the run, and
+ * insert it with glyph_run_cache_insert().
+ */
+pixman_image_t *glyph_run_cache_lookup(
+    struct glyph_run_cache *cache, const struct glyph_run_key *key,
+    const wchar_t *text, uint64_t hash, bool *insert);
+
+/* Takes ownership of ‘pix’ */
+void glyph_run_cache_insert(
+    struct glyph_run_cache *cache, const struct glyph_run_key *key,
+    const wchar_t *text, uint64_t hash, pixman_image_t *pix);
+
+void glyph_run_cache_release(
+    struct glyph_run_cache *cache, pixman_image_t *pix);
+
+/* Returns, and resets, the hit/miss counters */
+void glyph_run_cache_stats(
+    struct glyph_run_cache *cache, uint64_t *hits, uint64_t *misses);
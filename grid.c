@@ -1,7 +1,12 @@
 #include "grid.h"
 
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 
 #define LOG_MODULE "grid"
 #define LOG_ENABLE_DBG 0
@@ -13,7 +18,201 @@
 #include "util.h"
 #include "xmalloc.h"
 
-#define TIME_REFLOW 0
+/*
+ * Rows, including their cells, are allocated from slabs; blocks of
+ * memory holding many rows of the same width. Each grid has its own
+ * arena of slabs, replaced with a new one when the grid is resized.
+ *
+ * Slabs with free slots are kept at the front of the arena’s list,
+ * and completely empty slabs are released, unless it is the last
+ * one.
+ */
+#define ROW_SLAB_SIZE (256 * 1024)
+#define ROW_SLAB_MIN_SLOTS 16
+
+struct row_free_slot {
+    struct row_free_slot *next;
+};
+
+struct row_slab {
+    struct row_arena *arena;
+    struct row_slab *prev;
+    struct row_slab *next;
+
+    size_t live;                    /* Allocated rows */
+    size_t used;                    /* Slots handed out, ever */
+    struct row_free_slot *free;     /* Released slots */
+
+    max_align_t data[];
+};
+
+struct row_arena {
+    int cols;
+    size_t slot_size;
+    size_t slot_count;              /* Slots per slab */
+
+    struct row_slab *head;
+    struct row_slab *tail;
+};
+
+static struct row_arena *
+row_arena_new(int cols)
+{
+    const size_t align = _Alignof(struct row);
+    const size_t size =
+        sizeof(struct row) +
+        GRID_DIRTY_MAP_WORDS(cols) * sizeof(uint64_t) +
+        cols * sizeof(struct cell);
+
+    struct row_arena *arena = xmalloc(sizeof(*arena));
+    *arena = (struct row_arena){
+        .cols = cols,
+        .slot_size = (size + align - 1) & ~(align - 1),
+    };
+    arena->slot_count = max(
+        ROW_SLAB_SIZE / arena->slot_size, ROW_SLAB_MIN_SLOTS);
+    return arena;
+}
+
+static void
+row_arena_destroy(struct row_arena *arena)
+{
+    if (arena == NULL)
+        return;
+
+    for (struct row_slab *slab = arena->head, *next; slab != NULL; slab = next) {
+        next = slab->next;
+        free(slab);
+    }
+
+    free(arena);
+}
+
+static void
+row_slab_unlink(struct row_arena *arena, struct row_slab *slab)
+{
+    if (slab->prev != NULL)
+        slab->prev->next = slab->next;
+    else
+        arena->head = slab->next;
+
+    if (slab->next != NULL)
+        slab->next->prev = slab->prev;
+    else
+        arena->tail = slab->prev;
+
+    slab->prev = slab->next = NULL;
+}
+
+static void
+row_slab_push_front(struct row_arena *arena, struct row_slab *slab)
+{
+    slab->prev = NULL;
+    slab->next = arena->head;
+
+    if (arena->head != NULL)
+        arena->head->prev = slab;
+    else
+        arena->tail = slab;
+
+    arena->head = slab;
+}
+
+static void
+row_slab_push_back(struct row_arena *arena, struct row_slab *slab)
+{
+    slab->prev = arena->tail;
+    slab->next = NULL;
+
+    if (arena->tail != NULL)
+        arena->tail->next = slab;
+    else
+        arena->head = slab;
+
+    arena->tail = slab;
+}
+
+static inline bool
+row_slab_is_full(const struct row_arena *arena, const struct row_slab *slab)
+{
+    return slab->free == NULL && slab->used == arena->slot_count;
+}
+
+static struct row *
+row_arena_alloc(struct row_arena *arena)
+{
+    struct row_slab *slab = arena->head;
+
+    if (slab == NULL || row_slab_is_full(arena, slab)) {
+        /* Slabs with free slots are at the front; all slabs are full */
+        slab = xmalloc(sizeof(*slab) + arena->slot_count * arena->slot_size);
+        *slab = (struct row_slab){.arena = arena};
+        row_slab_push_front(arena, slab);
+    }
+
+    void *slot;
+    if (slab->free != NULL) {
+        slot = slab->free;
+        slab->free = slab->free->next;
+    } else
+        slot = (uint8_t *)slab->data + slab->used++ * arena->slot_size;
+
+    slab->live++;
+
+    if (row_slab_is_full(arena, slab) && slab != arena->tail) {
+        row_slab_unlink(arena, slab);
+        row_slab_push_back(arena, slab);
+    }
+
+    struct row *row = slot;
+    row->dirty_map = (uint64_t *)(row + 1);
+    row->cells = (struct cell *)(row->dirty_map + GRID_DIRTY_MAP_WORDS(arena->cols));
+    row->slab = slab;
+    return row;
+}
+
+static void
+row_arena_free(struct row *row)
+{
+    struct row_slab *slab = row->slab;
+    struct row_arena *arena = slab->arena;
+
+    const bool was_full = row_slab_is_full(arena, slab);
+
+    struct row_free_slot *slot = (struct row_free_slot *)row;
+    slot->next = slab->free;
+    slab->free = slot;
+
+    xassert(slab->live > 0);
+    slab->live--;
+
+    if (slab->live == 0 && arena->head != arena->tail) {
+        row_slab_unlink(arena, slab);
+        free(slab);
+    } else if (was_full && slab != arena->head) {
+        row_slab_unlink(arena, slab);
+        row_slab_push_front(arena, slab);
+    }
+}
+
+/* Moves all slabs from ‘src’ to ‘dst’, and destroys ‘src’ */
+static void
+row_arena_merge(struct row_arena *dst, struct row_arena *src)
+{
+    xassert(dst->cols == src->cols);
+
+    for (struct row_slab *slab = src->head, *next; slab != NULL; slab = next) {
+        next = slab->next;
+        slab->arena = dst;
+
+        if (row_slab_is_full(dst, slab))
+            row_slab_push_back(dst, slab);
+        else
+            row_slab_push_front(dst, slab);
+    }
+
+    free(src);
+}
 
 static void
 ensure_row_has_extra_data(struct row *row)
@@ -140,375 +339,1601 @@ uri_range_delete(struct row_data *extra, size_t idx)
     extra->uri_ranges.count--;
 }
 
-struct grid *
-grid_snapshot(const struct grid *grid)
+/*
+ * Cold scrollback rows.
+ *
+ * Rows far enough back in the scrollback are compressed (“frozen”),
+ * by the terminal, with grid_row_freeze(). A cold row is a heap
+ * allocated row, with ‘cells’ set to NULL, followed by its
+ * compressed cells.
+ *
+ * Trailing empty cells are not stored; only their attributes (the
+ * “fill”, typically the default attributes, or the background color
+ * the line was erased with). Blank rows store no cells at all. The
+ * remaining cells are stored as runs of identical attributes, each
+ * followed by its characters, where repeated characters are
+ * run-length encoded. All numbers are varints. With this, the memory
+ * used by a cold row is proportional to its content, rather than to
+ * the number of columns.
+ *
+ * Attributes are interned in a per-grid table, and referenced by
+ * index. Output rarely uses more than a handful of attribute
+ * combinations, so most runs need only one or two bytes for their
+ * attributes, instead of eight. The table is append-only; it is reset
+ * when the grid is resized, since that replaces all cold rows. Entries
+ * no longer referenced by any cold row are dropped by
+ * grid_cold_attrs_compact(). Should the table fill up anyway,
+ * attributes are stored inline.
+ *
+ * Cold rows are never rendered, nor modified. grid_row_thaw()
+ * decompresses a row back into a regular one, while grid_row_peek()
+ * decompresses it into a small per-grid cache, for read-only scans
+ * of the scrollback (search, reflow, pipe-scrollback etc).
+ */
+#define COLD_CACHE_SIZE 4
+#define COLD_ATTRS_MAX (64 * 1024)
+
+/* Smaller tables are never compacted */
+#define COLD_ATTRS_COMPACT_MIN 4096
+
+enum cold_run_kind {
+    COLD_RUN_DEFAULT,           /* Default attributes */
+    COLD_RUN_INTERNED,          /* Followed by an attribute table index */
+    COLD_RUN_INLINE,            /* Followed by the attributes */
+};
+
+struct cold_row {
+    struct row row;
+    uint32_t serial;            /* Identifies the row in the cache */
+    uint32_t size;              /* Size of ‘data’ */
+    uint16_t cols;
+    uint16_t used;              /* Stored cells, the rest are empty */
+    uint64_t fill;              /* Attributes of the empty cells */
+    uint8_t data[];
+};
+
+struct cold_cache {
+    uint32_t serial;            /* Last assigned cold row serial */
+    size_t next;                /* Next entry to evict */
+
+    uint8_t *scratch;           /* Compression buffer */
+    size_t scratch_size;
+
+    /* Interned attributes */
+    struct {
+        uint64_t *v;
+        uint32_t count;
+        uint32_t size;
+        uint32_t live;          /* Referenced entries, at last compaction */
+
+        uint32_t *hash;         /* Index + 1, or 0 if unused */
+        uint32_t hash_size;
+    } attrs;
+
+    struct {
+        const struct cold_row *cold;
+        uint32_t serial;
+        int cols;               /* Allocated cells */
+        struct row row;
+
+        /* Cells ‘filled’ to ‘fill_end’ are empty, with attributes
+         * ‘fill’; they only need to be re-initialized if the next row
+         * stores fewer cells, or has a different fill */
+        int filled;
+        int fill_end;
+        uint64_t fill;
+    } entries[COLD_CACHE_SIZE];
+};
+
+static struct cold_cache *
+cold_cache_get(struct grid *grid)
 {
-    struct grid *clone = xmalloc(sizeof(*clone));
-    clone->num_rows = grid->num_rows;
-    clone->num_cols = grid->num_cols;
-    clone->offset = grid->offset;
-    clone->view = grid->view;
-    clone->cursor = grid->cursor;
-    clone->rows = xcalloc(grid->num_rows, sizeof(clone->rows[0]));
-    memset(&clone->scroll_damage, 0, sizeof(clone->scroll_damage));
-    memset(&clone->sixel_images, 0, sizeof(clone->sixel_images));
-
-    tll_foreach(grid->scroll_damage, it)
-        tll_push_back(clone->scroll_damage, it->item);
+    if (unlikely(grid->cold == NULL))
+        grid->cold = xcalloc(1, sizeof(*grid->cold));
+    return grid->cold;
+}
 
-    for (int r = 0; r < grid->num_rows; r++) {
-        const struct row *row = grid->rows[r];
+static void
+cold_cache_destroy(struct cold_cache *cache)
+{
+    if (cache == NULL)
+        return;
 
-        if (row == NULL)
-            continue;
+    for (size_t i = 0; i < ALEN(cache->entries); i++)
+        free(cache->entries[i].row.cells);
+    free(cache->scratch);
+    free(cache->attrs.v);
+    free(cache->attrs.hash);
+    free(cache);
+}
 
-        struct row *clone_row = xmalloc(sizeof(*row));
-        clone->rows[r] = clone_row;
+static inline uint32_t
+cold_attrs_hash(uint64_t attrs, uint32_t hash_size)
+{
+    return (attrs * 0x9e3779b97f4a7c15ull) >> 32 & (hash_size - 1);
+}
 
-        clone_row->cells = xmalloc(grid->num_cols * sizeof(clone_row->cells[0]));
-        clone_row->linebreak = row->linebreak;
-        clone_row->dirty = row->dirty;
+static void
+cold_attrs_rehash(struct cold_cache *cache, uint32_t hash_size)
+{
+    free(cache->attrs.hash);
+    cache->attrs.hash = xcalloc(hash_size, sizeof(cache->attrs.hash[0]));
+    cache->attrs.hash_size = hash_size;
+
+    for (uint32_t i = 0; i < cache->attrs.count; i++) {
+        uint32_t h = cold_attrs_hash(cache->attrs.v[i], hash_size);
+        while (cache->attrs.hash[h] != 0)
+            h = (h + 1) & (hash_size - 1);
+        cache->attrs.hash[h] = i + 1;
+    }
+}
 
-        for (int c = 0; c < grid->num_cols; c++)
-            clone_row->cells[c] = row->cells[c];
+/* Returns the index of the (interned) attributes, or -1 if the table is full */
+static int
+cold_attrs_intern(struct cold_cache *cache, uint64_t attrs)
+{
+    if (unlikely(cache->attrs.hash_size == 0))
+        cold_attrs_rehash(cache, 64);
 
-        const struct row_data *extra = row->extra;
+    const uint32_t mask = cache->attrs.hash_size - 1;
+    uint32_t h = cold_attrs_hash(attrs, cache->attrs.hash_size);
 
-        if (extra != NULL) {
-            struct row_data *clone_extra = xcalloc(1, sizeof(*clone_extra));
-            clone_row->extra = clone_extra;
+    for (; cache->attrs.hash[h] != 0; h = (h + 1) & mask) {
+        const uint32_t idx = cache->attrs.hash[h] - 1;
+        if (cache->attrs.v[idx] == attrs)
+            return idx;
+    }
 
-            uri_range_ensure_size(clone_extra, extra->uri_ranges.count);
+    if (cache->attrs.count >= COLD_ATTRS_MAX)
+        return -1;
 
-            for (size_t i = 0; i < extra->uri_ranges.count; i++) {
-                const struct row_uri_range *range = &extra->uri_ranges.v[i];
-                uri_range_append(
-                    clone_extra,
-                    range->start, range->end, range->id, range->uri);
-            }
-        } else
-            clone_row->extra = NULL;
+    if (cache->attrs.count >= cache->attrs.size) {
+        cache->attrs.size = max(cache->attrs.size * 2, 64);
+        cache->attrs.v = xrealloc(
+            cache->attrs.v, cache->attrs.size * sizeof(cache->attrs.v[0]));
     }
 
-    tll_foreach(grid->sixel_images, it) {
-        int width = it->item.width;
-        int height = it->item.height;
-        pixman_image_t *pix = it->item.pix;
-        pixman_format_code_t pix_fmt = pixman_image_get_format(pix);
-        int stride = stride_for_format_and_width(pix_fmt, width);
+    const uint32_t idx = cache->attrs.count++;
+    cache->attrs.v[idx] = attrs;
+    cache->attrs.hash[h] = idx + 1;
 
-        size_t size = stride * height;
-        void *new_data = xmalloc(size);
-        memcpy(new_data, it->item.data, size);
+    /* Keep the load factor below 1/2 */
+    if (cache->attrs.count * 2 > cache->attrs.hash_size)
+        cold_attrs_rehash(cache, cache->attrs.hash_size * 2);
 
-        pixman_image_t *new_pix = pixman_image_create_bits_no_clear(
-            pix_fmt, width, height, new_data, stride);
+    return idx;
+}
 
-        struct sixel six = {
-            .data = new_data,
-            .pix = new_pix,
-            .width = width,
-            .height = height,
-            .rows = it->item.rows,
-            .cols = it->item.cols,
-            .pos = it->item.pos,
-        };
+static void
+cold_attrs_reset(struct cold_cache *cache)
+{
+    if (cache == NULL)
+        return;
 
-        tll_push_back(clone->sixel_images, six);
+    cache->attrs.count = 0;
+    cache->attrs.live = 0;
+    if (cache->attrs.hash != NULL) {
+        memset(cache->attrs.hash, 0,
+               cache->attrs.hash_size * sizeof(cache->attrs.hash[0]));
     }
-
-    return clone;
 }
 
-void
-grid_free(struct grid *grid)
+static inline size_t
+varint_put(uint8_t *p, uint32_t v)
 {
-    for (int r = 0; r < grid->num_rows; r++)
-        grid_row_free(grid->rows[r]);
-
-    tll_foreach(grid->sixel_images, it) {
-        sixel_destroy(&it->item);
-        tll_remove(grid->sixel_images, it);
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
     }
-
-    free(grid->rows);
-    tll_free(grid->scroll_damage);
+    p[n++] = v;
+    return n;
 }
 
-void
-grid_swap_row(struct grid *grid, int row_a, int row_b)
+static inline uint32_t
+varint_get(const uint8_t **p)
 {
-    xassert(grid->offset >= 0);
-    xassert(row_a != row_b);
-
-    int real_a = (grid->offset + row_a) & (grid->num_rows - 1);
-    int real_b = (grid->offset + row_b) & (grid->num_rows - 1);
-
-    struct row *a = grid->rows[real_a];
-    struct row *b = grid->rows[real_b];
-
-    grid->rows[real_a] = b;
-    grid->rows[real_b] = a;
+    uint32_t v = 0;
+    for (int shift = 0;; shift += 7) {
+        const uint8_t b = *(*p)++;
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return v;
+    }
 }
 
-struct row *
-grid_row_alloc(int cols, bool initialize)
+/* Attributes, minus the rendering state, as a plain integer */
+static inline uint64_t
+cold_attrs(const struct attributes *attrs)
 {
-    struct row *row = xmalloc(sizeof(*row));
-    row->dirty = false;
-    row->linebreak = false;
-    row->extra = NULL;
+    static const struct attributes render_state = {.selected = 1};
 
-    if (initialize) {
-        row->cells = xcalloc(cols, sizeof(row->cells[0]));
-        for (size_t c = 0; c < cols; c++)
-            row->cells[c].attrs.clean = 1;
-    } else
-        row->cells = xmalloc(cols * sizeof(row->cells[0]));
-
-    return row;
+    uint64_t v, mask;
+    memcpy(&v, attrs, sizeof(v));
+    memcpy(&mask, &render_state, sizeof(mask));
+    return v & ~mask;
 }
 
-void
-grid_row_free(struct row *row)
+static struct cell
+cold_fill_cell(uint64_t fill)
 {
-    if (row == NULL)
-        return;
-
-    grid_row_reset_extra(row);
-    free(row->extra);
-    free(row->cells);
-    free(row);
+    struct cell cell = {.wc = 0};
+    memcpy(&cell.attrs, &fill, sizeof(cell.attrs));
+    return cell;
 }
 
-void
-grid_resize_without_reflow(
-    struct grid *grid, int new_rows, int new_cols,
-    int old_screen_rows, int new_screen_rows)
+/* Encodes the first ‘used’ cells */
+static size_t
+cold_encode(struct cold_cache *cache, const struct cell *cells, int used,
+            uint8_t *out)
 {
-    struct row *const *old_grid = grid->rows;
-    const int old_rows = grid->num_rows;
-    const int old_cols = grid->num_cols;
+    size_t n = 0;
+
+    for (int c = 0; c < used;) {
+        const uint64_t attrs = cold_attrs(&cells[c].attrs);
+
+        int run = 1;
+        while (c + run < used && cold_attrs(&cells[c + run].attrs) == attrs)
+            run++;
+
+        const int idx = attrs != 0 ? cold_attrs_intern(cache, attrs) : -1;
+
+        if (attrs == 0)
+            n += varint_put(&out[n], (uint32_t)run << 2 | COLD_RUN_DEFAULT);
+        else if (idx >= 0) {
+            n += varint_put(&out[n], (uint32_t)run << 2 | COLD_RUN_INTERNED);
+            n += varint_put(&out[n], idx);
+        } else {
+            n += varint_put(&out[n], (uint32_t)run << 2 | COLD_RUN_INLINE);
+            memcpy(&out[n], &attrs, sizeof(attrs));
+            n += sizeof(attrs);
+        }
 
-    struct row **new_grid = xcalloc(new_rows, sizeof(new_grid[0]));
+        for (const int end = c + run; c < end;) {
+            const uint32_t wc = cells[c].wc;
+            xassert(wc < 0x80000000u);
 
-    tll(struct sixel) untranslated_sixels = tll_init();
-    tll_foreach(grid->sixel_images, it)
-        tll_push_back(untranslated_sixels, it->item);
-    tll_free(grid->sixel_images);
+            if (c + 1 >= end || (uint32_t)cells[c + 1].wc != wc) {
+                n += varint_put(&out[n], wc << 1);
+                c++;
+                continue;
+            }
 
-    int new_offset = 0;
+            int count = 1;
+            while (c + count < end && (uint32_t)cells[c + count].wc == wc)
+                count++;
 
-    /* Copy old lines, truncating them if old rows were longer */
-    for (int r = 0, n = min(old_screen_rows, new_screen_rows); r < n; r++) {
-        const int old_row_idx = (grid->offset + r) & (old_rows - 1);
-        const int new_row_idx = (new_offset + r) & (new_rows - 1);
+            if (count >= 3) {
+                n += varint_put(&out[n], wc << 1 | 1);
+                n += varint_put(&out[n], count);
+                c += count;
+            } else {
+                n += varint_put(&out[n], wc << 1);
+                c++;
+            }
+        }
+    }
 
-        const struct row *old_row = old_grid[old_row_idx];
-        xassert(old_row != NULL);
+    return n;
+}
 
-        struct row *new_row = grid_row_alloc(new_cols, false);
-        new_grid[new_row_idx] = new_row;
+/* Decodes the stored cells, but does not initialize the empty ones */
+static void
+cold_decode(const struct cold_cache *cache, const struct cold_row *cold,
+            struct cell *cells)
+{
+    const uint8_t *p = cold->data;
+    const int used = cold->used;
 
-        memcpy(new_row->cells,
-               old_row->cells,
-               sizeof(struct cell) * min(old_cols, new_cols));
+    int c = 0;
+    while (c < used) {
+        const uint32_t hdr = varint_get(&p);
+        const int end = c + (hdr >> 2);
 
-        new_row->dirty = old_row->dirty;
-        new_row->linebreak = false;
+        uint64_t v = 0;
+        switch ((enum cold_run_kind)(hdr & 3)) {
+        case COLD_RUN_DEFAULT:
+            break;
 
-        if (new_cols > old_cols) {
-            /* Clear "new" columns */
-            memset(&new_row->cells[old_cols], 0,
-                   sizeof(struct cell) * (new_cols - old_cols));
-            new_row->dirty = true;
-        } else if (old_cols > new_cols) {
-            /* Make sure we don't cut a multi-column character in two */
-            for (int i = new_cols; i > 0 && old_row->cells[i].wc > CELL_SPACER; i--)
-                new_row->cells[i - 1].wc = 0;
+        case COLD_RUN_INTERNED: {
+            const uint32_t idx = varint_get(&p);
+            xassert(idx < cache->attrs.count);
+            v = cache->attrs.v[idx];
+            break;
         }
 
-        /* Map sixels on current "old" row to current "new row" */
-        tll_foreach(untranslated_sixels, it) {
-            if (it->item.pos.row != old_row_idx)
-                continue;
-
-            struct sixel sixel = it->item;
-            sixel.pos.row = new_row_idx;
+        case COLD_RUN_INLINE:
+            memcpy(&v, p, sizeof(v));
+            p += sizeof(v);
+            break;
 
-            if (sixel.pos.col < new_cols)
-                tll_push_back(grid->sixel_images, sixel);
-            else
-                sixel_destroy(&it->item);
-            tll_remove(untranslated_sixels, it);
+        default:
+            BUG("invalid cold row attribute run");
         }
 
-        /* Copy URI ranges, truncating them if necessary */
-        const struct row_data *old_extra = old_row->extra;
-        if (old_extra == NULL)
-            continue;
-
-        ensure_row_has_extra_data(new_row);
-        struct row_data *new_extra = new_row->extra;
+        struct attributes attrs;
+        memcpy(&attrs, &v, sizeof(attrs));
 
-        uri_range_ensure_size(new_extra, old_extra->uri_ranges.count);
+        while (c < end) {
+            const uint32_t wc = varint_get(&p);
+            const int count = wc & 1 ? (int)varint_get(&p) : 1;
 
-        for (size_t i = 0; i < old_extra->uri_ranges.count; i++) {
-            const struct row_uri_range *range = &old_extra->uri_ranges.v[i];
+            for (int i = 0; i < count; i++, c++)
+                cells[c] = (struct cell){.wc = wc >> 1, .attrs = attrs};
+        }
+    }
 
-            if (range->start >= new_cols) {
-                /* The whole range is truncated */
-                continue;
-            }
+    xassert(c == used);
+    xassert(p == &cold->data[cold->size]);
+}
+
+static void
+cold_fill(struct cell *cells, int start, int end, uint64_t fill)
+{
+    if (fill == 0) {
+        memset(&cells[start], 0, (end - start) * sizeof(cells[0]));
+        return;
+    }
+
+    const struct cell cell = cold_fill_cell(fill);
+    for (int c = start; c < end; c++)
+        cells[c] = cell;
+}
+
+/* Skips a run’s characters */
+static void
+cold_skip_chars(const uint8_t **p, int count)
+{
+    for (int c = 0; c < count;) {
+        const uint32_t wc = varint_get(p);
+        c += wc & 1 ? (int)varint_get(p) : 1;
+    }
+}
+
+/* Marks the attribute table entries referenced by the row */
+static void
+cold_mark_attrs(const struct cold_row *cold, uint64_t *live)
+{
+    const uint8_t *p = cold->data;
+
+    for (int c = 0; c < cold->used;) {
+        const uint32_t hdr = varint_get(&p);
+        const int run = hdr >> 2;
+
+        if ((hdr & 3) == COLD_RUN_INTERNED) {
+            const uint32_t idx = varint_get(&p);
+            live[idx / 64] |= 1ull << (idx % 64);
+        } else if ((hdr & 3) == COLD_RUN_INLINE)
+            p += sizeof(uint64_t);
+
+        cold_skip_chars(&p, run);
+        c += run;
+    }
+}
+
+/*
+ * Re-encodes the row’s attribute table indices, in place. New indices
+ * are never larger than the old ones, and thus never need more bytes.
+ */
+static void
+cold_remap_attrs(struct cold_row *cold, const uint32_t *remap)
+{
+    const uint8_t *p = cold->data;
+    uint8_t *out = cold->data;
+
+    for (int c = 0; c < cold->used;) {
+        const uint32_t hdr = varint_get(&p);
+        const int run = hdr >> 2;
+
+        out += varint_put(out, hdr);
+
+        if ((hdr & 3) == COLD_RUN_INTERNED)
+            out += varint_put(out, remap[varint_get(&p)]);
+        else if ((hdr & 3) == COLD_RUN_INLINE) {
+            memmove(out, p, sizeof(uint64_t));
+            out += sizeof(uint64_t);
+            p += sizeof(uint64_t);
+        }
+
+        const uint8_t *chars = p;
+        cold_skip_chars(&p, run);
+        memmove(out, chars, p - chars);
+        out += p - chars;
+        c += run;
+    }
+
+    xassert(p == &cold->data[cold->size]);
+    cold->size = out - cold->data;
+}
+
+bool
+grid_cold_attrs_compact_pending(const struct grid *grid)
+{
+    const struct cold_cache *cache = grid->cold;
+    return cache != NULL &&
+        cache->attrs.count >= COLD_ATTRS_COMPACT_MIN &&
+        cache->attrs.count >= 2 * cache->attrs.live;
+}
+
+void
+grid_cold_attrs_compact(struct grid *grid)
+{
+    struct cold_cache *cache = grid->cold;
+    if (cache == NULL || cache->attrs.count == 0)
+        return;
+
+    const uint32_t count = cache->attrs.count;
+    uint64_t *live = xcalloc((count + 63) / 64, sizeof(live[0]));
+
+    for (int r = 0; r < grid->num_rows; r++) {
+        const struct row *row = grid->rows[r];
+        if (row != NULL && grid_row_is_cold(row))
+            cold_mark_attrs((const struct cold_row *)row, live);
+    }
+
+    uint32_t live_count = 0;
+    for (uint32_t i = 0; i < (count + 63) / 64; i++)
+        live_count += __builtin_popcountll(live[i]);
+
+    cache->attrs.live = live_count;
+
+    /* Only worth it if at least half of the entries are dead */
+    if (live_count * 2 > count) {
+        free(live);
+        return;
+    }
+
+    LOG_DBG("compacting cold attributes: %u -> %u", count, live_count);
+
+    uint32_t *remap = xmalloc(count * sizeof(remap[0]));
+    uint32_t idx = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!(live[i / 64] >> (i % 64) & 1))
+            continue;
+
+        remap[i] = idx;
+        cache->attrs.v[idx++] = cache->attrs.v[i];
+    }
+
+    xassert(idx == live_count);
+
+    if (live_count > 0) {
+        for (int r = 0; r < grid->num_rows; r++) {
+            struct row *row = grid->rows[r];
+            if (row != NULL && grid_row_is_cold(row))
+                cold_remap_attrs((struct cold_row *)row, remap);
+        }
+    }
+
+    cache->attrs.count = live_count;
+    cold_attrs_rehash(cache, cache->attrs.hash_size);
+
+    free(remap);
+    free(live);
+}
+
+bool
+grid_row_freeze(struct grid *grid, int row_no)
+{
+    row_no &= grid->num_rows - 1;
+
+    struct row *row = grid->rows[row_no];
+    if (row == NULL || row->cells == NULL)
+        return false;
+
+    const int cols = grid->num_cols;
+    if (cols > UINT16_MAX)
+        return false;
+
+    /* Trailing empty cells, all with the same attributes, are elided */
+    const struct cell *cells = row->cells;
+    const uint64_t fill = cells[cols - 1].wc == 0
+        ? cold_attrs(&cells[cols - 1].attrs) : 0;
+
+    int used = cols;
+    while (used > 0 &&
+           cells[used - 1].wc == 0 && cold_attrs(&cells[used - 1].attrs) == fill)
+    {
+        used--;
+    }
+
+    struct cold_cache *cache = cold_cache_get(grid);
+
+    /* Worst case: each cell in its own, inline, attribute run */
+    const size_t worst_case = used * (5 + sizeof(uint64_t) + 5);
+    if (cache->scratch_size < worst_case) {
+        free(cache->scratch);
+        cache->scratch = xmalloc(worst_case);
+        cache->scratch_size = worst_case;
+    }
+
+    const size_t size = cold_encode(cache, cells, used, cache->scratch);
+    if (size >= cols * sizeof(struct cell))
+        return false;
+
+    struct cold_row *cold = xmalloc(sizeof(*cold) + size);
+    memcpy(cold->data, cache->scratch, size);
+    cold->row = (struct row){
+        .cells = NULL,
+        .dirty_map = NULL,
+        .dirty = false,
+        .linebreak = row->linebreak,
+        .extra = row->extra,
+        .slab = NULL,
+    };
+    cold->serial = ++cache->serial;
+    cold->size = size;
+    cold->cols = cols;
+    cold->used = used;
+    cold->fill = fill;
+
+    /* URI ranges now belong to the cold row */
+    row->extra = NULL;
+    grid_row_free(row);
+
+    grid->rows[row_no] = &cold->row;
+    return true;
+}
+
+struct row *
+grid_row_thaw(struct grid *grid, int row_no)
+{
+    row_no &= grid->num_rows - 1;
+
+    struct row *row = grid->rows[row_no];
+    if (likely(row == NULL || row->cells != NULL))
+        return row;
+
+    const struct cold_row *cold = (const struct cold_row *)row;
+    xassert(cold->cols == grid->num_cols);
+
+    struct row *hot = grid_row_alloc(grid->arena, grid->num_cols, false);
+    cold_decode(grid->cold, cold, hot->cells);
+    cold_fill(hot->cells, cold->used, cold->cols, cold->fill);
+    hot->linebreak = row->linebreak;
+    hot->extra = row->extra;
+    hot->dirty = true;
+
+    free(row);
+    grid->rows[row_no] = hot;
+    grid->thawed = true;
+    return hot;
+}
+
+int
+grid_row_used_cols(const struct grid *grid, int row_no)
+{
+    const struct row *row = grid->rows[row_no & (grid->num_rows - 1)];
+    if (row == NULL)
+        return 0;
+    if (likely(row->cells != NULL))
+        return grid->num_cols;
+
+    return ((const struct cold_row *)row)->used;
+}
+
+void
+grid_thaw_view(struct grid *grid, int rows)
+{
+    for (int r = 0; r < rows; r++)
+        grid_row_thaw(grid, grid->view + r);
+}
+
+const struct row *
+grid_row_peek(struct grid *grid, int row_no)
+{
+    const struct row *row = grid->rows[row_no & (grid->num_rows - 1)];
+    if (likely(row == NULL || row->cells != NULL))
+        return row;
+
+    const struct cold_row *cold = (const struct cold_row *)row;
+    struct cold_cache *cache = cold_cache_get(grid);
+
+    for (size_t i = 0; i < ALEN(cache->entries); i++) {
+        if (cache->entries[i].cold == cold &&
+            cache->entries[i].serial == cold->serial)
+        {
+            return &cache->entries[i].row;
+        }
+    }
+
+    const size_t idx = cache->next++ % ALEN(cache->entries);
+    struct row *peek = &cache->entries[idx].row;
+    int *filled = &cache->entries[idx].filled;
+
+    if (cache->entries[idx].cols < cold->cols) {
+        free(peek->cells);
+        peek->cells = xmalloc(cold->cols * sizeof(peek->cells[0]));
+        cache->entries[idx].cols = cold->cols;
+        *filled = cold->cols;
+    }
+
+    if (cache->entries[idx].fill != cold->fill ||
+        cache->entries[idx].fill_end != cold->cols)
+    {
+        *filled = cold->cols;
+    }
+
+    /* Only decode the stored cells, and re-initialize the empty cells
+     * overwritten by the previous row */
+    cold_decode(cache, cold, peek->cells);
+    if (cold->used < *filled)
+        cold_fill(peek->cells, cold->used, *filled, cold->fill);
+
+    *filled = cold->used;
+    cache->entries[idx].fill_end = cold->cols;
+    cache->entries[idx].fill = cold->fill;
+
+    peek->dirty = false;
+    peek->linebreak = row->linebreak;
+    peek->extra = row->extra;
+    peek->slab = NULL;
+
+    cache->entries[idx].cold = cold;
+    cache->entries[idx].serial = cold->serial;
+    return peek;
+}
+
+/* A new cache, sharing nothing but the interned attributes */
+static struct cold_cache *
+cold_cache_clone_attrs(const struct cold_cache *cache)
+{
+    if (cache == NULL || cache->attrs.count == 0)
+        return NULL;
+
+    struct cold_cache *clone = xcalloc(1, sizeof(*clone));
+    clone->attrs.v = xmalloc(cache->attrs.count * sizeof(clone->attrs.v[0]));
+    clone->attrs.count = clone->attrs.size = cache->attrs.count;
+    memcpy(clone->attrs.v, cache->attrs.v,
+           cache->attrs.count * sizeof(clone->attrs.v[0]));
+    cold_attrs_rehash(clone, cache->attrs.hash_size);
+    return clone;
+}
+
+static struct row_data *
+row_extra_clone(const struct row_data *extra)
+{
+    if (extra == NULL)
+        return NULL;
+
+    struct row_data *clone_extra = xcalloc(1, sizeof(*clone_extra));
+    uri_range_ensure_size(clone_extra, extra->uri_ranges.count);
+
+    for (size_t i = 0; i < extra->uri_ranges.count; i++) {
+        const struct row_uri_range *range = &extra->uri_ranges.v[i];
+        uri_range_append(
+            clone_extra, range->start, range->end, range->id, range->uri);
+    }
+
+    return clone_extra;
+}
+
+struct grid *
+grid_snapshot(const struct grid *grid)
+{
+    struct grid *clone = xmalloc(sizeof(*clone));
+    clone->num_rows = grid->num_rows;
+    clone->num_cols = grid->num_cols;
+    clone->offset = grid->offset;
+    clone->view = grid->view;
+    clone->cursor = grid->cursor;
+    clone->rows = xcalloc(grid->num_rows, sizeof(clone->rows[0]));
+    clone->arena = row_arena_new(grid->num_cols);
+    clone->cold = cold_cache_clone_attrs(grid->cold);
+    clone->thawed = false;
+    memset(&clone->scroll_damage, 0, sizeof(clone->scroll_damage));
+    memset(&clone->sixel_images, 0, sizeof(clone->sixel_images));
+
+    tll_foreach(grid->scroll_damage, it)
+        tll_push_back(clone->scroll_damage, it->item);
+
+    for (int r = 0; r < grid->num_rows; r++) {
+        const struct row *row = grid->rows[r];
+
+        if (row == NULL)
+            continue;
+
+        if (row->cells == NULL) {
+            const struct cold_row *cold = (const struct cold_row *)row;
+            struct cold_row *clone_cold = xmalloc(sizeof(*cold) + cold->size);
+
+            memcpy(clone_cold, cold, sizeof(*cold) + cold->size);
+            clone_cold->row.extra = row_extra_clone(row->extra);
+            clone->rows[r] = &clone_cold->row;
+            continue;
+        }
+
+        struct row *clone_row = grid_row_alloc(
+            clone->arena, grid->num_cols, false);
+        clone->rows[r] = clone_row;
+
+        clone_row->linebreak = row->linebreak;
+        clone_row->dirty = row->dirty;
+
+        for (int c = 0; c < grid->num_cols; c++)
+            clone_row->cells[c] = row->cells[c];
+
+        memcpy(clone_row->dirty_map, row->dirty_map,
+               GRID_DIRTY_MAP_WORDS(grid->num_cols) * sizeof(uint64_t));
+
+        clone_row->extra = row_extra_clone(row->extra);
+    }
+
+    tll_foreach(grid->sixel_images, it) {
+        int width = it->item.width;
+        int height = it->item.height;
+        pixman_image_t *pix = it->item.pix;
+        pixman_format_code_t pix_fmt = pixman_image_get_format(pix);
+        int stride = stride_for_format_and_width(pix_fmt, width);
+
+        size_t size = stride * height;
+        void *new_data = xmalloc(size);
+        memcpy(new_data, it->item.data, size);
+
+        pixman_image_t *new_pix = pixman_image_create_bits_no_clear(
+            pix_fmt, width, height, new_data, stride);
+
+        struct sixel six = {
+            .data = new_data,
+            .pix = new_pix,
+            .width = width,
+            .height = height,
+            .rows = it->item.rows,
+            .cols = it->item.cols,
+            .pos = it->item.pos,
+        };
+
+        tll_push_back(clone->sixel_images, six);
+    }
+
+    return clone;
+}
+
+/*
+ * Releases everything owned by the row, except the row itself, when
+ * allocated from an arena. Use when the entire arena is about to be
+ * destroyed.
+ */
+static void
+row_release(struct row *row)
+{
+    if (row == NULL)
+        return;
+
+    grid_row_reset_extra(row);
+
+    if (row->slab == NULL) {
+        free(row->cells);
+        free(row);
+    }
+}
+
+void
+grid_free(struct grid *grid)
+{
+    for (int r = 0; r < grid->num_rows; r++)
+        row_release(grid->rows[r]);
+
+    row_arena_destroy(grid->arena);
+    grid->arena = NULL;
+
+    cold_cache_destroy(grid->cold);
+    grid->cold = NULL;
+
+    tll_foreach(grid->sixel_images, it) {
+        sixel_destroy(&it->item);
+        tll_remove(grid->sixel_images, it);
+    }
+
+    free(grid->rows);
+    tll_free(grid->scroll_damage);
+}
+
+void
+grid_swap_row(struct grid *grid, int row_a, int row_b)
+{
+    xassert(grid->offset >= 0);
+    xassert(row_a != row_b);
+
+    int real_a = (grid->offset + row_a) & (grid->num_rows - 1);
+    int real_b = (grid->offset + row_b) & (grid->num_rows - 1);
+
+    struct row *a = grid->rows[real_a];
+    struct row *b = grid->rows[real_b];
+
+    grid->rows[real_a] = b;
+    grid->rows[real_b] = a;
+}
+
+struct row *
+grid_row_alloc(struct row_arena *arena, int cols, bool initialize)
+{
+    struct row *row;
+
+    if (arena != NULL) {
+        xassert(arena->cols == cols);
+        row = row_arena_alloc(arena);
+    } else {
+        row = xmalloc(
+            sizeof(*row) + GRID_DIRTY_MAP_WORDS(cols) * sizeof(uint64_t));
+        row->cells = xmalloc(cols * sizeof(row->cells[0]));
+        row->dirty_map = (uint64_t *)(row + 1);
+        row->slab = NULL;
+    }
+
+    row->dirty = false;
+    row->linebreak = false;
+    row->extra = NULL;
+
+    if (initialize) {
+        memset(row->cells, 0, cols * sizeof(row->cells[0]));
+        grid_row_clean_all(row, cols);
+    } else {
+        /* Whatever the caller writes must be rendered */
+        grid_row_dirty_all(row, cols);
+    }
+
+    return row;
+}
+
+void
+grid_row_free(struct row *row)
+{
+    if (row == NULL)
+        return;
+
+    grid_row_reset_extra(row);
+
+    if (row->slab != NULL)
+        row_arena_free(row);
+    else {
+        free(row->cells);
+        free(row);
+    }
+}
+
+void
+grid_resize_without_reflow(
+    struct grid *grid, int new_rows, int new_cols,
+    int old_screen_rows, int new_screen_rows)
+{
+    struct row *const *old_grid = grid->rows;
+    const int old_rows = grid->num_rows;
+    const int old_cols = grid->num_cols;
+
+    struct row **new_grid = xcalloc(new_rows, sizeof(new_grid[0]));
+    struct row_arena *new_arena = row_arena_new(new_cols);
+
+    tll(struct sixel) untranslated_sixels = tll_init();
+    tll_foreach(grid->sixel_images, it)
+        tll_push_back(untranslated_sixels, it->item);
+    tll_free(grid->sixel_images);
+
+    int new_offset = 0;
+
+    /* Copy old lines, truncating them if old rows were longer */
+    for (int r = 0, n = min(old_screen_rows, new_screen_rows); r < n; r++) {
+        const int old_row_idx = (grid->offset + r) & (old_rows - 1);
+        const int new_row_idx = (new_offset + r) & (new_rows - 1);
+
+        const struct row *old_row = old_grid[old_row_idx];
+        xassert(old_row != NULL);
+
+        struct row *new_row = grid_row_alloc(new_arena, new_cols, false);
+        new_grid[new_row_idx] = new_row;
+
+        memcpy(new_row->cells,
+               old_row->cells,
+               sizeof(struct cell) * min(old_cols, new_cols));
+
+        new_row->dirty = old_row->dirty;
+        new_row->linebreak = false;
+
+        if (new_cols > old_cols) {
+            /* Clear "new" columns */
+            memset(&new_row->cells[old_cols], 0,
+                   sizeof(struct cell) * (new_cols - old_cols));
+            new_row->dirty = true;
+        } else if (old_cols > new_cols) {
+            /* Make sure we don't cut a multi-column character in two */
+            for (int i = new_cols; i > 0 && old_row->cells[i].wc > CELL_SPACER; i--)
+                new_row->cells[i - 1].wc = 0;
+        }
+
+        /* Map sixels on current "old" row to current "new row" */
+        tll_foreach(untranslated_sixels, it) {
+            if (it->item.pos.row != old_row_idx)
+                continue;
+
+            struct sixel sixel = it->item;
+            sixel.pos.row = new_row_idx;
+
+            if (sixel.pos.col < new_cols)
+                tll_push_back(grid->sixel_images, sixel);
+            else
+                sixel_destroy(&it->item);
+            tll_remove(untranslated_sixels, it);
+        }
+
+        /* Copy URI ranges, truncating them if necessary */
+        const struct row_data *old_extra = old_row->extra;
+        if (old_extra == NULL)
+            continue;
+
+        ensure_row_has_extra_data(new_row);
+        struct row_data *new_extra = new_row->extra;
+
+        uri_range_ensure_size(new_extra, old_extra->uri_ranges.count);
+
+        for (size_t i = 0; i < old_extra->uri_ranges.count; i++) {
+            const struct row_uri_range *range = &old_extra->uri_ranges.v[i];
+
+            if (range->start >= new_cols) {
+                /* The whole range is truncated */
+                continue;
+            }
 
             const int start = range->start;
             const int end = min(range->end, new_cols - 1);
             uri_range_append(new_extra, start, end, range->id, range->uri);
         }
-    }
+    }
+
+    /* Clear "new" lines */
+    for (int r = min(old_screen_rows, new_screen_rows); r < new_screen_rows; r++) {
+        struct row *new_row = grid_row_alloc(new_arena, new_cols, false);
+        new_grid[(new_offset + r) & (new_rows - 1)] = new_row;
+
+        memset(new_row->cells, 0, sizeof(struct cell) * new_cols);
+        new_row->dirty = true;
+    }
+
+#if defined(_DEBUG)
+    for (size_t r = 0; r < new_rows; r++) {
+        const struct row *row = new_grid[r];
+
+        if (row == NULL)
+            continue;
+        if (row->extra == NULL)
+            continue;
+
+        verify_no_overlapping_uris(row->extra);
+        verify_uris_are_sorted(row->extra);
+    }
+#endif
+
+    /* Free old grid */
+    for (int r = 0; r < grid->num_rows; r++)
+        row_release(old_grid[r]);
+    free(grid->rows);
+    row_arena_destroy(grid->arena);
+
+    /* There are no cold rows left */
+    cold_attrs_reset(grid->cold);
+
+    grid->rows = new_grid;
+    grid->arena = new_arena;
+    grid->num_rows = new_rows;
+    grid->num_cols = new_cols;
+
+    grid->view = grid->offset = new_offset;
+
+    /* Keep cursor at current position, but clamp to new dimensions */
+    struct coord cursor = grid->cursor.point;
+    if (cursor.row == old_screen_rows - 1) {
+        /* 'less' breaks if the cursor isn't at the bottom */
+        cursor.row = new_screen_rows - 1;
+    }
+    cursor.row = min(cursor.row, new_screen_rows - 1);
+    cursor.col = min(cursor.col, new_cols - 1);
+    grid->cursor.point = cursor;
+
+    struct coord saved_cursor = grid->saved_cursor.point;
+    if (saved_cursor.row == old_screen_rows - 1)
+        saved_cursor.row = new_screen_rows - 1;
+    saved_cursor.row = min(saved_cursor.row, new_screen_rows - 1);
+    saved_cursor.col = min(saved_cursor.col, new_cols - 1);
+    grid->saved_cursor.point = saved_cursor;
+
+    grid->cur_row = new_grid[(grid->offset + cursor.row) & (new_rows - 1)];
+    grid->cursor.lcf = false;
+    grid->saved_cursor.lcf = false;
+
+    /* Free sixels we failed to "map" to the new grid */
+    tll_foreach(untranslated_sixels, it)
+        sixel_destroy(&it->item);
+    tll_free(untranslated_sixels);
+
+#if defined(_DEBUG)
+    for (int r = 0; r < new_screen_rows; r++)
+        grid_row_in_view(grid, r);
+#endif
+}
+
+static void
+reflow_uri_range_start(struct row_uri_range *range, struct row *new_row,
+                       int new_col_idx)
+{
+    ensure_row_has_extra_data(new_row);
+    uri_range_append_no_strdup
+        (new_row->extra, new_col_idx, -1, range->id, range->uri);
+    range->uri = NULL;
+}
+
+static void
+reflow_uri_range_end(struct row_uri_range *range, struct row *new_row,
+                     int new_col_idx)
+{
+    struct row_data *extra = new_row->extra;
+    xassert(extra->uri_ranges.count > 0);
+
+    struct row_uri_range *new_range =
+        &extra->uri_ranges.v[extra->uri_ranges.count - 1];
+
+    xassert(new_range->id == range->id);
+    xassert(new_range->end < 0);
+    new_range->end = new_col_idx;
+}
+
+/*
+ * Large scrollbacks are reflowed in parallel. The old grid is split
+ * into chunks of whole logical lines (i.e. chunks always begin on
+ * the row following a hard linebreak), since a logical line’s
+ * reflowed rows do not depend on anything before it.
+ *
+ * This is done in two passes: the first one only counts the number
+ * of new rows each chunk produces. From this, each chunk’s position
+ * in the new grid, and the number of (oldest) rows that do not fit
+ * in it, are known. The second pass then copies the cells to their
+ * final location.
+ *
+ * Smaller grids are reflowed as a single chunk, in a single pass.
+ */
+#define REFLOW_PARALLEL_MIN_ROWS 8192
+#define REFLOW_CHUNKS_PER_THREAD 4
+
+struct reflow_chunk {
+    int start;                  /* First old row, relative scrollback start */
+    int end;                    /* One past the last old row */
+
+    int first_seq;              /* Sequence number of the first new row */
+    int last_seq;               /* Last new row to allocate */
+    int rows;                   /* Number of new rows produced */
+
+    struct coord **tps;         /* Tracking points, terminated */
+    struct row_arena *arena;
+};
+
+struct reflow_ctx {
+    struct grid *grid;          /* Old grid */
+    int offset;                 /* Old scrollback start */
+
+    struct row **new_grid;
+    int new_rows;
+    int new_cols;
+
+    /* New rows with a lower sequence number are dropped */
+    int first_kept;
+    bool count_only;
+
+    /* Sequence number of the new row each old row starts on */
+    int *row_seq;
+
+    const struct coord *tp_terminator;
+
+    struct reflow_chunk *chunks;
+    size_t chunk_count;
+    atomic_size_t next_chunk;
+};
+
+static struct row *
+reflow_row_get(const struct reflow_ctx *ctx, const struct reflow_chunk *chunk,
+               int seq)
+{
+    if (ctx->count_only || seq < ctx->first_kept || seq > chunk->last_seq)
+        return NULL;
+
+    const int idx = seq & (ctx->new_rows - 1);
+    struct row *row = ctx->new_grid[idx];
+
+    if (row == NULL) {
+        /* Scrollback not yet full, allocate a completely new row */
+        row = grid_row_alloc(chunk->arena, ctx->new_cols, false);
+        ctx->new_grid[idx] = row;
+    } else {
+        /* Scrollback is full, need to re-use a row */
+        grid_row_reset_extra(row);
+        row->linebreak = false;
+    }
+
+    return row;
+}
+
+/*
+ * ‘row’ is NULL when the current row is dropped (or only counted),
+ * in which case ‘open_uri’ is the old URI range that was still open
+ * at its end (if any).
+ */
+static struct row *
+reflow_line_wrap(const struct reflow_ctx *ctx, const struct reflow_chunk *chunk,
+                 struct row *row, const struct row_uri_range *open_uri,
+                 int *seq, int *col_idx)
+{
+    *col_idx = 0;
+    (*seq)++;
+
+    struct row *new_row = reflow_row_get(ctx, chunk, *seq);
+
+    if (row == NULL) {
+        if (new_row != NULL && open_uri != NULL) {
+            ensure_row_has_extra_data(new_row);
+            uri_range_append(
+                new_row->extra, 0, -1, open_uri->id, open_uri->uri);
+        }
+        return new_row;
+    }
+
+    struct row_data *extra = row->extra;
+    if (extra == NULL)
+        return new_row;
+
+    /*
+     * URI ranges are per row. Thus, we need to ‘close’ the still-open
+     * ranges on the previous row, and re-open them on the
+     * next/current row.
+     */
+    if (extra->uri_ranges.count > 0) {
+        struct row_uri_range *range =
+            &extra->uri_ranges.v[extra->uri_ranges.count - 1];
+
+        if (range->end < 0) {
+
+            /* Terminate URI range on the previous row */
+            range->end = ctx->new_cols - 1;
+
+            /* Open a new range on the new/current row */
+            if (new_row != NULL) {
+                ensure_row_has_extra_data(new_row);
+                uri_range_append(new_row->extra, 0, -1, range->id, range->uri);
+            }
+        }
+    }
+
+    return new_row;
+}
+
+/*
+ * Cold rows are decoded into ‘scratch’, rather than using
+ * grid_row_peek(), since chunks may be reflowed in parallel.
+ */
+static const struct row *
+reflow_old_row(const struct grid *grid, int row_no, struct row *scratch)
+{
+    const struct row *row = grid->rows[row_no];
+    if (likely(row == NULL || row->cells != NULL))
+        return row;
+
+    const struct cold_row *cold = (const struct cold_row *)row;
+    xassert(cold->cols == grid->num_cols);
+
+    cold_decode(grid->cold, cold, scratch->cells);
+    cold_fill(scratch->cells, cold->used, cold->cols, cold->fill);
+
+    scratch->linebreak = row->linebreak;
+    scratch->extra = row->extra;
+    return scratch;
+}
+
+static void
+reflow_chunk(struct reflow_ctx *ctx, struct reflow_chunk *chunk,
+             struct row *scratch)
+{
+    struct grid *grid = ctx->grid;
+    const int old_rows = grid->num_rows;
+    const int old_cols = grid->num_cols;
+    const int new_cols = ctx->new_cols;
+    const bool count_only = ctx->count_only;
+
+    int new_seq = count_only ? 0 : chunk->first_seq;
+    int new_col_idx = 0;
+    struct row *new_row = reflow_row_get(ctx, chunk, new_seq);
+    const struct row_uri_range *open_uri = NULL;
+
+    struct coord **next_tp = chunk->tps;
+
+    for (int r = chunk->start; r < chunk->end; r++) {
+        const int old_row_idx = (ctx->offset + r) & (old_rows - 1);
+
+        /* Unallocated (empty) rows we can simply skip */
+        const struct row *old_row = reflow_old_row(grid, old_row_idx, scratch);
+        if (old_row == NULL)
+            continue;
+
+        /* Sixels on the current "old" row are mapped to this "new" row */
+        if (ctx->row_seq != NULL && !count_only)
+            ctx->row_seq[r] = new_seq;
+
+#define line_wrap()                                                 \
+        new_row = reflow_line_wrap(                                 \
+            ctx, chunk, new_row, open_uri, &new_seq, &new_col_idx)
+
+        /* Find last non-empty cell */
+        int col_count = 0;
+        for (int c = grid_row_used_cols(grid, old_row_idx) - 1; c >= 0; c--) {
+            const struct cell *cell = &old_row->cells[c];
+            if (!(cell->wc == 0 || cell->wc == CELL_SPACER)) {
+                col_count = c + 1;
+                break;
+            }
+        }
+
+        xassert(col_count >= 0 && col_count <= old_cols);
+
+        /* Do we have a (at least one) tracking point on this row */
+        struct coord *tp;
+        if (unlikely((*next_tp)->row == old_row_idx)) {
+            tp = *next_tp;
+
+            /* Find the *last* tracking point on this row */
+            struct coord *last_on_row = tp;
+            for (struct coord **iter = next_tp; (*iter)->row == old_row_idx; iter++)
+                last_on_row = *iter;
+
+            /* And make sure its end point is included in the col range */
+            xassert(last_on_row->row == old_row_idx);
+            col_count = max(col_count, last_on_row->col + 1);
+        } else
+            tp = NULL;
+
+        /* Does this row have any URIs? */
+        struct row_uri_range *range, *range_terminator;
+        struct row_data *extra = old_row->extra;
+
+        if (extra != NULL && extra->uri_ranges.count > 0) {
+            range = &extra->uri_ranges.v[0];
+            range_terminator = &extra->uri_ranges.v[extra->uri_ranges.count];
+
+            /* Make sure the *last* URI range's end point is included
+             * in the copy */
+            const struct row_uri_range *last_on_row =
+                &extra->uri_ranges.v[extra->uri_ranges.count - 1];
+            col_count = max(col_count, last_on_row->end + 1);
+        } else
+            range = range_terminator = NULL;
+
+        for (int start = 0, left = col_count; left > 0;) {
+            int end;
+            bool tp_break = false;
+            bool uri_break = false;
+
+            /*
+             * Set end-coordinate for this chunk, by finding the next
+             * point-of-interrest on this row.
+             *
+             * If there are no more tracking points, or URI ranges,
+             * the end-coordinate will be at the end of the row,
+             */
+            if (range != range_terminator) {
+                int uri_col = (range->start >= start ? range->start : range->end) + 1;
+
+                if (tp != NULL) {
+                    int tp_col = tp->col + 1;
+                    end = min(tp_col, uri_col);
+
+                    tp_break = end == tp_col;
+                    uri_break = end == uri_col;
+                    LOG_DBG("tp+uri break at %d (%d, %d)", end, tp_col, uri_col);
+                } else {
+                    end = uri_col;
+                    uri_break = true;
+                    LOG_DBG("uri break at %d", end);
+                }
+            } else if (tp != NULL) {
+                end = tp->col + 1;
+                tp_break = true;
+                LOG_DBG("TP break at %d", end);
+            } else
+                end = col_count;
+
+            int cols = end - start;
+            xassert(cols > 0);
+            xassert(start + cols <= old_cols);
+
+            /*
+             * Copy the row chunk to the new grid. Note that there may
+             * be fewer cells left on the new row than what we have in
+             * the chunk. I.e. the chunk may have to be split up into
+             * multiple memcpy:ies.
+             */
+
+            for (int count = cols, from = start; count > 0;) {
+                xassert(new_col_idx <= new_cols);
+                int new_row_cells_left = new_cols - new_col_idx;
+
+                /* Row full, emit newline and get a new, fresh, row */
+                if (new_row_cells_left <= 0) {
+                    line_wrap();
+                    new_row_cells_left = new_cols;
+                }
+
+                /* Number of cells we can copy */
+                int amount = min(count, new_row_cells_left);
+                xassert(amount > 0);
+
+                /*
+                 * If we’re going to reach the end of the new row, we
+                 * need to make sure we don’t end in the middle of a
+                 * multi-column character.
+                 */
+                int spacers = 0;
+                if (new_col_idx + amount >= new_cols) {
+                    /*
+                     * While the cell *after* the last cell is a CELL_SPACER
+                     *
+                     * This means we have a multi-column character
+                     * that doesn’t fit on the current row. We need to
+                     * push it to the next row, and insert CELL_SPACER
+                     * cells as padding.
+                     */
+                    while (
+                        unlikely(
+                            amount > 1 &&
+                            from + amount < old_cols &&
+                            old_row->cells[from + amount].wc >= CELL_SPACER + 1))
+                    {
+                        amount--;
+                        spacers++;
+                    }
+
+                    xassert(
+                        amount == 1 ||
+                        old_row->cells[from + amount - 1].wc <= CELL_SPACER + 1);
+                }
+
+                xassert(new_col_idx + amount <= new_cols);
+                xassert(from + amount <= old_cols);
+
+                if (new_row != NULL) {
+                    memcpy(
+                        &new_row->cells[new_col_idx], &old_row->cells[from],
+                        amount * sizeof(struct cell));
+                }
+
+                count -= amount;
+                from += amount;
+                new_col_idx += amount;
+
+                xassert(new_col_idx <= new_cols);
+
+                if (unlikely(spacers > 0)) {
+                    xassert(new_col_idx + spacers == new_cols);
+
+                    const struct cell *cell = &old_row->cells[from - 1];
+
+                    for (int i = 0; i < spacers; i++, new_col_idx++) {
+                        if (new_row == NULL)
+                            continue;
+                        new_row->cells[new_col_idx].wc = CELL_SPACER;
+                        new_row->cells[new_col_idx].attrs = cell->attrs;
+                    }
+                }
+            }
+
+            xassert(new_col_idx > 0);
+
+            if (tp_break) {
+                do {
+                    xassert(tp != NULL);
+                    xassert(tp->row == old_row_idx);
+                    xassert(tp->col == end - 1);
+
+                    if (!count_only) {
+                        tp->row = new_seq & (ctx->new_rows - 1);
+                        tp->col = new_col_idx - 1;
+                    }
+
+                    next_tp++;
+                    tp = *next_tp;
+                } while (tp->row == old_row_idx && tp->col == end - 1);
+
+                if (tp->row != old_row_idx)
+                    tp = NULL;
+
+                LOG_DBG("next TP (tp=%p): %dx%d",
+                        (void*)tp, (*next_tp)->row, (*next_tp)->col);
+            }
+
+            if (uri_break) {
+                xassert(range != NULL);
+
+                if (range->start == end - 1) {
+                    if (new_row != NULL)
+                        reflow_uri_range_start(range, new_row, new_col_idx - 1);
+                    else
+                        open_uri = range;
+                }
+
+                if (range->end == end - 1) {
+                    if (new_row != NULL)
+                        reflow_uri_range_end(range, new_row, new_col_idx - 1);
+                    if (!count_only) {
+                        grid_row_uri_range_destroy(range);
+                        range->uri = NULL;
+                    }
+                    open_uri = NULL;
+                    range++;
+                }
+            }
+
+            left -= cols;
+            start += cols;
+        }
 
-    /* Clear "new" lines */
-    for (int r = min(old_screen_rows, new_screen_rows); r < new_screen_rows; r++) {
-        struct row *new_row = grid_row_alloc(new_cols, false);
-        new_grid[(new_offset + r) & (new_rows - 1)] = new_row;
 
-        memset(new_row->cells, 0, sizeof(struct cell) * new_cols);
-        new_row->dirty = true;
-    }
+        if (old_row->linebreak) {
+            /* Erase the remaining cells */
+            if (new_row != NULL) {
+                memset(&new_row->cells[new_col_idx], 0,
+                       (new_cols - new_col_idx) * sizeof(new_row->cells[0]));
+                new_row->linebreak = true;
+            }
+            line_wrap();
+        }
 
-#if defined(_DEBUG)
-    for (size_t r = 0; r < new_rows; r++) {
-        const struct row *row = new_grid[r];
+        if (!count_only) {
+            /* Chunks share the old arena's slabs; when reflowing in
+             * parallel, it is destroyed once all chunks are done */
+            if (ctx->chunk_count == 1)
+                grid_row_free(grid->rows[old_row_idx]);
+            else
+                row_release(grid->rows[old_row_idx]);
+            grid->rows[old_row_idx] = NULL;
+        }
 
-        if (row == NULL)
-            continue;
-        if (row->extra == NULL)
-            continue;
+#undef line_wrap
+    }
 
-        verify_no_overlapping_uris(row->extra);
-        verify_uris_are_sorted(row->extra);
+    /* Erase the remaining cells */
+    if (new_row != NULL) {
+        memset(&new_row->cells[new_col_idx], 0,
+               (new_cols - new_col_idx) * sizeof(new_row->cells[0]));
     }
-#endif
 
-    /* Free old grid */
-    for (int r = 0; r < grid->num_rows; r++)
-        grid_row_free(old_grid[r]);
-    free(grid->rows);
+    for (struct coord **tp = next_tp; *tp != ctx->tp_terminator; tp++) {
+        LOG_DBG("TP: row=%d, col=%d (old cols: %d, new cols: %d)",
+                (*tp)->row, (*tp)->col, old_cols, new_cols);
+    }
+    xassert(chunk->start == chunk->end || *next_tp == ctx->tp_terminator);
 
-    grid->rows = new_grid;
-    grid->num_rows = new_rows;
-    grid->num_cols = new_cols;
+    chunk->rows = new_seq - (count_only ? 0 : chunk->first_seq) + 1;
+}
 
-    grid->view = grid->offset = new_offset;
+static int
+reflow_worker_thread(void *_ctx)
+{
+    struct reflow_ctx *ctx = _ctx;
 
-    /* Keep cursor at current position, but clamp to new dimensions */
-    struct coord cursor = grid->cursor.point;
-    if (cursor.row == old_screen_rows - 1) {
-        /* 'less' breaks if the cursor isn't at the bottom */
-        cursor.row = new_screen_rows - 1;
-    }
-    cursor.row = min(cursor.row, new_screen_rows - 1);
-    cursor.col = min(cursor.col, new_cols - 1);
-    grid->cursor.point = cursor;
+    struct row scratch = {
+        .cells = xmalloc(ctx->grid->num_cols * sizeof(scratch.cells[0])),
+    };
 
-    struct coord saved_cursor = grid->saved_cursor.point;
-    if (saved_cursor.row == old_screen_rows - 1)
-        saved_cursor.row = new_screen_rows - 1;
-    saved_cursor.row = min(saved_cursor.row, new_screen_rows - 1);
-    saved_cursor.col = min(saved_cursor.col, new_cols - 1);
-    grid->saved_cursor.point = saved_cursor;
+    while (true) {
+        const size_t i = atomic_fetch_add_explicit(
+            &ctx->next_chunk, 1, memory_order_relaxed);
 
-    grid->cur_row = new_grid[(grid->offset + cursor.row) & (new_rows - 1)];
-    grid->cursor.lcf = false;
-    grid->saved_cursor.lcf = false;
+        if (i >= ctx->chunk_count)
+            break;
 
-    /* Free sixels we failed to "map" to the new grid */
-    tll_foreach(untranslated_sixels, it)
-        sixel_destroy(&it->item);
-    tll_free(untranslated_sixels);
+        reflow_chunk(ctx, &ctx->chunks[i], &scratch);
+    }
 
-#if defined(_DEBUG)
-    for (int r = 0; r < new_screen_rows; r++)
-        grid_row_in_view(grid, r);
-#endif
+    free(scratch.cells);
+    return 0;
 }
 
+/* Reflows all chunks, using up to ‘threads’ threads, in addition to
+ * the calling thread */
 static void
-reflow_uri_range_start(struct row_uri_range *range, struct row *new_row,
-                       int new_col_idx)
+reflow_chunks(struct reflow_ctx *ctx, size_t threads)
 {
-    ensure_row_has_extra_data(new_row);
-    uri_range_append_no_strdup
-        (new_row->extra, new_col_idx, -1, range->id, range->uri);
-    range->uri = NULL;
-}
+    atomic_store_explicit(&ctx->next_chunk, 0, memory_order_relaxed);
+
+    threads = min(threads, ctx->chunk_count - 1);
+    thrd_t tids[threads > 0 ? threads : 1];
+    size_t started = 0;
+
+    /* Signals must be delivered to the main thread; the new threads
+     * inherit the (blocked) mask */
+    sigset_t mask, old_mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, &old_mask);
+
+    for (; started < threads; started++) {
+        if (thrd_create(&tids[started], &reflow_worker_thread, ctx) != thrd_success) {
+            LOG_WARN("failed to create reflow thread; "
+                     "continuing with %zu threads", started);
+            break;
+        }
+    }
 
-static void
-reflow_uri_range_end(struct row_uri_range *range, struct row *new_row,
-                     int new_col_idx)
-{
-    struct row_data *extra = new_row->extra;
-    xassert(extra->uri_ranges.count > 0);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
 
-    struct row_uri_range *new_range =
-        &extra->uri_ranges.v[extra->uri_ranges.count - 1];
+    reflow_worker_thread(ctx);
 
-    xassert(new_range->id == range->id);
-    xassert(new_range->end < 0);
-    new_range->end = new_col_idx;
+    for (size_t i = 0; i < started; i++)
+        thrd_join(tids[i], NULL);
 }
 
-static struct row *
-_line_wrap(struct grid *old_grid, struct row **new_grid, struct row *row,
-           int *row_idx, int *col_idx, int row_count, int col_count)
+/*
+ * Splits the old rows [start, old_rows) (relative the scrollback
+ * start) into chunks of whole logical lines, of roughly the same
+ * size. Returns the number of chunks.
+ */
+static size_t
+reflow_split(const struct grid *grid, int offset, int start,
+             size_t threads, struct reflow_chunk **_chunks)
 {
-    *col_idx = 0;
-    *row_idx = (*row_idx + 1) & (row_count - 1);
+    const int old_rows = grid->num_rows;
+    const int count = old_rows - start;
 
-    struct row *new_row = new_grid[*row_idx];
+    size_t max_chunks = 1;
+    if (threads > 0 && count >= REFLOW_PARALLEL_MIN_ROWS)
+        max_chunks = (threads + 1) * REFLOW_CHUNKS_PER_THREAD;
 
-    if (new_row == NULL) {
-        /* Scrollback not yet full, allocate a completely new row */
-        new_row = grid_row_alloc(col_count, false);
-        new_grid[*row_idx] = new_row;
-    } else {
-        /* Scrollback is full, need to re-use a row */
-        grid_row_reset_extra(new_row);
-        new_row->linebreak = false;
+    const int chunk_size = (count + max_chunks - 1) / max_chunks;
 
-        tll_foreach(old_grid->sixel_images, it) {
-            if (it->item.pos.row == *row_idx) {
-                sixel_destroy(&it->item);
-                tll_remove(old_grid->sixel_images, it);
-            }
-        }
-    }
+    struct reflow_chunk *chunks = xcalloc(max_chunks, sizeof(chunks[0]));
+    size_t chunk_count = 0;
 
-    struct row_data *extra = row->extra;
-    if (extra == NULL)
-        return new_row;
+    for (int r = start; r < old_rows;) {
+        int end = min(r + chunk_size, old_rows);
 
-    /*
-     * URI ranges are per row. Thus, we need to ‘close’ the still-open
-     * ranges on the previous row, and re-open them on the
-     * next/current row.
-     */
-    if (extra->uri_ranges.count > 0) {
-        struct row_uri_range *range =
-            &extra->uri_ranges.v[extra->uri_ranges.count - 1];
+        /* Chunks must begin on a new logical line */
+        for (; end < old_rows; end++) {
+            const struct row *prev =
+                grid->rows[(offset + end - 1) & (old_rows - 1)];
+            if (prev != NULL && prev->linebreak)
+                break;
+        }
 
-        if (range->end < 0) {
+        xassert(chunk_count < max_chunks);
+        chunks[chunk_count++] = (struct reflow_chunk){
+            .start = r,
+            .end = end,
+            .last_seq = INT_MAX,
+        };
 
-            /* Terminate URI range on the previous row */
-            range->end = col_count - 1;
+        r = end;
+    }
 
-            /* Open a new range on the new/current row */
-            ensure_row_has_extra_data(new_row);
-            uri_range_append(new_row->extra, 0, -1, range->id, range->uri);
-        }
+    if (chunk_count == 0) {
+        chunks[chunk_count++] = (struct reflow_chunk){
+            .start = start,
+            .end = start,
+            .last_seq = INT_MAX,
+        };
     }
 
-    return new_row;
+    *_chunks = chunks;
+    return chunk_count;
+}
+
+struct reflow_sixel {
+    int row;                    /* Old row, relative scrollback start */
+    size_t idx;                 /* Keeps the sort stable */
+    struct sixel sixel;
+};
+
+static int
+reflow_sixel_cmp(const void *_a, const void *_b)
+{
+    const struct reflow_sixel *a = _a;
+    const struct reflow_sixel *b = _b;
+
+    if (a->row != b->row)
+        return a->row < b->row ? -1 : 1;
+    return a->idx < b->idx ? -1 : a->idx > b->idx;
 }
 
 static struct {
@@ -551,334 +1976,202 @@ tp_cmp(const void *_a, const void *_b)
 
 void
 grid_resize_and_reflow(
-    struct grid *grid, int new_rows, int new_cols,
+    struct grid *grid, size_t threads, int new_rows, int new_cols,
     int old_screen_rows, int new_screen_rows,
     size_t tracking_points_count,
     struct coord *const _tracking_points[static tracking_points_count])
 {
-#if defined(TIME_REFLOW) && TIME_REFLOW
-    struct timespec start;
-    clock_gettime(CLOCK_MONOTONIC, &start);
-#endif
-
-    struct row *const *old_grid = grid->rows;
-    const int old_rows = grid->num_rows;
-    const int old_cols = grid->num_cols;
-
-    /* Is viewpoint tracking current grid offset? */
-    const bool view_follows = grid->view == grid->offset;
-
-    int new_col_idx = 0;
-    int new_row_idx = 0;
-
-    struct row **new_grid = xcalloc(new_rows, sizeof(new_grid[0]));
-    struct row *new_row = new_grid[new_row_idx];
-
-    xassert(new_row == NULL);
-    new_row = grid_row_alloc(new_cols, false);
-    new_grid[new_row_idx] = new_row;
-
-    /* Start at the beginning of the old grid's scrollback. That is,
-     * at the output that is *oldest* */
-    int offset = grid->offset + old_screen_rows;
-
-    tll(struct sixel) untranslated_sixels = tll_init();
-    tll_foreach(grid->sixel_images, it)
-        tll_push_back(untranslated_sixels, it->item);
-    tll_free(grid->sixel_images);
-
-    /* Turn cursor coordinates into grid absolute coordinates */
-    struct coord cursor = grid->cursor.point;
-    cursor.row += grid->offset;
-    cursor.row &= old_rows - 1;
-
-    struct coord saved_cursor = grid->saved_cursor.point;
-    saved_cursor.row += grid->offset;
-    saved_cursor.row &= old_rows - 1;
-
-    size_t tp_count =
-        tracking_points_count +
-        1 +                       /* cursor */
-        1 +                       /* saved cursor */
-        !view_follows +           /* viewport */
-        1;                        /* terminator */
-
-    struct coord *tracking_points[tp_count];
-    memcpy(tracking_points, _tracking_points, tracking_points_count * sizeof(_tracking_points[0]));
-    tracking_points[tracking_points_count] = &cursor;
-    tracking_points[tracking_points_count + 1] = &saved_cursor;
-
-    struct coord viewport = {0, grid->view};
-    if (!view_follows)
-        tracking_points[tracking_points_count + 2] = &viewport;
-
-    /* Not thread safe! */
-    tp_cmp_ctx.scrollback_start = offset;
-    tp_cmp_ctx.rows = old_rows;
-    qsort(
-        tracking_points, tp_count - 1, sizeof(tracking_points[0]), &tp_cmp);
-
-    /* NULL terminate */
-    struct coord terminator = {-1, -1};
-    tracking_points[tp_count - 1] = &terminator;
-    struct coord **next_tp = &tracking_points[0];
-
-    LOG_DBG("scrollback-start=%d", offset);
-    for (size_t i = 0; i < tp_count - 1; i++) {
-        LOG_DBG("TP #%zu: row=%d, col=%d",
-                i, tracking_points[i]->row, tracking_points[i]->col);
-    }
-
-    /*
-     * Walk the old grid
-     */
-    for (int r = 0; r < old_rows; r++) {
-
-        const size_t old_row_idx = (offset + r) & (old_rows - 1);
-
-        /* Unallocated (empty) rows we can simply skip */
-        const struct row *old_row = old_grid[old_row_idx];
-        if (old_row == NULL)
-            continue;
-
-        /* Map sixels on current "old" row to current "new row" */
-        tll_foreach(untranslated_sixels, it) {
-            if (it->item.pos.row != old_row_idx)
-                continue;
-
-            struct sixel sixel = it->item;
-            sixel.pos.row = new_row_idx;
-
-            tll_push_back(grid->sixel_images, sixel);
-            tll_remove(untranslated_sixels, it);
-        }
-
-#define line_wrap()                                                 \
-        new_row = _line_wrap(                                       \
-            grid, new_grid, new_row, &new_row_idx, &new_col_idx,    \
-            new_rows, new_cols)
-
-        /* Find last non-empty cell */
-        int col_count = 0;
-        for (int c = old_cols - 1; c >= 0; c--) {
-            const struct cell *cell = &old_row->cells[c];
-            if (!(cell->wc == 0 || cell->wc == CELL_SPACER)) {
-                col_count = c + 1;
-                break;
-            }
-        }
-
-        xassert(col_count >= 0 && col_count <= old_cols);
-
-        /* Do we have a (at least one) tracking point on this row */
-        struct coord *tp;
-        if (unlikely((*next_tp)->row == old_row_idx)) {
-            tp = *next_tp;
-
-            /* Find the *last* tracking point on this row */
-            struct coord *last_on_row = tp;
-            for (struct coord **iter = next_tp; (*iter)->row == old_row_idx; iter++)
-                last_on_row = *iter;
-
-            /* And make sure its end point is included in the col range */
-            xassert(last_on_row->row == old_row_idx);
-            col_count = max(col_count, last_on_row->col + 1);
-        } else
-            tp = NULL;
-
-        /* Does this row have any URIs? */
-        struct row_uri_range *range, *range_terminator;
-        struct row_data *extra = old_row->extra;
+    const int old_rows = grid->num_rows;
+    const int old_cols = grid->num_cols;
 
-        if (extra != NULL && extra->uri_ranges.count > 0) {
-            range = &extra->uri_ranges.v[0];
-            range_terminator = &extra->uri_ranges.v[extra->uri_ranges.count];
+    /* Is viewpoint tracking current grid offset? */
+    const bool view_follows = grid->view == grid->offset;
 
-            /* Make sure the *last* URI range's end point is included
-             * in the copy */
-            const struct row_uri_range *last_on_row =
-                &extra->uri_ranges.v[extra->uri_ranges.count - 1];
-            col_count = max(col_count, last_on_row->end + 1);
-        } else
-            range = range_terminator = NULL;
+    struct row **new_grid = xcalloc(new_rows, sizeof(new_grid[0]));
+    struct row_arena *new_arena = row_arena_new(new_cols);
 
-        for (int start = 0, left = col_count; left > 0;) {
-            int end;
-            bool tp_break = false;
-            bool uri_break = false;
+    /* Start at the beginning of the old grid's scrollback. That is,
+     * at the output that is *oldest* */
+    int offset = grid->offset + old_screen_rows;
 
-            /*
-             * Set end-coordinate for this chunk, by finding the next
-             * point-of-interrest on this row.
-             *
-             * If there are no more tracking points, or URI ranges,
-             * the end-coordinate will be at the end of the row,
-             */
-            if (range != range_terminator) {
-                int uri_col = (range->start >= start ? range->start : range->end) + 1;
+    tll(struct sixel) untranslated_sixels = tll_init();
+    tll_foreach(grid->sixel_images, it)
+        tll_push_back(untranslated_sixels, it->item);
+    tll_free(grid->sixel_images);
 
-                if (tp != NULL) {
-                    int tp_col = tp->col + 1;
-                    end = min(tp_col, uri_col);
+    /* Turn cursor coordinates into grid absolute coordinates */
+    struct coord cursor = grid->cursor.point;
+    cursor.row += grid->offset;
+    cursor.row &= old_rows - 1;
 
-                    tp_break = end == tp_col;
-                    uri_break = end == uri_col;
-                    LOG_DBG("tp+uri break at %d (%d, %d)", end, tp_col, uri_col);
-                } else {
-                    end = uri_col;
-                    uri_break = true;
-                    LOG_DBG("uri break at %d", end);
-                }
-            } else if (tp != NULL) {
-                end = tp->col + 1;
-                tp_break = true;
-                LOG_DBG("TP break at %d", end);
-            } else
-                end = col_count;
+    struct coord saved_cursor = grid->saved_cursor.point;
+    saved_cursor.row += grid->offset;
+    saved_cursor.row &= old_rows - 1;
 
-            int cols = end - start;
-            xassert(cols > 0);
-            xassert(start + cols <= old_cols);
+    size_t tp_count =
+        tracking_points_count +
+        1 +                       /* cursor */
+        1 +                       /* saved cursor */
+        !view_follows;            /* viewport */
 
-            /*
-             * Copy the row chunk to the new grid. Note that there may
-             * be fewer cells left on the new row than what we have in
-             * the chunk. I.e. the chunk may have to be split up into
-             * multiple memcpy:ies.
-             */
+    struct coord *tracking_points[tp_count];
+    memcpy(tracking_points, _tracking_points, tracking_points_count * sizeof(_tracking_points[0]));
+    tracking_points[tracking_points_count] = &cursor;
+    tracking_points[tracking_points_count + 1] = &saved_cursor;
 
-            for (int count = cols, from = start; count > 0;) {
-                xassert(new_col_idx <= new_cols);
-                int new_row_cells_left = new_cols - new_col_idx;
+    struct coord viewport = {0, grid->view};
+    if (!view_follows)
+        tracking_points[tracking_points_count + 2] = &viewport;
 
-                /* Row full, emit newline and get a new, fresh, row */
-                if (new_row_cells_left <= 0) {
-                    line_wrap();
-                    new_row_cells_left = new_cols;
-                }
+    /* Not thread safe! */
+    tp_cmp_ctx.scrollback_start = offset;
+    tp_cmp_ctx.rows = old_rows;
+    qsort(
+        tracking_points, tp_count, sizeof(tracking_points[0]), &tp_cmp);
 
-                /* Number of cells we can copy */
-                int amount = min(count, new_row_cells_left);
-                xassert(amount > 0);
+    LOG_DBG("scrollback-start=%d", offset);
+    for (size_t i = 0; i < tp_count; i++) {
+        LOG_DBG("TP #%zu: row=%d, col=%d",
+                i, tracking_points[i]->row, tracking_points[i]->col);
+    }
 
-                /*
-                 * If we’re going to reach the end of the new row, we
-                 * need to make sure we don’t end in the middle of a
-                 * multi-column character.
-                 */
-                int spacers = 0;
-                if (new_col_idx + amount >= new_cols) {
-                    /*
-                     * While the cell *after* the last cell is a CELL_SPACER
-                     *
-                     * This means we have a multi-column character
-                     * that doesn’t fit on the current row. We need to
-                     * push it to the next row, and insert CELL_SPACER
-                     * cells as padding.
-                     */
-                    while (
-                        unlikely(
-                            amount > 1 &&
-                            from + amount < old_cols &&
-                            old_row->cells[from + amount].wc >= CELL_SPACER + 1))
-                    {
-                        amount--;
-                        spacers++;
-                    }
+    /* Skip the unallocated part of the scrollback */
+    int start = 0;
+    while (start < old_rows &&
+           grid->rows[(offset + start) & (old_rows - 1)] == NULL)
+    {
+        start++;
+    }
 
-                    xassert(
-                        amount == 1 ||
-                        old_row->cells[from + amount - 1].wc <= CELL_SPACER + 1);
-                }
+    struct reflow_ctx ctx = {
+        .grid = grid,
+        .offset = offset,
+        .new_grid = new_grid,
+        .new_rows = new_rows,
+        .new_cols = new_cols,
+    };
 
-                xassert(new_col_idx + amount <= new_cols);
-                xassert(from + amount <= old_cols);
+    ctx.chunk_count = reflow_split(grid, offset, start, threads, &ctx.chunks);
 
-                memcpy(
-                    &new_row->cells[new_col_idx], &old_row->cells[from],
-                    amount * sizeof(struct cell));
+    if (tll_length(untranslated_sixels) > 0) {
+        ctx.row_seq = xmalloc(old_rows * sizeof(ctx.row_seq[0]));
+        for (int r = 0; r < old_rows; r++)
+            ctx.row_seq[r] = -1;
+    }
 
-                count -= amount;
-                from += amount;
-                new_col_idx += amount;
+    /* Hand out the (sorted) tracking points to the chunks they are
+     * on, each chunk's list being NULL terminated */
+    struct coord terminator = {-1, -1};
+    struct coord **chunk_tps =
+        xmalloc((tp_count + ctx.chunk_count) * sizeof(chunk_tps[0]));
+    ctx.tp_terminator = &terminator;
 
-                xassert(new_col_idx <= new_cols);
+    for (size_t i = 0, tp_idx = 0, out = 0; i < ctx.chunk_count; i++) {
+        struct reflow_chunk *chunk = &ctx.chunks[i];
+        const bool last = i == ctx.chunk_count - 1;
 
-                if (unlikely(spacers > 0)) {
-                    xassert(new_col_idx + spacers == new_cols);
+        chunk->tps = &chunk_tps[out];
 
-                    const struct cell *cell = &old_row->cells[from - 1];
+        for (; tp_idx < tp_count; tp_idx++) {
+            const int row =
+                (tracking_points[tp_idx]->row - offset + old_rows) & (old_rows - 1);
+            if (!last && row >= chunk->end)
+                break;
+            chunk_tps[out++] = tracking_points[tp_idx];
+        }
 
-                    for (int i = 0; i < spacers; i++, new_col_idx++) {
-                        new_row->cells[new_col_idx].wc = CELL_SPACER;
-                        new_row->cells[new_col_idx].attrs = cell->attrs;
-                    }
-                }
-            }
+        chunk_tps[out++] = &terminator;
+    }
 
-            xassert(new_col_idx > 0);
+    if (ctx.chunk_count == 1) {
+        struct row scratch = {
+            .cells = xmalloc(old_cols * sizeof(scratch.cells[0])),
+        };
 
-            if (tp_break) {
-                do {
-                    xassert(tp != NULL);
-                    xassert(tp->row == old_row_idx);
-                    xassert(tp->col == end - 1);
+        ctx.chunks[0].arena = new_arena;
+        reflow_chunk(&ctx, &ctx.chunks[0], &scratch);
+        free(scratch.cells);
+    } else {
+        /* Count the number of new rows in each chunk */
+        ctx.count_only = true;
+        reflow_chunks(&ctx, threads);
+
+        int seq = 0;
+        for (size_t i = 0; i < ctx.chunk_count; i++) {
+            struct reflow_chunk *chunk = &ctx.chunks[i];
+            chunk->first_seq = seq;
+
+            /* All but the last chunk end with a hard linebreak. The
+             * fresh row following it is the next chunk's first row */
+            if (i < ctx.chunk_count - 1) {
+                chunk->last_seq = seq + chunk->rows - 2;
+                seq += chunk->rows - 1;
+            }
 
-                    tp->row = new_row_idx;
-                    tp->col = new_col_idx - 1;
+            chunk->arena = row_arena_new(new_cols);
+        }
 
-                    next_tp++;
-                    tp = *next_tp;
-                } while (tp->row == old_row_idx && tp->col == end - 1);
+        /* Don't bother reflowing rows that will not fit in the new grid */
+        const struct reflow_chunk *last = &ctx.chunks[ctx.chunk_count - 1];
+        ctx.first_kept = max(last->first_seq + last->rows - new_rows, 0);
+        ctx.count_only = false;
 
-                if (tp->row != old_row_idx)
-                    tp = NULL;
+        reflow_chunks(&ctx, threads);
 
-                LOG_DBG("next TP (tp=%p): %dx%d",
-                        (void*)tp, (*next_tp)->row, (*next_tp)->col);
-            }
+        for (size_t i = 0; i < ctx.chunk_count; i++)
+            row_arena_merge(new_arena, ctx.chunks[i].arena);
+    }
 
-            if (uri_break) {
-                xassert(range != NULL);
+    free(chunk_tps);
 
-                if (range->start == end - 1)
-                    reflow_uri_range_start(range, new_row, new_col_idx - 1);
+    const struct reflow_chunk *last = &ctx.chunks[ctx.chunk_count - 1];
+    const int last_seq = last->first_seq + last->rows - 1;
+    const int new_row_idx = last_seq & (new_rows - 1);
 
-                if (range->end == end - 1) {
-                    reflow_uri_range_end(range, new_row, new_col_idx - 1);
-                    grid_row_uri_range_destroy(range);
-                    range++;
-                }
-            }
+    /*
+     * Map sixels to the new row their "old" row begins on, in
+     * scrollback order. Sixels on rows that have been re-used, or
+     * dropped, are destroyed.
+     */
+    if (ctx.row_seq != NULL) {
+        const size_t count = tll_length(untranslated_sixels);
+        struct reflow_sixel *sixels = xmalloc(count * sizeof(sixels[0]));
 
-            left -= cols;
-            start += cols;
+        size_t i = 0;
+        tll_foreach(untranslated_sixels, it) {
+            sixels[i].row =
+                (it->item.pos.row - offset + old_rows) & (old_rows - 1);
+            sixels[i].idx = i;
+            sixels[i].sixel = it->item;
+            i++;
+            tll_remove(untranslated_sixels, it);
         }
 
+        qsort(sixels, count, sizeof(sixels[0]), &reflow_sixel_cmp);
 
-        if (old_row->linebreak) {
-            /* Erase the remaining cells */
-            memset(&new_row->cells[new_col_idx], 0,
-                   (new_cols - new_col_idx) * sizeof(new_row->cells[0]));
-            new_row->linebreak = true;
-            line_wrap();
-        }
+        for (size_t j = 0; j < count; j++) {
+            struct sixel *sixel = &sixels[j].sixel;
+            const int seq = ctx.row_seq[sixels[j].row];
 
-        grid_row_free(old_grid[old_row_idx]);
-        grid->rows[old_row_idx] = NULL;
+            if (seq < 0) {
+                tll_push_back(untranslated_sixels, *sixel);
+                continue;
+            }
 
-#undef line_wrap
-    }
+            if (seq + new_rows <= last_seq) {
+                sixel_destroy(sixel);
+                continue;
+            }
 
-    /* Erase the remaining cells */
-    memset(&new_row->cells[new_col_idx], 0,
-           (new_cols - new_col_idx) * sizeof(new_row->cells[0]));
+            sixel->pos.row = seq & (new_rows - 1);
+            tll_push_back(grid->sixel_images, *sixel);
+        }
 
-    for (struct coord **tp = next_tp; *tp != &terminator; tp++) {
-        LOG_DBG("TP: row=%d, col=%d (old cols: %d, new cols: %d)",
-                (*tp)->row, (*tp)->col, old_cols, new_cols);
+        free(sixels);
+        free(ctx.row_seq);
     }
-    xassert(old_rows == 0 || *next_tp == &terminator);
+
+    free(ctx.chunks);
 
 #if defined(_DEBUG)
     /* Verify all URI ranges have been “closed” */
@@ -902,6 +2195,9 @@ grid_resize_and_reflow(
         xassert(grid->rows[i] == NULL);
 #endif
 
+    /* There are no cold rows left */
+    cold_attrs_reset(grid->cold);
+
     /* Set offset such that the last reflowed row is at the bottom */
     grid->offset = new_row_idx - new_screen_rows + 1;
     while (grid->offset < 0)
@@ -913,7 +2209,7 @@ grid_resize_and_reflow(
     for (int r = 0; r < new_screen_rows; r++) {
         int idx = (grid->offset + r) & (new_rows - 1);
         if (new_grid[idx] == NULL)
-            new_grid[idx] = grid_row_alloc(new_cols, true);
+            new_grid[idx] = grid_row_alloc(new_arena, new_cols, true);
     }
 
     grid->view = view_follows ? grid->offset : viewport.row;
@@ -935,11 +2231,16 @@ grid_resize_and_reflow(
 
     /* Free old grid (rows already free:d) */
     free(grid->rows);
+    row_arena_destroy(grid->arena);
 
     grid->rows = new_grid;
+    grid->arena = new_arena;
     grid->num_rows = new_rows;
     grid->num_cols = new_cols;
 
+    /* All reflowed rows are regular (hot) rows */
+    grid->thawed = true;
+
     /* Convert absolute coordinates to screen relative */
     cursor.row -= grid->offset;
     while (cursor.row < 0)
@@ -964,18 +2265,6 @@ grid_resize_and_reflow(
     tll_foreach(untranslated_sixels, it)
         sixel_destroy(&it->item);
     tll_free(untranslated_sixels);
-
-#if defined(TIME_REFLOW) && TIME_REFLOW
-    struct timespec stop;
-    clock_gettime(CLOCK_MONOTONIC, &stop);
-
-    struct timespec diff;
-    timespec_sub(&stop, &start, &diff);
-    LOG_INFO("reflowed %d -> %d rows in %lds %ldns",
-             old_rows, new_rows,
-             (long)diff.tv_sec,
-             diff.tv_nsec);
-#endif
 }
 
 void
@@ -1273,3 +2562,311 @@ UNITTEST
         grid_row_uri_range_destroy(&row_data.uri_ranges.v[i]);
     free(row_data.uri_ranges.v);
 }
+
+UNITTEST
+{
+    /* Wide enough to only fit the minimum number of rows per slab */
+    const int cols = ROW_SLAB_SIZE / sizeof(struct cell);
+    struct row_arena *arena = row_arena_new(cols);
+    xassert(arena->slot_count == ROW_SLAB_MIN_SLOTS);
+
+    const size_t count = 3 * ROW_SLAB_MIN_SLOTS;
+    struct row *rows[count];
+
+    for (size_t i = 0; i < count; i++) {
+        rows[i] = grid_row_alloc(arena, cols, i % 2 == 0);
+        xassert(rows[i]->slab != NULL);
+        xassert(rows[i]->extra == NULL);
+
+        if (i % 2 == 0) {
+            xassert(rows[i]->cells[0].wc == 0);
+            xassert(!grid_row_cell_is_dirty(rows[i], cols - 1));
+        } else
+            xassert(grid_row_all_dirty(rows[i], cols));
+
+        /* Cells must not overlap the next row */
+        rows[i]->cells[cols - 1].wc = i;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        xassert(rows[i]->cells[cols - 1].wc == i);
+
+    /* All slabs are full */
+    size_t slabs = 0;
+    for (const struct row_slab *s = arena->head; s != NULL; s = s->next) {
+        xassert(row_slab_is_full(arena, s));
+        slabs++;
+    }
+    xassert(slabs == 3);
+
+    /* Freeing one row moves its slab to the front, and re-uses the slot */
+    struct row *freed = rows[ROW_SLAB_MIN_SLOTS + 1];
+    struct row_slab *slab = freed->slab;
+    grid_row_free(freed);
+    xassert(arena->head == slab);
+
+    rows[ROW_SLAB_MIN_SLOTS + 1] = grid_row_alloc(arena, cols, false);
+    xassert(rows[ROW_SLAB_MIN_SLOTS + 1] == freed);
+    xassert(arena->tail == slab);
+
+    /* Completely empty slabs are released */
+    for (size_t i = 0; i < ROW_SLAB_MIN_SLOTS; i++)
+        grid_row_free(rows[i]);
+
+    slabs = 0;
+    for (const struct row_slab *s = arena->head; s != NULL; s = s->next)
+        slabs++;
+    xassert(slabs == 2);
+
+    /* Rows not allocated from an arena */
+    struct row *heap_row = grid_row_alloc(NULL, cols, true);
+    xassert(heap_row->slab == NULL);
+    grid_row_free(heap_row);
+
+    row_arena_destroy(arena);
+}
+
+UNITTEST
+{
+    const int cols = 80;
+    struct grid grid = {
+        .num_rows = 4,
+        .num_cols = cols,
+        .rows = xcalloc(4, sizeof(grid.rows[0])),
+        .arena = row_arena_new(cols),
+    };
+
+    struct row *row = grid_row_alloc(grid.arena, cols, true);
+    grid.rows[1] = row;
+
+    const wchar_t text[] = L"hello    world";
+    for (size_t c = 0; c < ALEN(text) - 1; c++)
+        row->cells[c].wc = text[c];
+    row->cells[5].attrs.bold = true;
+    row->cells[6].attrs.bg_src = COLOR_RGB;
+    row->cells[6].attrs.bg = 0x123456;
+    row->cells[20].wc = CELL_SPACER + 1;
+    row->cells[cols - 1].attrs.reverse = true;
+    row->linebreak = true;
+
+    struct cell expected[80];
+    memcpy(expected, row->cells, sizeof(expected));
+
+    xassert(grid_row_freeze(&grid, 1));
+    xassert(grid_row_is_cold(grid.rows[1]));
+    xassert(grid.rows[1]->linebreak);
+    xassert(!grid_row_freeze(&grid, 1));
+    xassert(grid_row_used_cols(&grid, 1) == cols - 1);
+
+    /* Bold, and RGB background; the fill is stored in the row */
+    xassert(grid.cold->attrs.count == 2);
+
+    /* Peeking decompresses, but leaves the row cold */
+    const struct row *peek = grid_row_peek(&grid, 1);
+    xassert(memcmp(peek->cells, expected, sizeof(expected)) == 0);
+    xassert(peek->linebreak);
+    xassert(grid_row_peek(&grid, 1) == peek);
+    xassert(grid_row_is_cold(grid.rows[1]));
+
+    /* Hot, and unallocated, rows are returned as is */
+    xassert(grid_row_peek(&grid, 2) == NULL);
+    xassert(grid_row_thaw(&grid, 2) == NULL);
+
+    row = grid_row_thaw(&grid, 1);
+    xassert(!grid_row_is_cold(row));
+    xassert(grid.rows[1] == row);
+    xassert(row->dirty);
+    xassert(grid_row_all_dirty(row, cols));
+    xassert(row->linebreak);
+    xassert(grid.thawed);
+    xassert(memcmp(row->cells, expected, sizeof(expected)) == 0);
+    xassert(grid_row_peek(&grid, 1) == row);
+
+    /* Trailing empty cells are elided, including colored ones */
+    row->cells[cols - 1].attrs.reverse = false;
+    for (int c = 21; c < cols; c++) {
+        row->cells[c].attrs.bg_src = COLOR_BASE16;
+        row->cells[c].attrs.bg = 2;
+    }
+    memcpy(expected, row->cells, sizeof(expected));
+
+    xassert(grid_row_freeze(&grid, 1));
+    xassert(grid_row_used_cols(&grid, 1) == 21);
+    xassert(grid.cold->attrs.count == 2);
+    peek = grid_row_peek(&grid, 1);
+    xassert(memcmp(peek->cells, expected, sizeof(expected)) == 0);
+
+    /* Blank rows store no cells. Peeking at them must not leave
+     * cells from previously peeked rows behind */
+    grid.rows[3] = grid_row_alloc(grid.arena, cols, true);
+    xassert(grid_row_freeze(&grid, 3));
+    xassert(grid_row_used_cols(&grid, 3) == 0);
+
+    for (size_t i = 0; i < COLD_CACHE_SIZE; i++) {
+        peek = grid_row_peek(&grid, i % 2 == 0 ? 1 : 3);
+        xassert(grid_row_peek(&grid, 1) != grid_row_peek(&grid, 3));
+    }
+
+    peek = grid_row_peek(&grid, 3);
+    for (int c = 0; c < cols; c++) {
+        xassert(peek->cells[c].wc == 0);
+        xassert(cold_attrs(&peek->cells[c].attrs) == 0);
+    }
+
+    row = grid_row_thaw(&grid, 1);
+    xassert(memcmp(row->cells, expected, sizeof(expected)) == 0);
+
+    /* Attributes only referenced by freed rows are dropped when
+     * compacting; the remaining rows are re-encoded */
+    grid.rows[0] = grid_row_alloc(grid.arena, cols, true);
+    grid.rows[2] = grid_row_alloc(grid.arena, cols, true);
+    for (int c = 0; c < cols; c++) {
+        grid.rows[0]->cells[c] = (struct cell){
+            .wc = L'a', .attrs = {.fg_src = COLOR_RGB, .fg = c}};
+        grid.rows[2]->cells[c] = (struct cell){
+            .wc = L'b', .attrs = {.fg_src = COLOR_RGB, .fg = cols + c}};
+    }
+    memcpy(expected, grid.rows[2]->cells, sizeof(expected));
+
+    xassert(grid_row_freeze(&grid, 0));
+    xassert(grid_row_freeze(&grid, 2));
+    xassert(grid.cold->attrs.count == 2 + 2 * cols);
+
+    grid_row_free(grid.rows[0]);
+    grid.rows[0] = NULL;
+
+    grid_cold_attrs_compact(&grid);
+    xassert(grid.cold->attrs.count == cols);
+    peek = grid_row_peek(&grid, 2);
+    xassert(memcmp(peek->cells, expected, sizeof(expected)) == 0);
+
+    /* Nothing to drop */
+    grid_cold_attrs_compact(&grid);
+    xassert(grid.cold->attrs.count == cols);
+    xassert(!grid_cold_attrs_compact_pending(&grid));
+
+    /* Re-interned after compaction */
+    row = grid_row_thaw(&grid, 2);
+    xassert(memcmp(row->cells, expected, sizeof(expected)) == 0);
+    xassert(grid_row_freeze(&grid, 2));
+    xassert(grid.cold->attrs.count == cols);
+
+    grid_free(&grid);
+}
+
+static void
+verify_reflowed_grids_equal(const struct grid *a, const struct grid *b)
+{
+    xassert(a->num_rows == b->num_rows);
+    xassert(a->num_cols == b->num_cols);
+    xassert(a->offset == b->offset);
+    xassert(a->view == b->view);
+    xassert(a->cursor.point.row == b->cursor.point.row);
+    xassert(a->cursor.point.col == b->cursor.point.col);
+
+    for (int r = 0; r < a->num_rows; r++) {
+        const struct row *ra = a->rows[r];
+        const struct row *rb = b->rows[r];
+
+        xassert((ra == NULL) == (rb == NULL));
+        if (ra == NULL)
+            continue;
+
+        xassert(ra->linebreak == rb->linebreak);
+        xassert(memcmp(ra->cells, rb->cells,
+                       a->num_cols * sizeof(ra->cells[0])) == 0);
+
+        const size_t uris_a = ra->extra != NULL ? ra->extra->uri_ranges.count : 0;
+        const size_t uris_b = rb->extra != NULL ? rb->extra->uri_ranges.count : 0;
+        xassert(uris_a == uris_b);
+
+        for (size_t i = 0; i < uris_a; i++) {
+            const struct row_uri_range *ua = &ra->extra->uri_ranges.v[i];
+            const struct row_uri_range *ub = &rb->extra->uri_ranges.v[i];
+            xassert(ua->start == ub->start);
+            xassert(ua->end == ub->end);
+            xassert(ua->id == ub->id);
+            xassert(strcmp(ua->uri, ub->uri) == 0);
+        }
+    }
+}
+
+UNITTEST
+{
+    /* Parallel reflow must give the same result as a serial one */
+    const int rows = 16384;
+    const int cols = 40;
+    const int screen_rows = 24;
+
+    struct grid serial = {
+        .num_rows = rows,
+        .num_cols = cols,
+        .rows = xcalloc(rows, sizeof(serial.rows[0])),
+        .arena = row_arena_new(cols),
+        .cursor = {.point = {.row = screen_rows - 1, .col = 3}},
+    };
+
+    uint32_t seed = 1;
+    for (int r = 0; r < rows; r++) {
+        struct row *row = grid_row_alloc(serial.arena, cols, true);
+        serial.rows[r] = row;
+
+        seed = seed * 1103515245 + 12345;
+        const int len = (seed >> 16) % (cols + 1);
+
+        for (int c = 0; c < len; c++) {
+            row->cells[c].wc = L'a' + (r + c) % 26;
+            row->cells[c].attrs.fg = r % 7;
+        }
+
+        /* Double-width characters, at varying positions */
+        if (len > 2 && r % 5 == 0) {
+            row->cells[len - 2].wc = 0x4e00;
+            row->cells[len - 1].wc = CELL_SPACER + 1;
+        }
+
+        /* URIs, some of them running to the end of the row */
+        if (r % 11 == 0)
+            for (int c = cols - 8; c < cols; c++)
+                grid_row_uri_range_put(row, c, "http://foo.bar", r / 2);
+
+        row->linebreak = (seed >> 8) % 3 == 0 || r == screen_rows - 1;
+    }
+
+    /* Cold rows in the scrollback */
+    for (int r = screen_rows; r < rows; r += 3)
+        grid_row_freeze(&serial, r);
+
+    struct grid *parallel = grid_snapshot(&serial);
+    parallel->saved_cursor = serial.saved_cursor;
+
+    struct coord sel_serial = {7, screen_rows + 1234};
+    struct coord sel_parallel = sel_serial;
+
+    /* Shrinking produces more rows than fit in the new grid */
+    grid_resize_and_reflow(
+        &serial, 0, rows, 17, screen_rows, screen_rows,
+        1, (struct coord *[]){&sel_serial});
+    grid_resize_and_reflow(
+        parallel, 3, rows, 17, screen_rows, screen_rows,
+        1, (struct coord *[]){&sel_parallel});
+
+    verify_reflowed_grids_equal(&serial, parallel);
+    xassert(sel_serial.row == sel_parallel.row);
+    xassert(sel_serial.col == sel_parallel.col);
+
+    grid_resize_and_reflow(
+        &serial, 0, rows, 93, screen_rows, screen_rows + 10,
+        1, (struct coord *[]){&sel_serial});
+    grid_resize_and_reflow(
+        parallel, 3, rows, 93, screen_rows, screen_rows + 10,
+        1, (struct coord *[]){&sel_parallel});
+
+    verify_reflowed_grids_equal(&serial, parallel);
+    xassert(sel_serial.row == sel_parallel.row);
+    xassert(sel_serial.col == sel_parallel.col);
+
+    grid_free(&serial);
+    grid_free(parallel);
+    free(parallel);
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 #include "debug.h"
 #include "terminal.h"
 
@@ -8,15 +10,46 @@ struct grid *grid_snapshot(const struct grid *grid);
 void grid_free(struct grid *grid);
 
 void grid_swap_row(struct grid *grid, int row_a, int row_b);
-struct row *grid_row_alloc(int cols, bool initialize);
+struct row *grid_row_alloc(
+    struct row_arena *arena, int cols, bool initialize);
 void grid_row_free(struct row *row);
 
+/*
+ * Cold (compressed) scrollback rows. Row numbers are absolute.
+ *
+ * grid_row_peek() returns a decompressed copy of a cold row, valid
+ * until the next few peeks; the row itself is left compressed.
+ *
+ * grid_row_used_cols() returns the number of leading cells that may
+ * be non-empty; all cells after them are empty (wc == 0). This is
+ * always the number of columns for regular rows.
+ */
+bool grid_row_freeze(struct grid *grid, int row_no);
+struct row *grid_row_thaw(struct grid *grid, int row_no);
+const struct row *grid_row_peek(struct grid *grid, int row_no);
+int grid_row_used_cols(const struct grid *grid, int row_no);
+void grid_thaw_view(struct grid *grid, int rows);
+
+/*
+ * Drops interned cold row attributes no longer referenced by any cold
+ * row. This walks all cold rows; _pending() tells if the table has
+ * grown enough since the last compaction to be worth it.
+ */
+bool grid_cold_attrs_compact_pending(const struct grid *grid);
+void grid_cold_attrs_compact(struct grid *grid);
+
+static inline bool
+grid_row_is_cold(const struct row *row)
+{
+    return row->cells == NULL;
+}
+
 void grid_resize_without_reflow(
     struct grid *grid, int new_rows, int new_cols,
     int old_screen_rows, int new_screen_rows);
 
 void grid_resize_and_reflow(
-    struct grid *grid, int new_rows, int new_cols,
+    struct grid *grid, size_t threads, int new_rows, int new_cols,
     int old_screen_rows, int new_screen_rows,
     size_t tracking_points_count,
     struct coord *const _tracking_points[static tracking_points_count]);
@@ -41,8 +74,10 @@ _grid_row_maybe_alloc(struct grid *grid, int row_no, bool alloc_if_null)
     int real_row = grid_row_absolute(grid, row_no);
     struct row *row = grid->rows[real_row];
 
-    if (row == NULL && alloc_if_null) {
-        row = grid_row_alloc(grid->num_cols, false);
+    if (alloc_if_null && (row == NULL || unlikely(grid_row_is_cold(row)))) {
+        /* Callers overwrite the row; no need to thaw cold rows */
+        grid_row_free(row);
+        row = grid_row_alloc(grid->arena, grid->num_cols, false);
         grid->rows[real_row] = row;
     }
 
@@ -74,6 +109,116 @@ grid_row_in_view(struct grid *grid, int row_no)
     return row;
 }
 
+/*
+ * Per-cell dirty tracking. Each row has a bitmap with one bit per
+ * column; a set bit means the cell must be re-rendered. Bits past the
+ * last column are never set.
+ *
+ * Note that this is independent of row->dirty, which must be set as
+ * well, for the row to be rendered at all.
+ */
+#define GRID_DIRTY_MAP_WORDS(cols) (((size_t)(cols) + 63) / 64)
+
+static inline bool
+grid_row_cell_is_dirty(const struct row *row, int col)
+{
+    return (row->dirty_map[col / 64] >> (col % 64)) & 1;
+}
+
+static inline void
+grid_row_dirty_cell(struct row *row, int col)
+{
+    row->dirty_map[col / 64] |= 1ull << (col % 64);
+}
+
+static inline void
+grid_row_clean_cell(struct row *row, int col)
+{
+    row->dirty_map[col / 64] &= ~(1ull << (col % 64));
+}
+
+/* Dirties columns [start, end) */
+static inline void
+grid_row_dirty_cells(struct row *row, int start, int end)
+{
+    if (start >= end)
+        return;
+
+    const unsigned last = (unsigned)(end - 1) / 64;
+    unsigned w = (unsigned)start / 64;
+    uint64_t mask = ~0ull << ((unsigned)start % 64);
+
+    for (; w < last; w++) {
+        row->dirty_map[w] |= mask;
+        mask = ~0ull;
+    }
+
+    row->dirty_map[last] |= mask & (~0ull >> (63 - (unsigned)(end - 1) % 64));
+}
+
+static inline void
+grid_row_dirty_all(struct row *row, int cols)
+{
+    const size_t words = GRID_DIRTY_MAP_WORDS(cols);
+    memset(row->dirty_map, 0xff, words * sizeof(uint64_t));
+    if (cols % 64 != 0)
+        row->dirty_map[words - 1] = ~0ull >> (64 - cols % 64);
+}
+
+static inline void
+grid_row_clean_all(struct row *row, int cols)
+{
+    memset(row->dirty_map, 0, GRID_DIRTY_MAP_WORDS(cols) * sizeof(uint64_t));
+}
+
+static inline bool
+grid_row_all_dirty(const struct row *row, int cols)
+{
+    int count = 0;
+    for (size_t w = 0; w < GRID_DIRTY_MAP_WORDS(cols); w++)
+        count += __builtin_popcountll(row->dirty_map[w]);
+    return count == cols;
+}
+
+/* Returns the first dirty column in [col, end), or ‘end’ if there is none */
+static inline int
+grid_row_next_dirty(const struct row *row, int col, int end)
+{
+    if (col >= end)
+        return end;
+
+    size_t w = col / 64;
+    uint64_t bits = row->dirty_map[w] & (~0ull << (col % 64));
+
+    while (bits == 0) {
+        if (++w >= GRID_DIRTY_MAP_WORDS(end))
+            return end;
+        bits = row->dirty_map[w];
+    }
+
+    const int next = w * 64 + __builtin_ctzll(bits);
+    return next < end ? next : end;
+}
+
+/* Returns the last dirty column <= ‘col’, or -1 if there is none */
+static inline int
+grid_row_prev_dirty(const struct row *row, int col)
+{
+    if (col < 0)
+        return -1;
+
+    int w = col / 64;
+    uint64_t bits = row->dirty_map[w] & (~0ull >> (63 - col % 64));
+
+    while (bits == 0) {
+        if (--w < 0)
+            return -1;
+        bits = row->dirty_map[w];
+    }
+
+    return w * 64 + 63 - __builtin_clzll(bits);
+}
+
 void grid_row_uri_range_put(
     struct row *row, int col, const char *uri, uint64_t id);
 void grid_row_uri_range_add(struct row *row, struct row_uri_range range);
@@ -195,12 +195,12 @@ done(void *data, struct zwp_text_input_v3 *zwp_text_input_v3,
         int width = widths[i];
 
         cell->wc = seat->ime.preedit.text[i];
-        cell->attrs = (struct attributes){.clean = 0};
+        cell->attrs = (struct attributes){0};
 
         for (int j = 1; j < width; j++) {
             cell = &seat->ime.preedit.cells[cell_idx + j];
             cell->wc = CELL_SPACER + width - j;
-            cell->attrs = (struct attributes){.clean = 1};
+            cell->attrs = (struct attributes){0};
         }
 
         cell_idx += width;
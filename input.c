@@ -45,6 +45,9 @@ struct pipe_context {
     char *text;
     size_t idx;
     size_t left;
+
+    /* Scrollback is written in chunks, as the pipe becomes writable */
+    struct scrollback_stream *stream;
 };
 
 static bool
@@ -56,6 +59,28 @@ fdm_write_pipe(struct fdm *fdm, int fd, int events, void *data)
         goto pipe_closed;
 
     xassert(events & EPOLLOUT);
+
+    while (ctx->left == 0 && ctx->stream != NULL) {
+        bool done;
+
+        free(ctx->text);
+        ctx->idx = 0;
+
+        if (!term_scrollback_stream_next(
+                ctx->stream, &ctx->text, &ctx->left, &done))
+        {
+            goto pipe_closed;
+        }
+
+        if (done) {
+            term_scrollback_stream_destroy(ctx->stream);
+            ctx->stream = NULL;
+        }
+    }
+
+    if (ctx->left == 0)
+        goto pipe_closed;
+
     ssize_t written = write(fd, &ctx->text[ctx->idx], ctx->left);
 
     if (written < 0) {
@@ -67,12 +92,13 @@ fdm_write_pipe(struct fdm *fdm, int fd, int events, void *data)
     ctx->idx += written;
     ctx->left -= written;
 
-    if (ctx->left == 0)
+    if (ctx->left == 0 && ctx->stream == NULL)
         goto pipe_closed;
 
     return true;
 
 pipe_closed:
+    term_scrollback_stream_destroy(ctx->stream);
     free(ctx->text);
     free(ctx);
     fdm_del(fdm, fd);
@@ -204,6 +230,7 @@ execute_binding(struct seat *seat, struct terminal *term,
 
         char *text = NULL;
         size_t len = 0;
+        struct scrollback_stream *stream = NULL;
 
         if (pipe(pipe_fd) < 0) {
             LOG_ERRNO("failed to create pipe");
@@ -221,7 +248,8 @@ execute_binding(struct seat *seat, struct terminal *term,
         bool success;
         switch (action) {
         case BIND_ACTION_PIPE_SCROLLBACK:
-            success = term_scrollback_to_text(term, &text, &len);
+            stream = term_scrollback_stream_new(term);
+            success = stream != NULL;
             break;
 
         case BIND_ACTION_PIPE_VIEW:
@@ -276,6 +304,7 @@ execute_binding(struct seat *seat, struct terminal *term,
         *ctx = (struct pipe_context){
             .text = text,
             .left = len,
+            .stream = stream,
         };
 
         /* Asynchronously write the output to the pipe */
@@ -293,6 +322,7 @@ execute_binding(struct seat *seat, struct terminal *term,
             close(pipe_fd[0]);
         if (pipe_fd[1] >= 0)
             close(pipe_fd[1]);
+        term_scrollback_stream_destroy(stream);
         free(text);
         free(ctx);
         return true;
@@ -574,6 +574,8 @@ main(int argc, char *const *argv)
     }
 
     shm_set_max_pool_size(conf.tweak.max_shm_pool_size);
+    shm_set_max_cache_size(
+        (size_t)conf.tweak.max_shm_cache_size_mb * 1024 * 1024);
 
     if ((fdm = fdm_init()) == NULL)
         goto out;
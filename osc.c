@@ -10,6 +10,7 @@
 #include "log.h"
 #include "base64.h"
 #include "config.h"
+#include "glyph-run-cache.h"
 #include "grid.h"
 #include "macros.h"
 #include "notify.h"
@@ -614,6 +615,7 @@ osc_dispatch(struct terminal *term)
                         idx, term->colors.table[idx], color);
 
                 term->colors.table[idx] = color;
+                glyph_run_cache_flush(&term->render.glyph_runs);
                 term_damage_view(term);
             }
         }
@@ -702,6 +704,7 @@ osc_dispatch(struct terminal *term)
             break;
         }
 
+        glyph_run_cache_flush(&term->render.glyph_runs);
         term_damage_view(term);
         term_damage_margins(term);
         break;
@@ -783,6 +786,7 @@ osc_dispatch(struct terminal *term)
 
         }
 
+        glyph_run_cache_flush(&term->render.glyph_runs);
         term_damage_view(term);
         break;
     }
@@ -793,6 +797,7 @@ osc_dispatch(struct terminal *term)
     case 110: /* Reset default text foreground color */
         LOG_DBG("resetting foreground color");
         term->colors.fg = term->conf->colors.fg;
+        glyph_run_cache_flush(&term->render.glyph_runs);
         term_damage_view(term);
         break;
 
@@ -800,6 +805,7 @@ osc_dispatch(struct terminal *term)
         LOG_DBG("resetting background color");
         term->colors.bg = term->conf->colors.bg;
         term->colors.alpha = term->conf->colors.alpha;
+        glyph_run_cache_flush(&term->render.glyph_runs);
         term_damage_view(term);
         term_damage_margins(term);
         break;
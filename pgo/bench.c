@@ -0,0 +1,380 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <locale.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <sys/resource.h>
+
+#include "foot-features.h"
+#include "headless.h"
+#include "util.h"
+#include "version.h"
+#include "vt.h"
+
+/*
+ * Display-less VT throughput benchmark.
+ *
+ * Each stimuli file is fed to a freshly initialized, headless,
+ * terminal instance ‘iterations’ times, through the same
+ * fdm_ptmx()/vt_from_slave() code path foot itself uses. Throughput
+ * numbers are based on the median run.
+ *
+ * A final, separate, run is made with the parser instrumentation
+ * enabled. This is where the per-state numbers, and the number of
+ * printed cells, come from. Its timing is *not* used for the
+ * throughput numbers, since the instrumentation itself adds overhead.
+ */
+
+struct result {
+    const char *path;
+    size_t size;
+
+    double best;    /* Seconds */
+    double median;  /* Seconds */
+
+    struct vt_stats stats;
+};
+
+static void
+print_usage(const char *prog_name)
+{
+    static const char options[] =
+        "\nOptions:\n"
+        "  -i,--iterations=N                        number of timed runs, per file (5)\n"
+        "  -W,--window-size-chars=WIDTHxHEIGHT      terminal size, in characters (135x67)\n"
+        "  -s,--scrollback=LINES                    scrollback size, in lines (1000)\n"
+        "  -j,--json                                output results as JSON\n"
+        "  -v,--version                             show the version number and quit\n"
+        "  -h,--help                                show this help and quit\n";
+
+    printf("Usage: %s [OPTIONS...] stimuli-file...\n", prog_name);
+    puts(options);
+}
+
+static double
+elapsed(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) +
+        (end->tv_nsec - start->tv_nsec) / 1000000000.;
+}
+
+static int
+compare_double(const void *_a, const void *_b)
+{
+    const double *a = _a;
+    const double *b = _b;
+    return *a < *b ? -1 : *a > *b ? 1 : 0;
+}
+
+/*
+ * The parser instrumentation reads the clock once per state
+ * change. Estimate the cost of that, so that it can be subtracted
+ * from the per-state timings.
+ */
+static double
+clock_overhead_ns(void)
+{
+    const int count = 1000000;
+
+    struct timespec start, end, dummy;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < count; i++)
+        clock_gettime(CLOCK_MONOTONIC, &dummy);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return elapsed(&start, &end) * 1000000000. / count;
+}
+
+static bool
+run_one(int fd, size_t size, int cols, int rows, int grid_rows,
+        struct vt_stats *stats, double *seconds)
+{
+    struct headless h;
+    if (!headless_init(&h, cols, rows, grid_rows)) {
+        fprintf(stderr, "error: failed to instantiate terminal\n");
+        return false;
+    }
+
+    vt_stats_enable(stats);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool success = headless_feed(&h, fd, size);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    vt_stats_enable(NULL);
+    headless_destroy(&h);
+
+    *seconds = elapsed(&start, &end);
+    return success;
+}
+
+static bool
+bench(struct result *res, int iterations, int cols, int rows, int grid_rows)
+{
+    int fd = headless_load(res->path, &res->size);
+    if (fd < 0)
+        return false;
+
+    double *times = calloc(iterations, sizeof(times[0]));
+    if (times == NULL) {
+        close(fd);
+        return false;
+    }
+
+    bool success = false;
+
+    for (int i = 0; i < iterations; i++) {
+        if (!run_one(fd, res->size, cols, rows, grid_rows, NULL, &times[i]))
+            goto out;
+    }
+
+    double ignored;
+    memset(&res->stats, 0, sizeof(res->stats));
+    if (!run_one(fd, res->size, cols, rows, grid_rows, &res->stats, &ignored))
+        goto out;
+
+    qsort(times, iterations, sizeof(times[0]), &compare_double);
+    res->best = times[0];
+    res->median = iterations % 2 == 1
+        ? times[iterations / 2]
+        : (times[iterations / 2 - 1] + times[iterations / 2]) / 2.;
+
+    success = true;
+
+out:
+    free(times);
+    close(fd);
+    return success;
+}
+
+static double
+state_ns_per_byte(const struct vt_stats *stats, int state, double overhead)
+{
+    if (stats->bytes[state] == 0)
+        return 0.;
+
+    double ns = stats->ns[state] - stats->segments[state] * overhead;
+    return max(ns, 0.) / stats->bytes[state];
+}
+
+static void
+print_text(const struct result *results, size_t count, double overhead,
+           long peak_rss_kb)
+{
+    for (size_t i = 0; i < count; i++) {
+        const struct result *res = &results[i];
+        const double mb_per_s = res->size / res->median / 1000000.;
+        const double cells_per_s = res->stats.printed / res->median;
+
+        printf("%s: %zu bytes\n", res->path, res->size);
+        printf("  time:   %.3fs (median), %.3fs (best)\n",
+               res->median, res->best);
+        printf("  speed:  %.2f MB/s, %.2f Mcells/s (%llu cells)\n",
+               mb_per_s, cells_per_s / 1000000.,
+               (unsigned long long)res->stats.printed);
+        printf("  %-24s %12s %7s %9s\n", "state", "bytes", "share", "ns/byte");
+
+        for (int s = 0; s < VT_STATE_COUNT; s++) {
+            if (res->stats.bytes[s] == 0)
+                continue;
+
+            printf("  %-24s %12llu %6.2f%% %9.2f\n",
+                   vt_state_name(s),
+                   (unsigned long long)res->stats.bytes[s],
+                   100. * res->stats.bytes[s] / res->size,
+                   state_ns_per_byte(&res->stats, s, overhead));
+        }
+    }
+
+    printf("peak RSS: %ld KiB\n", peak_rss_kb);
+}
+
+static void
+print_json_string(const char *s)
+{
+    putchar('"');
+    for (; *s != '\0'; s++) {
+        const unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            printf("\\%c", c);
+        else if (c < 0x20)
+            printf("\\u%04x", c);
+        else
+            putchar(c);
+    }
+    putchar('"');
+}
+
+static void
+print_json(const struct result *results, size_t count, double overhead,
+           long peak_rss_kb, int iterations, int cols, int rows, int scrollback)
+{
+    printf("{\"version\": ");
+    print_json_string(FOOT_VERSION);
+    printf(", \"iterations\": %d, \"cols\": %d, \"rows\": %d, "
+           "\"scrollback\": %d, \"peak_rss_kb\": %ld, \"files\": [",
+           iterations, cols, rows, scrollback, peak_rss_kb);
+
+    for (size_t i = 0; i < count; i++) {
+        const struct result *res = &results[i];
+
+        printf("%s{\"path\": ", i > 0 ? ", " : "");
+        print_json_string(res->path);
+        printf(", \"bytes\": %zu, \"cells\": %llu, "
+               "\"seconds_median\": %.6f, \"seconds_best\": %.6f, "
+               "\"mb_per_s\": %.2f, \"cells_per_s\": %.0f, \"states\": {",
+               res->size, (unsigned long long)res->stats.printed,
+               res->median, res->best,
+               res->size / res->median / 1000000.,
+               res->stats.printed / res->median);
+
+        bool first = true;
+        for (int s = 0; s < VT_STATE_COUNT; s++) {
+            if (res->stats.bytes[s] == 0)
+                continue;
+
+            printf("%s", first ? "" : ", ");
+            print_json_string(vt_state_name(s));
+            printf(": {\"bytes\": %llu, \"ns_per_byte\": %.2f}",
+                   (unsigned long long)res->stats.bytes[s],
+                   state_ns_per_byte(&res->stats, s, overhead));
+            first = false;
+        }
+
+        printf("}}");
+    }
+
+    printf("]}\n");
+}
+
+int
+main(int argc, char *const *argv)
+{
+    const char *const prog_name = argc > 0 ? argv[0] : "<nullptr>";
+
+    static const struct option longopts[] = {
+        {"iterations",          required_argument, NULL, 'i'},
+        {"window-size-chars",   required_argument, NULL, 'W'},
+        {"scrollback",          required_argument, NULL, 's'},
+        {"json",                no_argument,       NULL, 'j'},
+        {"version",             no_argument,       NULL, 'v'},
+        {"help",                no_argument,       NULL, 'h'},
+        {NULL,                  no_argument,       NULL,   0},
+    };
+
+    int iterations = 5;
+    int cols = 135;
+    int rows = 67;
+    int scrollback = 1000;
+    bool json = false;
+
+    while (true) {
+        int c = getopt_long(argc, argv, "i:W:s:jvh", longopts, NULL);
+
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'i':
+            if (sscanf(optarg, "%d", &iterations) != 1 || iterations <= 0) {
+                fprintf(stderr, "error: invalid iteration count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'W':
+            if (sscanf(optarg, "%dx%d", &cols, &rows) != 2 ||
+                cols <= 0 || rows <= 0)
+            {
+                fprintf(stderr, "error: invalid window-size-chars: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 's':
+            if (sscanf(optarg, "%d", &scrollback) != 1 || scrollback < 0) {
+                fprintf(stderr, "error: invalid scrollback size: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'j':
+            json = true;
+            break;
+
+        case 'v':
+            printf("foot-bench version: %s %cpgo %cgraphemes %cassertions\n",
+                   FOOT_VERSION,
+                   feature_pgo() ? '+' : '-',
+                   feature_graphemes() ? '+' : '-',
+                   feature_assertions() ? '+' : '-');
+            return EXIT_SUCCESS;
+
+        case 'h':
+            print_usage(prog_name);
+            return EXIT_SUCCESS;
+
+        case '?':
+            return EXIT_FAILURE;
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc == 0) {
+        print_usage(prog_name);
+        return EXIT_FAILURE;
+    }
+
+    /*
+     * Don’t depend on the user’s locale; the results must be
+     * comparable between machines.
+     */
+    if (setlocale(LC_CTYPE, "C.UTF-8") == NULL &&
+        setlocale(LC_CTYPE, "en_US.UTF-8") == NULL)
+    {
+        fprintf(stderr, "error: failed to set an UTF-8 locale\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Same grid size calculation as foot itself */
+    const int lines = max(rows + scrollback, 2);
+    const int grid_rows = 1 << (32 - __builtin_clz(lines - 1));
+
+    struct result *results = calloc(argc, sizeof(results[0]));
+    if (results == NULL)
+        return EXIT_FAILURE;
+
+    int ret = EXIT_FAILURE;
+
+    for (int i = 0; i < argc; i++) {
+        results[i].path = argv[i];
+        if (!bench(&results[i], iterations, cols, rows, grid_rows))
+            goto out;
+    }
+
+    const double overhead = clock_overhead_ns();
+
+    struct rusage usage;
+    long peak_rss_kb = getrusage(RUSAGE_SELF, &usage) == 0
+        ? usage.ru_maxrss : -1;
+
+    if (json) {
+        print_json(results, argc, overhead, peak_rss_kb,
+                   iterations, cols, rows, scrollback);
+    } else
+        print_text(results, argc, overhead, peak_rss_kb);
+
+    ret = EXIT_SUCCESS;
+
+out:
+    free(results);
+    return ret;
+}
@@ -0,0 +1,39 @@
+#include "render.h"
+#include "shm.h"
+
+/*
+ * Stubs for the renderer and the SHM buffer handling, for headless
+ * binaries that do not link against render.c and shm.c.
+ */
+
+bool
+render_resize_force(struct terminal *term, int width, int height)
+{
+    return true;
+}
+
+void render_refresh(struct terminal *term) {}
+void render_refresh_csd(struct terminal *term) {}
+void render_refresh_title(struct terminal *term) {}
+void render_damage_history_destroy(struct terminal *term) {}
+
+bool
+render_xcursor_set(struct seat *seat, struct terminal *term, const char *xcursor)
+{
+    return true;
+}
+
+int
+render_worker_thread(void *_ctx)
+{
+    return 0;
+}
+
+void shm_unref(struct buffer *buf) {}
+void shm_chain_free(struct buffer_chain *chain) {}
+
+struct buffer_chain *
+shm_chain_new(struct wl_shm *shm, bool scrollable, size_t pix_instances)
+{
+    return NULL;
+}
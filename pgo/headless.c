@@ -0,0 +1,376 @@
+#include "headless.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+#include "async.h"
+#include "debug.h"
+#include "grid.h"
+#include "reaper.h"
+#include "sixel.h"
+#include "user-notification.h"
+
+extern bool fdm_ptmx(struct fdm *fdm, int fd, int events, void *data);
+
+/*
+ * Stubs for everything the VT parser and terminal core would
+ * otherwise pull in from the Wayland and process handling parts of
+ * foot. See headless-render.c for the renderer stubs.
+ */
+
+enum async_write_status
+async_write(int fd, const void *data, size_t len, size_t *idx)
+{
+    return ASYNC_WRITE_DONE;
+}
+
+bool
+fdm_add(struct fdm *fdm, int fd, int events, fdm_fd_handler_t handler, void *data)
+{
+    return true;
+}
+
+bool
+fdm_del(struct fdm *fdm, int fd)
+{
+    return true;
+}
+
+bool
+fdm_event_add(struct fdm *fdm, int fd, int events)
+{
+    return true;
+}
+
+bool
+fdm_event_del(struct fdm *fdm, int fd, int events)
+{
+    return true;
+}
+
+bool
+fdm_wait_hook_add(struct fdm *fdm, fdm_wait_hook_t hook, void *data)
+{
+    return true;
+}
+
+bool
+fdm_wait_hook_del(struct fdm *fdm, fdm_wait_hook_t hook, void *data)
+{
+    return true;
+}
+
+const char *
+xcursor_for_csd_border(struct terminal *term, int x, int y)
+{
+    return XCURSOR_LEFT_PTR;
+}
+
+struct wl_window *
+wayl_win_init(struct terminal *term, const char *token)
+{
+    return NULL;
+}
+
+void wayl_win_destroy(struct wl_window *win) {}
+bool wayl_win_set_urgent(struct wl_window *win) { return true; }
+
+bool
+spawn(struct reaper *reaper, const char *cwd, char *const argv[],
+      int stdin_fd, int stdout_fd, int stderr_fd)
+{
+    return true;
+}
+
+pid_t
+slave_spawn(
+    int ptmx, int argc, const char *cwd, char *const *argv, const char *term_env,
+    const char *conf_shell, bool login_shell,
+    const user_notifications_t *notifications)
+{
+    return 0;
+}
+
+struct extraction_context *
+extract_begin(enum selection_kind kind, bool strip_trailing_empty)
+{
+    return NULL;
+}
+
+bool
+extract_one(
+    const struct terminal *term, const struct row *row, const struct cell *cell,
+    int col, void *context)
+{
+    return true;
+}
+
+bool
+extract_flush(struct extraction_context *context, char **text, size_t *len)
+{
+    return true;
+}
+
+bool
+extract_finish(struct extraction_context *context, char **text, size_t *len)
+{
+    return true;
+}
+
+void cmd_scrollback_up(struct terminal *term, int rows) {}
+void cmd_scrollback_down(struct terminal *term, int rows) {}
+
+void ime_enable(struct seat *seat) {}
+void ime_disable(struct seat *seat) {}
+void ime_reset_preedit(struct seat *seat) {}
+
+void
+notify_notify(const struct terminal *term, const char *title, const char *body)
+{
+}
+
+void reaper_add(struct reaper *reaper, pid_t pid, reaper_cb cb, void *cb_data) {}
+void reaper_del(struct reaper *reaper, pid_t pid) {}
+
+void urls_reset(struct terminal *term) {}
+
+void search_selection_cancelled(struct terminal *term) {}
+void search_index_invalidate(struct terminal *term, int start, int count) {}
+bool search_matches_update(struct terminal *term) { return false; }
+bool search_count_matches(struct terminal *term) { return true; }
+void search_count_scroll(struct terminal *term, int rows) {}
+
+void get_current_modifiers(const struct seat *seat,
+                           xkb_mod_mask_t *effective,
+                           xkb_mod_mask_t *consumed, uint32_t key) {}
+
+bool
+headless_init(struct headless *h, int cols, int rows, int grid_rows)
+{
+    xassert(grid_rows >= rows);
+
+    memset(h, 0, sizeof(*h));
+    h->term.delayed_render_timer.lower_fd = -1;
+    h->term.delayed_render_timer.upper_fd = -1;
+
+    int lower_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (lower_fd < 0)
+        return false;
+
+    int upper_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (upper_fd < 0) {
+        close(lower_fd);
+        return false;
+    }
+
+    struct row **grid = calloc(grid_rows, sizeof(grid[0]));
+    if (grid == NULL)
+        goto err;
+
+    h->rows = grid;
+    h->grid_row_count = grid_rows;
+
+    for (int i = 0; i < grid_rows; i++) {
+        grid[i] = calloc(
+            1, sizeof(*grid[i]) + GRID_DIRTY_MAP_WORDS(cols) * sizeof(uint64_t));
+        if (grid[i] == NULL)
+            goto err;
+
+        grid[i]->cells = calloc(cols, sizeof(grid[i]->cells[0]));
+        if (grid[i]->cells == NULL)
+            goto err;
+
+        grid[i]->dirty_map = (uint64_t *)(grid[i] + 1);
+        grid_row_dirty_all(grid[i], cols);
+    }
+
+    h->conf = (struct config){
+        .tweak = {
+            .delayed_render_lower_ns = 500000,         /* 0.5ms */
+            .delayed_render_upper_ns = 16666666 / 2,   /* half a frame period (60Hz) */
+        },
+    };
+
+    h->wayl = (struct wayland){
+        .seats = tll_init(),
+        .monitors = tll_init(),
+        .terms = tll_init(),
+    };
+
+    struct terminal *term = &h->term;
+    *term = (struct terminal){
+        .conf = &h->conf,
+        .wl = &h->wayl,
+        .grid = &term->normal,
+        .normal = {
+            .num_rows = grid_rows,
+            .num_cols = cols,
+            .rows = grid,
+            .cur_row = grid[0],
+        },
+        .alt = {
+            .num_rows = grid_rows,
+            .num_cols = cols,
+            .rows = grid,
+            .cur_row = grid[0],
+        },
+        .ptmx = -1,
+        .cursor_blink = {
+            .fd = -1,
+        },
+        .cold_sweep = {
+            .fd = -1,
+        },
+        .scale = 1,
+        .width = cols * 8,
+        .height = rows * 15,
+        .cols = cols,
+        .rows = rows,
+        .cell_width = 8,
+        .cell_height = 15,
+        .scroll_region = {
+            .start = 0,
+            .end = rows,
+        },
+        .selection = {
+            .start = {-1, -1},
+            .end = {-1, -1},
+        },
+        .delayed_render_timer = {
+            .lower_fd = lower_fd,
+            .upper_fd = upper_fd
+        },
+        .sixel = {
+            .palette_size = SIXEL_MAX_COLORS,
+            .max_width = SIXEL_MAX_WIDTH,
+            .max_height = SIXEL_MAX_HEIGHT,
+        },
+    };
+
+    term_update_ascii_printer(term);
+    tll_push_back(h->wayl.terms, term);
+    return true;
+
+err:
+    headless_destroy(h);
+    close(lower_fd);
+    close(upper_fd);
+    return false;
+}
+
+void
+headless_destroy(struct headless *h)
+{
+    tll_free(h->wayl.terms);
+
+    if (h->rows != NULL) {
+        for (int i = 0; i < h->grid_row_count; i++) {
+            if (h->rows[i] == NULL)
+                break;
+            free(h->rows[i]->cells);
+            free(h->rows[i]);
+        }
+    }
+    free(h->rows);
+    h->rows = NULL;
+
+    if (h->term.delayed_render_timer.lower_fd >= 0)
+        close(h->term.delayed_render_timer.lower_fd);
+    if (h->term.delayed_render_timer.upper_fd >= 0)
+        close(h->term.delayed_render_timer.upper_fd);
+    h->term.delayed_render_timer.lower_fd = -1;
+    h->term.delayed_render_timer.upper_fd = -1;
+}
+
+int
+headless_load(const char *path, size_t *size)
+{
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        fprintf(stderr, "error: %s: failed to stat: %s\n",
+                path, strerror(errno));
+        return -1;
+    }
+
+    uint8_t *data = malloc(st.st_size);
+    if (data == NULL) {
+        fprintf(stderr, "error: %s: failed to allocate buffer: %s\n",
+                path, strerror(errno));
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "error: %s: failed to open: %s\n",
+                path, strerror(errno));
+        free(data);
+        return -1;
+    }
+
+    ssize_t amount = read(fd, data, st.st_size);
+    close(fd);
+
+    if (amount != st.st_size) {
+        fprintf(stderr, "error: %s: failed to read: %s\n",
+                path, strerror(errno));
+        free(data);
+        return -1;
+    }
+
+#if defined(MEMFD_CREATE)
+    int mem_fd = memfd_create("foot-pgo-ptmx", MFD_CLOEXEC);
+#elif defined(__FreeBSD__)
+    // memfd_create on FreeBSD 13 is SHM_ANON without sealing support
+    int mem_fd = shm_open(SHM_ANON, O_RDWR | O_CLOEXEC, 0600);
+#else
+    char name[] = "/tmp/foot-pgo-ptmx-XXXXXX";
+    int mem_fd = mkostemp(name, O_CLOEXEC);
+    unlink(name);
+#endif
+    if (mem_fd < 0) {
+        fprintf(stderr, "error: failed to create memory FD\n");
+        free(data);
+        return -1;
+    }
+
+    if (write(mem_fd, data, st.st_size) < 0) {
+        fprintf(stderr, "error: failed to write memory FD\n");
+        close(mem_fd);
+        free(data);
+        return -1;
+    }
+
+    free(data);
+
+    *size = st.st_size;
+    return mem_fd;
+}
+
+bool
+headless_feed(struct headless *h, int fd, size_t size)
+{
+    h->term.ptmx = fd;
+    lseek(fd, 0, SEEK_SET);
+
+    while (lseek(fd, 0, SEEK_CUR) < (off_t)size) {
+        term_ptmx_budget_reset(&h->wayl.ptmx_budget);
+        if (!fdm_ptmx(NULL, -1, EPOLLIN, &h->term)) {
+            fprintf(stderr, "error: fdm_ptmx() failed\n");
+            h->term.ptmx = -1;
+            return false;
+        }
+    }
+
+    h->term.ptmx = -1;
+    return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "config.h"
+#include "terminal.h"
+#include "wayland.h"
+
+/*
+ * A terminal instance without a window, renderer or client
+ * process. Used by the PGO helper and foot-bench to drive the VT
+ * parser from a file.
+ */
+struct headless {
+    struct config conf;
+    struct wayland wayl;
+    struct terminal term;
+
+    struct row **rows;
+    int grid_row_count;
+};
+
+bool headless_init(struct headless *h, int cols, int rows, int grid_rows);
+void headless_destroy(struct headless *h);
+
+/* Loads ‘path’ into an in-memory FD, returns -1 on error */
+int headless_load(const char *path, size_t *size);
+
+/* Feeds the (entire) contents of ‘fd’ to the VT parser, via fdm_ptmx() */
+bool headless_feed(struct headless *h, int fd, size_t size);
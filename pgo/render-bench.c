@@ -0,0 +1,736 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <locale.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <time.h>
+#include <threads.h>
+
+#include <sys/mman.h>
+
+#include <fcft/fcft.h>
+
+#define LOG_MODULE "render-bench"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "config.h"
+#include "foot-features.h"
+#include "grid.h"
+#include "headless.h"
+#include "render.h"
+#include "shm.h"
+#include "terminal.h"
+#include "user-notification.h"
+#include "util.h"
+#include "version.h"
+#include "vt.h"
+#include "xmalloc.h"
+
+/*
+ * Offscreen renderer benchmark.
+ *
+ * Renders frames of a headless terminal instance into offscreen
+ * (non-wl_buffer backed) SHM buffers, with real fonts, using the
+ * same grid_render() code path, and render worker threads, foot
+ * itself uses. Nothing is ever submitted to a compositor.
+ *
+ * The benchmark is repeated for 0..N render worker threads, and
+ * frame time percentiles, as well as the cost per rendered cell, are
+ * reported for each worker count.
+ *
+ * By default, the stimuli files are fed to the VT parser once, and
+ * each frame is then a full repaint of the resulting view. With
+ * --replay, the stimuli are instead split into ‘frames’ chunks, and
+ * a frame is rendered after each chunk; i.e. each frame only
+ * re-renders what that chunk damaged, like a live terminal would.
+ */
+
+struct stimuli {
+    const char *path;
+    const char *data;
+    size_t size;
+    int fd;
+};
+
+struct result {
+    int workers;
+    uint64_t cells;
+    uint64_t glyph_run_hits;
+    uint64_t glyph_run_misses;
+    double p50, p90, p99, max, mean;    /* Milliseconds */
+    double ns_per_cell;
+};
+
+struct setup {
+    const struct config *conf;
+    struct fcft_font *fonts[4];
+    int cell_width;
+    int cell_height;
+
+    int cols;
+    int rows;
+    int grid_rows;
+    int frames;
+    bool replay;
+
+    const struct stimuli *stimuli;
+    size_t stimuli_count;
+};
+
+/*
+ * There’s no window, but render.c expects one. Keep it CSD-less, and
+ * keep the title timer “armed” forever, to prevent window title
+ * updates (those would need an xdg_toplevel).
+ */
+static struct wl_window window = {.csd_mode = CSD_NO};
+
+/* Stubs for things render.c uses that the headless terminal doesn’t have */
+
+bool
+fdm_hook_add(struct fdm *fdm, void (*hook)(struct fdm *fdm, void *data),
+             void *data, enum fdm_hook_priority priority)
+{
+    return true;
+}
+
+bool
+fdm_hook_del(struct fdm *fdm, void (*hook)(struct fdm *fdm, void *data),
+             enum fdm_hook_priority priority)
+{
+    return true;
+}
+
+void
+ime_update_cursor_rect(struct seat *seat, struct terminal *term)
+{
+}
+
+bool
+wayl_win_subsurface_new(struct wl_window *win, struct wl_surf_subsurf *surf)
+{
+    return false;
+}
+
+void
+wayl_win_subsurface_destroy(struct wl_surf_subsurf *surf)
+{
+}
+
+static void
+print_usage(const char *prog_name)
+{
+    static const char options[] =
+        "\nOptions:\n"
+        "  -c,--config=PATH                         load configuration from PATH (built-in defaults)\n"
+        "  -o,--override=[section.]key=value        override configuration option\n"
+        "  -W,--window-size-chars=WIDTHxHEIGHT      terminal size, in characters (135x67)\n"
+        "  -s,--scrollback=LINES                    scrollback size, in lines (1000)\n"
+        "  -n,--frames=N                            number of timed frames, per worker count (200)\n"
+        "  -w,--workers=N                           benchmark 0..N render worker threads (number of CPUs)\n"
+        "  -r,--replay                              render one frame per stimuli chunk, instead of full repaints\n"
+        "  -j,--json                                output results as JSON\n"
+        "  -v,--version                             show the version number and quit\n"
+        "  -h,--help                                show this help and quit\n";
+
+    printf("Usage: %s [OPTIONS...] stimuli-file...\n", prog_name);
+    puts(options);
+}
+
+static double
+elapsed(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) +
+        (end->tv_nsec - start->tv_nsec) / 1000000000.;
+}
+
+static int
+compare_double(const void *_a, const void *_b)
+{
+    const double *a = _a;
+    const double *b = _b;
+    return *a < *b ? -1 : *a > *b ? 1 : 0;
+}
+
+static double
+percentile(const double *sorted, size_t count, double p)
+{
+    size_t idx = (size_t)(p / 100. * (count - 1) + .5);
+    return sorted[min(idx, count - 1)];
+}
+
+static bool
+load_fonts(const struct config *conf, struct fcft_font *fonts[static 4])
+{
+    /* Same as reload_fonts(), but without DPI scaling */
+    static const char *const attrs[4] = {
+        "dpi=96",
+        "dpi=96:weight=bold",
+        "dpi=96:slant=italic",
+        "dpi=96:weight=bold:slant=italic",
+    };
+
+    bool success = true;
+
+    for (size_t i = 0; i < 4; i++) {
+        const bool custom = conf->fonts[i].count > 0;
+        const struct config_font_list *list = custom
+            ? &conf->fonts[i] : &conf->fonts[0];
+
+        const char *names[list->count];
+        for (size_t j = 0; j < list->count; j++) {
+            const struct config_font *font = &list->arr[j];
+            names[j] = font->px_size > 0
+                ? xasprintf("%s:pixelsize=%d", font->pattern, font->px_size)
+                : xasprintf("%s:size=%.2f", font->pattern, font->pt_size);
+        }
+
+        fonts[i] = fcft_from_name(
+            list->count, names, custom ? attrs[0] : attrs[i]);
+
+        for (size_t j = 0; j < list->count; j++)
+            free((char *)names[j]);
+
+        if (fonts[i] == NULL) {
+            LOG_ERR("failed to load font: %s", list->arr[0].pattern);
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+static bool
+terminal_setup(const struct setup *setup, struct headless *h, int workers)
+{
+    if (!headless_init(h, setup->cols, setup->rows, setup->grid_rows))
+        return false;
+
+    const struct config *conf = setup->conf;
+    struct terminal *term = &h->term;
+
+    term->conf = conf;
+    term->window = &window;
+    term->render.title.is_armed = true;
+    term->font_dpi = 96.;
+    term->font_subpixel = conf->colors.alpha == 0xffff
+        ? FCFT_SUBPIXEL_DEFAULT : FCFT_SUBPIXEL_NONE;
+    term->font_line_height = conf->line_height;
+    memcpy(term->fonts, setup->fonts, sizeof(term->fonts));
+
+    term->colors.fg = conf->colors.fg;
+    term->colors.bg = conf->colors.bg;
+    term->colors.alpha = conf->colors.alpha;
+    term->colors.selection_fg = conf->colors.selection_fg;
+    term->colors.selection_bg = conf->colors.selection_bg;
+    term->colors.use_custom_selection = conf->colors.use_custom.selection;
+    memcpy(term->colors.table, conf->colors.table, sizeof(term->colors.table));
+
+    term->cursor_style = conf->cursor.style;
+    term->cursor_color.text = conf->cursor.color.text;
+    term->cursor_color.cursor = conf->cursor.color.cursor;
+    term->kbd_focus = true;
+
+    term->cell_width = setup->cell_width;
+    term->cell_height = setup->cell_height;
+    term->font_x_ofs = term_pt_or_px_as_pixels(term, &conf->horizontal_letter_offset);
+    term->font_y_ofs = term_pt_or_px_as_pixels(term, &conf->vertical_letter_offset);
+
+    term->width = 2 * conf->pad_x + term->cols * term->cell_width;
+    term->height = 2 * conf->pad_y + term->rows * term->cell_height;
+    term->margins.left = term->margins.right = conf->pad_x;
+    term->margins.top = term->margins.bottom = conf->pad_y;
+
+    for (size_t i = 0; i < ALEN(term->render.damage_history.frames); i++)
+        pixman_region32_init(&term->render.damage_history.frames[i].dirty);
+
+    term->render.chains.grid = shm_chain_new(NULL, true, 1 + workers);
+    if (!glyph_run_cache_init(&term->render.glyph_runs))
+        return false;
+
+    term->render.workers.count = workers;
+    render_resize_scratch(term);
+
+    if (workers == 0)
+        return true;
+
+    if (sem_init(&term->render.workers.start, 0, 0) < 0 ||
+        sem_init(&term->render.workers.done, 0, 0) < 0 ||
+        mtx_init(&term->render.workers.lock, mtx_plain) != thrd_success)
+    {
+        LOG_ERRNO("failed to instantiate render worker synchronization primitives");
+        return false;
+    }
+
+    term->render.workers.threads = xcalloc(
+        workers, sizeof(term->render.workers.threads[0]));
+
+    for (int i = 0; i < workers; i++) {
+        struct render_worker_context *ctx = xmalloc(sizeof(*ctx));
+        *ctx = (struct render_worker_context){
+            .term = term,
+            .my_id = 1 + i,
+        };
+
+        if (thrd_create(&term->render.workers.threads[i],
+                        &render_worker_thread, ctx) != thrd_success)
+        {
+            LOG_ERR("failed to create render worker thread");
+            free(ctx);
+            term->render.workers.count = i;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void
+terminal_teardown(struct headless *h)
+{
+    struct terminal *term = &h->term;
+
+    if (term->render.workers.threads != NULL) {
+        term->render.workers.quit = true;
+        for (size_t i = 0; i < term->render.workers.count; i++)
+            sem_post(&term->render.workers.start);
+
+        for (size_t i = 0; i < term->render.workers.count; i++)
+            thrd_join(term->render.workers.threads[i], NULL);
+
+        free(term->render.workers.threads);
+        mtx_destroy(&term->render.workers.lock);
+        sem_destroy(&term->render.workers.start);
+        sem_destroy(&term->render.workers.done);
+    }
+
+    free(term->render.workers.rendered);
+    free(term->render.workers.scratch_cells);
+    free(term->render.workers.scratch_text);
+
+    shm_unref(term->render.last_buf);
+    term->render.last_buf = NULL;
+    render_damage_history_destroy(term);
+    shm_chain_free(term->render.chains.grid);
+    term->render.chains.grid = NULL;
+    glyph_run_cache_destroy(&term->render.glyph_runs);
+
+    tll_foreach(term->normal.scroll_damage, it)
+        tll_remove(term->normal.scroll_damage, it);
+    tll_foreach(term->alt.scroll_damage, it)
+        tll_remove(term->alt.scroll_damage, it);
+
+    free(term->vt.osc.data);
+    free(term->vt.osc8.uri);
+    free(term->window_title);
+    tll_free_and_free(term->window_title_stack, free);
+
+    /* The fonts are shared between runs */
+    memset(term->fonts, 0, sizeof(term->fonts));
+    headless_destroy(h);
+}
+
+static uint64_t
+dirty_cells(const struct terminal *term)
+{
+    uint64_t cells = 0;
+    for (int r = 0; r < term->rows; r++) {
+        if (grid_row_in_view(term->grid, r)->dirty)
+            cells += term->cols;
+    }
+    return cells;
+}
+
+static bool
+run(const struct setup *setup, int workers, struct result *res)
+{
+    struct headless h;
+    if (!terminal_setup(setup, &h, workers)) {
+        terminal_teardown(&h);
+        return false;
+    }
+
+    struct terminal *term = &h.term;
+
+    size_t total_size = 0;
+    for (size_t i = 0; i < setup->stimuli_count; i++)
+        total_size += setup->stimuli[i].size;
+
+    const size_t chunk_size = setup->replay
+        ? max(total_size / setup->frames, (size_t)1) : 0;
+
+    if (!setup->replay) {
+        for (size_t i = 0; i < setup->stimuli_count; i++) {
+            vt_from_slave(
+                term, (const uint8_t *)setup->stimuli[i].data,
+                setup->stimuli[i].size);
+        }
+    }
+
+    /* Warm-up; instantiates the buffer and does the initial full repaint */
+    grid_render_offscreen(term);
+
+    uint64_t ignored_hits, ignored_misses;
+    glyph_run_cache_stats(
+        &term->render.glyph_runs, &ignored_hits, &ignored_misses);
+
+    double *times = xcalloc(setup->frames, sizeof(times[0]));
+    uint64_t cells = 0;
+    double total = 0.;
+
+    size_t file = 0;
+    size_t file_ofs = 0;
+
+    for (int frame = 0; frame < setup->frames; frame++) {
+        if (setup->replay) {
+            size_t left = frame == setup->frames - 1 ? SIZE_MAX : chunk_size;
+
+            while (left > 0 && file < setup->stimuli_count) {
+                const struct stimuli *s = &setup->stimuli[file];
+                size_t count = min(left, s->size - file_ofs);
+
+                vt_from_slave(
+                    term, (const uint8_t *)s->data + file_ofs, count);
+
+                left -= count;
+                file_ofs += count;
+
+                if (file_ofs >= s->size) {
+                    file++;
+                    file_ofs = 0;
+                }
+            }
+        } else
+            term_damage_view(term);
+
+        cells += dirty_cells(term);
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        grid_render_offscreen(term);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        times[frame] = elapsed(&start, &end) * 1000.;
+        total += times[frame];
+    }
+
+    qsort(times, setup->frames, sizeof(times[0]), &compare_double);
+
+    uint64_t hits, misses;
+    glyph_run_cache_stats(&term->render.glyph_runs, &hits, &misses);
+
+    *res = (struct result){
+        .workers = workers,
+        .cells = cells,
+        .glyph_run_hits = hits,
+        .glyph_run_misses = misses,
+        .p50 = percentile(times, setup->frames, 50),
+        .p90 = percentile(times, setup->frames, 90),
+        .p99 = percentile(times, setup->frames, 99),
+        .max = times[setup->frames - 1],
+        .mean = total / setup->frames,
+        .ns_per_cell = cells > 0 ? total * 1000000. / cells : 0.,
+    };
+
+    free(times);
+    terminal_teardown(&h);
+    return true;
+}
+
+static void
+print_text(const struct setup *setup, const struct result *results,
+           size_t count)
+{
+    printf("%dx%d cells, %dx%d px cells, %d frames, %s\n",
+           setup->cols, setup->rows, setup->cell_width, setup->cell_height,
+           setup->frames, setup->replay ? "replay" : "full repaint");
+    printf("%7s %9s %9s %9s %9s %9s %9s %21s\n",
+           "workers", "p50", "p90", "p99", "max", "mean", "ns/cell",
+           "glyph runs (hit/miss)");
+
+    for (size_t i = 0; i < count; i++) {
+        const struct result *res = &results[i];
+        printf("%7d %7.3fms %7.3fms %7.3fms %7.3fms %7.3fms %9.2f %10llu/%-10llu\n",
+               res->workers, res->p50, res->p90, res->p99, res->max,
+               res->mean, res->ns_per_cell,
+               (unsigned long long)res->glyph_run_hits,
+               (unsigned long long)res->glyph_run_misses);
+    }
+}
+
+static void
+print_json(const struct setup *setup, const struct result *results,
+           size_t count)
+{
+    printf("{\"version\": \"%s\", \"cols\": %d, \"rows\": %d, "
+           "\"cell_width\": %d, \"cell_height\": %d, \"frames\": %d, "
+           "\"mode\": \"%s\", \"runs\": [",
+           FOOT_VERSION, setup->cols, setup->rows,
+           setup->cell_width, setup->cell_height, setup->frames,
+           setup->replay ? "replay" : "full");
+
+    for (size_t i = 0; i < count; i++) {
+        const struct result *res = &results[i];
+        printf("%s{\"workers\": %d, \"cells\": %llu, "
+               "\"ms_p50\": %.4f, \"ms_p90\": %.4f, \"ms_p99\": %.4f, "
+               "\"ms_max\": %.4f, \"ms_mean\": %.4f, \"ns_per_cell\": %.2f, "
+               "\"glyph_run_hits\": %llu, \"glyph_run_misses\": %llu}",
+               i > 0 ? ", " : "", res->workers,
+               (unsigned long long)res->cells,
+               res->p50, res->p90, res->p99, res->max, res->mean,
+               res->ns_per_cell,
+               (unsigned long long)res->glyph_run_hits,
+               (unsigned long long)res->glyph_run_misses);
+    }
+
+    printf("]}\n");
+}
+
+int
+main(int argc, char *const *argv)
+{
+    const char *const prog_name = argc > 0 ? argv[0] : "<nullptr>";
+
+    static const struct option longopts[] = {
+        {"config",              required_argument, NULL, 'c'},
+        {"override",            required_argument, NULL, 'o'},
+        {"window-size-chars",   required_argument, NULL, 'W'},
+        {"scrollback",          required_argument, NULL, 's'},
+        {"frames",              required_argument, NULL, 'n'},
+        {"workers",             required_argument, NULL, 'w'},
+        {"replay",              no_argument,       NULL, 'r'},
+        {"json",                no_argument,       NULL, 'j'},
+        {"version",             no_argument,       NULL, 'v'},
+        {"help",                no_argument,       NULL, 'h'},
+        {NULL,                  no_argument,       NULL,   0},
+    };
+
+    const char *conf_path = "/dev/null";
+    config_override_t overrides = tll_init();
+    int cols = 135;
+    int rows = 67;
+    int scrollback = 1000;
+    int frames = 200;
+    long max_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    bool replay = false;
+    bool json = false;
+
+    int ret = EXIT_FAILURE;
+
+    while (true) {
+        int c = getopt_long(argc, argv, "c:o:W:s:n:w:rjvh", longopts, NULL);
+
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'c':
+            conf_path = optarg;
+            break;
+
+        case 'o':
+            tll_push_back(overrides, optarg);
+            break;
+
+        case 'W':
+            if (sscanf(optarg, "%dx%d", &cols, &rows) != 2 ||
+                cols <= 0 || rows <= 0)
+            {
+                fprintf(stderr, "error: invalid window-size-chars: %s\n", optarg);
+                goto out;
+            }
+            break;
+
+        case 's':
+            if (sscanf(optarg, "%d", &scrollback) != 1 || scrollback < 0) {
+                fprintf(stderr, "error: invalid scrollback size: %s\n", optarg);
+                goto out;
+            }
+            break;
+
+        case 'n':
+            if (sscanf(optarg, "%d", &frames) != 1 || frames <= 0) {
+                fprintf(stderr, "error: invalid frame count: %s\n", optarg);
+                goto out;
+            }
+            break;
+
+        case 'w':
+            if (sscanf(optarg, "%ld", &max_workers) != 1 || max_workers < 0) {
+                fprintf(stderr, "error: invalid worker count: %s\n", optarg);
+                goto out;
+            }
+            break;
+
+        case 'r':
+            replay = true;
+            break;
+
+        case 'j':
+            json = true;
+            break;
+
+        case 'v':
+            printf("foot-render-bench version: %s %cpgo %cime %cgraphemes %cassertions\n",
+                   FOOT_VERSION,
+                   feature_pgo() ? '+' : '-',
+                   feature_ime() ? '+' : '-',
+                   feature_graphemes() ? '+' : '-',
+                   feature_assertions() ? '+' : '-');
+            ret = EXIT_SUCCESS;
+            goto out;
+
+        case 'h':
+            print_usage(prog_name);
+            ret = EXIT_SUCCESS;
+            goto out;
+
+        case '?':
+            goto out;
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc == 0) {
+        print_usage(prog_name);
+        goto out;
+    }
+
+    log_init(LOG_COLORIZE_AUTO, false, LOG_FACILITY_USER, LOG_CLASS_WARNING);
+    fcft_log_init(FCFT_LOG_COLORIZE_AUTO, false, FCFT_LOG_CLASS_WARNING);
+
+    /*
+     * Don’t depend on the user’s locale; the results must be
+     * comparable between machines.
+     */
+    if (setlocale(LC_CTYPE, "C.UTF-8") == NULL &&
+        setlocale(LC_CTYPE, "en_US.UTF-8") == NULL)
+    {
+        fprintf(stderr, "error: failed to set an UTF-8 locale\n");
+        goto out;
+    }
+
+    user_notifications_t notifications = tll_init();
+    struct config conf = {NULL};
+    if (!config_load(&conf, conf_path, &notifications, &overrides, true)) {
+        config_free(conf);
+        user_notifications_free(&notifications);
+        goto out;
+    }
+
+    fcft_set_scaling_filter(conf.tweak.fcft_filter);
+
+    struct setup setup = {
+        .conf = &conf,
+        .cols = cols,
+        .rows = rows,
+        .frames = frames,
+        .replay = replay,
+    };
+
+    /* Same grid size calculation as foot itself */
+    const int lines = max(rows + scrollback, 2);
+    setup.grid_rows = 1 << (32 - __builtin_clz(lines - 1));
+
+    struct stimuli *stimuli = xcalloc(argc, sizeof(stimuli[0]));
+    struct result *results = xcalloc(max_workers + 1, sizeof(results[0]));
+
+    for (int i = 0; i < argc; i++)
+        stimuli[i].fd = -1;
+
+    for (int i = 0; i < argc; i++) {
+        struct stimuli *s = &stimuli[i];
+        s->path = argv[i];
+        s->fd = headless_load(s->path, &s->size);
+        if (s->fd < 0)
+            goto out_free;
+
+        if (s->size == 0)
+            continue;
+
+        s->data = mmap(NULL, s->size, PROT_READ, MAP_PRIVATE, s->fd, 0);
+        if (s->data == MAP_FAILED) {
+            fprintf(stderr, "error: %s: failed to mmap: %s\n",
+                    s->path, strerror(errno));
+            s->data = NULL;
+            goto out_free;
+        }
+    }
+
+    setup.stimuli = stimuli;
+    setup.stimuli_count = argc;
+
+    if (!load_fonts(&conf, setup.fonts))
+        goto out_free;
+
+    {
+        /* Same cell size calculation as term_set_fonts() */
+        struct headless h;
+        if (!terminal_setup(&setup, &h, 0)) {
+            terminal_teardown(&h);
+            goto out_free;
+        }
+
+        const struct fcft_font *font = setup.fonts[0];
+        const struct fcft_glyph *M = fcft_glyph_rasterize(
+            setup.fonts[0], L'M', h.term.font_subpixel);
+
+        setup.cell_width =
+            (M != NULL
+             ? M->advance.x
+             : (font->space_advance.x > 0
+                ? font->space_advance.x
+                : font->max_advance.x))
+            + term_pt_or_px_as_pixels(&h.term, &conf.letter_spacing);
+
+        setup.cell_height = h.term.font_line_height.px >= 0
+            ? term_pt_or_px_as_pixels(&h.term, &h.term.font_line_height)
+            : max(font->height, font->ascent + font->descent);
+
+        setup.cell_width = max(setup.cell_width, 1);
+        setup.cell_height = max(setup.cell_height, 1);
+
+        terminal_teardown(&h);
+    }
+
+    /* Untimed pass, to populate the glyph caches */
+    struct result ignored;
+    if (!run(&setup, 0, &ignored))
+        goto out_free;
+
+    for (long workers = 0; workers <= max_workers; workers++) {
+        if (!run(&setup, workers, &results[workers]))
+            goto out_free;
+    }
+
+    if (json)
+        print_json(&setup, results, max_workers + 1);
+    else
+        print_text(&setup, results, max_workers + 1);
+
+    ret = EXIT_SUCCESS;
+
+out_free:
+    for (size_t i = 0; i < 4; i++)
+        fcft_destroy(setup.fonts[i]);
+    for (int i = 0; i < argc; i++) {
+        if (stimuli[i].data != NULL)
+            munmap((void *)stimuli[i].data, stimuli[i].size);
+        if (stimuli[i].fd >= 0)
+            close(stimuli[i].fd);
+    }
+    free(stimuli);
+    free(results);
+    config_free(conf);
+    user_notifications_free(&notifications);
+
+out:
+    tll_free(overrides);
+    log_deinit();
+    return ret;
+}
@@ -0,0 +1,1184 @@
+#include "regex.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wctype.h>
+
+#define LOG_MODULE "regex"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "debug.h"
+#include "macros.h"
+#include "util.h"
+#include "xmalloc.h"
+
+/* Upper limits, guarding against patterns like a{1000}{1000} */
+#define REGEX_MAX_NODES 16384
+#define REGEX_MAX_REPEAT 1000
+
+/* Max nesting of groups; the parser recurses once per level */
+#define REGEX_MAX_DEPTH 64
+
+/* Max number of characters tracked by regex_required_chars() */
+#define REGEX_MAX_REQUIRED 16
+
+/* The DFA cache is flushed when it grows beyond this many states */
+#define REGEX_MAX_STATES 1024
+#define REGEX_HASH_SIZE 1024
+
+/* Input characters outside the Unicode range, used to match ^ and $ */
+#define REGEX_BOL 0x110000
+#define REGEX_EOL 0x110001
+
+#define STATE_DEAD (-1)
+#define STATE_UNKNOWN (-2)
+
+enum node_type {
+    NODE_CHAR,     /* A single (lower case) character */
+    NODE_CLASS,    /* [...], \d, \w, \s */
+    NODE_ANY,      /* . */
+    NODE_BOL,      /* ^ */
+    NODE_EOL,      /* $ */
+    NODE_SPLIT,    /* Epsilon transitions to both out and out1 */
+    NODE_EMPTY,    /* Epsilon transition to out */
+    NODE_MATCH,
+};
+
+enum class_flags {
+    CLASS_DIGIT = 1 << 0,
+    CLASS_NOT_DIGIT = 1 << 1,
+    CLASS_WORD = 1 << 2,
+    CLASS_NOT_WORD = 1 << 3,
+    CLASS_SPACE = 1 << 4,
+    CLASS_NOT_SPACE = 1 << 5,
+};
+
+struct char_range {
+    wchar_t lo;
+    wchar_t hi;
+};
+
+struct char_class {
+    bool negate;
+    unsigned flags;
+    struct char_range *ranges;
+    size_t count;
+};
+
+struct node {
+    enum node_type type;
+    int out;
+    int out1;
+    union {
+        wchar_t wc;
+        int class_idx;
+    };
+};
+
+struct dfa_state {
+    int *nodes;         /* Sorted NFA node indices */
+    size_t count;
+    uint32_t hash;
+    int chain;          /* Next state in the same hash bucket */
+    bool accept;
+    int8_t eol_accept;  /* -1 until computed */
+    int next[128];      /* Cached transitions on ASCII characters */
+};
+
+struct regex {
+    struct node *nodes;
+    size_t node_count;
+    size_t node_size;
+
+    struct char_class *classes;
+    size_t class_count;
+
+    bool reversed;     /* Matches the input backwards */
+    int start;
+    int search_start;  /* Like start, but prefixed with .* */
+
+    wchar_t required[REGEX_MAX_REQUIRED];
+    size_t required_count;
+
+    /* Lazily built DFA */
+    struct dfa_state *states;
+    size_t state_count;
+    size_t state_size;
+    int buckets[REGEX_HASH_SIZE];
+    int start_state[2][2];  /* [anchored][at_line_start] */
+
+    /* Scratch space for computing NFA state sets */
+    uint32_t *marks;
+    uint32_t generation;
+    int *set;
+    int *stack;
+};
+
+/*
+ * Compilation (Thompson's construction)
+ *
+ * Unconnected (“dangling”) out pointers of a fragment are kept in a
+ * linked list, threaded through the out pointers themselves. A list
+ * entry is a node index times two, plus one for out1.
+ *
+ * Each fragment also tracks (a subset of) the characters all of its
+ * matches contain.
+ */
+
+struct frag {
+    int start;
+    int out;  /* Head of the dangling list, or -1 */
+
+    wchar_t required[REGEX_MAX_REQUIRED];
+    size_t required_count;
+};
+
+struct parser {
+    struct regex *re;
+    const wchar_t *p;
+    const wchar_t *end;
+    int depth;  /* Number of currently open groups */
+};
+
+static int *
+slot(struct regex *re, int entry)
+{
+    struct node *n = &re->nodes[entry / 2];
+    return entry & 1 ? &n->out1 : &n->out;
+}
+
+static void
+patch(struct regex *re, int list, int target)
+{
+    while (list >= 0) {
+        int *s = slot(re, list);
+        list = *s;
+        *s = target;
+    }
+}
+
+static int
+append(struct regex *re, int l1, int l2)
+{
+    if (l1 < 0)
+        return l2;
+
+    int last = l1;
+    while (*slot(re, last) >= 0)
+        last = *slot(re, last);
+    *slot(re, last) = l2;
+    return l1;
+}
+
+static int
+node_new(struct regex *re, enum node_type type)
+{
+    if (re->node_count >= REGEX_MAX_NODES)
+        return -1;
+
+    if (re->node_count >= re->node_size) {
+        re->node_size = re->node_size == 0 ? 64 : re->node_size * 2;
+        re->nodes = xrealloc(re->nodes, re->node_size * sizeof(re->nodes[0]));
+    }
+
+    int idx = re->node_count++;
+    re->nodes[idx] = (struct node){.type = type, .out = -1, .out1 = -1};
+    return idx;
+}
+
+/* A fragment consuming one character; the out pointer dangles */
+static bool
+frag_single(struct regex *re, enum node_type type, struct frag *f)
+{
+    int n = node_new(re, type);
+    if (n < 0)
+        return false;
+
+    *f = (struct frag){.start = n, .out = n * 2};
+    return true;
+}
+
+static bool
+frag_requires(const struct frag *f, wchar_t wc)
+{
+    for (size_t i = 0; i < f->required_count; i++) {
+        if (f->required[i] == wc)
+            return true;
+    }
+    return false;
+}
+
+static void
+frag_concat(struct regex *re, struct frag *f, const struct frag *g, bool *empty)
+{
+    if (*empty) {
+        *f = *g;
+        *empty = false;
+        return;
+    }
+
+    if (re->reversed) {
+        /* The reversed input sees ‘g’ before ‘f’ */
+        patch(re, g->out, f->start);
+        f->start = g->start;
+    } else {
+        patch(re, f->out, g->start);
+        f->out = g->out;
+    }
+
+    /* Both fragments' characters are required. Dropping some, when
+     * there are too many, is fine */
+    for (size_t i = 0; i < g->required_count; i++) {
+        if (f->required_count < REGEX_MAX_REQUIRED &&
+            !frag_requires(f, g->required[i]))
+        {
+            f->required[f->required_count++] = g->required[i];
+        }
+    }
+}
+
+static bool
+frag_star(struct regex *re, struct frag *f)
+{
+    int s = node_new(re, NODE_SPLIT);
+    if (s < 0)
+        return false;
+
+    re->nodes[s].out = f->start;
+    patch(re, f->out, s);
+    *f = (struct frag){.start = s, .out = s * 2 + 1};
+    return true;
+}
+
+static bool
+frag_plus(struct regex *re, struct frag *f)
+{
+    int s = node_new(re, NODE_SPLIT);
+    if (s < 0)
+        return false;
+
+    /* Note: required characters are unchanged */
+    re->nodes[s].out = f->start;
+    patch(re, f->out, s);
+    f->out = s * 2 + 1;
+    return true;
+}
+
+static bool
+frag_quest(struct regex *re, struct frag *f)
+{
+    int s = node_new(re, NODE_SPLIT);
+    if (s < 0)
+        return false;
+
+    re->nodes[s].out = f->start;
+    *f = (struct frag){.start = s, .out = append(re, f->out, s * 2 + 1)};
+    return true;
+}
+
+static int
+class_new(struct regex *re)
+{
+    re->classes = xrealloc(
+        re->classes, (re->class_count + 1) * sizeof(re->classes[0]));
+    re->classes[re->class_count] = (struct char_class){0};
+    return re->class_count++;
+}
+
+static void
+class_add_range(struct char_class *class, wchar_t lo, wchar_t hi)
+{
+    class->ranges = xrealloc(
+        class->ranges, (class->count + 1) * sizeof(class->ranges[0]));
+    class->ranges[class->count++] = (struct char_range){lo, hi};
+}
+
+/* \d, \w and \s, and their negations */
+static unsigned
+class_escape_flags(wchar_t wc)
+{
+    switch (wc) {
+    case L'd': return CLASS_DIGIT;
+    case L'D': return CLASS_NOT_DIGIT;
+    case L'w': return CLASS_WORD;
+    case L'W': return CLASS_NOT_WORD;
+    case L's': return CLASS_SPACE;
+    case L'S': return CLASS_NOT_SPACE;
+    default:   return 0;
+    }
+}
+
+/* Parses the character following a backslash, outside of classes */
+static bool
+parse_escaped_char(wchar_t wc, wchar_t *out)
+{
+    switch (wc) {
+    case L't': *out = L'\t'; return true;
+    case L'n': *out = L'\n'; return true;
+    }
+
+    /* Reserve all other escaped letters and digits (e.g. \b) */
+    if (wc < 128 && iswalnum(wc))
+        return false;
+
+    *out = wc;
+    return true;
+}
+
+static bool
+parse_class(struct parser *p, struct frag *f)
+{
+    /* The opening '[' has already been consumed */
+    struct regex *re = p->re;
+    int idx = class_new(re);
+
+    if (p->p < p->end && *p->p == L'^') {
+        re->classes[idx].negate = true;
+        p->p++;
+    }
+
+    bool first = true;
+    while (true) {
+        if (p->p >= p->end)
+            return false;
+
+        wchar_t lo = *p->p++;
+        if (lo == L']' && !first)
+            break;
+        first = false;
+
+        if (lo == L'\\') {
+            if (p->p >= p->end)
+                return false;
+
+            wchar_t wc = *p->p++;
+            unsigned flags = class_escape_flags(wc);
+
+            if (flags != 0) {
+                re->classes[idx].flags |= flags;
+                continue;
+            }
+
+            if (!parse_escaped_char(wc, &lo))
+                return false;
+        }
+
+        wchar_t hi = lo;
+        if (p->end - p->p >= 2 && p->p[0] == L'-' && p->p[1] != L']') {
+            p->p++;
+            hi = *p->p++;
+
+            if (hi == L'\\') {
+                if (p->p >= p->end || !parse_escaped_char(*p->p++, &hi))
+                    return false;
+            }
+
+            if (hi < lo)
+                return false;
+        }
+
+        class_add_range(&re->classes[idx], lo, hi);
+    }
+
+    if (!frag_single(re, NODE_CLASS, f))
+        return false;
+    re->nodes[f->start].class_idx = idx;
+
+    const struct char_class *class = &re->classes[idx];
+    if (!class->negate && class->flags == 0 && class->count == 1 &&
+        class->ranges[0].lo == class->ranges[0].hi)
+    {
+        f->required[f->required_count++] = towlower(class->ranges[0].lo);
+    }
+    return true;
+}
+
+static bool parse_alt(struct parser *p, struct frag *f);
+static bool parse_concat(struct parser *p, struct frag *f);
+
+static bool
+parse_atom(struct parser *p, struct frag *f)
+{
+    struct regex *re = p->re;
+    wchar_t wc = *p->p++;
+
+    switch (wc) {
+    case L'(':
+        if (p->depth >= REGEX_MAX_DEPTH)
+            return false;
+
+        if (p->end - p->p >= 2 && p->p[0] == L'?' && p->p[1] == L':')
+            p->p += 2;
+
+        p->depth++;
+        if (!parse_alt(p, f))
+            return false;
+        p->depth--;
+
+        if (p->p >= p->end || *p->p != L')')
+            return false;
+        p->p++;
+        return true;
+
+    case L'[':
+        return parse_class(p, f);
+
+    case L'.':
+        return frag_single(re, NODE_ANY, f);
+
+    /* Line start and end trade places in the reversed input */
+    case L'^':
+        return frag_single(re, re->reversed ? NODE_EOL : NODE_BOL, f);
+
+    case L'$':
+        return frag_single(re, re->reversed ? NODE_BOL : NODE_EOL, f);
+
+    case L')':
+    case L'*':
+    case L'+':
+    case L'?':
+    case L'{':
+        /* Unbalanced parenthesis, or nothing to repeat */
+        return false;
+
+    case L'\\': {
+        if (p->p >= p->end)
+            return false;
+
+        wc = *p->p++;
+        unsigned flags = class_escape_flags(wc);
+
+        if (flags != 0) {
+            int idx = class_new(re);
+            re->classes[idx].flags = flags;
+
+            if (!frag_single(re, NODE_CLASS, f))
+                return false;
+            re->nodes[f->start].class_idx = idx;
+            return true;
+        }
+
+        if (!parse_escaped_char(wc, &wc))
+            return false;
+        break;
+    }
+    }
+
+    if (!frag_single(re, NODE_CHAR, f))
+        return false;
+    re->nodes[f->start].wc = towlower(wc);
+    f->required[f->required_count++] = towlower(wc);
+    return true;
+}
+
+static bool
+parse_number(struct parser *p, int *value)
+{
+    if (p->p >= p->end || !(*p->p >= L'0' && *p->p <= L'9'))
+        return false;
+
+    *value = 0;
+    while (p->p < p->end && *p->p >= L'0' && *p->p <= L'9') {
+        *value = *value * 10 + (*p->p++ - L'0');
+        if (*value > REGEX_MAX_REPEAT)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Compiles a new copy of an already parsed atom; used to expand
+ * counted repetitions.
+ */
+static bool
+parse_copy(struct parser *p, const wchar_t *start, const wchar_t *end,
+           struct frag *f)
+{
+    struct parser copy = {
+        .re = p->re, .p = start, .end = end, .depth = p->depth};
+    return parse_concat(&copy, f) && copy.p == end;
+}
+
+static bool
+parse_counted(struct parser *p, const wchar_t *atom_start,
+              const wchar_t *atom_end, struct frag *f)
+{
+    /* The opening '{' has already been consumed */
+    int min_count, max_count;
+
+    if (!parse_number(p, &min_count))
+        return false;
+
+    if (p->p < p->end && *p->p == L',') {
+        p->p++;
+        if (p->p < p->end && *p->p == L'}')
+            max_count = -1;
+        else if (!parse_number(p, &max_count) || max_count < min_count)
+            return false;
+    } else
+        max_count = min_count;
+
+    if (p->p >= p->end || *p->p != L'}')
+        return false;
+    p->p++;
+
+    /* The fragment already parsed is discarded, and re-compiled as
+     * many times as needed */
+    struct frag result, copy;
+    bool empty = true;
+
+    for (int i = 0; i < min_count; i++) {
+        if (!parse_copy(p, atom_start, atom_end, &copy))
+            return false;
+        frag_concat(p->re, &result, &copy, &empty);
+    }
+
+    if (max_count < 0) {
+        if (!parse_copy(p, atom_start, atom_end, &copy) ||
+            !frag_star(p->re, &copy))
+        {
+            return false;
+        }
+        frag_concat(p->re, &result, &copy, &empty);
+    } else {
+        for (int i = min_count; i < max_count; i++) {
+            if (!parse_copy(p, atom_start, atom_end, &copy) ||
+                !frag_quest(p->re, &copy))
+            {
+                return false;
+            }
+            frag_concat(p->re, &result, &copy, &empty);
+        }
+    }
+
+    if (empty)
+        return frag_single(p->re, NODE_EMPTY, f);
+
+    *f = result;
+    return true;
+}
+
+static bool
+parse_repeat(struct parser *p, struct frag *f)
+{
+    const wchar_t *atom_start = p->p;
+
+    if (!parse_atom(p, f))
+        return false;
+
+    while (p->p < p->end) {
+        const wchar_t *atom_end = p->p;
+        bool ok;
+
+        switch (*p->p) {
+        case L'*': p->p++; ok = frag_star(p->re, f); break;
+        case L'+': p->p++; ok = frag_plus(p->re, f); break;
+        case L'?': p->p++; ok = frag_quest(p->re, f); break;
+        case L'{': p->p++; ok = parse_counted(p, atom_start, atom_end, f); break;
+        default:   return true;
+        }
+
+        if (!ok)
+            return false;
+    }
+
+    return true;
+}
+
+static bool
+parse_concat(struct parser *p, struct frag *f)
+{
+    struct frag g;
+    bool empty = true;
+
+    while (p->p < p->end && *p->p != L'|' && *p->p != L')') {
+        if (!parse_repeat(p, &g))
+            return false;
+        frag_concat(p->re, f, &g, &empty);
+    }
+
+    if (empty)
+        return frag_single(p->re, NODE_EMPTY, f);
+    return true;
+}
+
+static bool
+parse_alt(struct parser *p, struct frag *f)
+{
+    if (!parse_concat(p, f))
+        return false;
+
+    while (p->p < p->end && *p->p == L'|') {
+        p->p++;
+
+        struct frag g;
+        if (!parse_concat(p, &g))
+            return false;
+
+        int s = node_new(p->re, NODE_SPLIT);
+        if (s < 0)
+            return false;
+
+        p->re->nodes[s].out = f->start;
+        p->re->nodes[s].out1 = g.start;
+        f->start = s;
+        f->out = append(p->re, f->out, g.out);
+
+        /* Only characters required by both alternatives are required */
+        size_t count = 0;
+        for (size_t i = 0; i < f->required_count; i++) {
+            if (frag_requires(&g, f->required[i]))
+                f->required[count++] = f->required[i];
+        }
+        f->required_count = count;
+    }
+
+    return true;
+}
+
+/*
+ * Matching
+ */
+
+static bool
+class_matches(const struct char_class *class, wchar_t wc)
+{
+    const wchar_t alts[] = {wc, towlower(wc), towupper(wc)};
+    bool match = false;
+
+    for (size_t i = 0; i < ALEN(alts) && !match; i++) {
+        const wchar_t c = alts[i];
+
+        for (size_t j = 0; j < class->count && !match; j++)
+            match = c >= class->ranges[j].lo && c <= class->ranges[j].hi;
+    }
+
+    const bool digit = iswdigit(wc);
+    const bool word = iswalnum(wc) || wc == L'_';
+    const bool space = iswspace(wc);
+
+    if (((class->flags & CLASS_DIGIT) && digit) ||
+        ((class->flags & CLASS_NOT_DIGIT) && !digit) ||
+        ((class->flags & CLASS_WORD) && word) ||
+        ((class->flags & CLASS_NOT_WORD) && !word) ||
+        ((class->flags & CLASS_SPACE) && space) ||
+        ((class->flags & CLASS_NOT_SPACE) && !space))
+    {
+        match = true;
+    }
+
+    return match != class->negate;
+}
+
+static bool
+node_matches(const struct regex *re, const struct node *node, uint32_t c)
+{
+    switch (node->type) {
+    case NODE_CHAR:  return c < REGEX_BOL && (wchar_t)towlower(c) == node->wc;
+    case NODE_CLASS: return c < REGEX_BOL && class_matches(&re->classes[node->class_idx], c);
+    case NODE_ANY:   return c < REGEX_BOL;
+    case NODE_BOL:   return c == REGEX_BOL;
+    case NODE_EOL:   return c == REGEX_EOL;
+
+    case NODE_SPLIT:
+    case NODE_EMPTY:
+    case NODE_MATCH:
+        return false;
+    }
+
+    BUG("Invalid node type");
+    return false;
+}
+
+/* Adds idx, and all nodes reachable through epsilon transitions */
+static void
+add_closure(struct regex *re, int idx, size_t *count)
+{
+    size_t depth = 0;
+    re->stack[depth++] = idx;
+
+    while (depth > 0) {
+        idx = re->stack[--depth];
+
+        if (re->marks[idx] == re->generation)
+            continue;
+        re->marks[idx] = re->generation;
+
+        const struct node *node = &re->nodes[idx];
+        switch (node->type) {
+        case NODE_SPLIT:
+            re->stack[depth++] = node->out1;
+            /* FALLTHROUGH */
+        case NODE_EMPTY:
+            re->stack[depth++] = node->out;
+            break;
+
+        default:
+            re->set[(*count)++] = idx;
+            break;
+        }
+    }
+}
+
+static void
+new_generation(struct regex *re)
+{
+    if (++re->generation == 0) {
+        memset(re->marks, 0, re->node_count * sizeof(re->marks[0]));
+        re->generation = 1;
+    }
+}
+
+static int
+int_cmp(const void *_a, const void *_b)
+{
+    const int *a = _a;
+    const int *b = _b;
+    return *a - *b;
+}
+
+static void
+dfa_flush(struct regex *re)
+{
+    LOG_DBG("flushing %zu DFA states", re->state_count);
+
+    for (size_t i = 0; i < re->state_count; i++)
+        free(re->states[i].nodes);
+
+    re->state_count = 0;
+    re->start_state[0][0] = re->start_state[0][1] = STATE_UNKNOWN;
+    re->start_state[1][0] = re->start_state[1][1] = STATE_UNKNOWN;
+    memset(re->buckets, 0xff, sizeof(re->buckets));
+}
+
+/* Returns the DFA state for the NFA state set in re->set */
+static int
+dfa_state_get(struct regex *re, size_t count)
+{
+    if (count == 0)
+        return STATE_DEAD;
+
+    qsort(re->set, count, sizeof(re->set[0]), &int_cmp);
+
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < count; i++)
+        hash = (hash ^ (uint32_t)re->set[i]) * 16777619u;
+
+    for (int i = re->buckets[hash % REGEX_HASH_SIZE]; i >= 0;
+         i = re->states[i].chain)
+    {
+        const struct dfa_state *s = &re->states[i];
+        if (s->hash == hash && s->count == count &&
+            memcmp(s->nodes, re->set, count * sizeof(re->set[0])) == 0)
+        {
+            return i;
+        }
+    }
+
+    if (re->state_count >= REGEX_MAX_STATES)
+        dfa_flush(re);
+
+    if (re->state_count >= re->state_size) {
+        re->state_size = re->state_size == 0 ? 16 : re->state_size * 2;
+        re->states = xrealloc(
+            re->states, re->state_size * sizeof(re->states[0]));
+    }
+
+    int idx = re->state_count++;
+    struct dfa_state *s = &re->states[idx];
+
+    s->nodes = xmalloc(count * sizeof(s->nodes[0]));
+    memcpy(s->nodes, re->set, count * sizeof(s->nodes[0]));
+    s->count = count;
+    s->hash = hash;
+    s->chain = re->buckets[hash % REGEX_HASH_SIZE];
+    s->accept = false;
+    s->eol_accept = -1;
+
+    for (size_t i = 0; i < ALEN(s->next); i++)
+        s->next[i] = STATE_UNKNOWN;
+
+    for (size_t i = 0; i < count; i++) {
+        if (re->nodes[re->set[i]].type == NODE_MATCH)
+            s->accept = true;
+    }
+
+    re->buckets[hash % REGEX_HASH_SIZE] = idx;
+    return idx;
+}
+
+/* Computes the NFA state set reached from 'state' on 'c', into re->set */
+static size_t
+nfa_step(struct regex *re, int state, uint32_t c)
+{
+    const struct dfa_state *s = &re->states[state];
+    size_t count = 0;
+
+    new_generation(re);
+    for (size_t i = 0; i < s->count; i++) {
+        const struct node *node = &re->nodes[s->nodes[i]];
+        if (node_matches(re, node, c))
+            add_closure(re, node->out, &count);
+    }
+
+    return count;
+}
+
+static int
+start_state(struct regex *re, bool anchored, bool at_line_start)
+{
+    int *start = &re->start_state[anchored][at_line_start];
+    if (*start != STATE_UNKNOWN)
+        return *start;
+
+    size_t count = 0;
+    new_generation(re);
+    add_closure(re, anchored ? re->start : re->search_start, &count);
+
+    if (at_line_start) {
+        /* Also include the states reachable by matching ^ */
+        const size_t initial_count = count;
+        for (size_t i = 0; i < initial_count; i++) {
+            const struct node *node = &re->nodes[re->set[i]];
+            if (node->type == NODE_BOL)
+                add_closure(re, node->out, &count);
+        }
+    }
+
+    /* Note: may flush the cache, and thus the other start states */
+    int state = dfa_state_get(re, count);
+    re->start_state[anchored][at_line_start] = state;
+    return state;
+}
+
+int
+regex_start(struct regex *re, bool at_line_start)
+{
+    return start_state(re, true, at_line_start);
+}
+
+int
+regex_search_start(struct regex *re, bool at_line_start)
+{
+    return start_state(re, false, at_line_start);
+}
+
+int
+regex_step(struct regex *re, int state, wchar_t wc)
+{
+    if (state < 0)
+        return STATE_DEAD;
+
+    if (wc >= 0 && wc < 128) {
+        int next = re->states[state].next[wc];
+        if (next != STATE_UNKNOWN)
+            return next;
+    }
+
+    size_t count = nfa_step(re, state, wc);
+
+    const size_t states_before = re->state_count;
+    int next = dfa_state_get(re, count);
+
+    /* Cache the transition, unless the cache was flushed */
+    if (wc >= 0 && wc < 128 &&
+        (next < 0 || re->state_count >= states_before))
+    {
+        re->states[state].next[wc] = next;
+    }
+
+    return next;
+}
+
+bool
+regex_is_accepting(const struct regex *re, int state)
+{
+    return state >= 0 && re->states[state].accept;
+}
+
+bool
+regex_accepts_at_eol(struct regex *re, int state)
+{
+    if (state < 0)
+        return false;
+
+    struct dfa_state *s = &re->states[state];
+    if (s->eol_accept < 0) {
+        /* Don't create a DFA state, since that may flush the cache */
+        size_t count = nfa_step(re, state, REGEX_EOL);
+        bool accept = s->accept;
+
+        for (size_t i = 0; i < count; i++) {
+            if (re->nodes[re->set[i]].type == NODE_MATCH)
+                accept = true;
+        }
+
+        s->eol_accept = accept;
+    }
+
+    return s->eol_accept;
+}
+
+bool
+regex_first_chars(struct regex *re,
+                  void (*cb)(wchar_t lo, wchar_t hi, void *data), void *data)
+{
+    size_t count = 0;
+    new_generation(re);
+    add_closure(re, re->start, &count);
+
+    for (size_t i = 0; i < count; i++) {
+        const struct node *node = &re->nodes[re->set[i]];
+        if (node->type == NODE_BOL)
+            add_closure(re, node->out, &count);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const struct node *node = &re->nodes[re->set[i]];
+
+        switch (node->type) {
+        case NODE_ANY:
+            return false;
+
+        case NODE_CLASS: {
+            const struct char_class *class = &re->classes[node->class_idx];
+            if (class->negate || class->flags != 0)
+                return false;
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const struct node *node = &re->nodes[re->set[i]];
+
+        if (node->type == NODE_CHAR)
+            cb(node->wc, node->wc, data);
+        else if (node->type == NODE_CLASS) {
+            const struct char_class *class = &re->classes[node->class_idx];
+            for (size_t j = 0; j < class->count; j++)
+                cb(class->ranges[j].lo, class->ranges[j].hi, data);
+        }
+    }
+
+    return true;
+}
+
+void
+regex_required_chars(struct regex *re,
+                     void (*cb)(wchar_t lo, wchar_t hi, void *data), void *data)
+{
+    for (size_t i = 0; i < re->required_count; i++)
+        cb(re->required[i], re->required[i], data);
+}
+
+static struct regex *
+compile(const wchar_t *pattern, size_t len, bool reversed)
+{
+    struct regex *re = xcalloc(1, sizeof(*re));
+    re->reversed = reversed;
+    struct parser p = {.re = re, .p = pattern, .end = pattern + len};
+    struct frag f;
+
+    if (!parse_alt(&p, &f) || p.p != p.end) {
+        LOG_DBG("invalid regex: %.*ls", (int)len, pattern);
+        goto err;
+    }
+
+    int match = node_new(re, NODE_MATCH);
+    if (match < 0)
+        goto err;
+
+    patch(re, f.out, match);
+    re->start = f.start;
+
+    memcpy(re->required, f.required, sizeof(re->required));
+    re->required_count = f.required_count;
+
+    /* .* prefix, for finding matches anywhere in the input */
+    int loop = node_new(re, NODE_SPLIT);
+    int any = node_new(re, NODE_ANY);
+    if (loop < 0 || any < 0)
+        goto err;
+
+    re->nodes[loop].out = re->start;
+    re->nodes[loop].out1 = any;
+    re->nodes[any].out = loop;
+    re->search_start = loop;
+
+    re->marks = xcalloc(re->node_count, sizeof(re->marks[0]));
+    re->set = xmalloc(re->node_count * sizeof(re->set[0]));
+
+    /* Each node is expanded at most once per closure, and pushes at
+     * most two nodes */
+    re->stack = xmalloc((2 * re->node_count + 1) * sizeof(re->stack[0]));
+
+    dfa_flush(re);
+    return re;
+
+err:
+    regex_destroy(re);
+    return NULL;
+}
+
+struct regex *
+regex_compile(const wchar_t *pattern, size_t len)
+{
+    return compile(pattern, len, false);
+}
+
+struct regex *
+regex_compile_reversed(const wchar_t *pattern, size_t len)
+{
+    return compile(pattern, len, true);
+}
+
+void
+regex_destroy(struct regex *re)
+{
+    if (re == NULL)
+        return;
+
+    for (size_t i = 0; i < re->state_count; i++)
+        free(re->states[i].nodes);
+    for (size_t i = 0; i < re->class_count; i++)
+        free(re->classes[i].ranges);
+
+    free(re->states);
+    free(re->classes);
+    free(re->nodes);
+    free(re->marks);
+    free(re->set);
+    free(re->stack);
+    free(re);
+}
+
+struct unittest_chars {
+    wchar_t chars[8];
+    size_t count;
+};
+
+static void UNUSED
+unittest_collect_chars(wchar_t lo, wchar_t hi, void *data)
+{
+    struct unittest_chars *chars = data;
+    for (wchar_t wc = lo; wc <= hi && chars->count < ALEN(chars->chars); wc++)
+        chars->chars[chars->count++] = wc;
+}
+
+UNITTEST
+{
+    struct {
+        const wchar_t *pattern;
+        const wchar_t *text;
+        bool at_eol;        /* Only matches at end-of-line */
+        bool match;
+    } tests[] = {
+        {L"abc", L"abc", false, true},
+        {L"abc", L"ABC", false, true},
+        {L"a.c", L"axc", false, true},
+        {L"a[0-9]+c", L"a123c", false, true},
+        {L"a[0-9]+c", L"ac", false, false},
+        {L"[^a]", L"a", false, false},
+        {L"[^a]", L"b", false, true},
+        {L"req-\\d{3}", L"req-123", false, true},
+        {L"req-\\d{3}", L"req-12x", false, false},
+        {L"x{2,3}", L"xx", false, true},
+        {L"x{2,}", L"xxxxx", false, true},
+        {L"(ab|cd)+", L"abcdab", false, true},
+        {L"(?:ab)?c", L"c", false, true},
+        {L"\\w+\\s\\w+", L"foo bar", false, true},
+        {L"\\.", L"x", false, false},
+        {L"abc$", L"abc", true, true},
+        {L"[[:]", L"[", false, true},
+        {L"[]a]", L"]", false, true},
+    };
+
+    for (size_t i = 0; i < ALEN(tests); i++) {
+        struct regex *re = regex_compile(
+            tests[i].pattern, wcslen(tests[i].pattern));
+        xassert(re != NULL);
+
+        int state = regex_start(re, true);
+        for (const wchar_t *c = tests[i].text; *c != L'\0'; c++)
+            state = regex_step(re, state, *c);
+
+        bool match = tests[i].at_eol
+            ? regex_accepts_at_eol(re, state)
+            : regex_is_accepting(re, state);
+        xassert(match == tests[i].match);
+
+        if (tests[i].at_eol)
+            xassert(!regex_is_accepting(re, state));
+
+        regex_destroy(re);
+
+        /* Fed backwards, from the end of the line, to its start */
+        re = regex_compile_reversed(
+            tests[i].pattern, wcslen(tests[i].pattern));
+        xassert(re != NULL);
+
+        state = regex_start(re, true);
+        for (size_t j = wcslen(tests[i].text); j > 0; j--)
+            state = regex_step(re, state, tests[i].text[j - 1]);
+
+        xassert((regex_is_accepting(re, state) ||
+                 regex_accepts_at_eol(re, state)) == tests[i].match);
+        regex_destroy(re);
+    }
+
+    /* ^ only matches at the beginning of a line */
+    struct regex *re = regex_compile(L"^a", 2);
+    xassert(regex_is_accepting(re, regex_step(re, regex_start(re, true), L'a')));
+    xassert(!regex_is_accepting(re, regex_step(re, regex_start(re, false), L'a')));
+    regex_destroy(re);
+
+    /* ...which is where the reversed input ends */
+    re = regex_compile_reversed(L"^a", 2);
+    int state = regex_step(re, regex_start(re, false), L'a');
+    xassert(!regex_is_accepting(re, state));
+    xassert(regex_accepts_at_eol(re, state));
+    regex_destroy(re);
+
+    /* Invalid patterns */
+    const wchar_t *const invalid[] = {
+        L"(a", L"a)", L"*a", L"a{2", L"a{3,2}", L"[a", L"[b-a]", L"\\", L"\\b",
+        L"a{1001}",
+        L"((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((("
+        L"a"
+        L")))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))",
+    };
+    for (size_t i = 0; i < ALEN(invalid); i++)
+        xassert(regex_compile(invalid[i], wcslen(invalid[i])) == NULL);
+
+    /* Characters all matches begin with, and contain */
+    struct unittest_chars chars = {0};
+
+    re = regex_compile(L"(Req|rex)-\\d+", 12);
+    xassert(regex_first_chars(re, &unittest_collect_chars, &chars));
+    xassert(chars.count == 2 && chars.chars[0] == L'r' && chars.chars[1] == L'r');
+
+    chars.count = 0;
+    regex_required_chars(re, &unittest_collect_chars, &chars);
+    xassert(chars.count == 3);
+    xassert(wmemchr(chars.chars, L'r', chars.count) != NULL);
+    xassert(wmemchr(chars.chars, L'e', chars.count) != NULL);
+    xassert(wmemchr(chars.chars, L'-', chars.count) != NULL);
+    regex_destroy(re);
+
+    re = regex_compile(L"a|.b", 4);
+    xassert(!regex_first_chars(re, &unittest_collect_chars, &chars));
+    regex_destroy(re);
+
+    /* The DFA cache is flushed when full */
+    re = regex_compile(L"(a|b)*a.{10}", 12);
+    state = regex_start(re, false);
+    for (int i = 0; i < 100000; i++)
+        state = regex_step(re, state, (i * 7919) % 3 ? L'a' : L'b');
+    xassert(state >= 0);
+    regex_destroy(re);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <wchar.h>
+
+/*
+ * A small, case insensitive, regular expression engine, used by
+ * the scrollback search.
+ *
+ * The pattern is compiled to an NFA, which is lazily converted to a
+ * DFA while matching. The input is fed one character at a time, which
+ * lets the caller match directly against grid cells.
+ */
+
+struct regex;
+
+/* Returns NULL if the pattern is invalid */
+struct regex *regex_compile(const wchar_t *pattern, size_t len);
+
+/*
+ * Like regex_compile(), but the result matches the input fed
+ * backwards, from the end of the line. Matches anywhere in the
+ * reversed input (see regex_search_start()) tell where matches of the
+ * original pattern may begin.
+ */
+struct regex *regex_compile_reversed(const wchar_t *pattern, size_t len);
+void regex_destroy(struct regex *re);
+
+/*
+ * A negative state means nothing can match. regex_start() matches
+ * at the beginning of the input only, while regex_search_start()
+ * finds matches anywhere in it.
+ */
+int regex_start(struct regex *re, bool at_line_start);
+int regex_search_start(struct regex *re, bool at_line_start);
+int regex_step(struct regex *re, int state, wchar_t wc);
+bool regex_is_accepting(const struct regex *re, int state);
+bool regex_accepts_at_eol(struct regex *re, int state);
+
+/*
+ * Calls cb() for each range of characters a (non-empty) match may
+ * begin with. Returns false, without calling cb(), if a match may
+ * begin with (almost) any character.
+ */
+bool regex_first_chars(
+    struct regex *re,
+    void (*cb)(wchar_t lo, wchar_t hi, void *data), void *data);
+
+/* Calls cb() for (some of) the characters all matches contain */
+void regex_required_chars(
+    struct regex *re,
+    void (*cb)(wchar_t lo, wchar_t hi, void *data), void *data);
@@ -30,11 +30,13 @@
 #include "log.h"
 #include "box-drawing.h"
 #include "config.h"
+#include "glyph-run-cache.h"
 #include "grid.h"
 #include "hsl.h"
 #include "ime.h"
 #include "quirks.h"
 #include "selection.h"
+#include "search.h"
 #include "shm.h"
 #include "sixel.h"
 #include "url-mode.h"
@@ -469,21 +471,86 @@ draw_cursor(const struct terminal *term, const struct cell *cell,
     }
 }
 
-static int
-render_cell(struct terminal *term, pixman_image_t *pix,
-            struct row *row, int col, int row_no, bool has_cursor)
+/* Per-cell render state, shared between the render passes */
+struct cell_render {
+    struct cell *cell;
+    struct fcft_font *font;
+    const struct composed *composed;
+    const struct fcft_glyph *single;
+    const struct fcft_glyph **glyphs;
+    unsigned glyph_count;
+    int cell_cols;
+    int render_width;
+    bool render;
+    pixman_color_t fg;
+    pixman_color_t bg;
+};
+
+/* Solid fill images, for the glyph colors, re-used within a row */
+struct solid_fill_cache {
+    size_t count;
+    size_t next;
+    struct {
+        pixman_color_t color;
+        pixman_image_t *pix;
+    } entries[8];
+};
+
+static inline bool
+color_equal(const pixman_color_t *a, const pixman_color_t *b)
+{
+    return a->red == b->red && a->green == b->green &&
+        a->blue == b->blue && a->alpha == b->alpha;
+}
+
+static pixman_image_t *
+solid_fill_cache_get(struct solid_fill_cache *cache, const pixman_color_t *color)
+{
+    for (size_t i = 0; i < cache->count; i++) {
+        if (color_equal(&cache->entries[i].color, color))
+            return cache->entries[i].pix;
+    }
+
+    size_t idx;
+    if (cache->count < ALEN(cache->entries))
+        idx = cache->count++;
+    else {
+        idx = cache->next;
+        cache->next = (cache->next + 1) % ALEN(cache->entries);
+        pixman_image_unref(cache->entries[idx].pix);
+    }
+
+    cache->entries[idx].color = *color;
+    cache->entries[idx].pix = pixman_image_create_solid_fill(color);
+    return cache->entries[idx].pix;
+}
+
+static void
+solid_fill_cache_destroy(struct solid_fill_cache *cache)
+{
+    for (size_t i = 0; i < cache->count; i++)
+        pixman_image_unref(cache->entries[i].pix);
+    cache->count = 0;
+    cache->next = 0;
+}
+
+/*
+ * Resolves colors and glyphs for a cell, and marks it clean. Returns
+ * false if the cell is already clean (and thus should not be
+ * rendered).
+ */
+static bool
+render_cell_prepare(struct terminal *term, struct row *row, int row_no,
+                    int col, struct cell_render *cr)
 {
     struct cell *cell = &row->cells[col];
-    if (cell->attrs.clean)
-        return 0;
+    if (!grid_row_cell_is_dirty(row, col))
+        return false;
 
-    cell->attrs.clean = 1;
+    grid_row_clean_cell(row, col);
     cell->attrs.confined = true;
 
-    int width = term->cell_width;
-    int height = term->cell_height;
-    const int x = term->margins.left + col * width;
-    const int y = term->margins.top + row_no * height;
+    const int width = term->cell_width;
 
     bool is_selected = cell->attrs.selected;
 
@@ -554,7 +621,10 @@ render_cell(struct terminal *term, pixman_image_t *pix,
     pixman_color_t fg = color_hex_to_pixman(_fg);
     pixman_color_t bg = color_hex_to_pixman_with_alpha(_bg, alpha);
 
-    if (term->is_searching && !is_selected) {
+    /* Matches other than the current (selected) one are not dimmed */
+    if (term->is_searching && !is_selected &&
+        !search_cell_is_highlighted(term, row_no, col))
+    {
         color_dim_for_search(&fg);
         color_dim_for_search(&bg);
     }
@@ -695,18 +765,6 @@ render_cell(struct terminal *term, pixman_image_t *pix,
         }
     }
 
-    pixman_region32_t clip;
-    pixman_region32_init_rect(
-        &clip, x, y,
-        render_width, term->cell_height);
-    pixman_image_set_clip_region32(pix, &clip);
-    pixman_region32_fini(&clip);
-
-    /* Background */
-    pixman_image_fill_rectangles(
-        PIXMAN_OP_SRC, pix, &bg, 1,
-        &(pixman_rectangle16_t){x, y, cell_cols * width, height});
-
     if (cell->attrs.blink && term->blink.fd < 0) {
         /* TODO: use a custom lock for this? */
         mtx_lock(&term->render.workers.lock);
@@ -714,8 +772,101 @@ render_cell(struct terminal *term, pixman_image_t *pix,
         mtx_unlock(&term->render.workers.lock);
     }
 
+    *cr = (struct cell_render){
+        .cell = cell,
+        .font = font,
+        .composed = composed,
+        .single = single,
+        .glyph_count = glyph_count,
+        .cell_cols = cell_cols,
+        .render_width = render_width,
+        .render = true,
+        .fg = fg,
+        .bg = bg,
+    };
+
+    /* ‘single’ lives in the cell_render struct; point into it */
+    cr->glyphs = glyphs == &single ? &cr->single : glyphs;
+    return true;
+}
+
+/*
+ * Returns true if any of the cell’s glyphs extend outside the cell
+ * (including the part of the right neighbor an overflowing glyph is
+ * allowed to use), and thus needs to be clipped.
+ */
+static bool
+render_cell_needs_clip(const struct terminal *term,
+                       const struct cell_render *cr, int x, int y)
+{
+    /* Combining glyphs are positioned relative to the cell’s edges */
+    if (cr->composed != NULL)
+        return true;
+
+    const int baseline = y + font_baseline(term);
+    int pen_x = x;
+
+    for (unsigned i = 0; i < cr->glyph_count; i++) {
+        const struct fcft_glyph *glyph = cr->glyphs[i];
+        if (glyph == NULL)
+            continue;
+
+        int g_x = glyph->x;
+        if (i > 0 && glyph->x >= 0)
+            g_x -= term->cell_width;
+
+        const int left = pen_x + (i == 0 ? term->font_x_ofs : 0) + g_x;
+        const int top = baseline - glyph->y;
+
+        if (left < x || left + glyph->width > x + cr->render_width ||
+            top < y || top + glyph->height > y + term->cell_height)
+        {
+            return true;
+        }
+
+        pen_x += glyph->advance.x;
+    }
+
+    return false;
+}
+
+static void
+render_cell_set_clip(const struct terminal *term, pixman_image_t *pix,
+                     const struct cell_render *cr, int x, int y)
+{
+    pixman_region32_t clip;
+    pixman_region32_init_rect(
+        &clip, x, y, cr->render_width, term->cell_height);
+    pixman_image_set_clip_region32(pix, &clip);
+    pixman_region32_fini(&clip);
+}
+
+/*
+ * Renders everything but the background. The cell’s background must
+ * already have been filled, and so must the background of its right
+ * neighbor (which an overflowing glyph may draw into).
+ */
+static void
+render_cell_fg(struct terminal *term, pixman_image_t *pix,
+               struct cell_render *cr, int x, int y, bool has_cursor,
+               struct solid_fill_cache *fill_cache)
+{
+    const struct cell *cell = cr->cell;
+    struct fcft_font *font = cr->font;
+    const struct composed *composed = cr->composed;
+    const struct fcft_glyph **glyphs = cr->glyphs;
+    const unsigned glyph_count = cr->glyph_count;
+    const int cell_cols = cr->cell_cols;
+    const bool is_selected = cell->attrs.selected;
+
+    /*
+     * Setting a clip region is relatively expensive. Only do it when
+     * something may actually be drawn outside the cell.
+     */
+    bool clipped = false;
+
     if (has_cursor && term->cursor_style == CURSOR_BLOCK && term->kbd_focus)
-        draw_cursor(term, cell, font, pix, &fg, &bg, x, y, cell_cols);
+        draw_cursor(term, cell, font, pix, &cr->fg, &cr->bg, x, y, cell_cols);
 
     if (cell->wc == 0 || cell->wc >= CELL_SPACER || cell->wc == L'\t' ||
         (unlikely(cell->attrs.conceal) && !is_selected))
@@ -723,7 +874,13 @@ render_cell(struct terminal *term, pixman_image_t *pix,
         goto draw_cursor;
     }
 
-    pixman_image_t *clr_pix = pixman_image_create_solid_fill(&fg);
+    if (glyph_count > 0 && render_cell_needs_clip(term, cr, x, y)) {
+        render_cell_set_clip(term, pix, cr, x, y);
+        clipped = true;
+    }
+
+    pixman_image_t *clr_pix = glyph_count > 0
+        ? solid_fill_cache_get(fill_cache, &cr->fg) : NULL;
 
     int pen_x = x;
     for (unsigned i = 0; i < glyph_count; i++) {
@@ -799,14 +956,20 @@ render_cell(struct terminal *term, pixman_image_t *pix,
         pen_x += glyph->advance.x;
     }
 
-    pixman_image_unref(clr_pix);
+    if (!clipped &&
+        (cell->attrs.underline || cell->attrs.strikethrough ||
+         unlikely(cell->attrs.url)))
+    {
+        render_cell_set_clip(term, pix, cr, x, y);
+        clipped = true;
+    }
 
     /* Underline */
     if (cell->attrs.underline)
-        draw_underline(term, pix, font, &fg, x, y, cell_cols);
+        draw_underline(term, pix, font, &cr->fg, x, y, cell_cols);
 
     if (cell->attrs.strikethrough)
-        draw_strikeout(term, pix, font, &fg, x, y, cell_cols);
+        draw_strikeout(term, pix, font, &cr->fg, x, y, cell_cols);
 
     if (unlikely(cell->attrs.url)) {
         pixman_color_t url_color = color_hex_to_pixman(
@@ -818,19 +981,282 @@ render_cell(struct terminal *term, pixman_image_t *pix,
     }
 
 draw_cursor:
-    if (has_cursor && (term->cursor_style != CURSOR_BLOCK || !term->kbd_focus))
-        draw_cursor(term, cell, font, pix, &fg, &bg, x, y, cell_cols);
+    if (has_cursor && (term->cursor_style != CURSOR_BLOCK || !term->kbd_focus)) {
+        if (!clipped) {
+            render_cell_set_clip(term, pix, cr, x, y);
+            clipped = true;
+        }
+        draw_cursor(term, cell, font, pix, &cr->fg, &cr->bg, x, y, cell_cols);
+    }
+
+    if (clipped)
+        pixman_image_set_clip_region32(pix, NULL);
+}
 
-    pixman_image_set_clip_region32(pix, NULL);
-    return cell_cols;
+/* Returns the width, in pixels, of what was rendered */
+static int
+render_cell(struct terminal *term, pixman_image_t *pix,
+            struct row *row, int col, int row_no, bool has_cursor)
+{
+    struct cell_render cr;
+    if (!render_cell_prepare(term, row, row_no, col, &cr))
+        return 0;
+
+    const int x = term->margins.left + col * term->cell_width;
+    const int y = term->margins.top + row_no * term->cell_height;
+
+    pixman_image_fill_rectangles(
+        PIXMAN_OP_SRC, pix, &cr.bg, 1,
+        &(pixman_rectangle16_t){
+            x, y, cr.cell_cols * term->cell_width, term->cell_height});
+
+    struct solid_fill_cache fill_cache = {0};
+    render_cell_fg(term, pix, &cr, x, y, has_cursor, &fill_cache);
+    solid_fill_cache_destroy(&fill_cache);
+    return cr.render_width;
 }
 
+/* Shortest run of cells worth caching, in columns */
+#define GLYPH_RUN_MIN_COLS 4
+
+static bool
+cell_is_glyph_run_cacheable(const struct terminal *term,
+                            const struct cell_render *cr)
+{
+    const struct cell *cell = cr->cell;
+
+    return cr->render &&
+        cr->render_width == cr->cell_cols * term->cell_width &&
+        !cell->attrs.blink &&
+        !cell->attrs.url &&
+        !(cell->wc >= CELL_COMB_CHARS_LO && cell->wc < CELL_SPACER);
+}
+
+static uint16_t
+glyph_run_flags(const struct cell_render *cr)
+{
+    const struct attributes *attrs = &cr->cell->attrs;
+    return attrs->underline |
+        attrs->strikethrough << 1 |
+        (attrs->conceal && !attrs->selected) << 2;
+}
+
+static bool
+glyph_run_continues(const struct cell_render *first,
+                    const struct cell_render *cr)
+{
+    return cr->font == first->font &&
+        color_equal(&cr->fg, &first->fg) &&
+        color_equal(&cr->bg, &first->bg) &&
+        glyph_run_flags(cr) == glyph_run_flags(first);
+}
+
+static pixman_image_t *
+render_glyph_run(struct terminal *term, struct cell_render *cells, int count,
+                 struct solid_fill_cache *fill_cache)
+{
+    const int width = term->cell_width;
+
+    pixman_image_t *pix = pixman_image_create_bits_no_clear(
+        PIXMAN_a8r8g8b8, count * width, term->cell_height, NULL, 0);
+    if (pix == NULL)
+        return NULL;
+
+    pixman_image_fill_rectangles(
+        PIXMAN_OP_SRC, pix, &cells[0].bg, 1,
+        &(pixman_rectangle16_t){0, 0, count * width, term->cell_height});
+
+    for (int i = count - 1; i >= 0; i--) {
+        if (cells[i].render)
+            render_cell_fg(term, pix, &cells[i], i * width, 0, false, fill_cache);
+    }
+
+    return pix;
+}
+
+/*
+ * Renders runs of (confined) cells sharing colors, font and
+ * decorations, from the glyph run cache, with a single blit per run.
+ *
+ * Runs not in the cache are rendered to, and inserted into, the
+ * cache the second time they are seen. Cells rendered here are marked
+ * as not needing any further rendering.
+ */
 static void
+render_glyph_runs(struct terminal *term, pixman_image_t *pix,
+                  const struct row *row, struct cell_render *cells,
+                  wchar_t *text, int y, int cursor_col,
+                  struct solid_fill_cache *fill_cache)
+{
+    const int cols = term->cols;
+    const int width = term->cell_width;
+
+    for (int col = 0; col < cols; ) {
+        const struct cell_render *first = &cells[col];
+
+        if (col == cursor_col || !cell_is_glyph_run_cacheable(term, first)) {
+            col++;
+            continue;
+        }
+
+        bool has_glyphs = first->glyph_count > 0;
+        int end = col + first->cell_cols;
+
+        while (end < cols && end != cursor_col &&
+               cell_is_glyph_run_cacheable(term, &cells[end]) &&
+               glyph_run_continues(first, &cells[end]))
+        {
+            has_glyphs = has_glyphs || cells[end].glyph_count > 0;
+            end += cells[end].cell_cols;
+        }
+
+        const int count = end - col;
+
+        /* Blank runs are cheaper to just fill */
+        if (count < GLYPH_RUN_MIN_COLS || !has_glyphs) {
+            col = end;
+            continue;
+        }
+
+        for (int i = 0; i < count; i++)
+            text[i] = row->cells[col + i].wc;
+
+        const struct glyph_run_key key = {
+            .fg = first->fg,
+            .bg = first->bg,
+            .font = first->font,
+            .cell_width = width,
+            .cell_height = term->cell_height,
+            .flags = glyph_run_flags(first),
+            .count = count,
+        };
+
+        const uint64_t hash = glyph_run_hash(&key, text);
+
+        bool insert;
+        pixman_image_t *run_pix = glyph_run_cache_lookup(
+            &term->render.glyph_runs, &key, text, hash, &insert);
+
+        if (run_pix == NULL && insert)
+            run_pix = render_glyph_run(term, &cells[col], count, fill_cache);
+
+        if (run_pix != NULL) {
+            pixman_image_composite32(
+                PIXMAN_OP_SRC, run_pix, NULL, pix, 0, 0, 0, 0,
+                term->margins.left + col * width, y,
+                count * width, term->cell_height);
+
+            if (insert) {
+                glyph_run_cache_insert(
+                    &term->render.glyph_runs, &key, text, hash, run_pix);
+            } else
+                glyph_run_cache_release(&term->render.glyph_runs, run_pix);
+
+            for (int i = col; i < end; i++)
+                cells[i].render = false;
+        }
+
+        col = end;
+    }
+}
+
+/*
+ * Renders the row’s dirty cells. Returns the horizontal range of
+ * pixels repainted, which is empty if no cell was rendered.
+ *
+ * ‘cells’ and ‘text’ are scratch memory, with room for (at least)
+ * term->cols entries each.
+ */
+static struct row_damage
 render_row(struct terminal *term, pixman_image_t *pix, struct row *row,
-           int row_no, int cursor_col)
+           int row_no, int cursor_col, struct cell_render *cells,
+           wchar_t *text)
 {
-    for (int col = term->cols - 1; col >= 0; col--)
-        render_cell(term, pix, row, col, row_no, cursor_col == col);
+    const int cols = term->cols;
+    const int width = term->cell_width;
+    const int y = term->margins.top + row_no * term->cell_height;
+
+    /*
+     * Resolve colors and glyphs. This is done right-to-left, since a
+     * cell may mark its right neighbor(s) as not confined.
+     *
+     * A multi-column cell’s background covers its right neighbor(s),
+     * which means anything rendered there would be overwritten
+     * anyway. Don’t bother rendering them.
+     */
+    for (int col = 0; col < cols; col++)
+        cells[col].render = false;
+
+    int first_col = cols;
+    int last_x = 0;
+
+    for (int col = grid_row_prev_dirty(row, cols - 1);
+         col >= 0;
+         col = grid_row_prev_dirty(row, col - 1))
+    {
+        if (!render_cell_prepare(term, row, row_no, col, &cells[col]))
+            continue;
+
+        for (int i = 1; i < cells[col].cell_cols; i++)
+            cells[col + i].render = false;
+
+        first_col = col;
+        last_x = max(last_x, col * width + cells[col].render_width);
+    }
+
+    if (first_col == cols)
+        return (struct row_damage){0};
+
+    struct solid_fill_cache fill_cache = {0};
+
+    render_glyph_runs(
+        term, pix, row, cells, text, y, cursor_col, &fill_cache);
+
+    /* Backgrounds, one fill per run of same-colored dirty cells */
+    for (int col = 0; col < cols; ) {
+        if (!cells[col].render) {
+            col++;
+            continue;
+        }
+
+        const pixman_color_t *bg = &cells[col].bg;
+        int end = col + cells[col].cell_cols;
+
+        while (end < cols && cells[end].render &&
+               color_equal(&cells[end].bg, bg))
+        {
+            end += cells[end].cell_cols;
+        }
+
+        pixman_image_fill_rectangles(
+            PIXMAN_OP_SRC, pix, bg, 1,
+            &(pixman_rectangle16_t){
+                term->margins.left + col * width, y,
+                (end - col) * width, term->cell_height});
+
+        col = end;
+    }
+
+    /*
+     * Glyphs, decorations and cursor. Right-to-left, since glyphs may
+     * overflow into their right neighbor; that neighbor must be
+     * rendered first, or it would overwrite the overflowing part.
+     */
+    for (int col = cols - 1; col >= 0; col--) {
+        if (!cells[col].render)
+            continue;
+
+        render_cell_fg(
+            term, pix, &cells[col], term->margins.left + col * width, y,
+            cursor_col == col, &fill_cache);
+    }
+
+    solid_fill_cache_destroy(&fill_cache);
+
+    return (struct row_damage){
+        .x1 = term->margins.left + first_col * width,
+        .x2 = term->margins.left + last_x,
+    };
 }
 
 static void
@@ -865,7 +1291,7 @@ render_urgency(struct terminal *term, struct buffer *buf)
 
 static void
 render_margin(struct terminal *term, struct buffer *buf,
-              int start_line, int end_line, bool apply_damage)
+              int start_line, int end_line, pixman_region32_t *damage)
 {
     /* Fill area outside the cell grid with the default background color */
     const int rmargin = term->width - term->margins.right;
@@ -911,32 +1337,215 @@ render_margin(struct terminal *term, struct buffer *buf,
         &buf->dirty, &buf->dirty,
         rmargin, 0, term->margins.right, term->height);
 
-    if (apply_damage) {
+    if (damage != NULL) {
         /* Top */
-        wl_surface_damage_buffer(
-            term->window->surface, 0, 0, term->width, term->margins.top);
+        pixman_region32_union_rect(
+            damage, damage, 0, 0, term->width, term->margins.top);
 
         /* Bottom */
-        wl_surface_damage_buffer(
-            term->window->surface, 0, bmargin, term->width, term->margins.bottom);
+        pixman_region32_union_rect(
+            damage, damage, 0, bmargin, term->width, term->margins.bottom);
 
         /* Left */
-        wl_surface_damage_buffer(
-            term->window->surface,
+        pixman_region32_union_rect(
+            damage, damage,
             0, term->margins.top + start_line * term->cell_height,
             term->margins.left, line_count * term->cell_height);
 
         /* Right */
-        wl_surface_damage_buffer(
-            term->window->surface,
+        pixman_region32_union_rect(
+            damage, damage,
             rmargin, term->margins.top + start_line * term->cell_height,
             term->margins.right, line_count * term->cell_height);
     }
 }
 
+/*
+ * SHM scrolling can be *much* faster than memmove:ing the buffer,
+ * but it depends on how many lines we're scrolling, and how much
+ * repairing we need to do afterwards: the scrolling regions, and the
+ * window margins, must be restored, and the latter is a *huge*
+ * performance hit when scrolling a large number of lines (in
+ * addition to the slowness of SHM scrolling as method). Where the
+ * break-even point is depends on the machine, the compositor, and
+ * the buffer size.
+ *
+ * So, instead of guessing, we time both methods, and model the cost
+ * of each one as a linear function of the number of lines it
+ * touches:
+ *
+ *  - memmove moves the lines that remain in the scrolling region
+ *  - SHM scrolling "moves" (punch hole + allocate) the scrolled
+ *    lines, and then restores everything outside the scrolling
+ *    region
+ *
+ * and use whichever method is predicted to be cheapest. Older
+ * measurements decay, and every now and then we deliberately use the
+ * other method, to keep both estimates current.
+ *
+ * SHM scrolling leaves the scrolled in lines backed by fresh pages;
+ * the page faults would otherwise hit whoever renders them, and not
+ * be charged to SHM scrolling. They are therefore pre-faulted, as
+ * part of the SHM path.
+ *
+ * Until both methods have been timed a couple of times (for the
+ * current buffer size), assume they perform roughly the same, given
+ * an equal number of lines, and SHM scroll if the total number of
+ * lines touched is less than half the screen.
+ *
+ * Scroll damage replayed to bring an older buffer up to date (see
+ * reapply_old_damage()) is neither timed, nor used for exploring.
+ */
+#define SCROLL_COST_DECAY 0.95
+#define SCROLL_COST_MIN_SAMPLES 3.
+#define SCROLL_COST_EXPLORE_INTERVAL 64
+
+static void
+scroll_cost_add(struct scroll_cost *cost, int lines, uint64_t ns)
+{
+    cost->n = cost->n * SCROLL_COST_DECAY + 1.;
+    cost->lines = cost->lines * SCROLL_COST_DECAY + lines;
+    cost->ns = cost->ns * SCROLL_COST_DECAY + ns;
+    cost->lines_sq = cost->lines_sq * SCROLL_COST_DECAY + (double)lines * lines;
+    cost->lines_ns = cost->lines_ns * SCROLL_COST_DECAY + (double)lines * ns;
+}
+
+static double
+scroll_cost_predict(const struct scroll_cost *cost, int lines)
+{
+    const double det = cost->n * cost->lines_sq - cost->lines * cost->lines;
+
+    if (det <= 1e-6 * cost->n * cost->lines_sq) {
+        /* All samples touched (roughly) the same number of lines */
+        return cost->lines > 0.
+            ? cost->ns / cost->lines * lines
+            : cost->ns / cost->n;
+    }
+
+    const double b = (cost->n * cost->lines_ns - cost->lines * cost->ns) / det;
+    const double a = (cost->ns - b * cost->lines) / cost->n;
+    return max(a + b * lines, 0.);
+}
+
+static bool
+scroll_cost_valid(const struct terminal *term)
+{
+    return term->render.scroll_cost.shm.n >= SCROLL_COST_MIN_SAMPLES &&
+           term->render.scroll_cost.memmove.n >= SCROLL_COST_MIN_SAMPLES;
+}
+
+static bool
+scroll_use_shm(struct terminal *term, const struct buffer *buf,
+               int memmove_lines, int shm_lines, bool explore)
+{
+    if (buf->width != term->render.scroll_cost.width ||
+        buf->height != term->render.scroll_cost.height)
+    {
+        /* Costs were measured for another buffer size */
+        term->render.scroll_cost.width = buf->width;
+        term->render.scroll_cost.height = buf->height;
+        term->render.scroll_cost.shm = (struct scroll_cost){0};
+        term->render.scroll_cost.memmove = (struct scroll_cost){0};
+    }
+
+    if (!shm_can_scroll(buf))
+        return false;
+
+    const struct scroll_cost *shm = &term->render.scroll_cost.shm;
+    const struct scroll_cost *mm = &term->render.scroll_cost.memmove;
+
+    bool use_shm = scroll_cost_valid(term)
+        ? (scroll_cost_predict(shm, shm_lines) <
+           scroll_cost_predict(mm, memmove_lines))
+        : shm_lines < term->rows / 2;
+
+    if (!explore)
+        return use_shm;
+
+    /* Try the other method now and then, more often while it's
+     * still unmeasured */
+    const uint64_t count = term->render.scroll_cost.count++;
+    const bool unmeasured =
+        (use_shm ? mm->n : shm->n) < SCROLL_COST_MIN_SAMPLES;
+
+    if ((unmeasured && count % 4 == 3) ||
+        count % SCROLL_COST_EXPLORE_INTERVAL == SCROLL_COST_EXPLORE_INTERVAL - 1)
+    {
+        use_shm = !use_shm;
+    }
+
+    return use_shm;
+}
+
+/* Faults in the pages backing ‘size’ bytes at ‘start’, without
+ * changing their content */
+static void
+scroll_prefault(uint8_t *start, size_t size)
+{
+    static long page_size = 0;
+    if (page_size <= 0)
+        page_size = max(sysconf(_SC_PAGESIZE), 4096);
+
+    if (size == 0)
+        return;
+
+    for (volatile uint8_t *p = start; p < start + size; p += page_size)
+        *p = *p;
+
+    volatile uint8_t *last = start + size - 1;
+    *last = *last;
+}
+
+static uint64_t
+scroll_cost_record(struct terminal *term, bool shm, int lines,
+                   const struct timespec *start_time)
+{
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+    struct timespec elapsed;
+    timespec_sub(&end_time, start_time, &elapsed);
+
+    const uint64_t ns = elapsed.tv_sec * 1000000000ull + elapsed.tv_nsec;
+
+    scroll_cost_add(
+        shm ? &term->render.scroll_cost.shm : &term->render.scroll_cost.memmove,
+        lines, ns);
+
+    term->render.scroll_cost.stats[shm].count++;
+    term->render.scroll_cost.stats[shm].ns += ns;
+    return ns;
+}
+
+/*
+ * Number of lines, when scrolling the entire screen, below which SHM
+ * scrolling is currently predicted to be faster than memmove. Returns
+ * -1 if there aren't enough measurements yet.
+ */
+static int
+scroll_cost_crossover(const struct terminal *term)
+{
+    if (!scroll_cost_valid(term))
+        return -1;
+
+    const struct scroll_cost *shm = &term->render.scroll_cost.shm;
+    const struct scroll_cost *mm = &term->render.scroll_cost.memmove;
+
+    int lines = 0;
+    while (lines < term->rows &&
+           scroll_cost_predict(shm, lines + 1) <
+           scroll_cost_predict(mm, term->rows - (lines + 1)))
+    {
+        lines++;
+    }
+
+    return lines;
+}
+
 static void
 grid_render_scroll(struct terminal *term, struct buffer *buf,
-                   const struct damage *dmg)
+                   const struct damage *dmg, bool replay,
+                   pixman_region32_t *damage)
 {
     int height = (dmg->region.end - dmg->region.start - dmg->lines) * term->cell_height;
 
@@ -947,69 +1556,40 @@ grid_render_scroll(struct terminal *term, struct buffer *buf,
     if (height <= 0)
         return;
 
-#if TIME_SCROLL_DAMAGE
-    struct timespec start_time;
-    clock_gettime(CLOCK_MONOTONIC, &start_time);
-#endif
-
     int dst_y = term->margins.top + (dmg->region.start + 0) * term->cell_height;
     int src_y = term->margins.top + (dmg->region.start + dmg->lines) * term->cell_height;
 
-    /*
-     * SHM scrolling can be *much* faster, but it depends on how many
-     * lines we're scrolling, and how much repairing we need to do.
-     *
-     * In short, scrolling a *large* number of rows is faster with a
-     * memmove, while scrolling a *small* number of lines is faster
-     * with SHM scrolling.
-     *
-     * However, since we need to restore the scrolling regions when
-     * SHM scrolling, we also need to take this into account.
-     *
-     * Finally, we also have to restore the window margins, and this
-     * is a *huge* performance hit when scrolling a large number of
-     * lines (in addition to the sloweness of SHM scrolling as
-     * method).
-     *
-     * So, we need to figure out when to SHM scroll, and when to
-     * memmove.
-     *
-     * For now, assume that the both methods perform roughly the same,
-     * given an equal number of bytes to move/allocate, and use the
-     * method that results in the least amount of bytes to touch.
-     *
-     * Since number of lines directly translates to bytes, we can
-     * simply count lines.
-     *
-     * SHM scrolling needs to first "move" (punch hole + allocate)
-     * dmg->lines number of lines, and then we need to restore
-     * the bottom scroll region.
-     *
-     * If the total number of lines is less than half the screen - use
-     * SHM. Otherwise use memmove.
-     */
-    bool try_shm_scroll =
-        shm_can_scroll(buf) && (
-            dmg->lines +
-            dmg->region.start +
-            (term->rows - dmg->region.end)) < term->rows / 2;
+    const int memmove_lines = dmg->region.end - dmg->region.start - dmg->lines;
+    const int shm_lines =
+        dmg->lines + dmg->region.start + (term->rows - dmg->region.end);
 
+    bool try_shm_scroll =
+        scroll_use_shm(term, buf, memmove_lines, shm_lines, !replay);
     bool did_shm_scroll = false;
 
-    //try_shm_scroll = false;
-    //try_shm_scroll = true;
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
 
     if (try_shm_scroll) {
         did_shm_scroll = shm_scroll(
             buf, dmg->lines * term->cell_height,
             term->margins.top, dmg->region.start * term->cell_height,
             term->margins.bottom, (term->rows - dmg->region.end) * term->cell_height);
+
+        /* Don't bill the fallback for the failed attempt */
+        if (!did_shm_scroll)
+            clock_gettime(CLOCK_MONOTONIC, &start_time);
     }
 
     if (did_shm_scroll) {
         /* Restore margins */
         render_margin(
-            term, buf, dmg->region.end - dmg->lines, term->rows, false);
+            term, buf, dmg->region.end - dmg->lines, term->rows, NULL);
+
+        /* Scrolled in lines are at the end of the buffer */
+        const size_t size = dmg->lines * term->cell_height * buf->stride;
+        scroll_prefault(
+            (uint8_t *)buf->data + buf->height * buf->stride - size, size);
     } else {
         /* Fallback for when we either cannot do SHM scrolling, or it failed */
         uint8_t *raw = buf->data;
@@ -1018,26 +1598,28 @@ grid_render_scroll(struct terminal *term, struct buffer *buf,
                 height * buf->stride);
     }
 
-#if TIME_SCROLL_DAMAGE
-    struct timespec end_time;
-    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    const uint64_t ns = replay ? 0 : scroll_cost_record(
+        term, did_shm_scroll, did_shm_scroll ? shm_lines : memmove_lines,
+        &start_time);
 
-    struct timespec memmove_time;
-    timespec_sub(&end_time, &start_time, &memmove_time);
-    LOG_INFO("scrolled %dKB (%d lines) using %s in %lds %ldns",
+#if TIME_SCROLL_DAMAGE
+    LOG_INFO("scrolled %dKB (%d lines) using %s in %lluns",
              height * buf->stride / 1024, dmg->lines,
              did_shm_scroll ? "SHM" : try_shm_scroll ? "memmove (SHM failed)" :  "memmove",
-             (long)memmove_time.tv_sec, memmove_time.tv_nsec);
+             (unsigned long long)ns);
+#else
+    (void)ns;
 #endif
 
-    wl_surface_damage_buffer(
-        term->window->surface, term->margins.left, dst_y,
+    pixman_region32_union_rect(
+        damage, damage, term->margins.left, dst_y,
         term->width - term->margins.left - term->margins.right, height);
 }
 
 static void
 grid_render_scroll_reverse(struct terminal *term, struct buffer *buf,
-                           const struct damage *dmg)
+                           const struct damage *dmg, bool replay,
+                           pixman_region32_t *damage)
 {
     int height = (dmg->region.end - dmg->region.start - dmg->lines) * term->cell_height;
 
@@ -1048,33 +1630,39 @@ grid_render_scroll_reverse(struct terminal *term, struct buffer *buf,
     if (height <= 0)
         return;
 
-#if TIME_SCROLL_DAMAGE
-    struct timespec start_time;
-    clock_gettime(CLOCK_MONOTONIC, &start_time);
-#endif
-
     int src_y = term->margins.top + (dmg->region.start + 0) * term->cell_height;
     int dst_y = term->margins.top + (dmg->region.start + dmg->lines) * term->cell_height;
 
-    bool try_shm_scroll =
-        shm_can_scroll(buf) && (
-            dmg->lines +
-            dmg->region.start +
-            (term->rows - dmg->region.end)) < term->rows / 2;
+    const int memmove_lines = dmg->region.end - dmg->region.start - dmg->lines;
+    const int shm_lines =
+        dmg->lines + dmg->region.start + (term->rows - dmg->region.end);
 
+    bool try_shm_scroll =
+        scroll_use_shm(term, buf, memmove_lines, shm_lines, !replay);
     bool did_shm_scroll = false;
 
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
     if (try_shm_scroll) {
         did_shm_scroll = shm_scroll(
             buf, -dmg->lines * term->cell_height,
             term->margins.top, dmg->region.start * term->cell_height,
             term->margins.bottom, (term->rows - dmg->region.end) * term->cell_height);
+
+        /* Don't bill the fallback for the failed attempt */
+        if (!did_shm_scroll)
+            clock_gettime(CLOCK_MONOTONIC, &start_time);
     }
 
     if (did_shm_scroll) {
         /* Restore margins */
         render_margin(
-            term, buf, dmg->region.start, dmg->region.start + dmg->lines, false);
+            term, buf, dmg->region.start, dmg->region.start + dmg->lines, NULL);
+
+        /* Scrolled in lines are at the beginning of the buffer */
+        scroll_prefault(
+            buf->data, dmg->lines * term->cell_height * buf->stride);
     } else {
         /* Fallback for when we either cannot do SHM scrolling, or it failed */
         uint8_t *raw = buf->data;
@@ -1083,26 +1671,28 @@ grid_render_scroll_reverse(struct terminal *term, struct buffer *buf,
                 height * buf->stride);
     }
 
-#if TIME_SCROLL_DAMAGE
-    struct timespec end_time;
-    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    const uint64_t ns = replay ? 0 : scroll_cost_record(
+        term, did_shm_scroll, did_shm_scroll ? shm_lines : memmove_lines,
+        &start_time);
 
-    struct timespec memmove_time;
-    timespec_sub(&end_time, &start_time, &memmove_time);
-    LOG_INFO("scrolled REVERSE %dKB (%d lines) using %s in %lds %ldns",
+#if TIME_SCROLL_DAMAGE
+    LOG_INFO("scrolled REVERSE %dKB (%d lines) using %s in %lluns",
              height * buf->stride / 1024, dmg->lines,
              did_shm_scroll ? "SHM" : try_shm_scroll ? "memmove (SHM failed)" :  "memmove",
-             (long)memmove_time.tv_sec, memmove_time.tv_nsec);
+             (unsigned long long)ns);
+#else
+    (void)ns;
 #endif
 
-    wl_surface_damage_buffer(
-        term->window->surface, term->margins.left, dst_y,
+    pixman_region32_union_rect(
+        damage, damage, term->margins.left, dst_y,
         term->width - term->margins.left - term->margins.right, height);
 }
 
 static void
 render_sixel_chunk(struct terminal *term, pixman_image_t *pix, const struct sixel *sixel,
-                   int term_start_row, int img_start_row, int count)
+                   int term_start_row, int img_start_row, int count,
+                   pixman_region32_t *damage)
 {
     /* Translate row/column to x/y pixel values */
     const int x = term->margins.left + sixel->pos.col * term->cell_width;
@@ -1138,12 +1728,13 @@ render_sixel_chunk(struct terminal *term, pixman_image_t *pix, const struct sixe
         x, y,
         width, height);
 
-    wl_surface_damage_buffer(term->window->surface, x, y, width, height);
+    pixman_region32_union_rect(damage, damage, x, y, width, height);
 }
 
 static void
 render_sixel(struct terminal *term, pixman_image_t *pix,
-             const struct coord *cursor, const struct sixel *sixel)
+             const struct coord *cursor, const struct sixel *sixel,
+             pixman_region32_t *damage)
 {
     const int view_end = (term->grid->view + term->rows - 1) & (term->grid->num_rows - 1);
     const bool last_row_needs_erase = sixel->height % term->cell_height != 0;
@@ -1157,7 +1748,8 @@ render_sixel(struct terminal *term, pixman_image_t *pix,
     if (chunk_row_count != 0) {                                         \
         render_sixel_chunk(                                             \
             term, pix, sixel,                                           \
-            chunk_term_start, chunk_img_start, chunk_row_count);        \
+            chunk_term_start, chunk_img_start, chunk_row_count,         \
+            damage);                                                    \
         chunk_term_start = chunk_img_start = -1;                        \
         chunk_row_count = 0;                                            \
     }
@@ -1221,39 +1813,58 @@ render_sixel(struct terminal *term, pixman_image_t *pix,
          * If image contains transparent parts, render all (dirty)
          * cells beneath it.
          *
-         * If image is opaque, loop cells and set their 'clean' bit,
+         * If image is opaque, loop the dirty cells and clean them,
          * to prevent the grid rendered from overwriting the sixel
          *
          * If the last sixel row only partially covers the cell row,
          * 'erase' the cell by rendering them.
          *
+         * Cells rendered here are cleaned, and will not be included
+         * in the regular renderer’s damage; damage them here.
+         *
          * In all cases, do *not* clear the ‘dirty’ bit on the row, to
-         * ensure the regular renderer includes them in the damage
-         * rect.
+         * ensure the regular renderer picks up the remaining cells.
          */
+        const int y = term->margins.top + term_row_no * term->cell_height;
+
         if (!sixel->opaque) {
             /* TODO: multithreading */
             int cursor_col = cursor->row == term_row_no ? cursor->col : -1;
-            render_row(term, pix, row, term_row_no, cursor_col);
+            const struct row_damage rendered = render_row(
+                term, pix, row, term_row_no, cursor_col,
+                term->render.workers.scratch_cells,
+                term->render.workers.scratch_text);
+
+            if (rendered.x2 > rendered.x1) {
+                pixman_region32_union_rect(
+                    damage, damage, rendered.x1, y,
+                    rendered.x2 - rendered.x1, term->cell_height);
+            }
         } else {
-            for (int col = sixel->pos.col;
-                 col < min(sixel->pos.col + sixel->cols, term->cols);
-                 col++)
+            const int end = min(sixel->pos.col + sixel->cols, term->cols);
+
+            for (int col = grid_row_next_dirty(row, sixel->pos.col, end);
+                 col < end;
+                 col = grid_row_next_dirty(row, col + 1, end))
             {
-                struct cell *cell = &row->cells[col];
-
-                if (!cell->attrs.clean) {
-                    bool last_row = abs_row_no == sixel->pos.row + sixel->rows - 1;
-                    bool last_col = col == sixel->pos.col + sixel->cols - 1;
-
-                    if ((last_row_needs_erase && last_row) ||
-                        (last_col_needs_erase && last_col))
-                    {
-                        render_cell(term, pix, row, col, term_row_no, cursor_col == col);
-                    } else {
-                        cell->attrs.clean = 1;
-                        cell->attrs.confined = 1;
+                bool last_row = abs_row_no == sixel->pos.row + sixel->rows - 1;
+                bool last_col = col == sixel->pos.col + sixel->cols - 1;
+
+                if ((last_row_needs_erase && last_row) ||
+                    (last_col_needs_erase && last_col))
+                {
+                    const int width = render_cell(
+                        term, pix, row, col, term_row_no, cursor_col == col);
+
+                    if (width > 0) {
+                        pixman_region32_union_rect(
+                            damage, damage,
+                            term->margins.left + col * term->cell_width, y,
+                            width, term->cell_height);
                     }
+                } else {
+                    grid_row_clean_cell(row, col);
+                    row->cells[col].attrs.confined = 1;
                 }
             }
         }
@@ -1273,7 +1884,7 @@ render_sixel(struct terminal *term, pixman_image_t *pix,
 
 static void
 render_sixel_images(struct terminal *term, pixman_image_t *pix,
-                    const struct coord *cursor)
+                    const struct coord *cursor, pixman_region32_t *damage)
 {
     if (likely(tll_length(term->grid->sixel_images)) == 0)
         return;
@@ -1309,7 +1920,7 @@ render_sixel_images(struct terminal *term, pixman_image_t *pix,
             break;
         }
 
-        render_sixel(term, pix, cursor, &it->item);
+        render_sixel(term, pix, cursor, &it->item, damage);
     }
 }
 
@@ -1402,7 +2013,6 @@ render_ime_preedit_for_seat(struct terminal *term, struct seat *seat,
     for (int i = 0; i < cells_used; i++) {
         xassert(col_idx + i < term->cols);
         real_cells[i] = row->cells[col_idx + i];
-        real_cells[i].attrs.clean = 0;
     }
     row->dirty = true;
 
@@ -1419,6 +2029,7 @@ render_ime_preedit_for_seat(struct terminal *term, struct seat *seat,
             break;
 
         row->cells[col_idx + i] = *cell;
+        grid_row_dirty_cell(row, col_idx + i);
         render_cell(term, buf->pix[0], row, col_idx + i, row_idx, false);
     }
 
@@ -1447,41 +2058,182 @@ render_ime_preedit_for_seat(struct terminal *term, struct seat *seat,
             term_ime_set_cursor_rect(term, x, y, 1, term->cell_height);
         }
 
-        else if (end > start) {
-            /* Hollow cursor */
-            if (start >= 0 && end <= term->cols) {
-                int cols = end - start;
-                draw_unfocused_block(term, buf->pix[0], &cursor_color, x, y, cols);
-            }
+        else if (end > start) {
+            /* Hollow cursor */
+            if (start >= 0 && end <= term->cols) {
+                int cols = end - start;
+                draw_unfocused_block(term, buf->pix[0], &cursor_color, x, y, cols);
+            }
+
+            term_ime_set_cursor_rect(
+                term, x, y, (end - start) * term->cell_width, term->cell_height);
+        }
+    }
+
+    /* Restore original content (but do not render) */
+    for (int i = 0; i < cells_used; i++)
+        row->cells[col_idx + i] = real_cells[i];
+    grid_row_dirty_cells(row, col_idx, col_idx + cells_used);
+    free(real_cells);
+
+    wl_surface_damage_buffer(
+        term->window->surface,
+        term->margins.left,
+        term->margins.top + row_idx * term->cell_height,
+        term->width - term->margins.left - term->margins.right,
+        1 * term->cell_height);
+}
+#endif
+
+static void
+render_ime_preedit(struct terminal *term, struct buffer *buf)
+{
+#if defined(FOOT_IME_ENABLED) && FOOT_IME_ENABLED
+    tll_foreach(term->wl->seats, it) {
+        if (it->item.kbd_focus == term)
+            render_ime_preedit_for_seat(term, &it->item, buf);
+    }
+#endif
+}
+
+/*
+ * Pre-pass to dirty cells affected by overflowing glyphs.
+ *
+ * Given any two pair of cells where the first cell is overflowing
+ * into the second, *both* cells must be re-rendered if any one of
+ * them is dirty.
+ *
+ * Thus, given a string of overflowing glyphs, with a single dirty
+ * cell in the middle, we need to re-render the entire string.
+ */
+static void
+dirty_overflowing_cells(const struct terminal *term, struct row *row)
+{
+    const int cols = term->cols;
+
+    /* Loop row from left to right, jumping between dirty cells */
+    for (int col = grid_row_next_dirty(row, 0, cols);
+         col < cols;
+         col = grid_row_next_dirty(row, col + 1, cols))
+    {
+        /*
+         * Cell is dirty, go back and dirty previous cells, if they
+         * are overflowing.
+         *
+         * As soon as we see a non-overflowing cell we can stop,
+         * since it isn’t affecting the string of overflowing glyphs
+         * that follows it.
+         *
+         * As soon as we see a dirty cell, we can stop, since that
+         * means we’ve already handled it (remember the outer loop
+         * goes from left to right).
+         */
+        for (int c = col - 1; c >= 0; c--) {
+            if (row->cells[c].attrs.confined)
+                break;
+            if (grid_row_cell_is_dirty(row, c))
+                break;
+            grid_row_dirty_cell(row, c);
+        }
+
+        /*
+         * Now move forward, dirtying all cells until we hit a
+         * non-overflowing cell.
+         *
+         * Note that the first non-overflowing cell must be
+         * re-rendered as well, but any cell *after* that is
+         * unaffected by the string of overflowing glyphs we’re
+         * dealing with right now.
+         *
+         * For performance, this iterates the *outer* loop’s column
+         * - no point in re-checking all these glyphs again, in the
+         * outer loop.
+         */
+        for (; col < cols; col++) {
+            grid_row_dirty_cell(row, col);
+            if (row->cells[col].attrs.confined)
+                break;
+        }
+    }
+}
+
+/*
+ * Claims rows of the current frame, one at a time, until all rows
+ * have been claimed. Dirty rows are rendered into ‘pix’, and the
+ * pixels repainted on each row are recorded in workers.rendered.
+ *
+ * Called by the render workers *and* the main thread. Since a row is
+ * only ever touched by the thread that claimed it, the scan, the
+ * overflowing glyphs pre-pass and the rendering itself all run in
+ * parallel.
+ */
+static void
+render_claimed_rows(struct terminal *term, pixman_image_t *pix, int my_id)
+{
+    /* Translate offset-relative cursor row to view-relative, unless
+     * cursor is hidden, then we just set it to -1 */
+    struct coord cursor = {-1, -1};
+    if (!term->hide_cursor) {
+        cursor = term->grid->cursor.point;
+        cursor.row += term->grid->offset;
+        cursor.row -= term->grid->view;
+        cursor.row &= term->grid->num_rows - 1;
+    }
+
+    const bool overflowing_glyphs = term->conf->tweak.overflowing_glyphs;
+    const int row_count = term->render.workers.row_count;
+    struct row_damage *rendered = term->render.workers.rendered;
 
-            term_ime_set_cursor_rect(
-                term, x, y, (end - start) * term->cell_width, term->cell_height);
+    xassert(term->render.workers.scratch_cols >= term->cols);
+    const size_t scratch_ofs =
+        (size_t)my_id * term->render.workers.scratch_cols;
+    struct cell_render *cells = &term->render.workers.scratch_cells[scratch_ofs];
+    wchar_t *text = &term->render.workers.scratch_text[scratch_ofs];
+
+    while (true) {
+        const int r = atomic_fetch_add_explicit(
+            &term->render.workers.next_row, 1, memory_order_relaxed);
+
+        if (r >= row_count)
+            break;
+
+        struct row *row = grid_row_in_view(term->grid, r);
+
+        if (!row->dirty) {
+            rendered[r] = (struct row_damage){0};
+            continue;
         }
-    }
 
-    /* Restore original content (but do not render) */
-    for (int i = 0; i < cells_used; i++)
-        row->cells[col_idx + i] = real_cells[i];
-    free(real_cells);
+        row->dirty = false;
 
-    wl_surface_damage_buffer(
-        term->window->surface,
-        term->margins.left,
-        term->margins.top + row_idx * term->cell_height,
-        term->width - term->margins.left - term->margins.right,
-        1 * term->cell_height);
+        if (overflowing_glyphs)
+            dirty_overflowing_cells(term, row);
+
+        int cursor_col = cursor.row == r ? cursor.col : -1;
+        rendered[r] = render_row(term, pix, row, r, cursor_col, cells, text);
+    }
 }
-#endif
 
-static void
-render_ime_preedit(struct terminal *term, struct buffer *buf)
+/*
+ * Grows the render threads’ scratch memory (see render_row()) to fit
+ * the current number of columns.
+ */
+void
+render_resize_scratch(struct terminal *term)
 {
-#if defined(FOOT_IME_ENABLED) && FOOT_IME_ENABLED
-    tll_foreach(term->wl->seats, it) {
-        if (it->item.kbd_focus == term)
-            render_ime_preedit_for_seat(term, &it->item, buf);
-    }
-#endif
+    if (term->render.workers.scratch_cols >= term->cols)
+        return;
+
+    const size_t count =
+        (size_t)(term->render.workers.count + 1) * term->cols;
+
+    term->render.workers.scratch_cells = xrealloc(
+        term->render.workers.scratch_cells,
+        count * sizeof(term->render.workers.scratch_cells[0]));
+    term->render.workers.scratch_text = xrealloc(
+        term->render.workers.scratch_text,
+        count * sizeof(term->render.workers.scratch_text[0]));
+    term->render.workers.scratch_cols = term->cols;
 }
 
 int
@@ -1504,50 +2256,18 @@ render_worker_thread(void *_ctx)
 
     sem_t *start = &term->render.workers.start;
     sem_t *done = &term->render.workers.done;
-    mtx_t *lock = &term->render.workers.lock;
 
     while (true) {
         sem_wait(start);
 
-        struct buffer *buf = term->render.workers.buf;
-        bool frame_done = false;
-
-        /* Translate offset-relative cursor row to view-relative */
-        struct coord cursor = {-1, -1};
-        if (!term->hide_cursor) {
-            cursor = term->grid->cursor.point;
-            cursor.row += term->grid->offset;
-            cursor.row -= term->grid->view;
-            cursor.row &= term->grid->num_rows - 1;
-        }
-
-        while (!frame_done) {
-            mtx_lock(lock);
-            xassert(tll_length(term->render.workers.queue) > 0);
-
-            int row_no = tll_pop_front(term->render.workers.queue);
-            mtx_unlock(lock);
-
-            switch (row_no) {
-            default: {
-                xassert(buf != NULL);
-
-                struct row *row = grid_row_in_view(term->grid, row_no);
-                int cursor_col = cursor.row == row_no ? cursor.col : -1;
+        if (term->render.workers.quit)
+            return 0;
 
-                render_row(term, buf->pix[my_id], row, row_no, cursor_col);
-                break;
-            }
-
-            case -1:
-                frame_done = true;
-                sem_post(done);
-                break;
+        struct buffer *buf = term->render.workers.buf;
+        xassert(buf != NULL);
 
-            case -2:
-                return 0;
-            }
-        }
+        render_claimed_rows(term, buf->pix[my_id], my_id);
+        sem_post(done);
     };
 
     return -1;
@@ -2326,15 +3046,136 @@ static const struct wl_callback_listener frame_listener = {
 };
 
 static void
-force_full_repaint(struct terminal *term, struct buffer *buf)
+force_full_repaint(struct terminal *term, struct buffer *buf,
+                   pixman_region32_t *damage)
 {
     tll_free(term->grid->scroll_damage);
-    render_margin(term, buf, 0, term->rows, true);
+    render_margin(term, buf, 0, term->rows, damage);
     term_damage_view(term);
 }
 
+/* Scroll damage is not applied when the viewport is in the scrollback */
+static bool
+scroll_damage_applies(const struct terminal *term, const struct damage *dmg)
+{
+    switch (dmg->type) {
+    case DAMAGE_SCROLL:
+    case DAMAGE_SCROLL_REVERSE:
+        return term->grid->view == term->grid->offset;
+
+    case DAMAGE_SCROLL_IN_VIEW:
+    case DAMAGE_SCROLL_REVERSE_IN_VIEW:
+        return true;
+    }
+
+    BUG("Invalid damage type");
+    return false;
+}
+
+static void
+render_scroll_damage(struct terminal *term, struct buffer *buf,
+                     const struct damage *dmg, bool replay,
+                     pixman_region32_t *damage)
+{
+    switch (dmg->type) {
+    case DAMAGE_SCROLL:
+    case DAMAGE_SCROLL_IN_VIEW:
+        grid_render_scroll(term, buf, dmg, replay, damage);
+        break;
+
+    case DAMAGE_SCROLL_REVERSE:
+    case DAMAGE_SCROLL_REVERSE_IN_VIEW:
+        grid_render_scroll_reverse(term, buf, dmg, replay, damage);
+        break;
+    }
+}
+
+/*
+ * Transforms ‘region’ (buffer coordinates) through the pixel moves
+ * done by grid_render_scroll() and grid_render_scroll_reverse().
+ *
+ * Forward, ‘region’ is moved along with the pixels it covers. Pixels
+ * scrolled out are dropped, and the rows vacated by the scroll (whose
+ * content is undefined until re-rendered) are added.
+ *
+ * Inverse, ‘region’ is mapped back to the pixels that end up in it.
+ */
+static void
+region_scroll(const struct terminal *term, const struct buffer *buf,
+              pixman_region32_t *region, const struct damage *dmg,
+              bool inverse)
+{
+    const bool reverse =
+        dmg->type == DAMAGE_SCROLL_REVERSE ||
+        dmg->type == DAMAGE_SCROLL_REVERSE_IN_VIEW;
+
+    const int top = term->margins.top + dmg->region.start * term->cell_height;
+    const int bottom = term->margins.top + dmg->region.end * term->cell_height;
+    const int lines = min(dmg->lines * term->cell_height, bottom - top);
+    const int height = bottom - top - lines;
+
+    /* Source, destination and vacated pixel rows */
+    const int src_y = reverse ? top : top + lines;
+    const int dst_y = reverse ? top + lines : top;
+    const int vacated_y = reverse ? top : bottom - lines;
+
+    pixman_region32_t moved, vacated;
+    pixman_region32_init(&moved);
+    pixman_region32_init(&vacated);
+
+    if (!inverse) {
+        pixman_region32_intersect_rect(
+            &moved, region, 0, src_y, buf->width, height);
+        pixman_region32_translate(&moved, 0, dst_y - src_y);
+        pixman_region32_init_rect(&vacated, 0, vacated_y, buf->width, lines);
+    } else {
+        pixman_region32_intersect_rect(
+            &moved, region, 0, dst_y, buf->width, height);
+        pixman_region32_translate(&moved, 0, src_y - dst_y);
+        pixman_region32_intersect_rect(
+            &vacated, region, 0, vacated_y, buf->width, lines);
+    }
+
+    pixman_region32_t scrolled;
+    pixman_region32_init_rect(&scrolled, 0, top, buf->width, bottom - top);
+    pixman_region32_subtract(region, region, &scrolled);
+    pixman_region32_union(region, region, &moved);
+    pixman_region32_union(region, region, &vacated);
+
+    pixman_region32_fini(&scrolled);
+    pixman_region32_fini(&vacated);
+    pixman_region32_fini(&moved);
+}
+
+void
+render_damage_history_destroy(struct terminal *term)
+{
+    for (size_t i = 0; i < ALEN(term->render.damage_history.frames); i++) {
+        free(term->render.damage_history.frames[i].scroll);
+        term->render.damage_history.frames[i].scroll = NULL;
+        pixman_region32_fini(&term->render.damage_history.frames[i].dirty);
+    }
+
+    term->render.damage_history.count = 0;
+}
+
+/* Returns the frame ‘age’ frames before the newest one */
+static inline size_t
+damage_history_idx(const struct terminal *term, size_t age)
+{
+    const size_t size = ALEN(term->render.damage_history.frames);
+    return (term->render.damage_history.head + size - age) % size;
+}
+
+/*
+ * Brings ‘new’ up to date with ‘old’ (the last frame), by replaying
+ * the scroll damage of the frames rendered since ‘new’ was last used,
+ * and copying what those frames rendered from ‘old’. Pixels this
+ * frame will re-render anyway are not copied.
+ */
 static void
-reapply_old_damage(struct terminal *term, struct buffer *new, struct buffer *old)
+reapply_old_damage(struct terminal *term, struct buffer *new, struct buffer *old,
+                   pixman_region32_t *damage)
 {
     static int counter = 0;
     static bool have_warned = false;
@@ -2344,24 +3185,18 @@ reapply_old_damage(struct terminal *term, struct buffer *new, struct buffer *old
         have_warned = true;
     }
 
-    if (new->age > 1) {
+    bool history_complete = new->age <= term->render.damage_history.count;
+    for (size_t i = 0; history_complete && i < new->age; i++) {
+        const size_t idx = damage_history_idx(term, i);
+        history_complete = term->render.damage_history.frames[idx].valid;
+    }
+
+    if (!history_complete) {
         memcpy(new->data, old->data, new->height * new->stride);
         return;
     }
 
-    /*
-     * TODO: remove this frame’s damage from the region we copy from
-     * the old frame.
-     *
-     * - this frame’s dirty region is only valid *after* we’ve applied
-     *   its scroll damage.
-     * - last frame’s dirty region is only valid *before* we’ve
-     *   applied this frame’s scroll damage.
-     *
-     * Can we transform one of the regions? It’s not trivial, since
-     * scroll damage isn’t just about counting lines; there may be
-     * multiple damage records, each with different scrolling regions.
-     */
+    /* Rows this frame will render in their entirety */
     pixman_region32_t dirty;
     pixman_region32_init(&dirty);
 
@@ -2370,16 +3205,9 @@ reapply_old_damage(struct terminal *term, struct buffer *new, struct buffer *old
     for (int r = 0; r < term->rows; r++) {
         const struct row *row = grid_row_in_view(term->grid, r);
 
-        bool row_all_dirty = true;
-        for (int c = 0; c < term->cols; c++) {
-            if (row->cells[c].attrs.clean) {
-                row_all_dirty = false;
-                full_repaint_needed = false;
-                break;
-            }
-        }
-
-        if (row_all_dirty) {
+        if (!grid_row_all_dirty(row, term->cols))
+            full_repaint_needed = false;
+        else {
             pixman_region32_union_rect(
                 &dirty, &dirty,
                 term->margins.left,
@@ -2390,45 +3218,66 @@ reapply_old_damage(struct terminal *term, struct buffer *new, struct buffer *old
     }
 
     if (full_repaint_needed) {
-        force_full_repaint(term, new);
+        pixman_region32_fini(&dirty);
+        force_full_repaint(term, new, damage);
         return;
     }
 
-    for (size_t i = 0; i < old->scroll_damage_count; i++) {
-        const struct damage *dmg = &old->scroll_damage[i];
+    /*
+     * Replay the missed frames, oldest first. Each frame's scroll
+     * damage moves what is already known to differ from ‘old’, and
+     * the rows it rendered are added.
+     *
+     * The replayed scrolling only brings ‘new’ up to date with what
+     * the compositor already has; it is not surface damage.
+     */
+    pixman_region32_t copy, replay_damage;
+    pixman_region32_init(&copy);
+    pixman_region32_init(&replay_damage);
+
+    for (size_t age = new->age; age > 0; age--) {
+        const size_t idx = damage_history_idx(term, age - 1);
+        const struct damage *scroll =
+            term->render.damage_history.frames[idx].scroll;
+        const size_t scroll_count =
+            term->render.damage_history.frames[idx].scroll_count;
+
+        for (size_t i = 0; i < scroll_count; i++) {
+            region_scroll(term, new, &copy, &scroll[i], false);
+            render_scroll_damage(term, new, &scroll[i], true, &replay_damage);
+        }
 
-        switch (dmg->type) {
-        case DAMAGE_SCROLL:
-            if (term->grid->view == term->grid->offset)
-                grid_render_scroll(term, new, dmg);
-            break;
+        pixman_region32_union(
+            &copy, &copy, &term->render.damage_history.frames[idx].dirty);
+    }
 
-        case DAMAGE_SCROLL_REVERSE:
-            if (term->grid->view == term->grid->offset)
-                grid_render_scroll_reverse(term, new, dmg);
-            break;
+    pixman_region32_fini(&replay_damage);
 
-        case DAMAGE_SCROLL_IN_VIEW:
-            grid_render_scroll(term, new, dmg);
-            break;
+    /*
+     * This frame's dirty rows are only valid *after* its scroll
+     * damage has been applied. Map the pixels we need (i.e. those
+     * that are *not* re-rendered) back through the scroll damage, in
+     * reverse order, to get them in the last frame's coordinates.
+     */
+    pixman_region32_t keep;
+    pixman_region32_init_rect(&keep, 0, 0, new->width, new->height);
+    pixman_region32_subtract(&keep, &keep, &dirty);
 
-        case DAMAGE_SCROLL_REVERSE_IN_VIEW:
-            grid_render_scroll_reverse(term, new, dmg);
-            break;
-        }
+    tll_rforeach(term->grid->scroll_damage, it) {
+        if (scroll_damage_applies(term, &it->item))
+            region_scroll(term, new, &keep, &it->item, true);
     }
 
-    if (tll_length(term->grid->scroll_damage) == 0) {
-        pixman_region32_subtract(&dirty, &old->dirty, &dirty);
-        pixman_image_set_clip_region32(new->pix[0], &dirty);
-    } else
-        pixman_image_set_clip_region32(new->pix[0], &old->dirty);
+    pixman_region32_intersect(&copy, &copy, &keep);
+    pixman_image_set_clip_region32(new->pix[0], &copy);
 
     pixman_image_composite32(
         PIXMAN_OP_SRC, old->pix[0], NULL, new->pix[0],
         0, 0, 0, 0, 0, 0, term->width, term->height);
 
     pixman_image_set_clip_region32(new->pix[0], NULL);
+    pixman_region32_fini(&keep);
+    pixman_region32_fini(&copy);
     pixman_region32_fini(&dirty);
 }
 
@@ -2437,8 +3286,7 @@ dirty_old_cursor(struct terminal *term)
 {
     if (term->render.last_cursor.row != NULL && !term->render.last_cursor.hidden) {
         struct row *row = term->render.last_cursor.row;
-        struct cell *cell = &row->cells[term->render.last_cursor.col];
-        cell->attrs.clean = 0;
+        grid_row_dirty_cell(row, term->render.last_cursor.col);
         row->dirty = true;
     }
 
@@ -2457,32 +3305,93 @@ dirty_cursor(struct terminal *term)
     const struct coord *cursor = &term->grid->cursor.point;
 
     struct row *row = grid_row(term->grid, cursor->row);
-    struct cell *cell = &row->cells[cursor->col];
-    cell->attrs.clean = 0;
+    grid_row_dirty_cell(row, cursor->col);
     row->dirty = true;
 }
 
+/*
+ * Damages the pixels repainted on each row, by the render workers.
+ *
+ * Consecutive rows are merged into a single rectangle, spanning all
+ * of them, as long as at least half of it has actually been
+ * repainted. This keeps the number of rectangles down when
+ * e.g. lines of varying length are printed, while a single changed
+ * cell only damages that cell.
+ */
 static void
-grid_render(struct terminal *term)
+damage_rendered_rows(const struct terminal *term, struct buffer *buf,
+                     pixman_region32_t *damage)
 {
-    if (term->shutdown.in_progress)
-        return;
+    const struct row_damage *rendered = term->render.workers.rendered;
+
+    /* Rectangle being built: rows [first_row, r), pixels [x1, x2) */
+    int first_row = -1;
+    int x1 = 0, x2 = 0;
+    int repainted = 0;  /* Sum of the rows’ widths */
+
+    for (int r = 0; r <= term->rows; r++) {
+        const bool empty =
+            r == term->rows || rendered[r].x2 <= rendered[r].x1;
+        const int width = empty ? 0 : rendered[r].x2 - rendered[r].x1;
+
+        if (!empty && first_row >= 0) {
+            const int merged_x1 = min(x1, rendered[r].x1);
+            const int merged_x2 = max(x2, rendered[r].x2);
+            const int rows = r - first_row + 1;
+
+            if ((merged_x2 - merged_x1) * rows <= 2 * (repainted + width)) {
+                x1 = merged_x1;
+                x2 = merged_x2;
+                repainted += width;
+                continue;
+            }
+        }
 
-    struct timespec start_time, start_double_buffering = {0}, stop_double_buffering = {0};
+        if (first_row >= 0) {
+            const int y = term->margins.top + first_row * term->cell_height;
+            const int height = (r - first_row) * term->cell_height;
 
-    if (term->conf->tweak.render_timer != RENDER_TIMER_NONE)
-        clock_gettime(CLOCK_MONOTONIC, &start_time);
+            pixman_region32_union_rect(damage, damage, x1, y, x2 - x1, height);
+            pixman_region32_union_rect(
+                &buf->dirty, &buf->dirty, x1, y, x2 - x1, height);
 
-    xassert(term->width > 0);
-    xassert(term->height > 0);
+            first_row = -1;
+        }
 
-    struct buffer_chain *chain = term->render.chains.grid;
-    struct buffer *buf = shm_get_buffer(chain, term->width, term->height);
+        if (!empty) {
+            first_row = r;
+            x1 = rendered[r].x1;
+            x2 = rendered[r].x2;
+            repainted = width;
+        }
+    }
+}
+
+/*
+ * Renders the grid (all dirty rows, scroll damage, sixels etc) to
+ * ‘buf’. Does *not* touch the Wayland surface; everything that needs
+ * to be damaged is added to ‘damage’.
+ */
+static void
+grid_render_to_buffer(struct terminal *term, struct buffer *buf,
+                      pixman_region32_t *damage,
+                      struct timespec *double_buffering_time)
+{
+    struct timespec start_double_buffering = {0}, stop_double_buffering = {0};
 
     /* Dirty old and current cursor cell, to ensure they’re repainted */
     dirty_old_cursor(term);
     dirty_cursor(term);
 
+    /* Record what the last frame rendered, now that it is complete */
+    if (term->render.last_buf != NULL && term->render.damage_history.count > 0) {
+        const size_t idx = term->render.damage_history.head;
+        pixman_region32_copy(
+            &term->render.damage_history.frames[idx].dirty,
+            &term->render.last_buf->dirty);
+        term->render.damage_history.frames[idx].valid = true;
+    }
+
     if (term->render.last_buf == NULL ||
         term->render.last_buf->width != buf->width ||
         term->render.last_buf->height != buf->height ||
@@ -2490,7 +3399,7 @@ grid_render(struct terminal *term)
         term->is_searching != term->render.was_searching ||
         term->render.margins)
     {
-        force_full_repaint(term, buf);
+        force_full_repaint(term, buf, damage);
     }
 
     else if (buf->age > 0) {
@@ -2502,7 +3411,7 @@ grid_render(struct terminal *term)
         xassert(term->render.last_buf->height == buf->height);
 
         clock_gettime(CLOCK_MONOTONIC, &start_double_buffering);
-        reapply_old_damage(term, buf, term->render.last_buf);
+        reapply_old_damage(term, buf, term->render.last_buf, damage);
         clock_gettime(CLOCK_MONOTONIC, &stop_double_buffering);
     }
 
@@ -2518,38 +3427,32 @@ grid_render(struct terminal *term)
     shm_addref(buf);
     buf->age = 0;
 
-    free(term->render.last_buf->scroll_damage);
-    buf->scroll_damage_count = tll_length(term->grid->scroll_damage);
-    buf->scroll_damage = xmalloc(
-        buf->scroll_damage_count * sizeof(buf->scroll_damage[0]));
+    struct damage *applied =
+        xmalloc(tll_length(term->grid->scroll_damage) * sizeof(applied[0]));
+    size_t applied_count = 0;
 
-    {
-        size_t i = 0;
-        tll_foreach(term->grid->scroll_damage, it) {
-            buf->scroll_damage[i++] = it->item;
-
-            switch (it->item.type) {
-            case DAMAGE_SCROLL:
-                if (term->grid->view == term->grid->offset)
-                    grid_render_scroll(term, buf, &it->item);
-                break;
+    tll_foreach(term->grid->scroll_damage, it) {
+        if (scroll_damage_applies(term, &it->item)) {
+            applied[applied_count++] = it->item;
+            render_scroll_damage(term, buf, &it->item, false, damage);
+        }
 
-            case DAMAGE_SCROLL_REVERSE:
-                if (term->grid->view == term->grid->offset)
-                    grid_render_scroll_reverse(term, buf, &it->item);
-                break;
+        tll_remove(term->grid->scroll_damage, it);
+    }
 
-            case DAMAGE_SCROLL_IN_VIEW:
-                grid_render_scroll(term, buf, &it->item);
-                break;
+    /* Start a new frame in the damage history */
+    {
+        const size_t size = ALEN(term->render.damage_history.frames);
+        const size_t idx = (term->render.damage_history.head + 1) % size;
 
-            case DAMAGE_SCROLL_REVERSE_IN_VIEW:
-                grid_render_scroll_reverse(term, buf, &it->item);
-                break;
-            }
+        free(term->render.damage_history.frames[idx].scroll);
+        term->render.damage_history.frames[idx].scroll = applied;
+        term->render.damage_history.frames[idx].scroll_count = applied_count;
+        term->render.damage_history.frames[idx].valid = false;
 
-            tll_remove(term->grid->scroll_damage, it);
-        }
+        term->render.damage_history.head = idx;
+        term->render.damage_history.count =
+            min(term->render.damage_history.count + 1, size);
     }
 
     /*
@@ -2571,6 +3474,9 @@ grid_render(struct terminal *term)
      */
     selection_dirty_cells(term);
 
+    if (unlikely(term->is_searching))
+        search_matches_update(term);
+
     /* Translate offset-relative row to view-relative, unless cursor
      * is hidden, then we just set it to -1 */
     struct coord cursor = {-1, -1};
@@ -2581,138 +3487,97 @@ grid_render(struct terminal *term)
         cursor.row &= term->grid->num_rows - 1;
     }
 
-    if (term->conf->tweak.overflowing_glyphs) {
-        /*
-         * Pre-pass to dirty cells affected by overflowing glyphs.
-         *
-         * Given any two pair of cells where the first cell is
-         * overflowing into the second, *both* cells must be
-         * re-rendered if any one of them is dirty.
-         *
-         * Thus, given a string of overflowing glyphs, with a single
-         * dirty cell in the middle, we need to re-render the entire
-         * string.
-         */
-        for (int r = 0; r < term->rows; r++) {
-            struct row *row = grid_row_in_view(term->grid, r);
+    /* Sixels are not part of the rows’ damage; add it explicitly,
+     * to ensure it is copied to the next frame’s buffer */
+    pixman_region32_t sixel_damage;
+    pixman_region32_init(&sixel_damage);
+    render_sixel_images(term, buf->pix[0], &cursor, &sixel_damage);
+    pixman_region32_union(damage, damage, &sixel_damage);
+    pixman_region32_union(&buf->dirty, &buf->dirty, &sixel_damage);
+    pixman_region32_fini(&sixel_damage);
+
+    if (term->render.workers.rendered_size < (size_t)term->rows) {
+        term->render.workers.rendered_size = term->rows;
+        term->render.workers.rendered = xrealloc(
+            term->render.workers.rendered,
+            term->rows * sizeof(term->render.workers.rendered[0]));
+    }
 
-            if (!row->dirty)
-                continue;
+    term->render.workers.buf = buf;
+    term->render.workers.row_count = term->rows;
+    atomic_store_explicit(
+        &term->render.workers.next_row, 0, memory_order_relaxed);
 
-            /* Loop row from left to right, looking for dirty cells */
-            for (struct cell *cell = &row->cells[0];
-                 cell < &row->cells[term->cols];
-                 cell++)
-            {
-                if (cell->attrs.clean)
-                    continue;
+    for (size_t i = 0; i < term->render.workers.count; i++)
+        sem_post(&term->render.workers.start);
 
-                /*
-                 * Cell is dirty, go back and dirty previous cells, if
-                 * they are overflowing.
-                 *
-                 * As soon as we see a non-overflowing cell we can
-                 * stop, since it isn’t affecting the string of
-                 * overflowing glyphs that follows it.
-                 *
-                 * As soon as we see a dirty cell, we can stop, since
-                 * that means we’ve already handled it (remember the
-                 * outer loop goes from left to right).
-                 */
-                for (struct cell *c = cell - 1; c >= &row->cells[0]; c--) {
-                    if (c->attrs.confined)
-                        break;
-                    if (!c->attrs.clean)
-                        break;
-                    c->attrs.clean = false;
-                }
+    /* The main thread renders rows too, and then waits for the
+     * workers to finish their last row */
+    render_claimed_rows(term, buf->pix[0], 0);
 
-                /*
-                 * Now move forward, dirtying all cells until we hit a
-                 * non-overflowing cell.
-                 *
-                 * Note that the first non-overflowing cell must be
-                 * re-rendered as well, but any cell *after* that is
-                 * unaffected by the string of overflowing glyphs
-                 * we’re dealing with right now.
-                 *
-                 * For performance, this iterates the *outer* loop’s
-                 * cell pointer - no point in re-checking all these
-                 * glyphs again, in the outer loop.
-                 */
-                for (; cell < &row->cells[term->cols]; cell++) {
-                    cell->attrs.clean = false;
-                    if (cell->attrs.confined)
-                        break;
-                }
-            }
-        }
-    }
+    for (size_t i = 0; i < term->render.workers.count; i++)
+        sem_wait(&term->render.workers.done);
+    term->render.workers.buf = NULL;
 
-    render_sixel_images(term, buf->pix[0], &cursor);
+    damage_rendered_rows(term, buf, damage);
 
-    if (term->render.workers.count > 0) {
-        mtx_lock(&term->render.workers.lock);
-        term->render.workers.buf = buf;
-        for (size_t i = 0; i < term->render.workers.count; i++)
-            sem_post(&term->render.workers.start);
+    timespec_sub(&stop_double_buffering, &start_double_buffering,
+                 double_buffering_time);
+}
 
-        xassert(tll_length(term->render.workers.queue) == 0);
-    }
+void
+grid_render_offscreen(struct terminal *term)
+{
+    xassert(term->width > 0);
+    xassert(term->height > 0);
 
-    int first_dirty_row = -1;
-    for (int r = 0; r < term->rows; r++) {
-        struct row *row = grid_row_in_view(term->grid, r);
+    struct buffer *buf = shm_get_buffer(
+        term->render.chains.grid, term->width, term->height);
 
-        if (!row->dirty) {
-            if (first_dirty_row >= 0) {
-                int x = term->margins.left;
-                int y = term->margins.top + first_dirty_row * term->cell_height;
-                int width = term->width - term->margins.left - term->margins.right;
-                int height = (r - first_dirty_row) * term->cell_height;
-
-                wl_surface_damage_buffer(
-                    term->window->surface, x, y, width, height);
-                pixman_region32_union_rect(
-                    &buf->dirty, &buf->dirty, 0, y, buf->width, height);
-            }
-            first_dirty_row = -1;
-            continue;
-        }
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
 
-        if (first_dirty_row < 0)
-            first_dirty_row = r;
+    struct timespec double_buffering_time;
+    grid_render_to_buffer(term, buf, &damage, &double_buffering_time);
 
-        row->dirty = false;
+    pixman_region32_fini(&damage);
+}
 
-        if (term->render.workers.count > 0)
-            tll_push_back(term->render.workers.queue, r);
+static void
+grid_render(struct terminal *term)
+{
+    if (term->shutdown.in_progress)
+        return;
 
-        else {
-            int cursor_col = cursor.row == r ? cursor.col : -1;
-            render_row(term, buf->pix[0], row, r, cursor_col);
-        }
-    }
+    struct timespec start_time;
 
-    if (first_dirty_row >= 0) {
-        int x = term->margins.left;
-        int y = term->margins.top + first_dirty_row * term->cell_height;
-        int width = term->width - term->margins.left - term->margins.right;
-        int height = (term->rows - first_dirty_row) * term->cell_height;
+    if (term->conf->tweak.render_timer != RENDER_TIMER_NONE)
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
 
-        wl_surface_damage_buffer(term->window->surface, x, y, width, height);
-        pixman_region32_union_rect(&buf->dirty, &buf->dirty, 0, y, buf->width, height);
-    }
+    xassert(term->width > 0);
+    xassert(term->height > 0);
 
-    /* Signal workers the frame is done */
-    if (term->render.workers.count > 0) {
-        for (size_t i = 0; i < term->render.workers.count; i++)
-            tll_push_back(term->render.workers.queue, -1);
-        mtx_unlock(&term->render.workers.lock);
+    struct buffer_chain *chain = term->render.chains.grid;
+    struct buffer *buf = shm_get_buffer(chain, term->width, term->height);
+
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
+
+    struct timespec double_buffering_time;
+    grid_render_to_buffer(term, buf, &damage, &double_buffering_time);
 
-        for (size_t i = 0; i < term->render.workers.count; i++)
-            sem_wait(&term->render.workers.done);
-        term->render.workers.buf = NULL;
+    {
+        int n_rects;
+        const pixman_box32_t *rects = pixman_region32_rectangles(&damage, &n_rects);
+
+        for (int i = 0; i < n_rects; i++) {
+            wl_surface_damage_buffer(
+                term->window->surface,
+                rects[i].x1, rects[i].y1,
+                rects[i].x2 - rects[i].x1, rects[i].y2 - rects[i].y1);
+        }
+
+        pixman_region32_fini(&damage);
     }
 
     /* Render IME pre-edit text */
@@ -2739,19 +3604,43 @@ grid_render(struct terminal *term)
         struct timespec render_time;
         timespec_sub(&end_time, &start_time, &render_time);
 
-        struct timespec double_buffering_time;
-        timespec_sub(&stop_double_buffering, &start_double_buffering, &double_buffering_time);
-
         switch (term->conf->tweak.render_timer) {
         case RENDER_TIMER_LOG:
-        case RENDER_TIMER_BOTH:
+        case RENDER_TIMER_BOTH: {
+            uint64_t hits, misses;
+            glyph_run_cache_stats(&term->render.glyph_runs, &hits, &misses);
+
+            const int crossover = scroll_cost_crossover(term);
+            char crossover_str[32] = "unknown";
+            if (crossover >= 0) {
+                snprintf(crossover_str, sizeof(crossover_str),
+                         "%d lines", crossover);
+            }
+
             LOG_INFO("frame rendered in %lds %ldns "
-                     "(%lds %ldns double buffering)",
+                     "(%lds %ldns double buffering, "
+                     "glyph run cache: %llu hits, %llu misses, "
+                     "PTY reads throttled %llu times, "
+                     "scrolled %llu times using memmove in %lluns, "
+                     "%llu times using SHM in %lluns, "
+                     "SHM scrolling cut-off: %s)",
                      (long)render_time.tv_sec,
                      render_time.tv_nsec,
                      (long)double_buffering_time.tv_sec,
-                     double_buffering_time.tv_nsec);
+                     double_buffering_time.tv_nsec,
+                     (unsigned long long)hits,
+                     (unsigned long long)misses,
+                     (unsigned long long)term->ptmx_stats.throttled,
+                     (unsigned long long)term->render.scroll_cost.stats[false].count,
+                     (unsigned long long)term->render.scroll_cost.stats[false].ns,
+                     (unsigned long long)term->render.scroll_cost.stats[true].count,
+                     (unsigned long long)term->render.scroll_cost.stats[true].ns,
+                     crossover_str);
+
+            memset(term->render.scroll_cost.stats, 0,
+                   sizeof(term->render.scroll_cost.stats));
             break;
+        }
 
         case RENDER_TIMER_OSD:
         case RENDER_TIMER_NONE:
@@ -2816,6 +3705,42 @@ grid_render(struct terminal *term)
 
     wl_surface_attach(term->window->surface, buf->wl_buf, 0, 0);
     wl_surface_commit(term->window->surface);
+
+    /* Rows may have been thawed, e.g. when scrolled into view */
+    term_cold_scrollback_sweep(term);
+}
+
+static void
+render_search_box_glyph(struct terminal *term, pixman_image_t *pix,
+                        struct fcft_font *font, const pixman_color_t *fg,
+                        wchar_t wc, int width, int x, int y)
+{
+    const struct fcft_glyph *glyph = fcft_glyph_rasterize(
+        font, wc, term->font_subpixel);
+
+    if (glyph == NULL)
+        return;
+
+    if (unlikely(pixman_image_get_format(glyph->pix) == PIXMAN_a8r8g8b8)) {
+        /* Glyph surface is a pre-rendered image (typically a color emoji...) */
+        pixman_image_composite32(
+            PIXMAN_OP_OVER, glyph->pix, NULL, pix, 0, 0, 0, 0,
+            x + glyph->x, y + font_baseline(term) - glyph->y,
+            glyph->width, glyph->height);
+    } else {
+        int combining_ofs = width == 0
+            ? (glyph->x < 0
+               ? width * term->cell_width
+               : (width - 1) * term->cell_width)
+            : 0;  /* Not a zero-width character - no additional offset */
+        pixman_image_t *src = pixman_image_create_solid_fill(fg);
+        pixman_image_composite32(
+            PIXMAN_OP_OVER, src, glyph->pix, pix, 0, 0, 0, 0,
+            x + combining_ofs + glyph->x,
+            y + font_baseline(term) - glyph->y,
+            glyph->width, glyph->height);
+        pixman_image_unref(src);
+    }
 }
 
 static void
@@ -2874,7 +3799,32 @@ render_search_box(struct terminal *term)
     widths[text_len] = 0;
 
     const size_t total_cells = wcswidth(text, text_len);
-    const size_t wanted_visible_cells = max(20, total_cells);
+
+    /* Highlight all matches in view, and count all matches */
+    if (search_matches_update(term))
+        render_refresh(term);
+    if (!search_count_matches(term))
+        render_refresh_search(term);
+
+    /* The counter is prefixed with the search mode, in regex mode */
+    const wchar_t *mode = term->search.regex.enabled ? L"regex" : L"";
+
+    wchar_t counter[64] = L"";
+    size_t counter_len = 0;
+    if (term->search.counter.valid) {
+        int ret = swprintf(
+            counter, ALEN(counter), L"%ls%ls%zu/%zu",
+            mode, mode[0] != L'\0' ? L" " : L"",
+            term->search.counter.index, term->search.counter.total);
+        counter_len = ret > 0 ? ret : 0;
+    } else if (mode[0] != L'\0') {
+        int ret = swprintf(counter, ALEN(counter), L"%ls", mode);
+        counter_len = ret > 0 ? ret : 0;
+    }
+
+    /* The counter is separated from the search string by one cell */
+    const size_t counter_cells = counter_len > 0 ? counter_len + 1 : 0;
+    const size_t wanted_visible_cells = max(20, total_cells) + counter_cells;
 
     xassert(term->scale >= 1);
     const int scale = term->scale;
@@ -2889,7 +3839,14 @@ render_search_box(struct terminal *term)
         term->height - 2 * margin,
         (2 * margin + 1 * term->cell_height + scale - 1) / scale * scale);
 
-    const size_t visible_cells = (visible_width - 2 * margin) / term->cell_width;
+    size_t visible_cells = (visible_width - 2 * margin) / term->cell_width;
+    if (visible_cells > counter_cells)
+        visible_cells -= counter_cells;
+    else {
+        /* Window too narrow for the counter */
+        counter_len = 0;
+    }
+
     size_t glyph_offset = term->render.search_glyph_offset;
 
     struct buffer_chain *chain = term->render.chains.search;
@@ -3070,39 +4027,20 @@ render_search_box(struct terminal *term)
             continue;
         }
 
-        const struct fcft_glyph *glyph = fcft_glyph_rasterize(
-            font, text[i], term->font_subpixel);
-
-        if (glyph == NULL) {
-            cell_idx = next_cell_idx;
-            continue;
-        }
-
-        if (unlikely(pixman_image_get_format(glyph->pix) == PIXMAN_a8r8g8b8)) {
-            /* Glyph surface is a pre-rendered image (typically a color emoji...) */
-            pixman_image_composite32(
-                PIXMAN_OP_OVER, glyph->pix, NULL, buf->pix[0], 0, 0, 0, 0,
-                x + x_ofs + glyph->x, y + font_baseline(term) - glyph->y,
-                glyph->width, glyph->height);
-        } else {
-            int combining_ofs = width == 0
-                ? (glyph->x < 0
-                   ? width * term->cell_width
-                   : (width - 1) * term->cell_width)
-                : 0;  /* Not a zero-width character - no additional offset */
-            pixman_image_t *src = pixman_image_create_solid_fill(&fg);
-            pixman_image_composite32(
-                PIXMAN_OP_OVER, src, glyph->pix, buf->pix[0], 0, 0, 0, 0,
-                x + x_ofs + combining_ofs + glyph->x,
-                y + font_baseline(term) - glyph->y,
-            glyph->width, glyph->height);
-            pixman_image_unref(src);
-        }
+        render_search_box_glyph(
+            term, buf->pix[0], font, &fg, text[i], width, x + x_ofs, y);
 
         x += width * term->cell_width;
         cell_idx = next_cell_idx;
     }
 
+    /* Match counter, right aligned */
+    for (size_t i = 0; i < counter_len; i++) {
+        render_search_box_glyph(
+            term, buf->pix[0], font, &fg, counter[i], 1,
+            x_left + x_ofs + (visible_cells + 1 + i) * term->cell_width, y);
+    }
+
 #if defined(FOOT_IME_ENABLED) && FOOT_IME_ENABLED
         if (ime_seat != NULL && ime_seat->ime.preedit.cells != NULL)
             /* Already rendered */;
@@ -3680,12 +4618,46 @@ maybe_resize(struct terminal *term, int width, int height, bool force)
         &term->selection.end,
     };
 
+    /* Streams must not reference rows we’re about to free */
+    term_scrollback_streams_detach(term);
+    search_index_invalidate(term, 0, term->normal.num_rows);
+
+    /* Large scrollbacks are reflowed in parallel, but there is
+     * nothing to gain from more threads than there are CPUs */
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const size_t reflow_threads =
+        min((long)term->render.workers.count, max(cpus - 1, 0L));
+
+    const bool time_reflow =
+        term->conf->tweak.render_timer == RENDER_TIMER_LOG ||
+        term->conf->tweak.render_timer == RENDER_TIMER_BOTH;
+
+    struct timespec reflow_start;
+    if (time_reflow)
+        clock_gettime(CLOCK_MONOTONIC, &reflow_start);
+
+    const int old_normal_grid_rows = term->normal.num_rows;
+
     /* Resize grids */
     grid_resize_and_reflow(
-        &term->normal, new_normal_grid_rows, new_cols, old_rows, new_rows,
+        &term->normal, reflow_threads,
+        new_normal_grid_rows, new_cols, old_rows, new_rows,
         term->selection.end.row >= 0 ? ALEN(tracking_points) : 0,
         tracking_points);
 
+    if (time_reflow) {
+        struct timespec reflow_end;
+        clock_gettime(CLOCK_MONOTONIC, &reflow_end);
+
+        struct timespec reflow_time;
+        timespec_sub(&reflow_end, &reflow_start, &reflow_time);
+
+        LOG_INFO("reflowed %d -> %d rows in %lds %ldns",
+                 old_normal_grid_rows, new_normal_grid_rows,
+                 (long)reflow_time.tv_sec,
+                 reflow_time.tv_nsec);
+    }
+
     grid_resize_without_reflow(
         &term->alt, new_alt_grid_rows, new_cols, old_rows, new_rows);
 
@@ -3697,8 +4669,12 @@ maybe_resize(struct terminal *term, int width, int height, bool force)
     term->cols = new_cols;
     term->rows = new_rows;
 
+    render_resize_scratch(term);
     sixel_reflow(term);
 
+    /* Reflowed rows are hot; re-freeze them in the background */
+    term_cold_scrollback_sweep(term);
+
 #if defined(_DEBUG) && LOG_ENABLE_DBG
     LOG_DBG("resize: %dx%d, grid: cols=%d, rows=%d "
             "(left-margin=%d, right-margin=%d, top-margin=%d, bottom-margin=%d)",
@@ -3752,6 +4728,7 @@ damage_view:
 
     shm_unref(term->render.last_buf);
     term->render.last_buf = NULL;
+    glyph_run_cache_flush(&term->render.glyph_runs);
     term_damage_view(term);
     render_refresh_csd(term);
     render_refresh_search(term);
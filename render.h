@@ -19,6 +19,11 @@ void render_refresh_search(struct terminal *term);
 void render_refresh_title(struct terminal *term);
 void render_refresh_urls(struct terminal *term);
 bool render_xcursor_set(struct seat *seat, struct terminal *term, const char *xcursor);
+void render_damage_history_destroy(struct terminal *term);
+void render_resize_scratch(struct terminal *term);
+
+/* Renders the grid into an off-screen buffer (foot-render-bench) */
+void grid_render_offscreen(struct terminal *term);
 
 struct render_worker_context {
     int my_id;
@@ -15,6 +15,7 @@
 #include "grid.h"
 #include "input.h"
 #include "misc.h"
+#include "regex.h"
 #include "render.h"
 #include "selection.h"
 #include "shm.h"
@@ -88,6 +89,29 @@ has_wrapped_around(const struct terminal *term, int abs_row_no)
     return rebased_row == 0;
 }
 
+/* Logical lines, i.e. rows joined by soft-wraps */
+static bool
+row_is_line_start(const struct terminal *term, int row_no)
+{
+    if (has_wrapped_around(term, row_no))
+        return true;
+
+    const struct row *prev =
+        term->grid->rows[(row_no - 1) & (term->grid->num_rows - 1)];
+    return prev == NULL || prev->linebreak;
+}
+
+static bool
+row_is_line_end(const struct terminal *term, int row_no)
+{
+    const struct row *row = term->grid->rows[row_no];
+    const int next_row_no = (row_no + 1) & (term->grid->num_rows - 1);
+
+    return row == NULL || row->linebreak ||
+        term->grid->rows[next_row_no] == NULL ||
+        has_wrapped_around(term, next_row_no);
+}
+
 static void
 search_cancel_keep_selection(struct terminal *term)
 {
@@ -108,6 +132,33 @@ search_cancel_keep_selection(struct terminal *term)
     term->search.match = (struct coord){-1, -1};
     term->search.match_len = 0;
     term->is_searching = false;
+
+    free(term->search.row_index.bits);
+    term->search.row_index.bits = NULL;
+    term->search.row_index.size = 0;
+    free(term->search.highlight.bits);
+    free(term->search.highlight.scratch);
+    term->search.highlight.bits = NULL;
+    term->search.highlight.scratch = NULL;
+
+    free(term->search.counter.query);
+    free(term->search.counter.row_matches);
+    memset(&term->search.counter, 0, sizeof(term->search.counter));
+
+    regex_destroy(term->search.regex.re);
+    regex_destroy(term->search.regex.re_reversed);
+    free(term->search.regex.pattern);
+    free(term->search.regex.line.matches);
+    free(term->search.regex.line.starts);
+    term->search.regex.re = NULL;
+    term->search.regex.re_reversed = NULL;
+    term->search.regex.pattern = NULL;
+    term->search.regex.pattern_len = 0;
+    term->search.regex.compiled = false;
+    term->search.regex.line.matches = NULL;
+    term->search.regex.line.count = term->search.regex.line.size = 0;
+    term->search.regex.line.starts = NULL;
+    term->search.regex.line.starts_size = 0;
     term->render.search_glyph_offset = 0;
 
     /* Reset IME state */
@@ -215,6 +266,7 @@ search_update_selection(struct terminal *term,
 
         /* Update view */
         term->grid->view = new_view;
+        grid_thaw_view(term->grid, term->rows);
         if (new_view != old_view)
             term_damage_view(term);
     }
@@ -251,6 +303,618 @@ search_update_selection(struct terminal *term,
     }
 }
 
+/*
+ * Row index
+ *
+ * While searching, we lazily build a 64-bit filter for each row in
+ * the scrollback, with one bit set for each (case folded) character
+ * in the row. This lets us skip rows that cannot contain a match
+ * without looking at their cells.
+ *
+ * Screen rows are never indexed, since they may change at any
+ * time. Scrollback rows only change when they are re-used as screen
+ * rows, at which point the terminal calls search_index_invalidate().
+ *
+ * Only the normal grid is indexed; the alt screen has no scrollback,
+ * and its rows are not tracked. The index is invalidated whenever
+ * the screens are switched.
+ */
+#define ROW_INDEX_VALID (1ull << 63)
+
+static uint64_t
+row_index_bit(wchar_t wc)
+{
+    return 1ull << ((uint32_t)towlower(wc) % 63);
+}
+
+static uint64_t
+row_index_build(const struct terminal *term, const struct row *row,
+                int used_cols)
+{
+    uint64_t bits = ROW_INDEX_VALID;
+
+    if (row == NULL)
+        return bits;
+
+    /* Cells past ‘used_cols’ are empty */
+    if (used_cols < term->cols)
+        bits |= row_index_bit(L' ');
+
+    for (int c = 0; c < used_cols; c++) {
+        wchar_t wc = row->cells[c].wc;
+
+        if (wc >= CELL_SPACER)
+            continue;
+
+        if (wc >= CELL_COMB_CHARS_LO && wc <= CELL_COMB_CHARS_HI) {
+            const struct composed *composed = composed_lookup(
+                term->composed, wc - CELL_COMB_CHARS_LO);
+
+            for (size_t i = 0; i < composed->count; i++)
+                bits |= row_index_bit(composed->chars[i]);
+            continue;
+        }
+
+        /* Empty cells match spaces, see matches_cell() */
+        bits |= row_index_bit(wc == 0 ? L' ' : wc);
+    }
+
+    return bits;
+}
+
+static uint64_t
+row_index_get(struct terminal *term, int abs_row_no)
+{
+    struct grid *grid = term->grid;
+    const int mask = grid->num_rows - 1;
+
+    if (((abs_row_no - grid->offset) & mask) < term->rows) {
+        /* Screen row - may match anything */
+        return UINT64_MAX;
+    }
+
+    uint64_t *bits = &term->search.row_index.bits[abs_row_no & mask];
+    if (!(*bits & ROW_INDEX_VALID))
+        *bits = row_index_build(
+            term, grid_row_peek(grid, abs_row_no),
+            min(grid_row_used_cols(grid, abs_row_no), term->cols));
+    return *bits;
+}
+
+static void
+row_index_ensure(struct terminal *term)
+{
+    /* The alt screen is small enough to not need an index */
+    if (term->grid == &term->normal &&
+        term->search.row_index.size != term->grid->num_rows)
+    {
+        free(term->search.row_index.bits);
+        term->search.row_index.bits = xcalloc(
+            term->grid->num_rows, sizeof(term->search.row_index.bits[0]));
+        term->search.row_index.size = term->grid->num_rows;
+    }
+}
+
+static void
+row_index_query_bits(const struct terminal *term,
+                     uint64_t *first_bit, uint64_t *query_bits)
+{
+    if (term->search.regex.enabled) {
+        *first_bit = term->search.regex.first_bits;
+        *query_bits = term->search.regex.required_bits;
+        return;
+    }
+
+    *first_bit = row_index_bit(term->search.buf[0]);
+    *query_bits = 0;
+    for (size_t i = 0; i < term->search.len; i++)
+        *query_bits |= row_index_bit(term->search.buf[i]);
+}
+
+static bool regex_row_may_match(struct terminal *term, int row_no);
+
+/*
+ * Returns false if it is certain that no match can *start* on the
+ * specified row.
+ */
+static bool
+row_may_match(struct terminal *term, int abs_row_no,
+              uint64_t first_bit, uint64_t query_bits)
+{
+    if (term->search.row_index.bits == NULL || term->grid != &term->normal)
+        return true;
+
+    uint64_t bits = row_index_get(term, abs_row_no);
+    if (!(bits & first_bit))
+        return false;
+
+    /* The match may continue on the next row(s); each search
+     * character consumes at most two cells (a wide character, and
+     * its spacer). Regex matches may continue to the end of the
+     * soft-wrapped line */
+    const bool regex = term->search.regex.enabled;
+    const int span = regex
+        ? term->grid->num_rows
+        : 1 + (2 * term->search.len + term->cols - 1) / term->cols;
+
+    const int mask = term->grid->num_rows - 1;
+
+    for (int i = 1; i < span && (bits & query_bits) != query_bits; i++) {
+        int row_no = (abs_row_no + i) & mask;
+        if (has_wrapped_around(term, row_no))
+            break;
+        if (regex && row_is_line_end(term, (row_no - 1) & mask))
+            break;
+        bits |= row_index_get(term, row_no);
+    }
+
+    if ((bits & query_bits) != query_bits)
+        return false;
+
+    /* In regex mode, the row's line is scanned for matches */
+    return !regex || regex_row_may_match(term, abs_row_no);
+}
+
+void
+search_index_invalidate(struct terminal *term, int start, int count)
+{
+    uint64_t *bits = term->search.row_index.bits;
+    if (bits == NULL)
+        return;
+
+    const int mask = term->search.row_index.size - 1;
+    count = min(count, term->search.row_index.size);
+
+    for (int i = 0; i < count; i++)
+        bits[(start + i) & mask] = 0;
+}
+
+UNITTEST
+{
+    const int grid_rows = 8;
+    const int term_rows = 2;
+    const int cols = 4;
+
+    struct terminal term = {
+        .rows = term_rows,
+        .cols = cols,
+        .normal = {
+            .rows = xcalloc(grid_rows, sizeof(term.normal.rows[0])),
+            .num_rows = grid_rows,
+            .num_cols = cols,
+            .offset = 6,  /* Screen is rows 6,7; scrollback 0-5 */
+        },
+        .search = {
+            .row_index = {
+                .bits = xcalloc(grid_rows, sizeof(uint64_t)),
+                .size = grid_rows,
+            },
+        },
+    };
+    term.grid = &term.normal;
+
+    const wchar_t *const text[] = {
+        L"abcd", L"efgh", L"ijkl", L"mnop", L"qrst", L"uvwx", L"yz", L"AB",
+    };
+
+    for (int r = 0; r < grid_rows; r++) {
+        struct row *row = grid_row_alloc(NULL, cols, true);
+        for (int c = 0; text[r][c] != L'\0'; c++)
+            row->cells[c].wc = text[r][c];
+        term.normal.rows[r] = row;
+    }
+
+    uint64_t first_bit, query_bits;
+
+#define may_match(row_no, query) (                                      \
+        term.search.buf = (wchar_t *)(query),                           \
+        term.search.len = wcslen(query),                                \
+        row_index_query_bits(&term, &first_bit, &query_bits),           \
+        row_may_match(&term, row_no, first_bit, query_bits))
+
+    xassert(may_match(0, L"bc"));
+    xassert(may_match(0, L"BC"));         /* Case insensitive */
+    xassert(may_match(0, L"cdef"));       /* Continues on next row */
+    xassert(!may_match(1, L"bc"));
+    xassert(!may_match(0, L"bz"));
+    xassert(may_match(6, L"qq"));         /* Screen rows always match */
+
+    /* Index entries are lazily built, and invalidated */
+    xassert(!(term.search.row_index.bits[2] & ROW_INDEX_VALID));
+    xassert(may_match(2, L"i"));
+    xassert(term.search.row_index.bits[2] & ROW_INDEX_VALID);
+    term.normal.rows[2]->cells[0].wc = L'Q';
+    xassert(!may_match(2, L"q"));
+    search_index_invalidate(&term, 2, 1);
+    xassert(may_match(2, L"q"));
+
+    /* The index only covers the normal grid */
+    term.grid = &term.alt;
+    xassert(may_match(1, L"bc"));
+    term.grid = &term.normal;
+
+#undef may_match
+
+    for (int r = 0; r < grid_rows; r++)
+        grid_row_free(term.normal.rows[r]);
+    free(term.normal.rows);
+    free(term.search.row_index.bits);
+}
+
+/*
+ * Regex mode
+ *
+ * Matches never cross hard line breaks. They are found one logical
+ * (i.e. possibly soft-wrapped) line at a time, by feeding the line's
+ * cells, one by one, to the regex automaton. All leftmost-longest,
+ * non-overlapping, matches in the line are cached, since match_at()
+ * is called for each cell of the line.
+ */
+struct regex_match {
+    int start;     /* Relative row * cols + col */
+    int end_row;   /* Relative to the line's first row */
+    int end_col;   /* Exclusive */
+};
+
+static void
+regex_chars_cb(wchar_t lo, wchar_t hi, void *data)
+{
+    uint64_t *bits = data;
+
+    if (hi - lo >= 256) {
+        *bits = UINT64_MAX;
+        return;
+    }
+
+    for (wchar_t wc = lo; wc <= hi; wc++)
+        *bits |= row_index_bit(wc);
+}
+
+/*
+ * Must be called before searching. In regex mode, (re-)compiles the
+ * search buffer if it has changed. Returns false if it is an invalid
+ * regex.
+ */
+static bool
+search_prepare(struct terminal *term)
+{
+    term->search.regex.line.first_row = -1;
+
+    if (!term->search.regex.enabled)
+        return true;
+
+    if (term->search.regex.compiled &&
+        term->search.regex.pattern_len == term->search.len &&
+        wmemcmp(term->search.regex.pattern, term->search.buf,
+                term->search.len) == 0)
+    {
+        return term->search.regex.re != NULL;
+    }
+
+    regex_destroy(term->search.regex.re);
+    regex_destroy(term->search.regex.re_reversed);
+    term->search.regex.re = regex_compile(term->search.buf, term->search.len);
+    term->search.regex.re_reversed = term->search.regex.re != NULL
+        ? regex_compile_reversed(term->search.buf, term->search.len)
+        : NULL;
+    term->search.regex.compiled = true;
+
+    free(term->search.regex.pattern);
+    term->search.regex.pattern = xmalloc(
+        (term->search.len + 1) * sizeof(term->search.regex.pattern[0]));
+    wmemcpy(term->search.regex.pattern, term->search.buf, term->search.len);
+    term->search.regex.pattern_len = term->search.len;
+
+    if (term->search.regex.re == NULL) {
+        LOG_DBG("search: invalid regex: %.*ls",
+                (int)term->search.len, term->search.buf);
+        return false;
+    }
+
+    uint64_t first_bits = 0;
+    if (!regex_first_chars(term->search.regex.re, &regex_chars_cb,
+                           &first_bits))
+    {
+        first_bits = UINT64_MAX;
+    }
+
+    uint64_t required_bits = 0;
+    regex_required_chars(term->search.regex.re, &regex_chars_cb,
+                         &required_bits);
+
+    term->search.regex.first_bits = first_bits;
+    term->search.regex.required_bits = required_bits;
+    return true;
+}
+
+/*
+ * Feeds the line, starting at the specified cell, to the
+ * automaton. Returns the end of the longest match starting at the
+ * specified cell.
+ */
+static bool
+regex_run(struct terminal *term, int rel_row, int col,
+          int *end_row_out, int *end_col_out)
+{
+    struct regex *re = term->search.regex.re;
+    struct grid *grid = term->grid;
+    const int first_row = term->search.regex.line.first_row;
+    const int rows = term->search.regex.line.rows;
+
+    int state = regex_start(re, rel_row == 0 && col == 0);
+
+    int end_row = rel_row;
+    int end_col = col;
+    bool found = false;
+
+    for (int r = rel_row; r < rows; r++) {
+        const struct row *row = grid_row_peek(grid, first_row + r);
+        const int cols = r == rows - 1
+            ? term->search.regex.line.last_cols : term->cols;
+
+        for (int c = r == rel_row ? col : 0; c < cols; c++) {
+            wchar_t wc = row->cells[c].wc;
+
+            if (wc >= CELL_SPACER)
+                continue;
+
+            if (wc >= CELL_COMB_CHARS_LO && wc <= CELL_COMB_CHARS_HI) {
+                const struct composed *composed = composed_lookup(
+                    term->composed, wc - CELL_COMB_CHARS_LO);
+
+                for (size_t i = 0; i < composed->count && state >= 0; i++)
+                    state = regex_step(re, state, composed->chars[i]);
+            } else {
+                /* Empty cells match spaces, like in literal mode */
+                state = regex_step(re, state, wc == 0 ? L' ' : wc);
+            }
+
+            if (state < 0)
+                return found;
+
+            end_row = r;
+            end_col = c + 1;
+
+            if (regex_is_accepting(re, state)) {
+                *end_row_out = end_row;
+                *end_col_out = end_col;
+                found = true;
+            }
+        }
+    }
+
+    /* Reached the end of the line; try matching '$' */
+    if (regex_accepts_at_eol(re, state) &&
+        (end_row != rel_row || end_col != col))
+    {
+        *end_row_out = end_row;
+        *end_col_out = end_col;
+        found = true;
+    }
+
+    return found;
+}
+
+/*
+ * Feeds the line, backwards, to the reversed automaton, marking each
+ * cell a (non-empty) match starts at. This finds the leftmost match
+ * in a single pass, instead of trying to match at each cell.
+ */
+static void
+regex_mark_starts(struct terminal *term)
+{
+    struct regex *re = term->search.regex.re_reversed;
+    struct grid *grid = term->grid;
+    const int first_row = term->search.regex.line.first_row;
+    const int rows = term->search.regex.line.rows;
+    const size_t words = ((size_t)rows * term->cols + 63) / 64;
+
+    if (words > term->search.regex.line.starts_size) {
+        term->search.regex.line.starts = xrealloc(
+            term->search.regex.line.starts,
+            words * sizeof(term->search.regex.line.starts[0]));
+        term->search.regex.line.starts_size = words;
+    }
+
+    uint64_t *starts = term->search.regex.line.starts;
+    memset(starts, 0, words * sizeof(starts[0]));
+
+    /* The reversed input starts at the end of the line */
+    int state = regex_search_start(re, true);
+
+    for (int r = rows - 1; r >= 0; r--) {
+        const struct row *row = grid_row_peek(grid, first_row + r);
+        const int cols = r == rows - 1
+            ? term->search.regex.line.last_cols : term->cols;
+
+        for (int c = cols - 1; c >= 0; c--) {
+            wchar_t wc = row->cells[c].wc;
+
+            if (wc >= CELL_SPACER)
+                continue;
+
+            if (wc >= CELL_COMB_CHARS_LO && wc <= CELL_COMB_CHARS_HI) {
+                const struct composed *composed = composed_lookup(
+                    term->composed, wc - CELL_COMB_CHARS_LO);
+
+                for (size_t i = composed->count; i > 0 && state >= 0; i--)
+                    state = regex_step(re, state, composed->chars[i - 1]);
+            } else
+                state = regex_step(re, state, wc == 0 ? L' ' : wc);
+
+            if (state < 0)
+                return;
+
+            /* '^' matches where the reversed input ends */
+            if (regex_is_accepting(re, state) ||
+                (r == 0 && c == 0 && regex_accepts_at_eol(re, state)))
+            {
+                const size_t idx = (size_t)r * term->cols + c;
+                starts[idx / 64] |= 1ull << (idx % 64);
+            }
+        }
+    }
+}
+
+/* Moves to the next cell (starting with the specified one) a match
+ * starts at. Returns false if there are no more matches */
+static bool
+regex_next_start(const struct terminal *term, int *rel_row, int *col)
+{
+    const uint64_t *starts = term->search.regex.line.starts;
+    const size_t count = (size_t)term->search.regex.line.rows * term->cols;
+    size_t idx = (size_t)*rel_row * term->cols + *col;
+
+    while (idx < count) {
+        uint64_t bits = starts[idx / 64] >> (idx % 64);
+
+        if (bits == 0) {
+            idx = (idx / 64 + 1) * 64;
+            continue;
+        }
+
+        idx += __builtin_ctzll(bits);
+        if (idx >= count)
+            break;
+
+        *rel_row = idx / term->cols;
+        *col = idx % term->cols;
+        return true;
+    }
+
+    return false;
+}
+
+static void
+regex_scan_line(struct terminal *term, int first_row)
+{
+    struct grid *grid = term->grid;
+    const int mask = grid->num_rows - 1;
+    const int cols = term->cols;
+
+    int rows = 1;
+    while (!row_is_line_end(term, (first_row + rows - 1) & mask))
+        rows++;
+
+    /* Trailing empty cells are not part of the line */
+    const struct row *last = grid_row_peek(grid, first_row + rows - 1);
+    int last_cols = min(cols, grid_row_used_cols(grid, first_row + rows - 1));
+    while (last_cols > 0 && last->cells[last_cols - 1].wc == 0)
+        last_cols--;
+
+    term->search.regex.line.first_row = first_row;
+    term->search.regex.line.rows = rows;
+    term->search.regex.line.last_cols = last_cols;
+    term->search.regex.line.count = 0;
+
+    regex_mark_starts(term);
+
+    int r = 0, c = 0;
+    while (regex_next_start(term, &r, &c)) {
+        int end_row, end_col;
+
+        /* Leftmost match found; now find its (longest) end */
+        if (!regex_run(term, r, c, &end_row, &end_col)) {
+            c++;
+            continue;
+        }
+
+        if (term->search.regex.line.count >= term->search.regex.line.size) {
+            size_t new_size = max(16, term->search.regex.line.size * 2);
+            term->search.regex.line.matches = xrealloc(
+                term->search.regex.line.matches,
+                new_size * sizeof(term->search.regex.line.matches[0]));
+            term->search.regex.line.size = new_size;
+        }
+
+        term->search.regex.line.matches[term->search.regex.line.count++] =
+            (struct regex_match){
+                .start = r * cols + c,
+                .end_row = end_row,
+                .end_col = end_col,
+            };
+
+        r = end_row;
+        c = end_col;
+    }
+
+    LOG_DBG("search: regex: line at row %d (%d rows): %zu matches",
+            first_row, rows, term->search.regex.line.count);
+}
+
+/*
+ * Returns the index of the first match, in the line containing the
+ * specified row, that starts at, or after, the specified cell. The
+ * line is scanned, unless it already is.
+ */
+static size_t
+regex_find(struct terminal *term, int row_no, int col, int *start_out)
+{
+    const int mask = term->grid->num_rows - 1;
+
+    if (term->search.regex.line.first_row < 0 ||
+        ((row_no - term->search.regex.line.first_row) & mask) >=
+        term->search.regex.line.rows)
+    {
+        int first_row = row_no;
+        while (!row_is_line_start(term, first_row))
+            first_row = (first_row - 1) & mask;
+
+        regex_scan_line(term, first_row);
+    }
+
+    const int start =
+        ((row_no - term->search.regex.line.first_row) & mask) * term->cols + col;
+
+    /* Matches are sorted by start position */
+    const struct regex_match *matches = term->search.regex.line.matches;
+    size_t lo = 0;
+    size_t hi = term->search.regex.line.count;
+
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+
+        if (matches[mid].start < start)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    *start_out = start;
+    return lo;
+}
+
+static bool
+regex_row_may_match(struct terminal *term, int row_no)
+{
+    int start;
+    size_t idx = regex_find(term, row_no, 0, &start);
+
+    return idx < term->search.regex.line.count &&
+        term->search.regex.line.matches[idx].start < start + term->cols;
+}
+
+static bool
+regex_match_at(struct terminal *term, int start_row, int start_col,
+               int *end_row_out, int *end_col_out)
+{
+    int start;
+    size_t idx = regex_find(term, start_row, start_col, &start);
+
+    if (idx >= term->search.regex.line.count ||
+        term->search.regex.line.matches[idx].start != start)
+    {
+        return false;
+    }
+
+    const struct regex_match *match = &term->search.regex.line.matches[idx];
+    *end_row_out =
+        (term->search.regex.line.first_row + match->end_row) &
+        (term->grid->num_rows - 1);
+    *end_col_out = match->end_col;
+    return true;
+}
+
 static ssize_t
 matches_cell(const struct terminal *term, const struct cell *cell, size_t search_ofs)
 {
@@ -284,13 +948,88 @@ matches_cell(const struct terminal *term, const struct cell *cell, size_t search
     return composed != NULL ? 1 + composed->count : 1;
 }
 
+/*
+ * Checks if the entire search buffer matches, starting at the
+ * specified cell. On success, the (exclusive) end coordinate, and
+ * the number of matched characters, are returned.
+ */
+static bool
+match_at(struct terminal *term, int start_row, int start_col,
+         int *end_row_out, int *end_col_out, size_t *match_len_out)
+{
+    const struct row *row = grid_row_peek(term->grid, start_row);
+    if (row == NULL)
+        return false;
+
+    if (term->search.regex.enabled) {
+        if (row->cells[start_col].wc >= CELL_SPACER ||
+            !regex_match_at(term, start_row, start_col,
+                            end_row_out, end_col_out))
+        {
+            return false;
+        }
+
+        *match_len_out = term->search.len;
+        return true;
+    }
+
+    if (matches_cell(term, &row->cells[start_col], 0) < 0)
+        return false;
+
+    /*
+     * Got a match on the first letter. Now we'll see if the
+     * rest of the search buffer matches.
+     */
+
+    LOG_DBG("search: initial match at row=%d, col=%d", start_row, start_col);
+
+    int end_row = start_row;
+    int end_col = start_col;
+    size_t match_len = 0;
+
+    for (size_t i = 0; i < term->search.len;) {
+        if (end_col >= term->cols) {
+            end_row = (end_row + 1) & (term->grid->num_rows - 1);
+            end_col = 0;
+
+            if (has_wrapped_around(term, end_row))
+                break;
+
+            row = grid_row_peek(term->grid, end_row);
+        }
+
+        if (row->cells[end_col].wc >= CELL_SPACER) {
+            end_col++;
+            continue;
+        }
+
+        ssize_t additional_chars = matches_cell(term, &row->cells[end_col], i);
+        if (additional_chars < 0)
+            break;
+
+        i += additional_chars;
+        match_len += additional_chars;
+        end_col++;
+    }
+
+    if (match_len != term->search.len) {
+        /* Didn't match (completely) */
+        return false;
+    }
+
+    *end_row_out = end_row;
+    *end_col_out = end_col;
+    *match_len_out = match_len;
+    return true;
+}
+
 static void
 search_find_next(struct terminal *term)
 {
     bool backward = term->search.direction == SEARCH_BACKWARD;
     term->search.direction = SEARCH_BACKWARD;
 
-    if (term->search.len == 0) {
+    if (term->search.len == 0 || !search_prepare(term)) {
         term->search.match = (struct coord){-1, -1};
         term->search.match_len = 0;
         selection_cancel(term);
@@ -318,6 +1057,11 @@ search_find_next(struct terminal *term)
             backward ? "backward" : "forward", start_row, start_col,
             term->grid->offset, term->grid->view);
 
+    row_index_ensure(term);
+
+    uint64_t first_bit, query_bits;
+    row_index_query_bits(term, &first_bit, &query_bits);
+
 #define ROW_DEC(_r) ((_r) = ((_r) - 1 + term->grid->num_rows) & (term->grid->num_rows - 1))
 #define ROW_INC(_r) ((_r) = ((_r) + 1) & (term->grid->num_rows - 1))
 
@@ -327,55 +1071,23 @@ search_find_next(struct terminal *term)
          r < term->grid->num_rows;
          backward ? ROW_DEC(start_row) : ROW_INC(start_row), r++)
     {
+        if (term->grid == &term->normal &&
+            !row_may_match(term, start_row, first_bit, query_bits))
+        {
+            start_col = backward ? term->cols - 1 : 0;
+            continue;
+        }
+
         for (;
              backward ? start_col >= 0 : start_col < term->cols;
              backward ? start_col-- : start_col++)
         {
-            const struct row *row = term->grid->rows[start_row];
-            if (row == NULL)
-                continue;
+            int end_row, end_col;
+            size_t match_len;
 
-            if (matches_cell(term, &row->cells[start_col], 0) < 0)
-                continue;
-
-            /*
-             * Got a match on the first letter. Now we'll see if the
-             * rest of the search buffer matches.
-             */
-
-            LOG_DBG("search: initial match at row=%d, col=%d", start_row, start_col);
-
-            int end_row = start_row;
-            int end_col = start_col;
-            size_t match_len = 0;
-
-            for (size_t i = 0; i < term->search.len;) {
-                if (end_col >= term->cols) {
-                    end_row = (end_row + 1) & (term->grid->num_rows - 1);
-                    end_col = 0;
-
-                    if (has_wrapped_around(term, end_row))
-                        break;
-
-                    row = term->grid->rows[end_row];
-                }
-
-                if (row->cells[end_col].wc >= CELL_SPACER) {
-                    end_col++;
-                    continue;
-                }
-
-                ssize_t additional_chars = matches_cell(term, &row->cells[end_col], i);
-                if (additional_chars < 0)
-                    break;
-
-                i += additional_chars;
-                match_len += additional_chars;
-                end_col++;
-            }
-
-            if (match_len != term->search.len) {
-                /* Didn't match (completely) */
+            if (!match_at(term, start_row, start_col,
+                          &end_row, &end_col, &match_len))
+            {
                 continue;
             }
 
@@ -404,6 +1116,505 @@ search_find_next(struct terminal *term)
 #undef ROW_DEC
 }
 
+/*
+ * Highlights all matches in the view. This is called before each
+ * frame is rendered, and marks the rows whose highlighting changed
+ * as dirty.
+ *
+ * Returns true if any row was dirtied.
+ */
+bool
+search_matches_update(struct terminal *term)
+{
+    struct grid *grid = term->grid;
+    const int mask = grid->num_rows - 1;
+    const int rows = term->rows;
+    const int cols = term->cols;
+    const int stride = (cols + 63) / 64;
+
+    uint64_t *old_bits = term->search.highlight.bits;
+    bool old_valid = old_bits != NULL &&
+        term->search.highlight.rows == rows &&
+        term->search.highlight.cols == cols;
+
+    uint64_t *bits = term->search.highlight.scratch;
+    if (!old_valid) {
+        free(old_bits);
+        free(bits);
+        old_bits = xcalloc(rows * stride, sizeof(old_bits[0]));
+        bits = xcalloc(rows * stride, sizeof(bits[0]));
+    } else
+        memset(bits, 0, rows * stride * sizeof(bits[0]));
+
+    if (term->search.len > 0 && search_prepare(term)) {
+        row_index_ensure(term);
+
+        uint64_t first_bit, query_bits;
+        row_index_query_bits(term, &first_bit, &query_bits);
+
+        /* Matches starting above the view may continue into it */
+        int above = (2 * term->search.len + cols - 1) / cols;
+
+        if (term->search.regex.enabled) {
+            /* Regex matches may span the entire (soft-wrapped) line */
+            above = 0;
+            while (above < grid->num_rows - rows &&
+                   grid->rows[(grid->view - above) & mask] != NULL &&
+                   !row_is_line_start(term, (grid->view - above) & mask))
+            {
+                above++;
+            }
+        }
+
+        for (int r = -above; r < rows; r++) {
+            const int start_row = (grid->view + r) & mask;
+
+            if (r < 0 && has_wrapped_around(term, (start_row + 1) & mask))
+                continue;
+
+            if (grid->rows[start_row] == NULL)
+                continue;
+
+            if (grid == &term->normal &&
+                !row_may_match(term, start_row, first_bit, query_bits))
+            {
+                continue;
+            }
+
+            for (int start_col = 0; start_col < cols; start_col++) {
+                int end_row, end_col;
+                size_t match_len;
+
+                if (!match_at(term, start_row, start_col,
+                              &end_row, &end_col, &match_len))
+                {
+                    continue;
+                }
+
+                /* Highlight all cells of the match that are in view */
+                for (int row_no = start_row, col = start_col;
+                     row_no != end_row || col < end_col;
+                     col++)
+                {
+                    if (col >= cols) {
+                        row_no = (row_no + 1) & mask;
+                        col = -1;
+                        continue;
+                    }
+
+                    const int view_row = (row_no - grid->view) & mask;
+                    if (view_row < rows)
+                        bits[view_row * stride + col / 64] |= 1ull << (col % 64);
+                }
+            }
+        }
+    }
+
+    /* Re-render rows where the highlighting changed */
+    bool dirtied = false;
+    for (int r = 0; r < rows; r++) {
+        if (memcmp(&bits[r * stride], &old_bits[r * stride],
+                   stride * sizeof(bits[0])) == 0)
+        {
+            continue;
+        }
+
+        struct row *row = grid_row_in_view(grid, r);
+        grid_row_dirty_all(row, cols);
+        row->dirty = true;
+        dirtied = true;
+    }
+
+    term->search.highlight.bits = bits;
+    term->search.highlight.scratch = old_bits;
+    term->search.highlight.rows = rows;
+    term->search.highlight.cols = cols;
+    return dirtied;
+}
+
+/* Rows scanned each time search_count_matches() is called */
+#define SEARCH_COUNT_CHUNK_ROWS 4096
+
+/*
+ * Counts all matches in the scrollback, and the index of the current
+ * match. To never block a frame, only a chunk of rows is scanned per
+ * call. The counting is restarted whenever the search string, or the
+ * current match changes.
+ *
+ * Progress is tracked relative to the oldest scrollback row, along
+ * with the number of matches in each scanned row. When output scrolls
+ * the normal grid, search_count_scroll() re-bases the count instead
+ * of restarting it; otherwise, the count would never complete while
+ * output is being received.
+ *
+ * Returns true when done.
+ */
+bool
+search_count_matches(struct terminal *term)
+{
+    struct grid *grid = term->grid;
+    const int mask = grid->num_rows - 1;
+
+    if (term->search.len == 0 || !search_prepare(term)) {
+        term->search.counter.valid = false;
+        term->search.counter.done = true;
+        term->search.counter.query_len = 0;
+        return true;
+    }
+
+    const bool new_query =
+        term->search.counter.regex != term->search.regex.enabled ||
+        term->search.counter.query_len != term->search.len ||
+        wmemcmp(term->search.counter.query, term->search.buf,
+                term->search.len) != 0;
+
+    /* Offset changes not seen by search_count_scroll() restart the count */
+    bool restart =
+        new_query ||
+        term->search.counter.grid != grid ||
+        term->search.counter.offset != grid->offset ||
+        term->search.counter.row_matches_size != grid->num_rows ||
+        term->search.counter.match.row != term->search.match.row ||
+        term->search.counter.match.col != term->search.match.col;
+
+    if (restart) {
+        if (new_query) {
+            /* Result from a different search string is meaningless */
+            term->search.counter.valid = false;
+            term->search.counter.regex = term->search.regex.enabled;
+
+            free(term->search.counter.query);
+            term->search.counter.query = xmalloc(
+                term->search.len * sizeof(term->search.counter.query[0]));
+            wmemcpy(term->search.counter.query, term->search.buf,
+                    term->search.len);
+            term->search.counter.query_len = term->search.len;
+        }
+
+        if (term->search.counter.row_matches_size != grid->num_rows) {
+            free(term->search.counter.row_matches);
+            term->search.counter.row_matches = xmalloc(
+                grid->num_rows * sizeof(term->search.counter.row_matches[0]));
+            term->search.counter.row_matches_size = grid->num_rows;
+        }
+
+        term->search.counter.grid = grid;
+        term->search.counter.offset = grid->offset;
+        term->search.counter.match = term->search.match;
+        term->search.counter.scanned = 0;
+        term->search.counter.found = 0;
+        term->search.counter.current = 0;
+        term->search.counter.done = false;
+    }
+
+    if (term->search.counter.done)
+        return true;
+
+    row_index_ensure(term);
+
+    uint64_t first_bit, query_bits;
+    row_index_query_bits(term, &first_bit, &query_bits);
+
+    const int start = grid->offset + term->rows;
+    uint32_t *const row_matches = term->search.counter.row_matches;
+
+    for (int i = 0;
+         i < SEARCH_COUNT_CHUNK_ROWS &&
+             term->search.counter.scanned < grid->num_rows;
+         i++, term->search.counter.scanned++)
+    {
+        const int row_no = (start + term->search.counter.scanned) & mask;
+        row_matches[row_no] = 0;
+
+        if (grid->rows[row_no] == NULL)
+            continue;
+
+        if (grid == &term->normal &&
+            !row_may_match(term, row_no, first_bit, query_bits))
+        {
+            continue;
+        }
+
+        for (int col = 0; col < term->cols; col++) {
+            int end_row, end_col;
+            size_t match_len;
+
+            if (!match_at(term, row_no, col, &end_row, &end_col, &match_len))
+                continue;
+
+            row_matches[row_no]++;
+            term->search.counter.found++;
+
+            if (row_no == term->search.match.row &&
+                col == term->search.match.col)
+            {
+                term->search.counter.current = term->search.counter.found;
+            }
+        }
+    }
+
+    if (term->search.counter.scanned < grid->num_rows)
+        return false;
+
+    term->search.counter.done = true;
+    term->search.counter.valid = true;
+    term->search.counter.total = term->search.counter.found;
+    term->search.counter.index = term->search.counter.current;
+    return true;
+}
+
+void
+search_count_scroll(struct terminal *term, int rows)
+{
+    const struct grid *grid = &term->normal;
+
+    if (term->search.counter.grid != grid ||
+        term->search.counter.offset != grid->offset ||
+        term->search.counter.row_matches_size != grid->num_rows)
+    {
+        /* Not counting, or already out of sync (will restart) */
+        return;
+    }
+
+    const int mask = grid->num_rows - 1;
+    const int start = grid->offset + term->rows;
+    const int scrollback_rows = grid->num_rows - term->rows;
+    const uint32_t *const row_matches = term->search.counter.row_matches;
+
+    int scanned = term->search.counter.scanned;
+    size_t found = term->search.counter.found;
+    size_t current = term->search.counter.current;
+
+    /* Screen rows are scrolled, or erased; re-scan all of them */
+    for (; scanned > scrollback_rows; scanned--)
+        found -= row_matches[(start + scanned - 1) & mask];
+
+    if (current > found)
+        current = 0;
+
+    /* The oldest rows are about to be re-used as screen rows */
+    const int gone = min(rows, scanned);
+    size_t dropped = 0;
+
+    for (int i = 0; i < gone; i++)
+        dropped += row_matches[(start + i) & mask];
+
+    current = current > dropped ? current - dropped : 0;
+    found -= dropped;
+    scanned -= gone;
+
+    term->search.counter.offset = (grid->offset + rows) & mask;
+    term->search.counter.scanned = scanned;
+    term->search.counter.found = found;
+    term->search.counter.current = current;
+    term->search.counter.done = false;
+}
+
+UNITTEST
+{
+    const int grid_rows = 8;
+    const int term_rows = 2;
+    const int cols = 4;
+
+    struct terminal term = {
+        .rows = term_rows,
+        .cols = cols,
+        .normal = {
+            .rows = xcalloc(grid_rows, sizeof(term.normal.rows[0])),
+            .num_rows = grid_rows,
+            .num_cols = cols,
+            .offset = 6,  /* Screen is rows 6,7; scrollback 0-5 */
+            .view = 6,
+        },
+        .search = {
+            .buf = (wchar_t *)L"ab",
+            .len = 2,
+            .match = {.row = 3, .col = 3},
+        },
+    };
+    term.grid = &term.normal;
+
+    const wchar_t *const text[] = {
+        L"abcd", L"ab", L"zzzz", L"zzza", L"bzzz", L"zzzz", L"abzz", L"zzzz",
+    };
+
+    for (int r = 0; r < grid_rows; r++) {
+        struct row *row = grid_row_alloc(NULL, cols, true);
+        for (int c = 0; text[r][c] != L'\0'; c++)
+            row->cells[c].wc = text[r][c];
+        term.normal.rows[r] = row;
+    }
+
+    /* Screen row 6 has a match */
+    xassert(search_matches_update(&term));
+    xassert(search_cell_is_highlighted(&term, 0, 0));
+    xassert(search_cell_is_highlighted(&term, 0, 1));
+    xassert(!search_cell_is_highlighted(&term, 0, 2));
+    xassert(!search_cell_is_highlighted(&term, 1, 0));
+    xassert(term.normal.rows[6]->dirty);
+    xassert(!term.normal.rows[7]->dirty);
+
+    /* Nothing changed - nothing dirtied */
+    term.normal.rows[6]->dirty = false;
+    xassert(!search_matches_update(&term));
+
+    /* Match wrapping from row 3 to 4 */
+    term.normal.view = 3;
+    xassert(search_matches_update(&term));
+    xassert(search_cell_is_highlighted(&term, 0, 3));
+    xassert(search_cell_is_highlighted(&term, 1, 0));
+    xassert(!search_cell_is_highlighted(&term, 0, 2));
+    xassert(!search_cell_is_highlighted(&term, 1, 1));
+
+    /* Counted oldest to newest: (0,0), (1,0), (3,3) and (6,0) */
+    while (!search_count_matches(&term))
+        ;
+    xassert(term.search.counter.valid);
+    xassert(term.search.counter.total == 4);
+    xassert(term.search.counter.index == 3);
+
+    /* Scroll one row: the oldest row (0) is re-used as a screen row */
+    search_count_scroll(&term, 1);
+    xassert(!term.search.counter.done);
+    term.normal.offset = term.normal.view = 7;
+    memset(term.normal.rows[0]->cells, 0, cols * sizeof(struct cell));
+    search_index_invalidate(&term, 0, 1);
+
+    while (!search_count_matches(&term))
+        ;
+    xassert(term.search.counter.valid);
+    xassert(term.search.counter.total == 3);
+    xassert(term.search.counter.index == 2);
+
+    for (int r = 0; r < grid_rows; r++)
+        grid_row_free(term.normal.rows[r]);
+    free(term.normal.rows);
+    free(term.search.row_index.bits);
+    free(term.search.highlight.bits);
+    free(term.search.highlight.scratch);
+    free(term.search.counter.query);
+    free(term.search.counter.row_matches);
+}
+
+UNITTEST
+{
+    const int grid_rows = 8;
+    const int term_rows = 2;
+    const int cols = 4;
+
+    struct composed composed = {
+        .chars = (wchar_t []){L'e', L'\u0301'},
+        .count = 2,
+        .width = 1,
+    };
+
+    struct terminal term = {
+        .rows = term_rows,
+        .cols = cols,
+        .composed = &composed,
+        .normal = {
+            .rows = xcalloc(grid_rows, sizeof(term.normal.rows[0])),
+            .num_rows = grid_rows,
+            .num_cols = cols,
+            .offset = 6,  /* Screen is rows 6,7; scrollback 0-5 */
+            .view = 6,
+        },
+        .search = {
+            .regex = {.enabled = true},
+        },
+    };
+    term.grid = &term.normal;
+
+    const wchar_t *const text[] = {
+        L"req-",    /* Soft-wrapped into the next row */
+        L"42 x",
+        L"ab",
+        L"abab",
+        L"\u4e16",    /* Wide character; spacer and '1' added below */
+        L"",          /* Composed character and 'x' added below */
+        L"zzzz",
+        L"zzzz",
+    };
+
+    for (int r = 0; r < grid_rows; r++) {
+        struct row *row = grid_row_alloc(NULL, cols, true);
+        for (int c = 0; c < cols && text[r][c] != L'\0'; c++)
+            row->cells[c].wc = text[r][c];
+        row->linebreak = r != 0;
+        term.normal.rows[r] = row;
+    }
+
+    term.normal.rows[4]->cells[1].wc = CELL_SPACER + 1;
+    term.normal.rows[4]->cells[2].wc = L'1';
+    term.normal.rows[5]->cells[0].wc = CELL_COMB_CHARS_LO;
+    term.normal.rows[5]->cells[1].wc = L'x';
+
+    int end_row, end_col;
+    size_t match_len;
+
+#define match(query, row_no, col) (                                     \
+        term.search.buf = (wchar_t *)(query),                           \
+        term.search.len = wcslen(query),                                \
+        search_prepare(&term) &&                                        \
+        match_at(&term, row_no, col, &end_row, &end_col, &match_len))
+
+    /* Matches continue across soft-wrapped rows */
+    xassert(match(L"REQ-\\d+", 0, 0));
+    xassert(end_row == 1 && end_col == 2);
+    xassert(!match(L"REQ-\\d+", 0, 1));
+    xassert(!match(L"x$", 0, 0));
+    xassert(match(L"x$", 1, 3));
+
+    /* ...but never across hard line breaks */
+    xassert(!match(L"x\\s*ab", 1, 3));
+
+    /* Trailing empty cells are not part of the line */
+    xassert(match(L"ab$", 2, 0));
+    xassert(end_row == 2 && end_col == 2);
+
+    /* Matches don't overlap */
+    xassert(match(L"\\w\\w", 3, 0));
+    xassert(!match(L"\\w\\w", 3, 1));
+    xassert(match(L"\\w\\w", 3, 2));
+    xassert(match(L"ab$", 3, 2));
+    xassert(!match(L"ab$", 3, 0));
+    xassert(match(L"^ab", 3, 0));
+    xassert(!match(L"^ab", 3, 2));
+
+    /* Spacers are skipped, composed characters are matched in full */
+    xassert(match(L"\u4e16\\d", 4, 0));
+    xassert(end_row == 4 && end_col == 3);
+    xassert(match(L"e\u0301x", 5, 0));
+    xassert(end_row == 5 && end_col == 2);
+    xassert(!match(L"ex", 5, 0));
+
+    /* Invalid regex */
+    xassert(!match(L"(a", 3, 0));
+
+#undef match
+
+    /* Counted per non-overlapping match */
+    term.search.buf = (wchar_t *)L"z+";
+    term.search.len = 2;
+    term.search.match = (struct coord){-1, -1};
+    while (!search_count_matches(&term))
+        ;
+    xassert(term.search.counter.valid);
+    xassert(term.search.counter.total == 2);
+
+    for (int r = 0; r < grid_rows; r++)
+        grid_row_free(term.normal.rows[r]);
+    free(term.normal.rows);
+    free(term.search.row_index.bits);
+    free(term.search.counter.query);
+    free(term.search.counter.row_matches);
+    regex_destroy(term.search.regex.re);
+    regex_destroy(term.search.regex.re_reversed);
+    free(term.search.regex.pattern);
+    free(term.search.regex.line.matches);
+    free(term.search.regex.line.starts);
+}
+
 static void
 add_wchars(struct terminal *term, wchar_t *src, size_t count)
 {
@@ -450,6 +1661,63 @@ search_add_chars(struct terminal *term, const char *src, size_t count)
     add_wchars(term, wcs, wchars);
 }
 
+/*
+ * Returns true if the pattern has an alternation outside of all
+ * groups; ‘a|b’ must become ‘(?:a|b)’ before anything is appended to
+ * it.
+ */
+static bool
+regex_has_top_level_alt(const wchar_t *pattern, size_t len)
+{
+    int depth = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        switch (pattern[i]) {
+        case L'\\':
+            i++;
+            break;
+
+        case L'[':
+            /* A leading ‘]’ (after an optional ‘^’) is a literal */
+            if (i + 1 < len && pattern[i + 1] == L'^')
+                i++;
+            if (i + 1 < len && pattern[i + 1] == L']')
+                i++;
+
+            for (i++; i < len && pattern[i] != L']'; i++) {
+                if (pattern[i] == L'\\')
+                    i++;
+            }
+            break;
+
+        case L'(': depth++; break;
+        case L')': depth--; break;
+
+        case L'|':
+            if (depth == 0)
+                return true;
+            break;
+        }
+    }
+
+    return false;
+}
+
+UNITTEST
+{
+#define has_alt(pattern) regex_has_top_level_alt(pattern, wcslen(pattern))
+    xassert(has_alt(L"a|b"));
+    xassert(has_alt(L"(a)|b"));
+    xassert(!has_alt(L"ab"));
+    xassert(!has_alt(L"(?:a|b)c"));
+    xassert(!has_alt(L"a\\|b"));
+    xassert(!has_alt(L"[|]"));
+    xassert(!has_alt(L"([)]a|b)"));
+    xassert(has_alt(L"[(]a|b"));
+    xassert(has_alt(L"[^]]|b"));
+#undef has_alt
+}
+
 static void
 search_match_to_end_of_word(struct terminal *term, bool spaces_only)
 {
@@ -462,7 +1730,7 @@ search_match_to_end_of_word(struct terminal *term, bool spaces_only)
 
     const struct coord old_end = term->selection.end;
     struct coord new_end = old_end;
-    struct row *row = NULL;
+    const struct row *row = NULL;
 
 #define newline(coord) __extension__                                    \
         ({                                                              \
@@ -470,7 +1738,7 @@ search_match_to_end_of_word(struct terminal *term, bool spaces_only)
             if (++(coord).col >= term->cols) {                           \
                 (coord).row = ((coord).row + 1) & (term->grid->num_rows - 1); \
                 (coord).col = 0;                                        \
-                row = term->grid->rows[(coord).row];                    \
+                row = grid_row_peek(term->grid, (coord).row);           \
                 if (has_wrapped_around(term, (coord.row)))              \
                     wrapped_around = true;                              \
             }                                                           \
@@ -489,7 +1757,7 @@ search_match_to_end_of_word(struct terminal *term, bool spaces_only)
     new_end.row += term->grid->view;
 
     struct coord pos = old_end;
-    row = term->grid->rows[pos.row];
+    row = grid_row_peek(term->grid, pos.row);
 
     struct extraction_context *ctx = extract_begin(SELECTION_NONE, false);
     if (ctx == NULL)
@@ -508,15 +1776,35 @@ search_match_to_end_of_word(struct terminal *term, bool spaces_only)
     if (!extract_finish_wide(ctx, &new_text, &new_len))
         return;
 
-    if (!search_ensure_size(term, term->search.len + new_len))
+    /* In regex mode, special characters may need to be escaped, and
+     * the pattern may need to be grouped */
+    if (!search_ensure_size(term, term->search.len + 2 * new_len + 4))
         return;
 
+    if (term->search.regex.enabled &&
+        regex_has_top_level_alt(term->search.buf, term->search.len))
+    {
+        wmemmove(&term->search.buf[3], term->search.buf, term->search.len);
+        wmemcpy(term->search.buf, L"(?:", 3);
+        term->search.len += 3;
+        term->search.buf[term->search.len++] = L')';
+
+        if (!move_cursor)
+            term->search.cursor += 3;
+    }
+
     for (size_t i = 0; i < new_len; i++) {
         if (new_text[i] == L'\n') {
             /* extract() adds newlines, which we never match against */
             continue;
         }
 
+        if (term->search.regex.enabled &&
+            wcschr(L"\\^$.|?*+()[]{}", new_text[i]) != NULL)
+        {
+            term->search.buf[term->search.len++] = L'\\';
+        }
+
         term->search.buf[term->search.len++] = new_text[i];
     }
 
@@ -625,6 +1913,7 @@ execute_binding(struct seat *seat, struct terminal *term,
         else {
             term->grid->view = ensure_view_is_allocated(
                 term, term->search.original_view);
+            grid_thaw_view(term->grid, term->rows);
         }
         term_damage_view(term);
         search_cancel(term);
@@ -815,6 +2104,11 @@ execute_binding(struct seat *seat, struct terminal *term,
         *update_search_result = *redraw = true;
         return true;
 
+    case BIND_ACTION_SEARCH_TOGGLE_REGEX:
+        term->search.regex.enabled = !term->search.regex.enabled;
+        *update_search_result = *redraw = true;
+        return true;
+
     case BIND_ACTION_SEARCH_COUNT:
         BUG("Invalid action type");
         return true;
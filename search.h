@@ -13,3 +13,27 @@ void search_input(
 void search_add_chars(struct terminal *term, const char *text, size_t len);
 
 void search_selection_cancelled(struct terminal *term);
+
+bool search_matches_update(struct terminal *term);
+bool search_count_matches(struct terminal *term);
+
+/* Must be called before the normal grid is scrolled (forward) */
+void search_count_scroll(struct terminal *term, int rows);
+
+static inline bool
+search_cell_is_highlighted(const struct terminal *term, int row_no, int col)
+{
+    const uint64_t *bits = term->search.highlight.bits;
+    if (bits == NULL ||
+        row_no >= term->search.highlight.rows ||
+        col >= term->search.highlight.cols)
+    {
+        return false;
+    }
+
+    const int stride = (term->search.highlight.cols + 63) / 64;
+    return (bits[row_no * stride + col / 64] >> (col % 64)) & 1;
+}
+
+/* Must be called before scrollback rows are modified, or re-used */
+void search_index_invalidate(struct terminal *term, int start, int count);
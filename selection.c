@@ -134,7 +134,7 @@ foreach_selected_normal(
 
     for (int r = start_row; r <= end_row; r++) {
         size_t real_r = r & (term->grid->num_rows - 1);
-        struct row *row = term->grid->rows[real_r];
+        struct row *row = grid_row_thaw(term->grid, real_r);
         xassert(row != NULL);
 
         for (int c = start_col;
@@ -170,7 +170,7 @@ foreach_selected_block(
 
     for (int r = top_left.row; r <= bottom_right.row; r++) {
         size_t real_r = r & (term->grid->num_rows - 1);
-        struct row *row = term->grid->rows[real_r];
+        struct row *row = grid_row_thaw(term->grid, real_r);
         xassert(row != NULL);
 
         for (int c = top_left.col; c <= bottom_right.col; c++) {
@@ -518,7 +518,7 @@ unmark_selected(struct terminal *term, struct row *row, struct cell *cell,
 
     row->dirty = true;
     cell->attrs.selected = false;
-    cell->attrs.clean = false;
+    grid_row_dirty_cell(row, col);
     return true;
 }
 
@@ -578,7 +578,7 @@ mark_selected(struct terminal *term, struct row *row, struct cell *cell,
         if (!c->attrs.selected) {
             row->dirty = true;
             c->attrs.selected = true;
-            c->attrs.clean = false;
+            grid_row_dirty_cell(row, col - i);
         }
     }
 
@@ -1912,7 +1912,7 @@ receive_offer_done(void *user)
 
     /* Make sure we send any queued up non-paste data */
     if (tll_length(term->ptmx_buffers) > 0)
-        fdm_event_add(term->fdm, term->ptmx, EPOLLOUT);
+        term_ptmx_pollout_enable(term);
 }
 
 void
@@ -54,16 +54,28 @@
  */
 static off_t max_pool_size = 512 * 1024 * 1024;
 
+/*
+ * Maximum amount of memory held by released pools, kept around for
+ * re-use (by any chain). Can be overridden by calling
+ * shm_set_max_cache_size().
+ */
+static size_t max_cache_size = 32 * 1024 * 1024;
+
+/* Maximum number of cached pools, regardless of their size */
+#define MAX_CACHED_POOLS 32
+
 static bool can_punch_hole = false;
 static bool can_punch_hole_initialized = false;
 
 struct buffer_pool {
     int fd;                /* memfd */
+    struct wl_shm *shm;
     struct wl_shm_pool *wl_pool;
 
     void *real_mmapped;    /* Address returned from mmap */
     size_t mmap_size;      /* Size of mmap (>= size) */
 
+    bool scrollable;       /* Single buffer, moved around by shm_scroll() */
     size_t ref_count;
 };
 
@@ -91,10 +103,25 @@ struct buffer_chain {
 
 static tll(struct buffer_private *) deferred;
 
-#undef MEASURE_SHM_ALLOCS
-#if defined(MEASURE_SHM_ALLOCS)
-static size_t max_alloced = 0;
-#endif
+/*
+ * Released pools, most recently released first. New buffers are
+ * allocated from these, when possible, instead of creating a new
+ * memfd, mmap() and wl_shm_pool.
+ */
+static tll(struct buffer_pool *) cached_pools;
+static size_t cached_size = 0;
+
+/* Set by shm_fini(); pools released after that are not cached */
+static bool cache_disabled = false;
+
+/* Allocation statistics, logged by shm_fini() */
+static struct {
+    size_t allocated;     /* Pools created */
+    size_t reused;        /* Pools taken from the cache */
+    size_t trimmed;       /* Cached pools destroyed, to make room */
+    size_t mapped;        /* Bytes currently mmap:ed, by all pools */
+    size_t max_mapped;
+} stats;
 
 void
 shm_set_max_pool_size(off_t _max_pool_size)
@@ -102,6 +129,12 @@ shm_set_max_pool_size(off_t _max_pool_size)
     max_pool_size = _max_pool_size;
 }
 
+void
+shm_set_max_cache_size(size_t _max_cache_size)
+{
+    max_cache_size = _max_cache_size;
+}
+
 static void
 buffer_destroy_dont_close(struct buffer *buf)
 {
@@ -119,17 +152,58 @@ buffer_destroy_dont_close(struct buffer *buf)
     buf->data = NULL;
 }
 
-static void
-pool_unref(struct buffer_pool *pool)
+static size_t
+page_size(void)
 {
-    if (pool == NULL)
-        return;
+    static size_t size = 0;
+    if (size == 0) {
+        long n = sysconf(_SC_PAGE_SIZE);
+        if (n <= 0) {
+            LOG_ERRNO("failed to get page size");
+            size = 4096;
+        } else {
+            size = (size_t)n;
+        }
+    }
+    xassert(size > 0);
+    return size;
+}
 
-    xassert(pool->ref_count > 0);
-    pool->ref_count--;
+/*
+ * Rounds ‘size’ up to its size class. Pools are allocated, and
+ * re-used, by size class. There are four classes per power of two,
+ * wasting at most 25% of the address space; pages that are never
+ * written to are never backed by memory.
+ */
+static size_t
+pool_size_class(size_t size)
+{
+    const size_t page = page_size();
+    size = (size + page - 1) & ~(page - 1);
 
-    if (pool->ref_count > 0)
-        return;
+    if (size <= 4 * page)
+        return size;
+
+    const int msb = (int)(sizeof(unsigned long) * 8) - 1 - __builtin_clzl(size);
+    const size_t step = (size_t)1 << (msb - 2);
+    return (size + step - 1) & ~(step - 1);
+}
+
+/* Memory held by a pool while it is in the cache */
+static size_t
+pool_cached_size(const struct buffer_pool *pool)
+{
+    /* Scrollable pools are trimmed before being cached */
+    return pool->scrollable ? 0 : pool->mmap_size;
+}
+
+static void
+pool_destroy(struct buffer_pool *pool)
+{
+    xassert(pool->ref_count == 0);
+
+    if (pool->real_mmapped != MAP_FAILED)
+        stats.mapped -= pool->mmap_size;
 
     if (pool->real_mmapped != MAP_FAILED)
         munmap(pool->real_mmapped, pool->mmap_size);
@@ -144,6 +218,104 @@ pool_unref(struct buffer_pool *pool)
     free(pool);
 }
 
+/*
+ * Puts a released pool in the cache, trimming the least recently
+ * released pools if the cache grows too large. Returns false if the
+ * pool could not be cached, in which case it must be destroyed.
+ */
+static bool
+pool_cache_put(struct buffer_pool *pool)
+{
+    const size_t size = pool_cached_size(pool);
+
+    if (cache_disabled || max_cache_size == 0 || size > max_cache_size)
+        return false;
+
+#if __SIZEOF_POINTER__ == 8 && defined(FALLOC_FL_PUNCH_HOLE)
+    if (pool->scrollable) {
+        /* Free the memory used by the (last) buffer */
+        if (fallocate(
+                pool->fd,
+                FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                0, pool->mmap_size) < 0)
+        {
+            LOG_ERRNO("failed to trim SHM backing memory file");
+            return false;
+        }
+    }
+#endif
+
+    tll_push_front(cached_pools, pool);
+    cached_size += size;
+
+    while (cached_size > max_cache_size ||
+           tll_length(cached_pools) > MAX_CACHED_POOLS)
+    {
+        struct buffer_pool *lru = tll_pop_back(cached_pools);
+        cached_size -= pool_cached_size(lru);
+        pool_destroy(lru);
+
+        stats.trimmed++;
+    }
+
+    return true;
+}
+
+/*
+ * Takes the most recently released pool that can host ‘size’ bytes
+ * worth of buffers for ‘chain’ out of the cache. Returns NULL if
+ * there is none.
+ */
+static struct buffer_pool *
+pool_cache_take(const struct buffer_chain *chain, size_t size)
+{
+#if __SIZEOF_POINTER__ == 8
+    const bool scrollable =
+        chain->scrollable && max_pool_size > 0 && can_punch_hole;
+#else
+    const bool scrollable = false;
+#endif
+    const size_t size_class = pool_size_class(size);
+
+    tll_foreach(cached_pools, it) {
+        struct buffer_pool *pool = it->item;
+
+        if (pool->shm != chain->shm || pool->scrollable != scrollable)
+            continue;
+
+        if (scrollable
+            ? (off_t)pool->mmap_size != max_pool_size
+            : pool->mmap_size != size_class)
+        {
+            continue;
+        }
+
+        tll_remove(cached_pools, it);
+        cached_size -= pool_cached_size(pool);
+
+        stats.reused++;
+        return pool;
+    }
+
+    return NULL;
+}
+
+static void
+pool_unref(struct buffer_pool *pool)
+{
+    if (pool == NULL)
+        return;
+
+    xassert(pool->ref_count > 0);
+    pool->ref_count--;
+
+    if (pool->ref_count > 0)
+        return;
+
+    if (!pool_cache_put(pool))
+        pool_destroy(pool);
+}
+
 static void
 buffer_destroy(struct buffer_private *buf)
 {
@@ -151,7 +323,6 @@ buffer_destroy(struct buffer_private *buf)
     pool_unref(buf->pool);
     buf->pool = NULL;
 
-    free(buf->public.scroll_damage);
     pixman_region32_fini(&buf->public.dirty);
     free(buf);
 }
@@ -175,6 +346,10 @@ buffer_unref_no_remove_from_chain(struct buffer_private *buf)
 void
 shm_fini(void)
 {
+    /* Buffer chains are destroyed after us, together with the
+     * terminals; their pools must be destroyed, not cached */
+    cache_disabled = true;
+
     LOG_DBG("deferred buffers: %zu", tll_length(deferred));
 
     tll_foreach(deferred, it) {
@@ -182,9 +357,19 @@ shm_fini(void)
         tll_remove(deferred, it);
     }
 
-#if defined(MEASURE_SHM_ALLOCS) && MEASURE_SHM_ALLOCS
-    LOG_INFO("max total allocations was: %zu MB", max_alloced / 1024 / 1024);
-#endif
+    LOG_DBG("cached pools: %zu (%zu bytes)",
+            tll_length(cached_pools), cached_size);
+
+    tll_foreach(cached_pools, it) {
+        pool_destroy(it->item);
+        tll_remove(cached_pools, it);
+    }
+    cached_size = 0;
+
+    LOG_INFO("pools: %zu allocated, %zu re-used, %zu trimmed from cache; "
+             "max mapped: %zu MB",
+             stats.allocated, stats.reused, stats.trimmed,
+             stats.max_mapped / 1024 / 1024);
 }
 
 static void
@@ -218,25 +403,6 @@ static const struct wl_buffer_listener buffer_listener = {
     .release = &buffer_release,
 };
 
-#if __SIZEOF_POINTER__ == 8
-static size_t
-page_size(void)
-{
-    static size_t size = 0;
-    if (size == 0) {
-        long n = sysconf(_SC_PAGE_SIZE);
-        if (n <= 0) {
-            LOG_ERRNO("failed to get page size");
-            size = 4096;
-        } else {
-            size = (size_t)n;
-        }
-    }
-    xassert(size > 0);
-    return size;
-}
-#endif
-
 static bool
 instantiate_offset(struct buffer_private *buf, off_t new_offset)
 {
@@ -253,14 +419,16 @@ instantiate_offset(struct buffer_private *buf, off_t new_offset)
 
     mmapped = (uint8_t *)pool->real_mmapped + new_offset;
 
-    wl_buf = wl_shm_pool_create_buffer(
-        pool->wl_pool, new_offset,
-        buf->public.width, buf->public.height, buf->public.stride,
-        WL_SHM_FORMAT_ARGB8888);
+    if (pool->wl_pool != NULL) {
+        wl_buf = wl_shm_pool_create_buffer(
+            pool->wl_pool, new_offset,
+            buf->public.width, buf->public.height, buf->public.stride,
+            WL_SHM_FORMAT_ARGB8888);
 
-    if (wl_buf == NULL) {
-        LOG_ERR("failed to create SHM buffer");
-        goto err;
+        if (wl_buf == NULL) {
+            LOG_ERR("failed to create SHM buffer");
+            goto err;
+        }
     }
 
     /* One pixman image for each worker thread (do we really need multiple?) */
@@ -279,7 +447,8 @@ instantiate_offset(struct buffer_private *buf, off_t new_offset)
     buf->public.pix = pix;
     buf->offset = new_offset;
 
-    wl_buffer_add_listener(wl_buf, &buffer_listener, buf);
+    if (wl_buf != NULL)
+        wl_buffer_add_listener(wl_buf, &buffer_listener, buf);
     return true;
 
 err:
@@ -296,39 +465,24 @@ err:
     return false;
 }
 
-static void NOINLINE
-get_new_buffers(struct buffer_chain *chain, size_t count,
-                int widths[static count], int heights[static count],
-                struct buffer *bufs[static count], bool immediate_purge)
+/*
+ * Creates a new pool, large enough for ‘size’ bytes worth of
+ * buffers, by:
+ *
+ * 1. open a memory backed "file" with memfd_create()
+ * 2. mmap() the memory file, to be used by the pixman image
+ * 3. create a wayland shm pool for the same memory file
+ *
+ * The pixman images and the wayland buffers created from the pool
+ * are now sharing memory.
+ */
+static struct buffer_pool *
+pool_new(struct buffer_chain *chain, size_t size)
 {
-    xassert(count == 1 || !chain->scrollable);
-    /*
-     * No existing buffer available. Create a new one by:
-     *
-     * 1. open a memory backed "file" with memfd_create()
-     * 2. mmap() the memory file, to be used by the pixman image
-     * 3. create a wayland shm buffer for the same memory file
-     *
-     * The pixman image and the wayland buffer are now sharing memory.
-     */
-
-    int stride[count];
-    int sizes[count];
-
-    size_t total_size = 0;
-    for (size_t i = 0; i < count; i++) {
-        stride[i] = stride_for_format_and_width(PIXMAN_a8r8g8b8, widths[i]);
-        sizes[i] = stride[i] * heights[i];
-        total_size += sizes[i];
-    }
-    if (total_size == 0)
-        return;
-
     int pool_fd = -1;
 
     void *real_mmapped = MAP_FAILED;
     struct wl_shm_pool *wl_pool = NULL;
-    struct buffer_pool *pool = NULL;
 
     /* Backing memory for SHM */
 #if defined(MEMFD_CREATE)
@@ -347,20 +501,14 @@ get_new_buffers(struct buffer_chain *chain, size_t count,
     }
 
 #if __SIZEOF_POINTER__ == 8
-    off_t offset = chain->scrollable && max_pool_size > 0
-        ? (max_pool_size / 4) & ~(page_size() - 1)
-        : 0;
     off_t memfd_size = chain->scrollable && max_pool_size > 0
         ? max_pool_size
-        : total_size;
+        : (off_t)pool_size_class(size);
 #else
-    off_t offset = 0;
-    off_t memfd_size = total_size;
+    off_t memfd_size = pool_size_class(size);
 #endif
 
-    xassert(chain->scrollable || (offset == 0 && memfd_size == total_size));
-
-    LOG_DBG("memfd-size: %lu, initial offset: %lu", memfd_size, offset);
+    LOG_DBG("memfd-size: %lu", memfd_size);
 
     if (ftruncate(pool_fd, memfd_size) == -1) {
         LOG_ERRNO("failed to set size of SHM backing memory file");
@@ -386,8 +534,7 @@ get_new_buffers(struct buffer_chain *chain, size_t count,
     }
 
     if (chain->scrollable && !can_punch_hole) {
-        offset = 0;
-        memfd_size = total_size;
+        memfd_size = pool_size_class(size);
         chain->scrollable = false;
 
         if (ftruncate(pool_fd, memfd_size) < 0) {
@@ -396,6 +543,12 @@ get_new_buffers(struct buffer_chain *chain, size_t count,
         }
     }
 
+#if __SIZEOF_POINTER__ == 8
+    const bool scrollable = chain->scrollable && max_pool_size > 0;
+#else
+    const bool scrollable = false;
+#endif
+
     real_mmapped = mmap(
         NULL, memfd_size, PROT_READ | PROT_WRITE,
         MAP_SHARED | MAP_UNINITIALIZED, pool_fd, 0);
@@ -416,26 +569,95 @@ get_new_buffers(struct buffer_chain *chain, size_t count,
     }
 #endif
 
-    wl_pool = wl_shm_create_pool(chain->shm, pool_fd, memfd_size);
-    if (wl_pool == NULL) {
-        LOG_ERR("failed to create SHM pool");
-        goto err;
+    if (chain->shm != NULL) {
+        wl_pool = wl_shm_create_pool(chain->shm, pool_fd, memfd_size);
+        if (wl_pool == NULL) {
+            LOG_ERR("failed to create SHM pool");
+            goto err;
+        }
     }
 
-    pool = xmalloc(sizeof(*pool));
-    if (pool == NULL) {
-        LOG_ERRNO("failed to allocate buffer pool");
-        goto err;
+    if (!scrollable) {
+        /* We only need to keep the pool FD open if we’re going to SHM
+         * scroll it */
+        close(pool_fd);
+        pool_fd = -1;
     }
 
+    struct buffer_pool *pool = xmalloc(sizeof(*pool));
     *pool = (struct buffer_pool){
         .fd = pool_fd,
+        .shm = chain->shm,
         .wl_pool = wl_pool,
         .real_mmapped = real_mmapped,
         .mmap_size = memfd_size,
+        .scrollable = scrollable,
         .ref_count = 0,
     };
 
+    stats.allocated++;
+    stats.mapped += memfd_size;
+    if (stats.mapped > stats.max_mapped)
+        stats.max_mapped = stats.mapped;
+
+    return pool;
+
+err:
+    if (wl_pool != NULL)
+        wl_shm_pool_destroy(wl_pool);
+    if (real_mmapped != MAP_FAILED)
+        munmap(real_mmapped, memfd_size);
+    if (pool_fd != -1)
+        close(pool_fd);
+
+    /* We don't handle this */
+    abort();
+    return NULL;
+}
+
+static void NOINLINE
+get_new_buffers(struct buffer_chain *chain, size_t count,
+                int widths[static count], int heights[static count],
+                struct buffer *bufs[static count], bool immediate_purge)
+{
+    xassert(count == 1 || !chain->scrollable);
+    /*
+     * No existing buffer available. Re-use a previously released
+     * pool, from any chain, if there is one of the right size. If
+     * not, create a new one.
+     */
+
+    int stride[count];
+    int sizes[count];
+
+    size_t total_size = 0;
+    for (size_t i = 0; i < count; i++) {
+        stride[i] = stride_for_format_and_width(PIXMAN_a8r8g8b8, widths[i]);
+        sizes[i] = stride[i] * heights[i];
+        total_size += sizes[i];
+    }
+    if (total_size == 0)
+        return;
+
+    struct buffer_pool *pool = pool_cache_take(chain, total_size);
+    if (pool == NULL)
+        pool = pool_new(chain, total_size);
+    else
+        LOG_DBG("re-using cached pool %p", (void *)pool);
+
+    xassert(pool->ref_count == 0);
+    xassert(pool->mmap_size >= total_size);
+
+#if __SIZEOF_POINTER__ == 8
+    off_t offset = pool->scrollable
+        ? (max_pool_size / 4) & ~(page_size() - 1)
+        : 0;
+#else
+    off_t offset = 0;
+#endif
+
+    LOG_DBG("initial offset: %lu", offset);
+
     for (size_t i = 0; i < count; i++) {
         if (sizes[i] == 0) {
             bufs[i] = NULL;
@@ -454,7 +676,7 @@ get_new_buffers(struct buffer_chain *chain, size_t count,
             },
             .chain = chain,
             .ref_count = immediate_purge ? 0 : 1,
-            .busy = true,
+            .busy = chain->shm != NULL,
             .pool = pool,
             .offset = 0,
             .size = sizes[i],
@@ -477,34 +699,9 @@ get_new_buffers(struct buffer_chain *chain, size_t count,
         bufs[i] = &buf->public;
     }
 
-#if defined(MEASURE_SHM_ALLOCS) && MEASURE_SHM_ALLOCS
-    {
-        size_t currently_alloced = 0;
-        tll_foreach(buffers, it)
-            currently_alloced += it->item.size;
-        if (currently_alloced > max_alloced)
-            max_alloced = currently_alloced;
-    }
-#endif
-
-    if (!(bufs[0] && shm_can_scroll(bufs[0]))) {
-        /* We only need to keep the pool FD open if we’re going to SHM
-         * scroll it */
-        close(pool_fd);
-        pool->fd = -1;
-    }
-
     return;
 
 err:
-    pool_unref(pool);
-    if (wl_pool != NULL)
-        wl_shm_pool_destroy(wl_pool);
-    if (real_mmapped != MAP_FAILED)
-        munmap(real_mmapped, memfd_size);
-    if (pool_fd != -1)
-        close(pool_fd);
-
     /* We don't handle this */
     abort();
 }
@@ -572,10 +769,8 @@ shm_get_buffer(struct buffer_chain *chain, int width, int height)
 
     if (cached != NULL) {
         LOG_DBG("re-using buffer %p from cache", (void *)cached);
-        cached->busy = true;
+        cached->busy = chain->shm != NULL;
         pixman_region32_clear(&cached->public.dirty);
-        free(cached->public.scroll_damage);
-        cached->public.scroll_damage = NULL;
         xassert(cached->public.pix_instances == chain->pix_instances);
         return &cached->public;
     }
@@ -647,9 +842,9 @@ shm_scroll_forward(struct buffer_private *buf, int rows,
     struct buffer_pool *pool = buf->pool;
 
     xassert(can_punch_hole);
-    xassert(buf->busy);
+    xassert(buf->busy || buf->chain->shm == NULL);
     xassert(buf->public.pix != NULL);
-    xassert(buf->public.wl_buf != NULL);
+    xassert(buf->public.wl_buf != NULL || buf->chain->shm == NULL);
     xassert(pool != NULL);
     xassert(pool->ref_count == 1);
     xassert(pool->fd >= 0);
@@ -9,8 +9,6 @@
 
 #include <tllist.h>
 
-struct damage;
-
 struct buffer {
     int width;
     int height;
@@ -24,15 +22,25 @@ struct buffer {
 
     unsigned age;
 
-    struct damage *scroll_damage;
-    size_t scroll_damage_count;
     pixman_region32_t dirty;
 };
 
 void shm_fini(void);
 void shm_set_max_pool_size(off_t max_pool_size);
 
+/*
+ * Maximum amount of memory used to keep released SHM pools around,
+ * for re-use by any chain. 0 disables the cache.
+ */
+void shm_set_max_cache_size(size_t max_cache_size);
+
 struct buffer_chain;
+
+/*
+ * If ‘shm’ is NULL, the chain’s buffers are offscreen only; they are
+ * not shared with the compositor, have no wl_buffer, and are never
+ * busy.
+ */
 struct buffer_chain *shm_chain_new(
     struct wl_shm *shm, bool scrollable, size_t pix_instances);
 void shm_chain_free(struct buffer_chain *chain);
@@ -7,6 +7,7 @@
 #define LOG_ENABLE_DBG 0
 #include "log.h"
 #include "debug.h"
+#include "grid.h"
 #include "render.h"
 #include "hsl.h"
 #include "util.h"
@@ -129,10 +130,13 @@ sixel_erase(struct terminal *term, struct sixel *sixel)
             continue;
         }
 
-        row->dirty = true;
+        if (grid_row_is_cold(row)) {
+            /* Cold rows are fully re-rendered when thawed */
+            continue;
+        }
 
-        for (int c = sixel->pos.col; c < min(sixel->cols, term->cols); c++)
-            row->cells[c].attrs.clean = 0;
+        row->dirty = true;
+        grid_row_dirty_cells(row, sixel->pos.col, min(sixel->cols, term->cols));
     }
 
     sixel_destroy(sixel);
@@ -1036,13 +1040,8 @@ sixel_unhook(struct terminal *term)
         for (size_t i = 0; i < image.rows; i++) {
             struct row *row = term->grid->rows[cur_row + i];
             row->dirty = true;
-
-            for (int col = image.pos.col;
-                 col < min(image.pos.col + image.cols, term->cols);
-                 col++)
-            {
-                row->cells[col].attrs.clean = 0;
-            }
+            grid_row_dirty_cells(
+                row, image.pos.col, min(image.pos.col + image.cols, term->cols));
 
             if (do_scroll) {
                 /*
@@ -7,6 +7,8 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
 
 #include <sys/stat.h>
 #include <sys/wait.h>
@@ -33,6 +35,7 @@
 #include "quirks.h"
 #include "reaper.h"
 #include "render.h"
+#include "search.h"
 #include "selection.h"
 #include "sixel.h"
 #include "slave.h"
@@ -86,7 +89,7 @@ data_to_slave(struct terminal *term, const void *data, size_t len,
     switch (async_write(term->ptmx, data, len, &async_idx)) {
     case ASYNC_WRITE_REMAIN:
         /* Switch to asynchronous mode; let FDM write the remaining data */
-        if (!fdm_event_add(term->fdm, term->ptmx, EPOLLOUT))
+        if (!term_ptmx_pollout_enable(term))
             return false;
         enqueue_data_for_slave(data, len, async_idx, buffer_list);
         return true;
@@ -149,14 +152,15 @@ term_to_slave(struct terminal *term, const void *data, size_t len)
     return data_to_slave(term, data, len, &term->ptmx_buffers);
 }
 
+/*
+ * Writes queued up data to the slave. ‘done’ is set to false if not
+ * all data could be written, in which case we need to wait for the
+ * PTY to become writable again.
+ */
 static bool
-fdm_ptmx_out(struct fdm *fdm, int fd, int events, void *data)
+ptmx_write_queued(struct terminal *term, bool *done)
 {
-    struct terminal *term = data;
-
-    /* If there is no queued data, then we shouldn't be in asynchronous mode */
-    xassert(tll_length(term->ptmx_buffers) > 0 ||
-           tll_length(term->ptmx_paste_buffers) > 0);
+    *done = false;
 
     /* Writes a single buffer, returns if not all of it could be written */
 #define write_one_buffer(buffer_list)                                   \
@@ -187,17 +191,38 @@ fdm_ptmx_out(struct fdm *fdm, int fd, int events, void *data)
             write_one_buffer(term->ptmx_buffers);
     }
 
+#undef write_one_buffer
+
     /*
      * If we get here, *all* buffers were successfully flushed.
      *
      * Or, we're still sending paste data, in which case we do *not*
      * want to send the "normal" queued up data
-     *
-     * In both cases, we want to *disable* the FDM callback since
-     * otherwise we'd just be called right away again, with nothing to
-     * write.
      */
-    fdm_event_del(term->fdm, term->ptmx, EPOLLOUT);
+    *done = true;
+    return true;
+}
+
+static bool
+fdm_ptmx_out(struct fdm *fdm, int fd, int events, void *data)
+{
+    struct terminal *term = data;
+
+    /* If there is no queued data, then we shouldn't be in asynchronous mode */
+    xassert(tll_length(term->ptmx_buffers) > 0 ||
+           tll_length(term->ptmx_paste_buffers) > 0);
+
+    bool done;
+    if (!ptmx_write_queued(term, &done))
+        return false;
+
+    /*
+     * Nothing more to write (right now); *disable* the FDM callback
+     * since otherwise we'd just be called right away again, with
+     * nothing to write.
+     */
+    if (done)
+        fdm_event_del(term->fdm, term->ptmx, EPOLLOUT);
     return true;
 }
 
@@ -207,54 +232,16 @@ static struct timespec last = {0};
 
 static bool cursor_blink_rearm_timer(struct terminal *term);
 
-/* Externally visible, but not declared in terminal.h, to enable pgo
- * to call this function directly */
-bool
-fdm_ptmx(struct fdm *fdm, int fd, int events, void *data)
+/* Schedules a new frame, after having parsed client output */
+static void
+ptmx_output_parsed(struct terminal *term)
 {
-    struct terminal *term = data;
-
-    const bool pollin = events & EPOLLIN;
-    const bool pollout = events & EPOLLOUT;
-    const bool hup = events & EPOLLHUP;
-
-    if (pollout) {
-        if (!fdm_ptmx_out(fdm, fd, events, data))
-            return false;
-    }
-
     /* Prevent blinking while typing */
     if (term->cursor_blink.fd >= 0) {
         term->cursor_blink.state = CURSOR_BLINK_ON;
         cursor_blink_rearm_timer(term);
     }
 
-    uint8_t buf[24 * 1024];
-    const size_t max_iterations = !hup ? 10 : (size_t)-1ll;
-
-    for (size_t i = 0; i < max_iterations && pollin; i++) {
-        xassert(pollin);
-        ssize_t count = read(term->ptmx, buf, sizeof(buf));
-
-        if (count < 0) {
-            if (errno == EAGAIN || errno == EIO) {
-                /*
-                 * EAGAIN: no more to read - FDM will trigger us again
-                 * EIO: assume PTY was closed - we already have, or will get, a EPOLLHUP
-                 */
-                break;
-            }
-
-            LOG_ERRNO("failed to read from pseudo terminal");
-            return false;
-        } else if (count == 0) {
-            /* Reached end-of-file */
-            break;
-        }
-
-        vt_from_slave(term, buf, count);
-    }
-
     if (!term->render.app_sync_updates.enabled) {
         /*
          * We likely need to re-render. But, we don't want to do it
@@ -322,176 +309,591 @@ fdm_ptmx(struct fdm *fdm, int fd, int events, void *data)
         } else
             render_refresh(term);
     }
+}
 
-    if (hup) {
-        fdm_del(fdm, fd);
-        term->ptmx = -1;
+/*
+ * Upper limit on how much client output we read and parse, across
+ * *all* terminals, in a single FDM loop iteration.
+ */
+#define PTMX_BUDGET_BYTES (256 * 1024)
+#define PTMX_BUDGET_NSECS (8 * 1000000)
+
+void
+term_ptmx_budget_reset(struct ptmx_budget *budget)
+{
+    if (budget->bytes_left < PTMX_BUDGET_BYTES) {
+        /* Only roll over from iterations that actually read something */
+        budget->busy_prev = budget->busy;
     }
 
-    return true;
+    budget->busy = 0;
+    budget->bytes_left = PTMX_BUDGET_BYTES;
+    budget->start = (struct timespec){0};
 }
 
 static bool
-fdm_flash(struct fdm *fdm, int fd, int events, void *data)
+ptmx_budget_time_exceeded(struct ptmx_budget *budget)
 {
-    if (events & EPOLLHUP)
-        return false;
-
-    struct terminal *term = data;
-    uint64_t expiration_count;
-    ssize_t ret = read(
-        term->flash.fd, &expiration_count, sizeof(expiration_count));
-
-    if (ret < 0) {
-        if (errno == EAGAIN)
-            return true;
-
-        LOG_ERRNO("failed to read flash timer");
-        return false;
-    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
 
-    LOG_DBG("flash timer expired %llu times",
-            (unsigned long long)expiration_count);
+    struct timespec elapsed;
+    timespec_sub(&now, &budget->start, &elapsed);
 
-    term->flash.active = false;
-    term_damage_view(term);
-    render_refresh(term);
-    return true;
+    return elapsed.tv_sec > 0 || elapsed.tv_nsec >= PTMX_BUDGET_NSECS;
 }
 
-static bool
-fdm_blink(struct fdm *fdm, int fd, int events, void *data)
+/* Externally visible, but not declared in terminal.h, to enable pgo
+ * to call this function directly */
+bool
+fdm_ptmx(struct fdm *fdm, int fd, int events, void *data)
 {
-    if (events & EPOLLHUP)
-        return false;
-
     struct terminal *term = data;
-    uint64_t expiration_count;
-    ssize_t ret = read(
-        term->blink.fd, &expiration_count, sizeof(expiration_count));
 
-    if (ret < 0) {
-        if (errno == EAGAIN)
-            return true;
+    const bool pollin = events & EPOLLIN;
+    const bool pollout = events & EPOLLOUT;
+    const bool hup = events & EPOLLHUP;
 
-        LOG_ERRNO("failed to read blink timer");
-        return false;
+    if (pollout) {
+        if (!fdm_ptmx_out(fdm, fd, events, data))
+            return false;
     }
 
-    LOG_DBG("blink timer expired %llu times",
-            (unsigned long long)expiration_count);
+    uint8_t buf[24 * 1024];
 
-    /* Invert blink state */
-    term->blink.state = term->blink.state == BLINK_ON
-        ? BLINK_OFF : BLINK_ON;
+    /*
+     * Our share of this loop iteration’s budget. Terminals that were
+     * throttled in the previous iteration split the budget equally;
+     * everyone else may use all of it.
+     *
+     * We always read at least one chunk, regardless of budget. This
+     * ensures e.g. keystroke echoes are processed in a timely manner,
+     * even when other terminals are flooding us with output.
+     *
+     * When the slave has hung up, we read everything there is.
+     */
+    struct ptmx_budget *budget = &term->wl->ptmx_budget;
+    const size_t share = PTMX_BUDGET_BYTES / max(budget->busy_prev, (size_t)1);
 
-    /* Scan all visible cells and mark rows with blinking cells dirty */
-    bool no_blinking_cells = true;
-    for (int r = 0; r < term->rows; r++) {
-        struct row *row = grid_row_in_view(term->grid, r);
-        for (int col = 0; col < term->cols; col++) {
-            struct cell *cell = &row->cells[col];
+    if (pollin && budget->start.tv_sec == 0 && budget->start.tv_nsec == 0)
+        clock_gettime(CLOCK_MONOTONIC, &budget->start);
 
-            if (cell->attrs.blink) {
-                cell->attrs.clean = 0;
-                row->dirty = true;
-                no_blinking_cells = false;
+    size_t consumed = 0;
+    bool throttled = false;
+
+    while (pollin) {
+        if (!hup && consumed > 0 &&
+            (consumed >= share ||
+             budget->bytes_left == 0 ||
+             ptmx_budget_time_exceeded(budget)))
+        {
+            /* If there’s more to read, FDM will trigger us again */
+            int pending;
+            throttled = ioctl(term->ptmx, FIONREAD, &pending) < 0 || pending > 0;
+            break;
+        }
+
+        ssize_t count = read(term->ptmx, buf, sizeof(buf));
+
+        if (count < 0) {
+            if (errno == EAGAIN || errno == EIO) {
+                /*
+                 * EAGAIN: no more to read - FDM will trigger us again
+                 * EIO: assume PTY was closed - we already have, or will get, a EPOLLHUP
+                 */
+                break;
             }
+
+            LOG_ERRNO("failed to read from pseudo terminal");
+            return false;
+        } else if (count == 0) {
+            /* Reached end-of-file */
+            break;
         }
+
+        consumed += count;
+        budget->bytes_left -= min((size_t)count, budget->bytes_left);
+
+        vt_from_slave(term, buf, count);
     }
 
-    if (no_blinking_cells) {
-        LOG_DBG("disarming blink timer");
+    if (throttled) {
+        term->ptmx_stats.throttled++;
+        budget->busy++;
+    }
+
+    ptmx_output_parsed(term);
+
+    if (hup) {
+        fdm_del(fdm, fd);
+        term->ptmx = -1;
+    }
 
-        term->blink.state = BLINK_ON;
-        fdm_del(term->fdm, term->blink.fd);
-        term->blink.fd = -1;
-    } else
-        render_refresh(term);
     return true;
 }
 
+/*
+ * Parser threads
+ *
+ * The main thread “owns” the terminal, i.e. holds term->parser.lock,
+ * except while it is blocked in fdm_poll(), waiting for events. This
+ * is when the parser thread gets to parse the client output it has
+ * read, and to write queued up data to the client.
+ *
+ * When done, the parser thread notifies the main thread (via an
+ * event FD), which then schedules a new frame, just like
+ * fdm_ptmx() does.
+ */
+
+static mtx_t shared_lock;
+static once_flag shared_lock_once = ONCE_FLAG_INIT;
+
+static void
+shared_lock_init(void)
+{
+    if (mtx_init(&shared_lock, mtx_recursive) != thrd_success)
+        BUG("failed to instantiate terminal shared state mutex");
+}
+
 void
-term_arm_blink_timer(struct terminal *term)
+term_shared_lock(struct terminal *term)
 {
-    if (term->blink.fd >= 0)
+    if (!term->parser.running)
         return;
 
-    LOG_DBG("arming blink timer");
+    call_once(&shared_lock_once, &shared_lock_init);
+    mtx_lock(&shared_lock);
+}
 
-    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
-    if (fd < 0) {
-        LOG_ERRNO("failed to create blink timer FD");
+void
+term_shared_unlock(struct terminal *term)
+{
+    if (!term->parser.running)
         return;
-    }
 
-    if (!fdm_add(term->fdm, fd, EPOLLIN, &fdm_blink, term)) {
-        close(fd);
-        return;
-    }
+    mtx_unlock(&shared_lock);
+}
 
-    struct itimerspec alarm = {
-        .it_value = {.tv_sec = 0, .tv_nsec = 500 * 1000000},
-        .it_interval = {.tv_sec = 0, .tv_nsec = 500 * 1000000},
-    };
+static void
+parser_wake(struct terminal *term)
+{
+    if (write(term->parser.wake_fd, &(uint64_t){1}, sizeof(uint64_t)) < 0)
+        LOG_ERRNO("failed to wake parser thread");
+}
 
-    if (timerfd_settime(fd, 0, &alarm, NULL) < 0) {
-        LOG_ERRNO("failed to arm blink timer");
-        fdm_del(term->fdm, fd);
+bool
+term_ptmx_pollout_enable(struct terminal *term)
+{
+    if (term->parser.running) {
+        atomic_store_explicit(
+            &term->parser.want_pollout, true, memory_order_release);
+        parser_wake(term);
+        return true;
     }
 
-    term->blink.fd = fd;
+    return fdm_event_add(term->fdm, term->ptmx, EPOLLOUT);
 }
 
 static void
-cursor_refresh(struct terminal *term)
+parser_unlock(struct terminal *term)
 {
-    term->grid->cur_row->cells[term->grid->cursor.point.col].attrs.clean = 0;
-    term->grid->cur_row->dirty = true;
-    render_refresh(term);
+    mtx_unlock(&term->parser.lock);
+
+    /* Mutexes aren’t fair; make sure the main thread gets in, if it
+     * is waiting for us */
+    while (atomic_load_explicit(
+               &term->parser.main_waiting, memory_order_acquire))
+    {
+        thrd_yield();
+    }
 }
 
-static bool
-fdm_cursor_blink(struct fdm *fdm, int fd, int events, void *data)
+static void
+fdm_parser_wait_hook(struct fdm *fdm, bool waiting, void *data)
 {
-    if (events & EPOLLHUP)
-        return false;
-
     struct terminal *term = data;
-    uint64_t expiration_count;
-    ssize_t ret = read(
-        term->cursor_blink.fd, &expiration_count, sizeof(expiration_count));
-
-    if (ret < 0) {
-        if (errno == EAGAIN)
-            return true;
 
-        LOG_ERRNO("failed to read cursor blink timer");
-        return false;
+    if (waiting)
+        mtx_unlock(&term->parser.lock);
+    else {
+        atomic_store_explicit(
+            &term->parser.main_waiting, true, memory_order_release);
+        mtx_lock(&term->parser.lock);
+        atomic_store_explicit(
+            &term->parser.main_waiting, false, memory_order_release);
     }
-
-    LOG_DBG("cursor blink timer expired %llu times",
-            (unsigned long long)expiration_count);
-
-    /* Invert blink state */
-    term->cursor_blink.state = term->cursor_blink.state == CURSOR_BLINK_ON
-        ? CURSOR_BLINK_OFF : CURSOR_BLINK_ON;
-
-    cursor_refresh(term);
-    return true;
 }
 
-static bool
-fdm_delayed_render(struct fdm *fdm, int fd, int events, void *data)
+static int
+parser_thread(void *data)
 {
-    if (events & EPOLLHUP)
-        return false;
-
     struct terminal *term = data;
 
-    uint64_t unused;
-    ssize_t ret1 = 0;
-    ssize_t ret2 = 0;
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+
+    if (pthread_setname_np(pthread_self(), "foot:parser") < 0)
+        LOG_ERRNO("parser thread: failed to set process title");
+
+    uint8_t buf[24 * 1024];
+    bool hup = false;
+
+    while (!hup) {
+        const bool want_pollout = atomic_load_explicit(
+            &term->parser.want_pollout, memory_order_acquire);
+
+        struct pollfd fds[] = {
+            {.fd = term->ptmx, .events = POLLIN | (want_pollout ? POLLOUT : 0)},
+            {.fd = term->parser.wake_fd, .events = POLLIN},
+        };
+
+        if (poll(fds, ALEN(fds), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            LOG_ERRNO("parser thread: failed to poll");
+            hup = true;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t unused;
+            if (read(term->parser.wake_fd, &unused, sizeof(unused)) < 0 &&
+                errno != EAGAIN)
+            {
+                LOG_ERRNO("parser thread: failed to read wake event FD");
+            }
+        }
+
+        if (atomic_load_explicit(&term->parser.quit, memory_order_acquire))
+            break;
+
+        const bool pollin = fds[0].revents & POLLIN;
+        const bool pollout = fds[0].revents & POLLOUT;
+        hup = hup || (fds[0].revents & (POLLHUP | POLLERR));
+
+        if (pollout) {
+            mtx_lock(&term->parser.lock);
+
+            bool done;
+            if (!ptmx_write_queued(term, &done))
+                hup = true;
+            else if (done) {
+                atomic_store_explicit(
+                    &term->parser.want_pollout, false, memory_order_release);
+            }
+
+            parser_unlock(term);
+        }
+
+        const size_t max_iterations = !hup ? 10 : (size_t)-1ll;
+        bool parsed = false;
+
+        for (size_t i = 0; i < max_iterations && (pollin || hup); i++) {
+            ssize_t count = read(term->ptmx, buf, sizeof(buf));
+
+            if (count < 0) {
+                if (errno == EAGAIN || errno == EIO)
+                    break;
+
+                LOG_ERRNO("parser thread: failed to read from pseudo terminal");
+                hup = true;
+                break;
+            } else if (count == 0)
+                break;
+
+            /* Only hold the lock while parsing; this gives the main
+             * thread a chance to get in between each chunk */
+            mtx_lock(&term->parser.lock);
+            vt_from_slave(term, buf, count);
+            parser_unlock(term);
+
+            parsed = true;
+        }
+
+        if (hup) {
+            mtx_lock(&term->parser.lock);
+            term->parser.hup = true;
+            parser_unlock(term);
+        }
+
+        if (parsed || hup) {
+            if (write(term->parser.notify_fd,
+                      &(uint64_t){1}, sizeof(uint64_t)) < 0)
+            {
+                LOG_ERRNO("parser thread: failed to notify main thread");
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void
+parser_thread_stop(struct terminal *term)
+{
+    if (!term->parser.running)
+        return;
+
+    atomic_store_explicit(&term->parser.quit, true, memory_order_release);
+    parser_wake(term);
+
+    /* Let the thread finish whatever it is doing */
+    fdm_wait_hook_del(term->fdm, &fdm_parser_wait_hook, term);
+    mtx_unlock(&term->parser.lock);
+
+    thrd_join(term->parser.thread, NULL);
+    term->parser.running = false;
+
+    mtx_destroy(&term->parser.lock);
+    fdm_del(term->fdm, term->parser.notify_fd);
+    close(term->parser.wake_fd);
+    term->parser.notify_fd = -1;
+    term->parser.wake_fd = -1;
+}
+
+static bool
+fdm_parser_notify(struct fdm *fdm, int fd, int events, void *data)
+{
+    struct terminal *term = data;
+
+    uint64_t unused;
+    if (read(fd, &unused, sizeof(unused)) < 0 && errno != EAGAIN) {
+        LOG_ERRNO("failed to read parser thread event FD");
+        return false;
+    }
+
+    ptmx_output_parsed(term);
+
+    if (term->parser.hup) {
+        parser_thread_stop(term);
+        close(term->ptmx);
+        term->ptmx = -1;
+    }
+
+    return true;
+}
+
+static bool
+parser_thread_start(struct terminal *term)
+{
+    int wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    int notify_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (wake_fd < 0 || notify_fd < 0) {
+        LOG_ERRNO("failed to create parser thread event FDs");
+        goto err;
+    }
+
+    if (mtx_init(&term->parser.lock, mtx_plain) != thrd_success) {
+        LOG_ERR("failed to instantiate parser thread mutex");
+        goto err;
+    }
+
+    if (!fdm_add(term->fdm, notify_fd, EPOLLIN, &fdm_parser_notify, term)) {
+        mtx_destroy(&term->parser.lock);
+        goto err;
+    }
+
+    term->parser.wake_fd = wake_fd;
+    term->parser.notify_fd = notify_fd;
+    term->parser.hup = false;
+    atomic_store(&term->parser.quit, false);
+    atomic_store(&term->parser.want_pollout,
+                 tll_length(term->ptmx_buffers) > 0 ||
+                 tll_length(term->ptmx_paste_buffers) > 0);
+    atomic_store(&term->parser.main_waiting, false);
+
+    /* We’re running in the main thread, i.e. we own the terminal */
+    mtx_lock(&term->parser.lock);
+    fdm_wait_hook_add(term->fdm, &fdm_parser_wait_hook, term);
+
+    term->parser.running = true;
+
+    if (thrd_create(&term->parser.thread, &parser_thread, term) != thrd_success) {
+        LOG_ERR("failed to create parser thread");
+
+        term->parser.running = false;
+        fdm_wait_hook_del(term->fdm, &fdm_parser_wait_hook, term);
+        mtx_unlock(&term->parser.lock);
+        mtx_destroy(&term->parser.lock);
+        fdm_del(term->fdm, notify_fd);
+        close(wake_fd);
+        term->parser.wake_fd = term->parser.notify_fd = -1;
+        return false;
+    }
+
+    return true;
+
+err:
+    if (wake_fd >= 0)
+        close(wake_fd);
+    if (notify_fd >= 0)
+        close(notify_fd);
+    return false;
+}
+
+static bool
+fdm_flash(struct fdm *fdm, int fd, int events, void *data)
+{
+    if (events & EPOLLHUP)
+        return false;
+
+    struct terminal *term = data;
+    uint64_t expiration_count;
+    ssize_t ret = read(
+        term->flash.fd, &expiration_count, sizeof(expiration_count));
+
+    if (ret < 0) {
+        if (errno == EAGAIN)
+            return true;
+
+        LOG_ERRNO("failed to read flash timer");
+        return false;
+    }
+
+    LOG_DBG("flash timer expired %llu times",
+            (unsigned long long)expiration_count);
+
+    term->flash.active = false;
+    term_damage_view(term);
+    render_refresh(term);
+    return true;
+}
+
+static bool
+fdm_blink(struct fdm *fdm, int fd, int events, void *data)
+{
+    if (events & EPOLLHUP)
+        return false;
+
+    struct terminal *term = data;
+    uint64_t expiration_count;
+    ssize_t ret = read(
+        term->blink.fd, &expiration_count, sizeof(expiration_count));
+
+    if (ret < 0) {
+        if (errno == EAGAIN)
+            return true;
+
+        LOG_ERRNO("failed to read blink timer");
+        return false;
+    }
+
+    LOG_DBG("blink timer expired %llu times",
+            (unsigned long long)expiration_count);
+
+    /* Invert blink state */
+    term->blink.state = term->blink.state == BLINK_ON
+        ? BLINK_OFF : BLINK_ON;
+
+    /* Scan all visible cells and mark rows with blinking cells dirty */
+    bool no_blinking_cells = true;
+    for (int r = 0; r < term->rows; r++) {
+        struct row *row = grid_row_in_view(term->grid, r);
+        for (int col = 0; col < term->cols; col++) {
+            struct cell *cell = &row->cells[col];
+
+            if (cell->attrs.blink) {
+                grid_row_dirty_cell(row, col);
+                row->dirty = true;
+                no_blinking_cells = false;
+            }
+        }
+    }
+
+    if (no_blinking_cells) {
+        LOG_DBG("disarming blink timer");
+
+        term->blink.state = BLINK_ON;
+        fdm_del(term->fdm, term->blink.fd);
+        term->blink.fd = -1;
+    } else
+        render_refresh(term);
+    return true;
+}
+
+void
+term_arm_blink_timer(struct terminal *term)
+{
+    if (term->blink.fd >= 0)
+        return;
+
+    LOG_DBG("arming blink timer");
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) {
+        LOG_ERRNO("failed to create blink timer FD");
+        return;
+    }
+
+    if (!fdm_add(term->fdm, fd, EPOLLIN, &fdm_blink, term)) {
+        close(fd);
+        return;
+    }
+
+    struct itimerspec alarm = {
+        .it_value = {.tv_sec = 0, .tv_nsec = 500 * 1000000},
+        .it_interval = {.tv_sec = 0, .tv_nsec = 500 * 1000000},
+    };
+
+    if (timerfd_settime(fd, 0, &alarm, NULL) < 0) {
+        LOG_ERRNO("failed to arm blink timer");
+        fdm_del(term->fdm, fd);
+    }
+
+    term->blink.fd = fd;
+}
+
+static void
+cursor_refresh(struct terminal *term)
+{
+    grid_row_dirty_cell(term->grid->cur_row, term->grid->cursor.point.col);
+    term->grid->cur_row->dirty = true;
+    render_refresh(term);
+}
+
+static bool
+fdm_cursor_blink(struct fdm *fdm, int fd, int events, void *data)
+{
+    if (events & EPOLLHUP)
+        return false;
+
+    struct terminal *term = data;
+    uint64_t expiration_count;
+    ssize_t ret = read(
+        term->cursor_blink.fd, &expiration_count, sizeof(expiration_count));
+
+    if (ret < 0) {
+        if (errno == EAGAIN)
+            return true;
+
+        LOG_ERRNO("failed to read cursor blink timer");
+        return false;
+    }
+
+    LOG_DBG("cursor blink timer expired %llu times",
+            (unsigned long long)expiration_count);
+
+    /* Invert blink state */
+    term->cursor_blink.state = term->cursor_blink.state == CURSOR_BLINK_ON
+        ? CURSOR_BLINK_OFF : CURSOR_BLINK_ON;
+
+    cursor_refresh(term);
+    return true;
+}
+
+static bool
+fdm_delayed_render(struct fdm *fdm, int fd, int events, void *data)
+{
+    if (events & EPOLLHUP)
+        return false;
+
+    struct terminal *term = data;
+
+    uint64_t unused;
+    ssize_t ret1 = 0;
+    ssize_t ret2 = 0;
 
     if (fd == term->delayed_render_timer.lower_fd)
         ret1 = read(term->delayed_render_timer.lower_fd, &unused, sizeof(unused));
@@ -666,6 +1068,9 @@ term_set_fonts(struct terminal *term, struct fcft_font *fonts[static 4])
     free_custom_glyphs(
         &term->custom_glyphs.legacy, GLYPH_LEGACY_COUNT);
 
+    /* Cached glyph runs were rendered with the old fonts */
+    glyph_run_cache_flush(&term->render.glyph_runs);
+
     const int old_cell_width = term->cell_width;
     const int old_cell_height = term->cell_height;
 
@@ -1117,6 +1522,10 @@ term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
         .conf = conf,
         .ptmx = ptmx,
         .ptmx_buffers = tll_init(),
+        .parser = {
+            .wake_fd = -1,
+            .notify_fd = -1,
+        },
         .ptmx_paste_buffers = tll_init(),
         .font_sizes = {
             xmalloc(sizeof(term->font_sizes[0][0]) * conf->fonts[0].count),
@@ -1136,6 +1545,7 @@ term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
         .scale = 1,
         .flash = {.fd = flash_fd},
         .blink = {.fd = -1},
+        .cold_sweep = {.fd = -1},
         .vt = {
             .state = 0,  /* STATE_GROUND */
         },
@@ -1196,7 +1606,6 @@ term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
             },
             .workers = {
                 .count = conf->render_worker_count,
-                .queue = tll_init(),
             },
             .presentation_timings = conf->presentation_timings,
         },
@@ -1226,6 +1635,9 @@ term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
 
    term_update_ascii_printer(term);
 
+    for (size_t i = 0; i < ALEN(term->render.damage_history.frames); i++)
+        pixman_region32_init(&term->render.damage_history.frames[i].dirty);
+
     for (size_t i = 0; i < 4; i++) {
         const struct config_font_list *font_list = &conf->fonts[i];
         for (size_t j = 0; j < font_list->count; j++) {
@@ -1284,6 +1696,9 @@ term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
         break;
     }
 
+    if (!glyph_run_cache_init(&term->render.glyph_runs))
+        goto err;
+
     if (!initialize_render_workers(term))
         goto err;
 
@@ -1309,9 +1724,13 @@ close_fds:
 void
 term_window_configured(struct terminal *term)
 {
-    /* Enable ptmx FDM callback */
+    /* Enable ptmx FDM callback, or start the parser thread */
     if (!term->shutdown.in_progress) {
         xassert(term->window->is_configured);
+
+        if (term->conf->tweak.parser_threads && parser_thread_start(term))
+            return;
+
         fdm_add(term->fdm, term->ptmx, EPOLLIN, &fdm_ptmx, term);
     }
 }
@@ -1497,9 +1916,13 @@ term_shutdown(struct terminal *term)
     fdm_del(term->fdm, term->delayed_render_timer.lower_fd);
     fdm_del(term->fdm, term->delayed_render_timer.upper_fd);
     fdm_del(term->fdm, term->blink.fd);
+    fdm_del(term->fdm, term->cold_sweep.fd);
     fdm_del(term->fdm, term->flash.fd);
 
-    if (term->window != NULL && term->window->is_configured)
+    if (term->parser.running) {
+        parser_thread_stop(term);
+        close(term->ptmx);
+    } else if (term->window != NULL && term->window->is_configured)
         fdm_del(term->fdm, term->ptmx);
     else
         close(term->ptmx);
@@ -1533,6 +1956,7 @@ term_shutdown(struct terminal *term)
     term->delayed_render_timer.lower_fd = -1;
     term->delayed_render_timer.upper_fd = -1;
     term->blink.fd = -1;
+    term->cold_sweep.fd = -1;
     term->flash.fd = -1;
     term->ptmx = -1;
 
@@ -1578,6 +2002,8 @@ term_destroy(struct terminal *term)
         }
     }
 
+    term_scrollback_streams_detach(term);
+
     fdm_del(term->fdm, term->selection.auto_scroll.fd);
     fdm_del(term->fdm, term->render.app_sync_updates.timer_fd);
     fdm_del(term->fdm, term->render.title.timer_fd);
@@ -1585,19 +2011,23 @@ term_destroy(struct terminal *term)
     fdm_del(term->fdm, term->delayed_render_timer.upper_fd);
     fdm_del(term->fdm, term->cursor_blink.fd);
     fdm_del(term->fdm, term->blink.fd);
+    fdm_del(term->fdm, term->cold_sweep.fd);
     fdm_del(term->fdm, term->flash.fd);
-    fdm_del(term->fdm, term->ptmx);
-    if (term->shutdown.terminate_timeout_fd >= 0)
-        fdm_del(term->fdm, term->shutdown.terminate_timeout_fd);
+
+    if (term->parser.running) {
+        parser_thread_stop(term);
+        close(term->ptmx);
+    } else
+        fdm_del(term->fdm, term->ptmx);
+
+    if (term->shutdown.terminate_timeout_fd >= 0)
+        fdm_del(term->fdm, term->shutdown.terminate_timeout_fd);
 
     if (term->window != NULL) {
         wayl_win_destroy(term->window);
         term->window = NULL;
     }
 
-    mtx_lock(&term->render.workers.lock);
-    xassert(tll_length(term->render.workers.queue) == 0);
-
     /* Count livinig threads - we may get here when only some of the
      * threads have been successfully started */
     size_t worker_count = 0;
@@ -1607,12 +2037,10 @@ term_destroy(struct terminal *term)
                 break;
         }
 
-        for (size_t i = 0; i < worker_count; i++) {
+        term->render.workers.quit = true;
+        for (size_t i = 0; i < worker_count; i++)
             sem_post(&term->render.workers.start);
-            tll_push_back(term->render.workers.queue, -2);
-        }
     }
-    mtx_unlock(&term->render.workers.lock);
 
     urls_reset(term);
 
@@ -1650,10 +2078,14 @@ term_destroy(struct terminal *term)
     mtx_destroy(&term->render.workers.lock);
     sem_destroy(&term->render.workers.start);
     sem_destroy(&term->render.workers.done);
-    xassert(tll_length(term->render.workers.queue) == 0);
-    tll_free(term->render.workers.queue);
+    free(term->render.workers.rendered);
+    free(term->render.workers.scratch_cells);
+    free(term->render.workers.scratch_text);
+
+    glyph_run_cache_destroy(&term->render.glyph_runs);
 
     shm_unref(term->render.last_buf);
+    render_damage_history_destroy(term);
     shm_chain_free(term->render.chains.grid);
     shm_chain_free(term->render.chains.search);
     shm_chain_free(term->render.chains.scrollback_indicator);
@@ -1771,6 +2203,7 @@ erase_cell_range(struct terminal *term, struct row *row, int start, int end)
     xassert(end < term->cols);
 
     row->dirty = true;
+    grid_row_dirty_cells(row, start, end + 1);
 
     const enum color_source bg_src = term->vt.attrs.bg_src;
 
@@ -1836,6 +2269,7 @@ term_reset(struct terminal *term, bool hard)
 
     if (term->grid == &term->alt) {
         term->grid = &term->normal;
+        search_index_invalidate(term, 0, term->normal.num_rows);
         selection_cancel(term);
     }
 
@@ -1871,6 +2305,7 @@ term_reset(struct terminal *term, bool hard)
     term->colors.use_custom_selection = term->conf->colors.use_custom.selection;
     memcpy(term->colors.table, term->conf->colors.table,
            sizeof(term->colors.table));
+    glyph_run_cache_flush(&term->render.glyph_runs);
     term->origin = ORIGIN_ABSOLUTE;
     term->normal.cursor.lcf = false;
     term->alt.cursor.lcf = false;
@@ -1885,6 +2320,12 @@ term_reset(struct terminal *term, bool hard)
     term->cursor_color.text = term->conf->cursor.color.text;
     term->cursor_color.cursor = term->conf->cursor.color.cursor;
     selection_cancel(term);
+
+    /* Streams, and the search index, must not reference rows we’re
+     * about to free */
+    term_scrollback_streams_detach(term);
+    search_index_invalidate(term, 0, term->normal.num_rows);
+
     term->normal.offset = term->normal.view = 0;
     term->alt.offset = term->alt.view = 0;
     for (size_t i = 0; i < term->rows; i++) {
@@ -2031,6 +2472,7 @@ term_font_subpixel_changed(struct terminal *term)
 #endif
 
     term->font_subpixel = subpixel;
+    glyph_run_cache_flush(&term->render.glyph_runs);
     term_damage_view(term);
     render_refresh(term);
 }
@@ -2042,8 +2484,7 @@ term_damage_rows(struct terminal *term, int start, int end)
     for (int r = start; r <= end; r++) {
         struct row *row = grid_row(term->grid, r);
         row->dirty = true;
-        for (int c = 0; c < term->grid->num_cols; c++)
-            row->cells[c].attrs.clean = 0;
+        grid_row_dirty_all(row, term->grid->num_cols);
     }
 }
 
@@ -2054,8 +2495,7 @@ term_damage_rows_in_view(struct terminal *term, int start, int end)
     for (int r = start; r <= end; r++) {
         struct row *row = grid_row_in_view(term->grid, r);
         row->dirty = true;
-        for (int c = 0; c < term->grid->num_cols; c++)
-            row->cells[c].attrs.clean = 0;
+        grid_row_dirty_all(row, term->grid->num_cols);
     }
 }
 
@@ -2074,7 +2514,7 @@ term_damage_view(struct terminal *term)
 void
 term_damage_cursor(struct terminal *term)
 {
-    term->grid->cur_row->cells[term->grid->cursor.point.col].attrs.clean = 0;
+    grid_row_dirty_cell(term->grid->cur_row, term->grid->cursor.point.col);
     term->grid->cur_row->dirty = true;
 }
 
@@ -2139,6 +2579,11 @@ term_erase(struct terminal *term, int start_row, int start_col,
 void
 term_erase_scrollback(struct terminal *term)
 {
+    if (term->grid == &term->normal) {
+        term_scrollback_streams_detach(term);
+        search_index_invalidate(term, 0, term->grid->num_rows);
+    }
+
     const int num_rows = term->grid->num_rows;
     const int mask = num_rows - 1;
 
@@ -2207,6 +2652,9 @@ term_erase_scrollback(struct terminal *term)
             break;
     }
 
+    /* Drops the attributes interned by the erased (cold) rows */
+    grid_cold_attrs_compact(term->grid);
+
     term->grid->view = term->grid->offset;
     term_damage_view(term);
 }
@@ -2245,8 +2693,10 @@ UNITTEST
 #define populate_scrollback() do {                                      \
         for (int i = 0; i < scrollback_rows; i++) {                     \
             if (term.normal.rows[i] == NULL) {                          \
-                struct row *r = xcalloc(1, sizeof(*term.normal.rows[i])); \
+                struct row *r = xcalloc(                                \
+                    1, sizeof(*r) + GRID_DIRTY_MAP_WORDS(cols) * sizeof(uint64_t)); \
                 r->cells = xcalloc(cols, sizeof(r->cells[0]));          \
+                r->dirty_map = (uint64_t *)(r + 1);                     \
                 term.normal.rows[i] = r;                                \
             }                                                           \
         }                                                               \
@@ -2279,195 +2729,816 @@ UNITTEST
     term.selection.end = (struct coord){.row = 19};
     term.selection.kind = SELECTION_CHAR_WISE;
 
-    populate_scrollback();
-    term_erase_scrollback(&term);
-    xassert(term.selection.start.row < 0);
-    xassert(term.selection.end.row < 0);
-    xassert(term.selection.kind == SELECTION_NONE);
+    populate_scrollback();
+    term_erase_scrollback(&term);
+    xassert(term.selection.start.row < 0);
+    xassert(term.selection.end.row < 0);
+    xassert(term.selection.kind == SELECTION_NONE);
+
+    /*
+     * Test case 3 - selection that does *not* touch the
+     * scrollback. Verify the selection is *not* cancelled.
+     */
+
+    /* Selection covers rows 15,0 */
+    term.selection.start = (struct coord){.row = 15};
+    term.selection.end = (struct coord){.row = 16};
+    term.selection.kind = SELECTION_CHAR_WISE;
+
+    populate_scrollback();
+    term_erase_scrollback(&term);
+    xassert(term.selection.start.row == 15);
+    xassert(term.selection.end.row == 16);
+    xassert(term.selection.kind == SELECTION_CHAR_WISE);
+
+    term.selection.start = (struct coord){-1, -1};
+    term.selection.end = (struct coord){-1, -1};
+    term.selection.kind = SELECTION_NONE;
+
+    /*
+     * Test case 4 - sixel that touch the scrollback
+     */
+
+    struct sixel six = {
+        .rows = 5,
+        .pos = {
+            .row = 15,
+        },
+    };
+    tll_push_back(term.normal.sixel_images, six);
+    populate_scrollback();
+    term_erase_scrollback(&term);
+    xassert(tll_length(term.normal.sixel_images) == 0);
+
+    /*
+     * Test case 5 - sixel that does *not* touch the scrollback
+     */
+    six.rows = 3;
+    tll_push_back(term.normal.sixel_images, six);
+    populate_scrollback();
+    term_erase_scrollback(&term);
+    xassert(tll_length(term.normal.sixel_images) == 1);
+
+    /* Cleanup */
+    tll_free(term.normal.sixel_images);
+    close(term.selection.auto_scroll.fd);
+    for (int i = 0; i < scrollback_rows; i++)
+        grid_row_free(term.normal.rows[i]);
+    free(term.normal.rows);
+    fdm_destroy(fdm);
+}
+
+int
+term_row_rel_to_abs(const struct terminal *term, int row)
+{
+    switch (term->origin) {
+    case ORIGIN_ABSOLUTE:
+        return min(row, term->rows - 1);
+
+    case ORIGIN_RELATIVE:
+        return min(row + term->scroll_region.start, term->scroll_region.end - 1);
+    }
+
+    BUG("Invalid cursor_origin value");
+    return -1;
+}
+
+void
+term_cursor_to(struct terminal *term, int row, int col)
+{
+    xassert(row < term->rows);
+    xassert(col < term->cols);
+
+    term->grid->cursor.lcf = false;
+
+    term->grid->cursor.point.col = col;
+    term->grid->cursor.point.row = row;
+
+    term->grid->cur_row = grid_row(term->grid, row);
+}
+
+void
+term_cursor_home(struct terminal *term)
+{
+    term_cursor_to(term, term_row_rel_to_abs(term, 0), 0);
+}
+
+void
+term_cursor_left(struct terminal *term, int count)
+{
+    int move_amount = min(term->grid->cursor.point.col, count);
+    term->grid->cursor.point.col -= move_amount;
+    xassert(term->grid->cursor.point.col >= 0);
+    term->grid->cursor.lcf = false;
+}
+
+void
+term_cursor_right(struct terminal *term, int count)
+{
+    int move_amount = min(term->cols - term->grid->cursor.point.col - 1, count);
+    term->grid->cursor.point.col += move_amount;
+    xassert(term->grid->cursor.point.col < term->cols);
+    term->grid->cursor.lcf = false;
+}
+
+void
+term_cursor_up(struct terminal *term, int count)
+{
+    int top = term->origin == ORIGIN_ABSOLUTE ? 0 : term->scroll_region.start;
+    xassert(term->grid->cursor.point.row >= top);
+
+    int move_amount = min(term->grid->cursor.point.row - top, count);
+    term_cursor_to(term, term->grid->cursor.point.row - move_amount, term->grid->cursor.point.col);
+}
+
+void
+term_cursor_down(struct terminal *term, int count)
+{
+    int bottom = term->origin == ORIGIN_ABSOLUTE ? term->rows : term->scroll_region.end;
+    xassert(bottom >= term->grid->cursor.point.row);
+
+    int move_amount = min(bottom - term->grid->cursor.point.row - 1, count);
+    term_cursor_to(term, term->grid->cursor.point.row + move_amount, term->grid->cursor.point.col);
+}
+
+static bool
+cursor_blink_rearm_timer(struct terminal *term)
+{
+    if (term->cursor_blink.fd < 0) {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (fd < 0) {
+            LOG_ERRNO("failed to create cursor blink timer FD");
+            return false;
+        }
+
+        if (!fdm_add(term->fdm, fd, EPOLLIN, &fdm_cursor_blink, term)) {
+            close(fd);
+            return false;
+        }
+
+        term->cursor_blink.fd = fd;
+    }
+
+    static const struct itimerspec timer = {
+        .it_value = {.tv_sec = 0, .tv_nsec = 500000000},
+        .it_interval = {.tv_sec = 0, .tv_nsec = 500000000},
+    };
+
+    if (timerfd_settime(term->cursor_blink.fd, 0, &timer, NULL) < 0) {
+        LOG_ERRNO("failed to arm cursor blink timer");
+        fdm_del(term->fdm, term->cursor_blink.fd);
+        term->cursor_blink.fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+cursor_blink_disarm_timer(struct terminal *term)
+{
+    fdm_del(term->fdm, term->cursor_blink.fd);
+    term->cursor_blink.fd = -1;
+    return true;
+}
+
+void
+term_cursor_blink_update(struct terminal *term)
+{
+    bool enable = term->cursor_blink.decset || term->cursor_blink.deccsusr;
+    bool activate = !term->shutdown.in_progress && enable && term->visual_focus;
+
+    LOG_DBG("decset=%d, deccsrusr=%d, focus=%d, shutting-down=%d, enable=%d, activate=%d",
+            term->cursor_blink.decset, term->cursor_blink.deccsusr,
+            term->visual_focus, term->shutdown.in_progress,
+            enable, activate);
+
+    if (activate && term->cursor_blink.fd < 0) {
+        term->cursor_blink.state = CURSOR_BLINK_ON;
+        cursor_blink_rearm_timer(term);
+    } else if (!activate && term->cursor_blink.fd >= 0)
+        cursor_blink_disarm_timer(term);
+}
+
+/*
+ * Scrollback streams
+ *
+ * Converts the scrollback to text incrementally, a chunk of rows at
+ * a time, instead of building one big string up front.
+ *
+ * The screen rows are snapshotted when the stream is created, since
+ * they are constantly being modified. Scrollback rows are not, but
+ * they may be overwritten when the terminal scrolls, or freed when
+ * the scrollback is erased, or the window resized. Streams are
+ * notified before this happens (see scrollback_streams_overwrite()
+ * and term_scrollback_streams_detach()), at which point the affected
+ * rows are extracted immediately.
+ *
+ * Text extracted ahead of the reader is buffered, up to
+ * SCROLLBACK_STREAM_MAX_AHEAD characters. When a slow reader falls
+ * further behind than that, rows about to be overwritten are instead
+ * copied, and pinned in the stream, until the reader catches up. The
+ * copies have their trailing empty cells trimmed.
+ *
+ * Pinned rows are always older than the remaining scrollback rows,
+ * and are extracted first.
+ */
+
+#define SCROLLBACK_STREAM_CHUNK_ROWS 256
+#define SCROLLBACK_STREAM_MAX_AHEAD (4 * 1024 * 1024)
+
+struct scrollback_stream_row {
+    struct row *row;
+    int used;               /* Number of cells in the copy */
+};
+
+struct scrollback_stream {
+    struct terminal *term;  /* NULL when detached */
+    struct extraction_context *ctx;
+
+    int next;               /* Next scrollback row (absolute) to extract */
+    int left;               /* Number of scrollback rows left to extract */
+
+    /* Copies of overwritten rows, not yet extracted */
+    tll(struct scrollback_stream_row) pinned;
+
+    /* Last extracted pinned row. The extraction context compares row
+     * pointers to detect new rows, so it must not be re-used yet */
+    struct row *last_pinned;
+
+    struct row **screen;    /* Snapshot of the screen rows */
+    int screen_rows;
+    int cols;
+};
+
+static bool
+scrollback_stream_extract_row(struct scrollback_stream *stream,
+                              const struct row *row, int used)
+{
+    static const struct cell empty = {0};
+
+    for (int c = 0; c < stream->cols; c++) {
+        const struct cell *cell = c < used ? &row->cells[c] : &empty;
+        if (!extract_one(stream->term, row, cell, c, stream->ctx))
+            return false;
+    }
+    return true;
+}
+
+static void
+scrollback_stream_pin(struct scrollback_stream *stream, const struct row *row)
+{
+    int used = stream->cols;
+    while (used > 0 && row->cells[used - 1].wc == 0)
+        used--;
+
+    /* Keep one empty cell, it decides how soft-wrapped rows are joined */
+    if (used < stream->cols)
+        used++;
+
+    struct row *copy = grid_row_alloc(NULL, used, false);
+    memcpy(copy->cells, row->cells, used * sizeof(copy->cells[0]));
+    copy->linebreak = row->linebreak;
+
+    tll_push_back(
+        stream->pinned,
+        ((struct scrollback_stream_row){.row = copy, .used = used}));
+}
+
+/* Extracts, and frees, up to ‘count’ pinned rows */
+static bool
+scrollback_stream_extract_pinned(struct scrollback_stream *stream, int count)
+{
+    bool ret = true;
+
+    tll_foreach(stream->pinned, it) {
+        if (count-- <= 0)
+            break;
+
+        struct scrollback_stream_row pinned = it->item;
+        tll_remove(stream->pinned, it);
+
+        if (ret)
+            ret = scrollback_stream_extract_row(stream, pinned.row, pinned.used);
+
+        grid_row_free(stream->last_pinned);
+        stream->last_pinned = pinned.row;
+    }
+
+    return ret;
+}
+
+/*
+ * Extracts the next ‘count’ scrollback rows. When extracting ahead of
+ * the reader, rows that don’t fit in the buffer are pinned instead.
+ */
+static bool
+scrollback_stream_extract(struct scrollback_stream *stream, int count,
+                          bool ahead)
+{
+    struct grid *grid = &stream->term->normal;
+    const int mask = grid->num_rows - 1;
+
+    xassert(count <= stream->left);
+
+    for (; count > 0; count--) {
+        const struct row *row = grid_row_peek(grid, stream->next);
+
+        stream->next = (stream->next + 1) & mask;
+        stream->left--;
+
+        if (row == NULL)
+            continue;
+
+        if (ahead &&
+            (tll_length(stream->pinned) > 0 ||
+             extract_pending(stream->ctx) >= SCROLLBACK_STREAM_MAX_AHEAD))
+        {
+            scrollback_stream_pin(stream, row);
+            continue;
+        }
+
+        if (!scrollback_stream_extract_row(stream, row, stream->cols))
+            return false;
+    }
+
+    return true;
+}
+
+static void
+scrollback_stream_free_screen(struct scrollback_stream *stream)
+{
+    if (stream->screen == NULL)
+        return;
+
+    for (int r = 0; r < stream->screen_rows; r++)
+        grid_row_free(stream->screen[r]);
+    free(stream->screen);
+    stream->screen = NULL;
+}
+
+struct scrollback_stream *
+term_scrollback_stream_new(struct terminal *term)
+{
+    const struct grid *grid = &term->normal;
+    const int mask = grid->num_rows - 1;
+
+    struct extraction_context *ctx = extract_begin(SELECTION_NONE, true);
+    if (ctx == NULL)
+        return NULL;
+
+    struct scrollback_stream *stream = xmalloc(sizeof(*stream));
+    *stream = (struct scrollback_stream){
+        .term = term,
+        .ctx = ctx,
+        .screen = xcalloc(term->rows, sizeof(stream->screen[0])),
+        .screen_rows = term->rows,
+        .cols = term->cols,
+    };
+
+    /* If scrollback isn't full yet, some rows may be NULL, so scan
+     * forward until we find the first non-NULL row */
+    int start = (grid->offset + term->rows) & mask;
+    int count = grid->num_rows - term->rows;
+
+    while (count > 0 && grid->rows[start] == NULL) {
+        start = (start + 1) & mask;
+        count--;
+    }
+
+    stream->next = start;
+    stream->left = count;
+
+    for (int r = 0; r < term->rows; r++) {
+        const struct row *row = grid->rows[(grid->offset + r) & mask];
+        struct row *copy = grid_row_alloc(NULL, term->cols, false);
+
+        memcpy(copy->cells, row->cells, term->cols * sizeof(copy->cells[0]));
+        copy->linebreak = row->linebreak;
+        stream->screen[r] = copy;
+    }
+
+    tll_push_back(term->scrollback_streams, stream);
+    return stream;
+}
+
+void
+term_scrollback_stream_destroy(struct scrollback_stream *stream)
+{
+    if (stream == NULL)
+        return;
+
+    struct terminal *term = stream->term;
+    if (term != NULL) {
+        tll_foreach(term->scrollback_streams, it) {
+            if (it->item == stream) {
+                tll_remove(term->scrollback_streams, it);
+                break;
+            }
+        }
+    }
+
+    scrollback_stream_free_screen(stream);
+
+    tll_foreach(stream->pinned, it) {
+        grid_row_free(it->item.row);
+        tll_remove(stream->pinned, it);
+    }
+    grid_row_free(stream->last_pinned);
+
+    if (stream->ctx != NULL) {
+        char *text;
+        if (extract_finish(stream->ctx, &text, NULL))
+            free(text);
+    }
+
+    free(stream);
+}
+
+bool
+term_scrollback_stream_next(struct scrollback_stream *stream,
+                            char **text, size_t *len, bool *done)
+{
+    *done = false;
+
+    if (tll_length(stream->pinned) > 0) {
+        if (!scrollback_stream_extract_pinned(
+                stream, SCROLLBACK_STREAM_CHUNK_ROWS))
+        {
+            goto err;
+        }
+
+        return extract_flush(stream->ctx, text, len);
+    }
+
+    if (stream->left > 0) {
+        xassert(stream->term != NULL);
+        if (!scrollback_stream_extract(
+                stream, min(stream->left, SCROLLBACK_STREAM_CHUNK_ROWS),
+                false))
+        {
+            goto err;
+        }
+    }
+
+    if (stream->left > 0)
+        return extract_flush(stream->ctx, text, len);
+
+    if (stream->screen != NULL) {
+        for (int r = 0; r < stream->screen_rows; r++) {
+            if (!scrollback_stream_extract_row(
+                    stream, stream->screen[r], stream->cols))
+            {
+                goto err;
+            }
+        }
+        scrollback_stream_free_screen(stream);
+    }
+
+    /* The context is free:d by extract_finish() */
+    bool ret = extract_finish(stream->ctx, text, len);
+    stream->ctx = NULL;
+    *done = true;
+    return ret;
+
+err:
+    *text = NULL;
+    *len = 0;
+    return false;
+}
+
+/*
+ * Called before ‘count’ rows, starting at absolute row ‘start’, in
+ * the normal grid’s scrollback are overwritten.
+ */
+static void
+scrollback_streams_overwrite(struct terminal *term, int start, int count)
+{
+    const int mask = term->normal.num_rows - 1;
+
+    tll_foreach(term->scrollback_streams, it) {
+        struct scrollback_stream *stream = it->item;
+
+        if (stream->left == 0)
+            continue;
+
+        /* Extract everything up to, and including, the last
+         * overwritten row */
+        const int start_rel = (start - stream->next) & mask;
+        const int next_rel = (stream->next - start) & mask;
+
+        int extract = 0;
+        if (start_rel < stream->left)
+            extract = min(stream->left, start_rel + count);
+        else if (next_rel < count)
+            extract = min(stream->left, count - next_rel);
+
+        if (extract > 0)
+            scrollback_stream_extract(stream, extract, true);
+    }
+}
+
+void
+term_scrollback_streams_detach(struct terminal *term)
+{
+    tll_foreach(term->scrollback_streams, it) {
+        struct scrollback_stream *stream = it->item;
+
+        /* Extraction needs the terminal, so everything left is
+         * extracted now, regardless of how far behind the reader is */
+        scrollback_stream_extract_pinned(
+            stream, tll_length(stream->pinned));
+        scrollback_stream_extract(stream, stream->left, false);
+        xassert(stream->left == 0);
+        xassert(tll_length(stream->pinned) == 0);
+
+        if (stream->screen != NULL) {
+            for (int r = 0; r < stream->screen_rows; r++) {
+                scrollback_stream_extract_row(
+                    stream, stream->screen[r], stream->cols);
+            }
+            scrollback_stream_free_screen(stream);
+        }
+
+        stream->term = NULL;
+        tll_remove(term->scrollback_streams, it);
+    }
+}
+
+UNITTEST
+{
+    const int grid_rows = 16;
+    const int term_rows = 4;
+    const int cols = 3;
+
+    struct terminal term = {
+        .rows = term_rows,
+        .cols = cols,
+        .normal = {
+            .rows = xcalloc(grid_rows, sizeof(term.normal.rows[0])),
+            .num_rows = grid_rows,
+            .num_cols = cols,
+            .offset = 0,
+        },
+    };
+    term.grid = &term.normal;
+
+    /* Screen rows are ‘A’-‘D’, scrollback rows ‘E’-‘P’ */
+    for (int i = 0; i < grid_rows; i++) {
+        struct row *row = grid_row_alloc(NULL, cols, true);
+        row->cells[0].wc = L'A' + i;
+        row->linebreak = true;
+        term.normal.rows[i] = row;
+    }
+
+    const char *expected = "E\nF\nG\nH\nI\nJ\nK\nL\nM\nN\nO\nP\nA\nB\nC\nD";
+
+#define drain_stream(stream, result) do {                               \
+        bool done = false;                                              \
+        size_t total = 0;                                               \
+        while (!done) {                                                 \
+            char *chunk;                                                \
+            size_t len;                                                 \
+            xassert(term_scrollback_stream_next(stream, &chunk, &len, &done)); \
+            xassert(total + len < sizeof(result));                      \
+            memcpy(&result[total], chunk, len);                         \
+            total += len;                                               \
+            free(chunk);                                                \
+        }                                                               \
+        result[total] = '\0';                                           \
+        term_scrollback_stream_destroy(stream);                         \
+    } while (0)
+
+    /*
+     * Test case 1 - rows overwritten while streaming. Verify we get
+     * the text as it was when the stream was created.
+     */
+    {
+        struct scrollback_stream *stream = term_scrollback_stream_new(&term);
+        xassert(stream != NULL);
+        xassert(tll_length(term.scrollback_streams) == 1);
+
+        scrollback_streams_overwrite(&term, term.normal.offset + term_rows, 2);
+        term.normal.rows[4]->cells[0].wc = L'x';
+        term.normal.rows[5]->cells[0].wc = L'x';
+        term.normal.rows[0]->cells[0].wc = L'y';
+
+        char result[128];
+        drain_stream(stream, result);
+        xassert(strcmp(result, expected) == 0);
+        xassert(tll_length(term.scrollback_streams) == 0);
+
+        term.normal.rows[4]->cells[0].wc = L'E';
+        term.normal.rows[5]->cells[0].wc = L'F';
+        term.normal.rows[0]->cells[0].wc = L'A';
+    }
 
     /*
-     * Test case 3 - selection that does *not* touch the
-     * scrollback. Verify the selection is *not* cancelled.
+     * Test case 2 - stream detached (e.g. scrollback erased)
      */
+    {
+        struct scrollback_stream *stream = term_scrollback_stream_new(&term);
+        xassert(stream != NULL);
 
-    /* Selection covers rows 15,0 */
-    term.selection.start = (struct coord){.row = 15};
-    term.selection.end = (struct coord){.row = 16};
-    term.selection.kind = SELECTION_CHAR_WISE;
+        term_scrollback_streams_detach(&term);
+        xassert(tll_length(term.scrollback_streams) == 0);
 
-    populate_scrollback();
-    term_erase_scrollback(&term);
-    xassert(term.selection.start.row == 15);
-    xassert(term.selection.end.row == 16);
-    xassert(term.selection.kind == SELECTION_CHAR_WISE);
+        for (int i = 0; i < grid_rows; i++)
+            term.normal.rows[i]->cells[0].wc = L'z';
 
-    term.selection.start = (struct coord){-1, -1};
-    term.selection.end = (struct coord){-1, -1};
-    term.selection.kind = SELECTION_NONE;
+        char result[128];
+        drain_stream(stream, result);
+        xassert(strcmp(result, expected) == 0);
+    }
 
     /*
-     * Test case 4 - sixel that touch the scrollback
+     * Test case 3 - reader fell too far behind; overwritten rows are
+     * pinned, and the output is still exact
      */
+    {
+        for (int i = 0; i < grid_rows; i++)
+            term.normal.rows[i]->cells[0].wc = L'A' + i;
 
-    struct sixel six = {
-        .rows = 5,
-        .pos = {
-            .row = 15,
-        },
-    };
-    tll_push_back(term.normal.sixel_images, six);
-    populate_scrollback();
-    term_erase_scrollback(&term);
-    xassert(tll_length(term.normal.sixel_images) == 0);
+        struct scrollback_stream *stream = term_scrollback_stream_new(&term);
+        xassert(stream != NULL);
 
-    /*
-     * Test case 5 - sixel that does *not* touch the scrollback
-     */
-    six.rows = 3;
-    tll_push_back(term.normal.sixel_images, six);
-    populate_scrollback();
-    term_erase_scrollback(&term);
-    xassert(tll_length(term.normal.sixel_images) == 1);
+        scrollback_streams_overwrite(&term, term.normal.offset + term_rows, 2);
+        xassert(tll_length(stream->pinned) == 0);
 
-    /* Cleanup */
-    tll_free(term.normal.sixel_images);
-    close(term.selection.auto_scroll.fd);
-    for (int i = 0; i < scrollback_rows; i++)
-        grid_row_free(term.normal.rows[i]);
-    free(term.normal.rows);
-    fdm_destroy(fdm);
-}
+        /* Simulate a full buffer; ‘G’-‘I’ are pinned */
+        for (int i = 0; i < 3; i++)
+            scrollback_stream_pin(stream, term.normal.rows[6 + i]);
+        stream->next += 3;
+        stream->left -= 3;
 
-int
-term_row_rel_to_abs(const struct terminal *term, int row)
-{
-    switch (term->origin) {
-    case ORIGIN_ABSOLUTE:
-        return min(row, term->rows - 1);
+        /* Once rows have been pinned, all following rows must be too */
+        scrollback_streams_overwrite(&term, term.normal.offset + term_rows, 6);
+        xassert(tll_length(stream->pinned) == 4);
 
-    case ORIGIN_RELATIVE:
-        return min(row + term->scroll_region.start, term->scroll_region.end - 1);
+        for (int i = 4; i < 10; i++)
+            term.normal.rows[i]->cells[0].wc = L'x';
+
+        char result[128];
+        drain_stream(stream, result);
+        xassert(strcmp(result, expected) == 0);
+
+        for (int i = 4; i < 10; i++)
+            term.normal.rows[i]->cells[0].wc = L'A' + i;
     }
 
-    BUG("Invalid cursor_origin value");
-    return -1;
+#undef drain_stream
+
+    for (int i = 0; i < grid_rows; i++)
+        grid_row_free(term.normal.rows[i]);
+    free(term.normal.rows);
 }
 
-void
-term_cursor_to(struct terminal *term, int row, int col)
+/*
+ * Scrollback rows more than tweak.cold-scrollback lines above the
+ * screen are compressed, see grid_row_freeze(). Rows near the view,
+ * selected rows, and the row the cursor was last rendered on, are
+ * left alone; they are likely to be accessed again soon.
+ *
+ * Rows are frozen as they cross the threshold. Rows that have been
+ * thawed, or reflowed, are re-frozen in the background, a chunk at a
+ * time, from a timer; freezing the whole scrollback at once would
+ * block the main thread.
+ */
+
+#define COLD_SWEEP_CHUNK_ROWS 4096
+#define COLD_SWEEP_INTERVAL_MS 10
+static bool
+cold_scrollback_row_is_busy(const struct terminal *term, int row_no)
 {
-    xassert(row < term->rows);
-    xassert(col < term->cols);
+    const struct grid *grid = &term->normal;
+    const int mask = grid->num_rows - 1;
 
-    term->grid->cursor.lcf = false;
+    if (((row_no - grid->view + term->rows) & mask) < 3 * term->rows)
+        return true;
 
-    term->grid->cursor.point.col = col;
-    term->grid->cursor.point.row = row;
+    if (term->grid == grid && term->selection.end.row >= 0) {
+        const int start = min(term->selection.start.row, term->selection.end.row);
+        const int end = max(term->selection.start.row, term->selection.end.row);
 
-    term->grid->cur_row = grid_row(term->grid, row);
-}
+        if (((row_no - start) & mask) <= end - start)
+            return true;
+    }
 
-void
-term_cursor_home(struct terminal *term)
-{
-    term_cursor_to(term, term_row_rel_to_abs(term, 0), 0);
+    return term->render.last_cursor.row == grid->rows[row_no & mask];
 }
 
-void
-term_cursor_left(struct terminal *term, int count)
+/* Freezes ‘count’ scrollback rows, the first one being ‘first’ lines
+ * above the screen, and the others above it */
+static void
+cold_scrollback_freeze(struct terminal *term, int first, int count)
 {
-    int move_amount = min(term->grid->cursor.point.col, count);
-    term->grid->cursor.point.col -= move_amount;
-    xassert(term->grid->cursor.point.col >= 0);
-    term->grid->cursor.lcf = false;
-}
+    struct grid *grid = &term->normal;
+    const int scrollback_rows = grid->num_rows - term->rows;
 
-void
-term_cursor_right(struct terminal *term, int count)
-{
-    int move_amount = min(term->cols - term->grid->cursor.point.col - 1, count);
-    term->grid->cursor.point.col += move_amount;
-    xassert(term->grid->cursor.point.col < term->cols);
-    term->grid->cursor.lcf = false;
-}
+    if (first < 0 || first >= scrollback_rows)
+        return;
 
-void
-term_cursor_up(struct terminal *term, int count)
-{
-    int top = term->origin == ORIGIN_ABSOLUTE ? 0 : term->scroll_region.start;
-    xassert(term->grid->cursor.point.row >= top);
+    count = min(count, scrollback_rows - first);
 
-    int move_amount = min(term->grid->cursor.point.row - top, count);
-    term_cursor_to(term, term->grid->cursor.point.row - move_amount, term->grid->cursor.point.col);
-}
+    for (int i = 0; i < count; i++) {
+        const int row_no = grid->offset - 1 - first - i;
 
-void
-term_cursor_down(struct terminal *term, int count)
-{
-    int bottom = term->origin == ORIGIN_ABSOLUTE ? term->rows : term->scroll_region.end;
-    xassert(bottom >= term->grid->cursor.point.row);
+        if (cold_scrollback_row_is_busy(term, row_no))
+            continue;
 
-    int move_amount = min(bottom - term->grid->cursor.point.row - 1, count);
-    term_cursor_to(term, term->grid->cursor.point.row + move_amount, term->grid->cursor.point.col);
+        grid_row_freeze(grid, row_no);
+    }
 }
 
 static bool
-cursor_blink_rearm_timer(struct terminal *term)
+fdm_cold_sweep(struct fdm *fdm, int fd, int events, void *data)
 {
-    if (term->cursor_blink.fd < 0) {
-        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
-        if (fd < 0) {
-            LOG_ERRNO("failed to create cursor blink timer FD");
-            return false;
-        }
+    if (events & EPOLLHUP)
+        return false;
 
-        if (!fdm_add(term->fdm, fd, EPOLLIN, &fdm_cursor_blink, term)) {
-            close(fd);
-            return false;
-        }
+    struct terminal *term = data;
+    uint64_t expiration_count;
+    ssize_t ret = read(
+        term->cold_sweep.fd, &expiration_count, sizeof(expiration_count));
 
-        term->cursor_blink.fd = fd;
+    if (ret < 0) {
+        if (errno == EAGAIN)
+            return true;
+        LOG_ERRNO("failed to read cold scrollback sweep timer");
+        return false;
     }
 
-    static const struct itimerspec timer = {
-        .it_value = {.tv_sec = 0, .tv_nsec = 500000000},
-        .it_interval = {.tv_sec = 0, .tv_nsec = 500000000},
-    };
+    const int distance = min(term->conf->tweak.cold_scrollback, INT32_MAX);
+    const int scrollback_rows = term->normal.num_rows - term->rows;
 
-    if (timerfd_settime(term->cursor_blink.fd, 0, &timer, NULL) < 0) {
-        LOG_ERRNO("failed to arm cursor blink timer");
-        fdm_del(term->fdm, term->cursor_blink.fd);
-        term->cursor_blink.fd = -1;
-        return false;
+    if (distance < scrollback_rows &&
+        term->cold_sweep.next < scrollback_rows - distance)
+    {
+        cold_scrollback_freeze(
+            term, distance + term->cold_sweep.next, COLD_SWEEP_CHUNK_ROWS);
+        term->cold_sweep.next += COLD_SWEEP_CHUNK_ROWS;
+        return true;
     }
 
-    return true;
-}
+    if (term->normal.thawed) {
+        /* Rows were thawed while we were sweeping */
+        term->cold_sweep.next = 0;
+        term->normal.thawed = false;
+        return true;
+    }
 
-static bool
-cursor_blink_disarm_timer(struct terminal *term)
-{
-    fdm_del(term->fdm, term->cursor_blink.fd);
-    term->cursor_blink.fd = -1;
+    if (grid_cold_attrs_compact_pending(&term->normal))
+        grid_cold_attrs_compact(&term->normal);
+
+    LOG_DBG("cold scrollback sweep done");
+    fdm_del(term->fdm, term->cold_sweep.fd);
+    term->cold_sweep.fd = -1;
     return true;
 }
 
+/* Starts re-freezing thawed rows, and compacting the interned
+ * attributes, in the background. Must be called from the main thread */
 void
-term_cursor_blink_update(struct terminal *term)
+term_cold_scrollback_sweep(struct terminal *term)
 {
-    bool enable = term->cursor_blink.decset || term->cursor_blink.deccsusr;
-    bool activate = !term->shutdown.in_progress && enable && term->visual_focus;
+    if (term->conf->tweak.cold_scrollback == 0)
+        return;
 
-    LOG_DBG("decset=%d, deccsrusr=%d, focus=%d, shutting-down=%d, enable=%d, activate=%d",
-            term->cursor_blink.decset, term->cursor_blink.deccsusr,
-            term->visual_focus, term->shutdown.in_progress,
-            enable, activate);
+    if (!term->normal.thawed &&
+        !grid_cold_attrs_compact_pending(&term->normal))
+    {
+        return;
+    }
 
-    if (activate && term->cursor_blink.fd < 0) {
-        term->cursor_blink.state = CURSOR_BLINK_ON;
-        cursor_blink_rearm_timer(term);
-    } else if (!activate && term->cursor_blink.fd >= 0)
-        cursor_blink_disarm_timer(term);
+    /* Restarts by itself, if rows are thawed while running */
+    if (term->cold_sweep.fd >= 0)
+        return;
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) {
+        LOG_ERRNO("failed to create cold scrollback sweep timer FD");
+        return;
+    }
+
+    if (!fdm_add(term->fdm, fd, EPOLLIN, &fdm_cold_sweep, term)) {
+        close(fd);
+        return;
+    }
+
+    const struct itimerspec alarm = {
+        .it_value = {.tv_sec = 0, .tv_nsec = COLD_SWEEP_INTERVAL_MS * 1000000},
+        .it_interval = {.tv_sec = 0, .tv_nsec = COLD_SWEEP_INTERVAL_MS * 1000000},
+    };
+
+    if (timerfd_settime(fd, 0, &alarm, NULL) < 0) {
+        LOG_ERRNO("failed to arm cold scrollback sweep timer");
+        fdm_del(term->fdm, fd);
+        return;
+    }
+
+    term->cold_sweep.fd = fd;
+    term->cold_sweep.next = 0;
+    term->normal.thawed = false;
 }
 
 static bool
@@ -2512,6 +3583,20 @@ term_scroll_partial(struct terminal *term, struct scroll_region region, int rows
 
     sixel_scroll_up(term, rows);
 
+    if (unlikely(tll_length(term->scrollback_streams) > 0) &&
+        term->grid == &term->normal)
+    {
+        scrollback_streams_overwrite(
+            term, term->grid->offset + term->rows, rows);
+    }
+
+    if (unlikely(term->search.row_index.bits != NULL) &&
+        term->grid == &term->normal)
+    {
+        search_index_invalidate(term, term->grid->offset + term->rows, rows);
+        search_count_scroll(term, rows);
+    }
+
     bool view_follows = term->grid->view == term->grid->offset;
     term->grid->offset += rows;
     term->grid->offset &= term->grid->num_rows - 1;
@@ -2535,6 +3620,17 @@ term_scroll_partial(struct terminal *term, struct scroll_region region, int rows
         erase_line(term, row);
     }
 
+    if (term->grid == &term->normal && term->conf->tweak.cold_scrollback > 0) {
+        /* Rows that just crossed the threshold */
+        cold_scrollback_freeze(
+            term, min(term->conf->tweak.cold_scrollback, INT32_MAX), rows);
+
+        /* Keep the background sweep on the same row */
+        if (unlikely(term->cold_sweep.fd >= 0))
+            term->cold_sweep.next = min(term->cold_sweep.next + rows,
+                                        term->normal.num_rows);
+    }
+
     term_damage_scroll(term, DAMAGE_SCROLL, region, rows);
     term->grid->cur_row = grid_row(term->grid, term->grid->cursor.point.row);
 
@@ -2577,6 +3673,19 @@ term_scroll_reverse_partial(struct terminal *term,
 
     sixel_scroll_down(term, rows);
 
+    if (unlikely(tll_length(term->scrollback_streams) > 0) &&
+        term->grid == &term->normal)
+    {
+        scrollback_streams_overwrite(
+            term, term->grid->offset - rows, rows);
+    }
+
+    if (unlikely(term->search.row_index.bits != NULL) &&
+        term->grid == &term->normal)
+    {
+        search_index_invalidate(term, term->grid->offset - rows, rows);
+    }
+
     bool view_follows = term->grid->view == term->grid->offset;
     term->grid->offset -= rows;
     while (term->grid->offset < 0)
@@ -3192,8 +4301,7 @@ print_insert(struct terminal *term, int width)
         move_count * sizeof(struct cell));
 
     /* Mark moved cells as dirty */
-    for (size_t i = term->grid->cursor.point.col + width; i < term->cols; i++)
-        row->cells[i].attrs.clean = 0;
+    grid_row_dirty_cells(row, term->grid->cursor.point.col + width, term->cols);
 }
 
 static void
@@ -3205,6 +4313,7 @@ print_spacer(struct terminal *term, int col, int remaining)
 
     cell->wc = CELL_SPACER + remaining;
     cell->attrs = term->vt.attrs;
+    grid_row_dirty_cell(row, col);
 }
 
 void
@@ -3258,6 +4367,7 @@ term_print(struct terminal *term, wchar_t wc, int width)
     struct cell *cell = &row->cells[col];
     cell->wc = term->vt.last_printed = wc;
     cell->attrs = term->vt.attrs;
+    grid_row_dirty_cell(row, col);
 
     if (term->vt.osc8.uri != NULL) {
         grid_row_uri_range_put(
@@ -3318,6 +4428,7 @@ ascii_printer_fast(struct terminal *term, wchar_t wc)
     struct cell *cell = &row->cells[col];
     cell->wc = term->vt.last_printed = wc;
     cell->attrs = term->vt.attrs;
+    grid_row_dirty_cell(row, col);
 
     /* Advance cursor */
     if (unlikely(++col >= term->cols)) {
@@ -3332,6 +4443,71 @@ ascii_printer_fast(struct terminal *term, wchar_t wc)
         grid_row_uri_range_erase(row, uri_start, uri_start);
 }
 
+void
+term_print_ascii_run(struct terminal *term, const uint8_t *s, size_t count)
+{
+    /*
+     * Only the fast printer can be batched. Note that the printer may
+     * change after the first character (single shift).
+     */
+    while (count > 0 && term->ascii_printer != &ascii_printer_fast) {
+        term->ascii_printer(term, *s++);
+        count--;
+    }
+
+    if (count == 0)
+        return;
+
+    struct grid *grid = term->grid;
+
+    xassert(term->charsets.set[term->charsets.selected] == CHARSET_ASCII);
+    xassert(!term->insert_mode);
+    xassert(tll_length(grid->sixel_images) == 0);
+
+    const struct attributes attrs = term->vt.attrs;
+
+    while (count > 0) {
+        print_linewrap(term);
+
+        /* *Must* get current cell *after* linewrap */
+        int col = grid->cursor.point.col;
+        const int uri_start = col;
+
+        /* Number of characters that fit before the right margin */
+        const size_t fits = min(count, (size_t)(term->cols - col));
+        xassert(fits > 0);
+
+        struct row *row = grid->cur_row;
+        row->dirty = true;
+        row->linebreak = true;
+
+        struct cell *cell = &row->cells[col];
+        for (size_t i = 0; i < fits; i++) {
+            cell[i].wc = s[i];
+            cell[i].attrs = attrs;
+        }
+        grid_row_dirty_cells(row, col, col + fits);
+
+        if (unlikely(row->extra != NULL))
+            grid_row_uri_range_erase(row, uri_start, uri_start + fits - 1);
+
+        term->vt.last_printed = s[fits - 1];
+
+        /* Advance cursor */
+        col += fits;
+        if (col >= term->cols) {
+            grid->cursor.lcf = true;
+            col = term->cols - 1;
+        } else
+            xassert(!grid->cursor.lcf);
+
+        grid->cursor.point.col = col;
+
+        s += fits;
+        count -= fits;
+    }
+}
+
 static void
 ascii_printer_single_shift(struct terminal *term, wchar_t wc)
 {
@@ -3418,7 +4594,7 @@ rows_to_text(const struct terminal *term, int start, int end,
          r != ((end + 1) & (term->grid->num_rows - 1));
          r = (r + 1) & (term->grid->num_rows - 1))
     {
-        const struct row *row = term->grid->rows[r];
+        const struct row *row = grid_row_peek(term->grid, r);
         xassert(row != NULL);
 
         for (int c = 0; c < term->cols; c++)
@@ -3430,31 +4606,6 @@ out:
     return extract_finish(ctx, text, len);
 }
 
-bool
-term_scrollback_to_text(const struct terminal *term, char **text, size_t *len)
-{
-    int start = term->grid->offset + term->rows;
-    int end = term->grid->offset + term->rows - 1;
-
-    /* If scrollback isn't full yet, this may be NULL, so scan forward
-     * until we find the first non-NULL row */
-    while (term->grid->rows[start] == NULL) {
-        start++;
-        start &= term->grid->num_rows - 1;
-    }
-
-    if (end < 0)
-        end += term->grid->num_rows;
-
-    while (term->grid->rows[end] == NULL) {
-        end--;
-        if (end < 0)
-            end += term->grid->num_rows;
-    }
-
-    return rows_to_text(term, start, end, text, len);
-}
-
 bool
 term_view_to_text(const struct terminal *term, char **text, size_t *len)
 {
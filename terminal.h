@@ -7,6 +7,7 @@
 
 #include <threads.h>
 #include <semaphore.h>
+#include <stdatomic.h>
 
 #if defined(FOOT_GRAPHEME_CLUSTERING)
  #include <utf8proc.h>
@@ -19,6 +20,7 @@
 #include "composed.h"
 #include "debug.h"
 #include "fdm.h"
+#include "glyph-run-cache.h"
 #include "macros.h"
 #include "reaper.h"
 #include "shm.h"
@@ -49,7 +51,6 @@ struct attributes {
     bool reverse:1;
     uint32_t fg:24;
 
-    bool clean:1;
     enum color_source fg_src:2;
     enum color_source bg_src:2;
     bool confined:1;
@@ -94,6 +95,27 @@ struct damage {
     int lines;
 };
 
+/* Horizontal pixel range, [x1, x2), repainted on a row */
+struct row_damage {
+    int x1;
+    int x2;
+};
+
+struct cell_render;
+
+/*
+ * Measured cost, in nanoseconds, of one way of applying scroll
+ * damage, as a function of the number of lines it touches. These
+ * are decaying sums, for a least squares fit of cost = a + b*lines.
+ */
+struct scroll_cost {
+    double n;
+    double lines;
+    double ns;
+    double lines_sq;
+    double lines_ns;
+};
+
 struct row_uri_range {
     int start;
     int end;
@@ -109,11 +131,17 @@ struct row_data {
     } uri_ranges;
 };
 
+struct row_arena;
+struct row_slab;
+struct cold_cache;
+
 struct row {
     struct cell *cells;
+    uint64_t *dirty_map;    /* One bit per cell, set if it needs rendering */
     bool dirty;
     bool linebreak;
     struct row_data *extra;
+    struct row_slab *slab;  /* NULL if not allocated from a row arena */
 };
 
 struct sixel {
@@ -159,6 +187,9 @@ struct grid {
 
     struct row **rows;
     struct row *cur_row;
+    struct row_arena *arena;  /* Allocator for ‘rows’ (grid.c) */
+    struct cold_cache *cold;  /* Decompressed cold rows (grid.c) */
+    bool thawed;              /* Scrollback may have new hot rows */
 
     tll(struct damage) scroll_damage;
     tll(struct sixel) sixel_images;
@@ -316,6 +347,10 @@ struct terminal {
     pid_t slave;
     int ptmx;
 
+    struct {
+        uint64_t throttled;  /* Times fdm_ptmx() stopped due to the read budget */
+    } ptmx_stats;
+
     struct vt vt;
     struct grid *grid;
     struct grid normal;
@@ -346,6 +381,9 @@ struct terminal {
 
     tll(int) tab_stops;
 
+    /* Active term_scrollback_stream_new() streams */
+    tll(struct scrollback_stream *) scrollback_streams;
+
     size_t composed_count;
     struct composed *composed;
 
@@ -390,6 +428,29 @@ struct terminal {
     ptmx_buffer_list_t ptmx_buffers;
     ptmx_buffer_list_t ptmx_paste_buffers;
 
+    /*
+     * PTY reader/VT parser thread (tweak.parser-threads)
+     *
+     * The main thread holds ‘lock’ at all times, except while it is
+     * blocked waiting for events (see fdm_wait_hook_add()). The
+     * parser thread takes it while parsing, or writing queued data
+     * to the PTY. Thus, the parser thread never runs concurrently
+     * with rendering, input handling etc, but parser threads of
+     * different terminals run in parallel.
+     */
+    struct {
+        bool running;
+        thrd_t thread;
+        mtx_t lock;
+        int wake_fd;     /* Main -> parser: quit, or want POLLOUT */
+        int notify_fd;   /* Parser -> main: output parsed, or PTY HUP */
+
+        atomic_bool quit;
+        atomic_bool want_pollout;
+        atomic_bool main_waiting;
+        bool hup;
+    } parser;
+
     struct {
         bool esc_prefix;
         bool eight_bit;
@@ -446,6 +507,12 @@ struct terminal {
         int fd;
     } blink;
 
+    /* Background freezing, see term_cold_scrollback_sweep() */
+    struct {
+        int fd;
+        int next;   /* Next row, in lines above the cold threshold */
+    } cold_sweep;
+
     int scale;
     int width;  /* pixels */
     int height; /* pixels */
@@ -515,6 +582,66 @@ struct terminal {
         struct coord match;
         size_t match_len;
 
+        struct {
+            uint64_t *bits;  /* Per-row character filter, see search.c */
+            int size;
+        } row_index;
+
+        /* All matches in view, one bit per cell, see search.c */
+        struct {
+            uint64_t *bits;
+            uint64_t *scratch;
+            int rows;
+            int cols;
+        } highlight;
+
+        /* Regular expression mode, see search.c */
+        struct {
+            bool enabled;
+            bool compiled;
+            struct regex *re;      /* NULL if the pattern is invalid */
+            struct regex *re_reversed;
+            wchar_t *pattern;
+            size_t pattern_len;
+            uint64_t first_bits;     /* Row filter, see row_index_query_bits() */
+            uint64_t required_bits;
+
+            /* All matches in the last scanned (logical) line */
+            struct {
+                int first_row;
+                int rows;
+                int last_cols;
+                struct regex_match *matches;
+                size_t count;
+                size_t size;
+
+                uint64_t *starts;  /* Cells where matches may start */
+                size_t starts_size;
+            } line;
+        } regex;
+
+        /* Match counter (“n/N”), see search_count_matches() */
+        struct {
+            wchar_t *query;
+            size_t query_len;
+            bool regex;
+            const struct grid *grid;
+            int offset;
+            struct coord match;
+
+            int scanned;            /* Rows scanned, from the oldest */
+            uint32_t *row_matches;  /* Per (absolute) row match count */
+            int row_matches_size;
+            size_t found;
+            size_t current;
+            bool done;
+
+            /* Last complete count */
+            bool valid;
+            size_t total;
+            size_t index;
+        } counter;
+
         struct {
             wchar_t *buf;
             size_t len;
@@ -575,11 +702,36 @@ struct terminal {
             sem_t start;
             sem_t done;
             mtx_t lock;
-            tll(int) queue;
             thrd_t *threads;
             struct buffer *buf;
+            bool quit;
+
+            /*
+             * Rows of the current frame are claimed, scanned and
+             * (if dirty) rendered by the workers *and* the main
+             * thread, by bumping ‘next_row’. The pixels repainted
+             * on each row are recorded in ‘rendered’, from which the
+             * main thread builds the frame’s damage once all threads
+             * are done.
+             */
+            struct row_damage *rendered;
+            size_t rendered_size;
+            int row_count;
+            atomic_int next_row;
+
+            /*
+             * Per-thread scratch memory for render_row(), ‘scratch_cols’
+             * entries per thread; the main thread’s first, followed by
+             * the workers’. Kept off the (possibly small) thread stacks.
+             */
+            struct cell_render *scratch_cells;
+            wchar_t *scratch_text;
+            int scratch_cols;
         } workers;
 
+        /* Pre-rendered runs of cells, re-used between frames */
+        struct glyph_run_cache glyph_runs;
+
         /* Last rendered cursor position */
         struct {
             struct row *row;
@@ -588,6 +740,38 @@ struct terminal {
         } last_cursor;
 
         struct buffer *last_buf;     /* Buffer we rendered to last time */
+
+        /*
+         * The last few frames’ scroll damage (as applied), and the
+         * region they rendered, after scrolling. Used to bring
+         * re-used buffers, still holding an older frame, up to date.
+         */
+        struct {
+            struct {
+                struct damage *scroll;
+                size_t scroll_count;
+                pixman_region32_t dirty;
+                bool valid;          /* ‘dirty’ has been recorded */
+            } frames[4];
+            size_t head;             /* Newest frame */
+            size_t count;
+        } damage_history;
+
+        /* SHM scrolling vs. memmove, see render.c */
+        struct {
+            int width;               /* Buffer size the costs apply to */
+            int height;
+            struct scroll_cost shm;
+            struct scroll_cost memmove;
+            uint64_t count;          /* Scrolls, for exploring */
+
+            /* Since last logged frame */
+            struct {
+                uint64_t count;
+                uint64_t ns;
+            } stats[2];              /* Indexed by ‘used SHM’ */
+        } scroll_cost;
+
         bool was_flashing;           /* Flash was active last time we rendered */
         bool was_searching;
 
@@ -691,6 +875,15 @@ void term_reset(struct terminal *term, bool hard);
 bool term_to_slave(struct terminal *term, const void *data, size_t len);
 bool term_paste_data_to_slave(
     struct terminal *term, const void *data, size_t len);
+bool term_ptmx_pollout_enable(struct terminal *term);
+void term_ptmx_budget_reset(struct ptmx_budget *budget);
+
+/*
+ * Serializes parser threads’ access to state shared between
+ * terminals. No-op unless the terminal has a parser thread.
+ */
+void term_shared_lock(struct terminal *term);
+void term_shared_unlock(struct terminal *term);
 
 bool term_font_size_increase(struct terminal *term);
 bool term_font_size_decrease(struct terminal *term);
@@ -724,6 +917,7 @@ void term_erase(
     int start_row, int start_col,
     int end_row, int end_col);
 void term_erase_scrollback(struct terminal *term);
+void term_cold_scrollback_sweep(struct terminal *term);
 
 int term_row_rel_to_abs(const struct terminal *term, int row);
 void term_cursor_home(struct terminal *term);
@@ -735,6 +929,8 @@ void term_cursor_down(struct terminal *term, int count);
 void term_cursor_blink_update(struct terminal *term);
 
 void term_print(struct terminal *term, wchar_t wc, int width);
+void term_print_ascii_run(
+    struct terminal *term, const uint8_t *s, size_t count);
 
 void term_scroll(struct terminal *term, int rows);
 void term_scroll_reverse(struct terminal *term, int rows);
@@ -784,8 +980,11 @@ void term_disable_app_sync_updates(struct terminal *term);
 enum term_surface term_surface_kind(
     const struct terminal *term, const struct wl_surface *surface);
 
-bool term_scrollback_to_text(
-    const struct terminal *term, char **text, size_t *len);
+struct scrollback_stream *term_scrollback_stream_new(struct terminal *term);
+void term_scrollback_stream_destroy(struct scrollback_stream *stream);
+bool term_scrollback_stream_next(
+    struct scrollback_stream *stream, char **text, size_t *len, bool *done);
+void term_scrollback_streams_detach(struct terminal *term);
 bool term_view_to_text(
     const struct terminal *term, char **text, size_t *len);
 
@@ -1137,6 +1137,8 @@ test_section_tweak(void)
 #endif
     test_boolean(&ctx, &parse_section_tweak, "damage-whole-window",
                  &conf.tweak.damage_whole_window);
+    test_boolean(&ctx, &parse_section_tweak, "parser-threads",
+                 &conf.tweak.parser_threads);
 
 #if defined(FOOT_GRAPHEME_CLUSTERING)
     test_boolean(&ctx, &parse_section_tweak, "grapheme-shaping",
@@ -1157,6 +1159,11 @@ test_section_tweak(void)
     test_boolean(&ctx, &parse_section_tweak, "font-monospace-warn",
                  &conf.tweak.font_monospace_warn);
 
+    test_uint32(&ctx, &parse_section_tweak, "cold-scrollback",
+                &conf.tweak.cold_scrollback);
+    test_uint32(&ctx, &parse_section_tweak, "max-shm-cache-size-mb",
+                &conf.tweak.max_shm_cache_size_mb);
+
 #if 0 /* Must be equal to, or less than INT32_MAX */
     test_uint32(&ctx, &parse_section_tweak, "max-shm-pool-size-mb",
                 &conf.tweak.max_shm_pool_size);
@@ -669,13 +669,13 @@ tag_cells_for_url(struct terminal *term, const struct url *url, bool value)
     size_t r = start->row & (term->grid->num_rows - 1);
     size_t c = start->col;
 
-    struct row *row = term->grid->rows[r];
+    struct row *row = grid_row_thaw(term->grid, r);
     row->dirty = true;
 
     while (true) {
         struct cell *cell = &row->cells[c];
         cell->attrs.url = value;
-        cell->attrs.clean = 0;
+        grid_row_dirty_cell(row, c);
 
         if (r == end_r && c == end->col)
             break;
@@ -684,7 +684,7 @@ tag_cells_for_url(struct terminal *term, const struct url *url, bool value)
             r = (r + 1) & (term->grid->num_rows - 1);
             c = 0;
 
-            row = term->grid->rows[r];
+            row = grid_row_thaw(term->grid, r);
             if (row == NULL) {
                 /* Un-allocated scrollback. This most likely means a
                  * runaway OSC-8 URL. */
@@ -716,8 +716,7 @@ urls_render(struct terminal *term)
     {
         struct row *cursor_row = term->render.last_cursor.row;
         if (cursor_row != NULL) {
-            struct cell *cell = &cursor_row->cells[term->render.last_cursor.col];
-            cell->attrs.clean = 0;
+            grid_row_dirty_cell(cursor_row, term->render.last_cursor.col);
             cursor_row->dirty = true;
         }
     }
@@ -4,10 +4,18 @@
 #include <string.h>
 #include <unistd.h>
 
+#if defined(__AVX2__) || defined(__SSE2__)
+ #include <immintrin.h>
+#endif
+
 #if defined(FOOT_GRAPHEME_CLUSTERING)
  #include <utf8proc.h>
 #endif
 
+#if defined(FOOT_VT_STATS)
+ #include <time.h>
+#endif
+
 #define LOG_MODULE "vt"
 #define LOG_ENABLE_DBG 0
 #include "log.h"
@@ -52,7 +60,8 @@ enum state {
     STATE_UTF8_43,
 };
 
-#if defined(_DEBUG) && defined(LOG_ENABLE_DBG) && LOG_ENABLE_DBG && 0
+#if (defined(_DEBUG) && defined(LOG_ENABLE_DBG) && LOG_ENABLE_DBG && 0) || \
+    defined(FOOT_VT_STATS)
 static const char *const state_names[] = {
     [STATE_GROUND] = "ground",
 
@@ -77,9 +86,51 @@ static const char *const state_names[] = {
     [STATE_UTF8_21] = "UTF8 2-byte 1/2",
     [STATE_UTF8_31] = "UTF8 3-byte 1/3",
     [STATE_UTF8_32] = "UTF8 3-byte 2/3",
+    [STATE_UTF8_41] = "UTF8 4-byte 1/4",
+    [STATE_UTF8_42] = "UTF8 4-byte 2/4",
+    [STATE_UTF8_43] = "UTF8 4-byte 3/4",
 };
 #endif
 
+#if defined(FOOT_VT_STATS)
+static_assert(ALEN(state_names) == VT_STATE_COUNT, "state count mismatch");
+
+/*
+ * Parser instrumentation, used by foot-bench. Only compiled in when
+ * FOOT_VT_STATS is defined, and only active when a stats object has
+ * been registered with vt_stats_enable().
+ */
+static struct vt_stats *stats;
+
+void
+vt_stats_enable(struct vt_stats *_stats)
+{
+    stats = _stats;
+}
+
+const char *
+vt_state_name(int state)
+{
+    xassert(state >= 0 && state < VT_STATE_COUNT);
+    return state_names[state];
+}
+
+/* Account everything since ‘*since’ to ‘state’, and restart the clock */
+static void
+stats_account(enum state state, size_t bytes, struct timespec *since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    stats->bytes[state] += bytes;
+    stats->ns[state] +=
+        (now.tv_sec - since->tv_sec) * 1000000000ull +
+        (now.tv_nsec - since->tv_nsec);
+    stats->segments[state]++;
+    *since = now;
+}
+#endif
+
 #if defined(LOG_ENABLE_DBG) && LOG_ENABLE_DBG
 static const char *
 esc_as_string(struct terminal *term, uint8_t final)
@@ -102,11 +153,6 @@ esc_as_string(struct terminal *term, uint8_t final)
 }
 #endif
 
-static void
-action_ignore(struct terminal *term)
-{
-}
-
 static void
 action_clear(struct terminal *term)
 {
@@ -129,7 +175,9 @@ action_execute(struct terminal *term, uint8_t c)
 
     case '\a':
         /* BEL - bell */
+        term_shared_lock(term);
         term_bell(term);
+        term_shared_unlock(term);
         break;
 
     case '\b':
@@ -203,15 +251,16 @@ action_execute(struct terminal *term, uint8_t c)
             row->dirty = true;
 
             row->cells[start_col].wc = '\t';
-            row->cells[start_col].attrs.clean = 0;
+            grid_row_dirty_cell(row, start_col);
 
             for (struct cell *cell = &row->cells[start_col + 1];
                  cell < &row->cells[new_col];
                  cell++)
             {
                 cell->wc = L' ';
-                cell->attrs.clean = 0;
             }
+
+            grid_row_dirty_cells(row, start_col + 1, new_col);
         }
 
         /* According to the specification, HT _should_ cancel LCF. But
@@ -290,6 +339,23 @@ action_print(struct terminal *term, uint8_t c)
 {
     term_reset_grapheme_state(term);
     term->ascii_printer(term, c);
+
+#if defined(FOOT_VT_STATS)
+    if (stats != NULL)
+        stats->printed++;
+#endif
+}
+
+static void
+action_print_run(struct terminal *term, const uint8_t *s, size_t count)
+{
+    term_reset_grapheme_state(term);
+    term_print_ascii_run(term, s, count);
+
+#if defined(FOOT_VT_STATS)
+    if (stats != NULL)
+        stats->printed += count;
+#endif
 }
 
 static void
@@ -452,7 +518,9 @@ action_esc_dispatch(struct terminal *term, uint8_t final)
             break;
 
         case 'c':
+            term_shared_lock(term);
             term_reset(term, true);
+            term_shared_unlock(term);
             break;
 
         case 'n':
@@ -552,6 +620,7 @@ action_esc_dispatch(struct terminal *term, uint8_t final)
                     row->cells[c].wc = L'E';
                     row->cells[c].attrs = (struct attributes){0};
                 }
+                grid_row_dirty_all(row, term->cols);
                 row->dirty = true;
             }
             break;
@@ -561,10 +630,27 @@ action_esc_dispatch(struct terminal *term, uint8_t final)
     }
 }
 
+/*
+ * CSI sequences that may touch state shared with other terminals
+ * (seats, the FDM, Wayland objects etc); mode changes (DECSET,
+ * DECRST, XTRESTORE), window operations, DECSCUSR and DECSTR.
+ */
+static inline bool
+csi_needs_shared_lock(uint8_t final)
+{
+    return final == 'h' || final == 'l' || final == 'r' ||
+           final == 't' || final == 'q' || final == 'p';
+}
+
 static void
 action_csi_dispatch(struct terminal *term, uint8_t c)
 {
-    csi_dispatch(term, c);
+    if (unlikely(csi_needs_shared_lock(c))) {
+        term_shared_lock(term);
+        csi_dispatch(term, c);
+        term_shared_unlock(term);
+    } else
+        csi_dispatch(term, c);
 }
 
 static void
@@ -580,7 +666,10 @@ action_osc_end(struct terminal *term, uint8_t c)
         return;
     term->vt.osc.data[term->vt.osc.idx] = '\0';
     term->vt.osc.bel = c == '\a';
+
+    term_shared_lock(term);
     osc_dispatch(term);
+    term_shared_unlock(term);
 }
 
 static void
@@ -594,13 +683,17 @@ action_osc_put(struct terminal *term, uint8_t c)
 static void
 action_hook(struct terminal *term, uint8_t c)
 {
+    term_shared_lock(term);
     dcs_hook(term, c);
+    term_shared_unlock(term);
 }
 
 static void
 action_unhook(struct terminal *term, uint8_t c)
 {
+    term_shared_lock(term);
     dcs_unhook(term);
+    term_shared_unlock(term);
 }
 
 static void
@@ -822,8 +915,14 @@ action_utf8_print(struct terminal *term, wchar_t wc)
 
 
 out:
-    if (width > 0)
+    if (width > 0) {
         term_print(term, wc, width);
+
+#if defined(FOOT_VT_STATS)
+        if (stats != NULL)
+            stats->printed++;
+#endif
+    }
 }
 
 static void
@@ -892,392 +991,514 @@ action_utf8_44(struct terminal *term, uint8_t c)
     action_utf8_print(term, term->vt.utf8);
 }
 
-IGNORE_WARNING("-Wpedantic")
-
-static enum state
-anywhere(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x18:                                           action_execute(term, data);                                       return STATE_GROUND;
-    case 0x1a:                                           action_execute(term, data);                                       return STATE_GROUND;
-    case 0x1b:                                                                            action_clear(term);              return STATE_ESCAPE;
-
-    /* 8-bit C1 control characters (not supported) */
-    case 0x80 ... 0x9f:                                                                                                    return STATE_GROUND;
-    }
+/*
+ * Parser actions. Transitions that perform more than one action
+ * (exit + entry actions, in DEC parser terms) have their own,
+ * combined, action.
+ */
+enum action {
+    ACTION_IGNORE,
+    ACTION_CLEAR,
+    ACTION_EXECUTE,
+    ACTION_PRINT,
+    ACTION_PARAM,
+    ACTION_COLLECT,
+    ACTION_ESC_DISPATCH,
+    ACTION_CSI_DISPATCH,
+    ACTION_OSC_START,
+    ACTION_OSC_PUT,
+    ACTION_OSC_END,
+    ACTION_OSC_END_EXECUTE,
+    ACTION_OSC_END_CLEAR,
+    ACTION_HOOK,
+    ACTION_PUT,
+    ACTION_UNHOOK,
+    ACTION_UNHOOK_EXECUTE,
+    ACTION_UNHOOK_CLEAR,
+    ACTION_UTF8_21,
+    ACTION_UTF8_22,
+    ACTION_UTF8_31,
+    ACTION_UTF8_32,
+    ACTION_UTF8_33,
+    ACTION_UTF8_41,
+    ACTION_UTF8_42,
+    ACTION_UTF8_43,
+    ACTION_UTF8_44,
+};
 
-    return term->vt.state;
-}
+struct transition {
+    uint8_t action;  /* enum action */
+    uint8_t state;   /* enum state - the new state */
+};
 
-static enum state
-state_ground_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_GROUND;
-
-    /* modified from 0x20..0x7f to 0x20..0x7e, since 0x7f is DEL, which is a zero-width character */
-    case 0x20 ... 0x7e:                                  action_print(term, data);                                         return STATE_GROUND;
-
-    case 0xc2 ... 0xdf:                                  action_utf8_21(term, data);                                       return STATE_UTF8_21;
-    case 0xe0 ... 0xef:                                  action_utf8_31(term, data);                                       return STATE_UTF8_31;
-    case 0xf0 ... 0xf4:                                  action_utf8_41(term, data);                                       return STATE_UTF8_41;
-    }
+/*
+ * Default transitions for states that handle the “anywhere”
+ * transitions. Bytes not explicitly handled by the state are
+ * ignored, and do not change the state.
+ *
+ * Must be listed *first*, since the state specific transitions
+ * override these.
+ */
+#define ANYWHERE(current)                                                 \
+    [0x00 ... 0xff] = {ACTION_IGNORE,           STATE_##current},        \
+    [0x18]          = {ACTION_EXECUTE,          STATE_GROUND},           \
+    [0x1a]          = {ACTION_EXECUTE,          STATE_GROUND},           \
+    [0x1b]          = {ACTION_CLEAR,            STATE_ESCAPE},           \
+                                                                          \
+    /* 8-bit C1 control characters (not supported) */                     \
+    [0x80 ... 0x9f] = {ACTION_IGNORE,           STATE_GROUND}
+
+/* C0 control characters, *except* 0x18, 0x1a and 0x1b (“anywhere”) */
+#define C0(action, state)                                                 \
+    [0x00 ... 0x17] = {ACTION_##action,         STATE_##state},          \
+    [0x19]          = {ACTION_##action,         STATE_##state},          \
+    [0x1c ... 0x1f] = {ACTION_##action,         STATE_##state}
 
-    return anywhere(term, data);
-}
+IGNORE_WARNING("-Wpedantic")
+IGNORE_WARNING("-Woverride-init")
+
+static const struct transition transitions[][256] = {
+    [STATE_GROUND] = {
+        ANYWHERE(GROUND),
+        C0(EXECUTE, GROUND),
+
+        /* modified from 0x20..0x7f to 0x20..0x7e, since 0x7f is DEL, which is a zero-width character */
+        [0x20 ... 0x7e] = {ACTION_PRINT,            STATE_GROUND},
+
+        [0xc2 ... 0xdf] = {ACTION_UTF8_21,          STATE_UTF8_21},
+        [0xe0 ... 0xef] = {ACTION_UTF8_31,          STATE_UTF8_31},
+        [0xf0 ... 0xf4] = {ACTION_UTF8_41,          STATE_UTF8_41},
+    },
+
+    [STATE_ESCAPE] = {
+        ANYWHERE(ESCAPE),
+        C0(EXECUTE, ESCAPE),
+
+        [0x20 ... 0x2f] = {ACTION_COLLECT,          STATE_ESCAPE_INTERMEDIATE},
+        [0x30 ... 0x4f] = {ACTION_ESC_DISPATCH,     STATE_GROUND},
+        [0x50]          = {ACTION_CLEAR,            STATE_DCS_ENTRY},
+        [0x51 ... 0x57] = {ACTION_ESC_DISPATCH,     STATE_GROUND},
+        [0x58]          = {ACTION_IGNORE,           STATE_SOS_PM_APC_STRING},
+        [0x59]          = {ACTION_ESC_DISPATCH,     STATE_GROUND},
+        [0x5a]          = {ACTION_ESC_DISPATCH,     STATE_GROUND},
+        [0x5b]          = {ACTION_CLEAR,            STATE_CSI_ENTRY},
+        [0x5c]          = {ACTION_ESC_DISPATCH,     STATE_GROUND},
+        [0x5d]          = {ACTION_OSC_START,        STATE_OSC_STRING},
+        [0x5e ... 0x5f] = {ACTION_IGNORE,           STATE_SOS_PM_APC_STRING},
+        [0x60 ... 0x7e] = {ACTION_ESC_DISPATCH,     STATE_GROUND},
+        [0x7f]          = {ACTION_IGNORE,           STATE_ESCAPE},
+    },
+
+    [STATE_ESCAPE_INTERMEDIATE] = {
+        ANYWHERE(ESCAPE_INTERMEDIATE),
+        C0(EXECUTE, ESCAPE_INTERMEDIATE),
+
+        [0x20 ... 0x2f] = {ACTION_COLLECT,          STATE_ESCAPE_INTERMEDIATE},
+        [0x30 ... 0x7e] = {ACTION_ESC_DISPATCH,     STATE_GROUND},
+        [0x7f]          = {ACTION_IGNORE,           STATE_ESCAPE_INTERMEDIATE},
+    },
+
+    [STATE_CSI_ENTRY] = {
+        ANYWHERE(CSI_ENTRY),
+        C0(EXECUTE, CSI_ENTRY),
+
+        [0x20 ... 0x2f] = {ACTION_COLLECT,          STATE_CSI_INTERMEDIATE},
+        [0x30 ... 0x39] = {ACTION_PARAM,            STATE_CSI_PARAM},
+        [0x3a ... 0x3b] = {ACTION_PARAM,            STATE_CSI_PARAM},
+        [0x3c ... 0x3f] = {ACTION_COLLECT,          STATE_CSI_PARAM},
+        [0x40 ... 0x7e] = {ACTION_CSI_DISPATCH,     STATE_GROUND},
+        [0x7f]          = {ACTION_IGNORE,           STATE_CSI_ENTRY},
+    },
+
+    [STATE_CSI_PARAM] = {
+        ANYWHERE(CSI_PARAM),
+        C0(EXECUTE, CSI_PARAM),
+
+        [0x20 ... 0x2f] = {ACTION_COLLECT,          STATE_CSI_INTERMEDIATE},
+        [0x30 ... 0x39] = {ACTION_PARAM,            STATE_CSI_PARAM},
+        [0x3a ... 0x3b] = {ACTION_PARAM,            STATE_CSI_PARAM},
+        [0x3c ... 0x3f] = {ACTION_IGNORE,           STATE_CSI_IGNORE},
+        [0x40 ... 0x7e] = {ACTION_CSI_DISPATCH,     STATE_GROUND},
+        [0x7f]          = {ACTION_IGNORE,           STATE_CSI_PARAM},
+    },
+
+    [STATE_CSI_INTERMEDIATE] = {
+        ANYWHERE(CSI_INTERMEDIATE),
+        C0(EXECUTE, CSI_INTERMEDIATE),
+
+        [0x20 ... 0x2f] = {ACTION_COLLECT,          STATE_CSI_INTERMEDIATE},
+        [0x30 ... 0x3f] = {ACTION_IGNORE,           STATE_CSI_IGNORE},
+        [0x40 ... 0x7e] = {ACTION_CSI_DISPATCH,     STATE_GROUND},
+        [0x7f]          = {ACTION_IGNORE,           STATE_CSI_INTERMEDIATE},
+    },
+
+    [STATE_CSI_IGNORE] = {
+        ANYWHERE(CSI_IGNORE),
+        C0(EXECUTE, CSI_IGNORE),
+
+        [0x20 ... 0x3f] = {ACTION_IGNORE,           STATE_CSI_IGNORE},
+        [0x40 ... 0x7e] = {ACTION_IGNORE,           STATE_GROUND},
+        [0x7f]          = {ACTION_IGNORE,           STATE_CSI_IGNORE},
+    },
+
+    [STATE_OSC_STRING] = {
+        /* Note: original was 20-7f, but I changed to 20-ff to include utf-8. Don't forget to add EXECUTE to 8-bit C1 if we implement that. */
+        [0x00 ... 0xff] = {ACTION_OSC_PUT,          STATE_OSC_STRING},
+
+        C0(IGNORE, OSC_STRING),
+        [0x07]          = {ACTION_OSC_END,          STATE_GROUND},
+
+        [0x18]          = {ACTION_OSC_END_EXECUTE,  STATE_GROUND},
+        [0x1a]          = {ACTION_OSC_END_EXECUTE,  STATE_GROUND},
+        [0x1b]          = {ACTION_OSC_END_CLEAR,    STATE_ESCAPE},
+    },
+
+    [STATE_DCS_ENTRY] = {
+        ANYWHERE(DCS_ENTRY),
+        C0(IGNORE, DCS_ENTRY),
+
+        [0x20 ... 0x2f] = {ACTION_COLLECT,          STATE_DCS_INTERMEDIATE},
+        [0x30 ... 0x39] = {ACTION_PARAM,            STATE_DCS_PARAM},
+        [0x3a]          = {ACTION_IGNORE,           STATE_DCS_IGNORE},
+        [0x3b]          = {ACTION_PARAM,            STATE_DCS_PARAM},
+        [0x3c ... 0x3f] = {ACTION_COLLECT,          STATE_DCS_PARAM},
+        [0x40 ... 0x7e] = {ACTION_HOOK,             STATE_DCS_PASSTHROUGH},
+        [0x7f]          = {ACTION_IGNORE,           STATE_DCS_ENTRY},
+    },
+
+    [STATE_DCS_PARAM] = {
+        ANYWHERE(DCS_PARAM),
+        C0(IGNORE, DCS_PARAM),
+
+        [0x20 ... 0x2f] = {ACTION_COLLECT,          STATE_DCS_INTERMEDIATE},
+        [0x30 ... 0x39] = {ACTION_PARAM,            STATE_DCS_PARAM},
+        [0x3a]          = {ACTION_IGNORE,           STATE_DCS_IGNORE},
+        [0x3b]          = {ACTION_PARAM,            STATE_DCS_PARAM},
+        [0x3c ... 0x3f] = {ACTION_IGNORE,           STATE_DCS_IGNORE},
+        [0x40 ... 0x7e] = {ACTION_HOOK,             STATE_DCS_PASSTHROUGH},
+        [0x7f]          = {ACTION_IGNORE,           STATE_DCS_PARAM},
+    },
+
+    [STATE_DCS_INTERMEDIATE] = {
+        ANYWHERE(DCS_INTERMEDIATE),
+        C0(IGNORE, DCS_INTERMEDIATE),
+
+        [0x20 ... 0x2f] = {ACTION_COLLECT,          STATE_DCS_INTERMEDIATE},
+        [0x30 ... 0x3f] = {ACTION_IGNORE,           STATE_DCS_IGNORE},
+        [0x40 ... 0x7e] = {ACTION_HOOK,             STATE_DCS_PASSTHROUGH},
+        [0x7f]          = {ACTION_IGNORE,           STATE_DCS_INTERMEDIATE},
+    },
+
+    [STATE_DCS_IGNORE] = {
+        ANYWHERE(DCS_IGNORE),
+        C0(IGNORE, DCS_IGNORE),
+
+        [0x20 ... 0x7f] = {ACTION_IGNORE,           STATE_DCS_IGNORE},
+    },
+
+    [STATE_DCS_PASSTHROUGH] = {
+        [0x00 ... 0xff] = {ACTION_IGNORE,           STATE_DCS_PASSTHROUGH},
+
+        C0(PUT, DCS_PASSTHROUGH),
+        [0x20 ... 0x7e] = {ACTION_PUT,              STATE_DCS_PASSTHROUGH},
+        [0x7f]          = {ACTION_IGNORE,           STATE_DCS_PASSTHROUGH},
+
+        /* Anywhere */
+        [0x18]          = {ACTION_UNHOOK_EXECUTE,   STATE_GROUND},
+        [0x1a]          = {ACTION_UNHOOK_EXECUTE,   STATE_GROUND},
+        [0x1b]          = {ACTION_UNHOOK_CLEAR,     STATE_ESCAPE},
+
+        /* 8-bit C1 control characters (not supported) */
+        [0x80 ... 0x9f] = {ACTION_UNHOOK,           STATE_GROUND},
+    },
+
+    [STATE_SOS_PM_APC_STRING] = {
+        ANYWHERE(SOS_PM_APC_STRING),
+        C0(IGNORE, SOS_PM_APC_STRING),
+
+        [0x20 ... 0x7f] = {ACTION_IGNORE,           STATE_SOS_PM_APC_STRING},
+    },
+
+    /* Invalid UTF-8 sequences are silently dropped */
+    [STATE_UTF8_21] = {
+        [0x00 ... 0xff] = {ACTION_IGNORE,           STATE_GROUND},
+        [0x80 ... 0xbf] = {ACTION_UTF8_22,          STATE_GROUND},
+    },
+
+    [STATE_UTF8_31] = {
+        [0x00 ... 0xff] = {ACTION_IGNORE,           STATE_GROUND},
+        [0x80 ... 0xbf] = {ACTION_UTF8_32,          STATE_UTF8_32},
+    },
+
+    [STATE_UTF8_32] = {
+        [0x00 ... 0xff] = {ACTION_IGNORE,           STATE_GROUND},
+        [0x80 ... 0xbf] = {ACTION_UTF8_33,          STATE_GROUND},
+    },
+
+    [STATE_UTF8_41] = {
+        [0x00 ... 0xff] = {ACTION_IGNORE,           STATE_GROUND},
+        [0x80 ... 0xbf] = {ACTION_UTF8_42,          STATE_UTF8_42},
+    },
+
+    [STATE_UTF8_42] = {
+        [0x00 ... 0xff] = {ACTION_IGNORE,           STATE_GROUND},
+        [0x80 ... 0xbf] = {ACTION_UTF8_43,          STATE_UTF8_43},
+    },
+
+    [STATE_UTF8_43] = {
+        [0x00 ... 0xff] = {ACTION_IGNORE,           STATE_GROUND},
+        [0x80 ... 0xbf] = {ACTION_UTF8_44,          STATE_GROUND},
+    },
+};
 
-static enum state
-state_escape_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_ESCAPE;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_ESCAPE_INTERMEDIATE;
-    case 0x30 ... 0x4f:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x50:                                                                            action_clear(term);              return STATE_DCS_ENTRY;
-    case 0x51 ... 0x57:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x58:                                                                                                             return STATE_SOS_PM_APC_STRING;
-    case 0x59:                                           action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x5a:                                           action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x5b:                                                                            action_clear(term);              return STATE_CSI_ENTRY;
-    case 0x5c:                                           action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x5d:                                                                            action_osc_start(term, data);    return STATE_OSC_STRING;
-    case 0x5e ... 0x5f:                                                                                                    return STATE_SOS_PM_APC_STRING;
-    case 0x60 ... 0x7e:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_ESCAPE;
-    }
+UNIGNORE_WARNINGS
+UNIGNORE_WARNINGS
 
-    return anywhere(term, data);
-}
+#undef ANYWHERE
+#undef C0
 
-static enum state
-state_escape_intermediate_switch(struct terminal *term, uint8_t data)
+static void
+perform_action(struct terminal *term, enum action action, uint8_t data)
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_ESCAPE_INTERMEDIATE;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_ESCAPE_INTERMEDIATE;
-    case 0x30 ... 0x7e:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_ESCAPE_INTERMEDIATE;
+    switch (action) {
+    case ACTION_IGNORE:                                                 break;
+    case ACTION_CLEAR:            action_clear(term);                   break;
+    case ACTION_EXECUTE:          action_execute(term, data);           break;
+    case ACTION_PRINT:            action_print(term, data);             break;
+    case ACTION_PARAM:            action_param(term, data);             break;
+    case ACTION_COLLECT:          action_collect(term, data);           break;
+    case ACTION_ESC_DISPATCH:     action_esc_dispatch(term, data);      break;
+    case ACTION_CSI_DISPATCH:     action_csi_dispatch(term, data);      break;
+    case ACTION_OSC_START:        action_osc_start(term, data);         break;
+    case ACTION_OSC_PUT:          action_osc_put(term, data);           break;
+    case ACTION_OSC_END:          action_osc_end(term, data);           break;
+    case ACTION_OSC_END_EXECUTE:  action_osc_end(term, data);
+                                  action_execute(term, data);           break;
+    case ACTION_OSC_END_CLEAR:    action_osc_end(term, data);
+                                  action_clear(term);                   break;
+    case ACTION_HOOK:             action_hook(term, data);              break;
+    case ACTION_PUT:              action_put(term, data);               break;
+    case ACTION_UNHOOK:           action_unhook(term, data);            break;
+    case ACTION_UNHOOK_EXECUTE:   action_unhook(term, data);
+                                  action_execute(term, data);           break;
+    case ACTION_UNHOOK_CLEAR:     action_unhook(term, data);
+                                  action_clear(term);                   break;
+    case ACTION_UTF8_21:          action_utf8_21(term, data);           break;
+    case ACTION_UTF8_22:          action_utf8_22(term, data);           break;
+    case ACTION_UTF8_31:          action_utf8_31(term, data);           break;
+    case ACTION_UTF8_32:          action_utf8_32(term, data);           break;
+    case ACTION_UTF8_33:          action_utf8_33(term, data);           break;
+    case ACTION_UTF8_41:          action_utf8_41(term, data);           break;
+    case ACTION_UTF8_42:          action_utf8_42(term, data);           break;
+    case ACTION_UTF8_43:          action_utf8_43(term, data);           break;
+    case ACTION_UTF8_44:          action_utf8_44(term, data);           break;
     }
-
-    return anywhere(term, data);
 }
 
-static enum state
-state_csi_entry_switch(struct terminal *term, uint8_t data)
+/*
+ * Returns the number of leading bytes in 's' that are printable ASCII
+ * (0x20-0x7e), i.e. bytes that in STATE_GROUND would all be handed
+ * to action_print(), and nothing else.
+ */
+static inline size_t
+ascii_printable_run_length(const uint8_t *s, size_t len)
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_ENTRY;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_CSI_INTERMEDIATE;
-    case 0x30 ... 0x39:                                  action_param(term, data);                                         return STATE_CSI_PARAM;
-    case 0x3a ... 0x3b:                                  action_param(term, data);                                         return STATE_CSI_PARAM;
-    case 0x3c ... 0x3f:                                  action_collect(term, data);                                       return STATE_CSI_PARAM;
-    case 0x40 ... 0x7e:                                  action_csi_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_ENTRY;
-    }
+    size_t i = 0;
 
-    return anywhere(term, data);
-}
+#if defined(__AVX2__)
+    const __m256i lo = _mm256_set1_epi8(0x20);
+    const __m256i hi = _mm256_set1_epi8(0x7e);
 
-static enum state
-state_csi_param_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_PARAM;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)&s[i]);
 
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_CSI_INTERMEDIATE;
+        /* Signed compare: bytes >= 0x80 are negative, and thus < 0x20 */
+        const __m256i bad = _mm256_or_si256(
+            _mm256_cmpgt_epi8(lo, v), _mm256_cmpgt_epi8(v, hi));
+        const uint32_t mask = _mm256_movemask_epi8(bad);
 
-    case 0x30 ... 0x39:
-    case 0x3a ... 0x3b:                                  action_param(term, data);                                         return STATE_CSI_PARAM;
-
-    case 0x3c ... 0x3f:                                                                                                    return STATE_CSI_IGNORE;
-    case 0x40 ... 0x7e:                                  action_csi_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_PARAM;
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
     }
+#endif
 
-    return anywhere(term, data);
-}
-
-static enum state
-state_csi_intermediate_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_INTERMEDIATE;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_CSI_INTERMEDIATE;
-    case 0x30 ... 0x3f:                                                                                                    return STATE_CSI_IGNORE;
-    case 0x40 ... 0x7e:                                  action_csi_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_INTERMEDIATE;
-    }
+#if defined(__SSE2__)
+    const __m128i lo128 = _mm_set1_epi8(0x20);
+    const __m128i hi128 = _mm_set1_epi8(0x7e);
 
-    return anywhere(term, data);
-}
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)&s[i]);
+        const __m128i bad = _mm_or_si128(
+            _mm_cmplt_epi8(v, lo128), _mm_cmpgt_epi8(v, hi128));
+        const uint32_t mask = _mm_movemask_epi8(bad);
 
-static enum state
-state_csi_ignore_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_IGNORE;
-
-    case 0x20 ... 0x3f:                                  action_ignore(term);                                              return STATE_CSI_IGNORE;
-    case 0x40 ... 0x7e:                                                                                                    return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_IGNORE;
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
     }
+#endif
 
-    return anywhere(term, data);
-}
-
-static enum state
-state_osc_string_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-
-    /* Note: original was 20-7f, but I changed to 20-ff to include utf-8. Don't forget to add EXECUTE to 8-bit C1 if we implement that. */
-    default:                                             action_osc_put(term, data);                                       return STATE_OSC_STRING;
-
-    case 0x07:          action_osc_end(term, data);                                                                        return STATE_GROUND;
-
-    case 0x00 ... 0x06:
-    case 0x08 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_OSC_STRING;
-
-
-    case 0x18:
-    case 0x1a:          action_osc_end(term, data);      action_execute(term, data);                                       return STATE_GROUND;
-
-    case 0x1b:          action_osc_end(term, data);      action_clear(term);                                               return STATE_ESCAPE;
+    for (; i < len; i++) {
+        if (s[i] < 0x20 || s[i] > 0x7e)
+            break;
     }
+
+    return i;
 }
 
-static enum state
-state_dcs_entry_switch(struct terminal *term, uint8_t data)
+/*
+ * Decodes a complete UTF-8 sequence, bypassing the intermediate UTF-8
+ * states. Returns the number of bytes consumed, or 0 if the sequence
+ * is incomplete (or invalid), in which case it is left to the state
+ * machine.
+ */
+static inline size_t
+utf8_sequence(struct terminal *term, const uint8_t *s, size_t len)
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_DCS_ENTRY;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_DCS_INTERMEDIATE;
-    case 0x30 ... 0x39:                                  action_param(term, data);                                         return STATE_DCS_PARAM;
-    case 0x3a:                                                                                                             return STATE_DCS_IGNORE;
-    case 0x3b:                                           action_param(term, data);                                         return STATE_DCS_PARAM;
-    case 0x3c ... 0x3f:                                  action_collect(term, data);                                       return STATE_DCS_PARAM;
-    case 0x40 ... 0x7e:                                                                   action_hook(term, data);         return STATE_DCS_PASSTHROUGH;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_ENTRY;
-    }
+    const uint8_t c = s[0];
 
-    return anywhere(term, data);
-}
+    if (c >= 0xc2 && c <= 0xdf) {
+        if (len < 2 || (s[1] & 0xc0) != 0x80)
+            return 0;
 
-static enum state
-state_dcs_param_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_DCS_PARAM;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_DCS_INTERMEDIATE;
-    case 0x30 ... 0x39:                                  action_param(term, data);                                         return STATE_DCS_PARAM;
-    case 0x3a:                                                                                                             return STATE_DCS_IGNORE;
-    case 0x3b:                                           action_param(term, data);                                         return STATE_DCS_PARAM;
-    case 0x3c ... 0x3f:                                                                                                    return STATE_DCS_IGNORE;
-    case 0x40 ... 0x7e:                                                                   action_hook(term, data);         return STATE_DCS_PASSTHROUGH;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_PARAM;
+        action_utf8_21(term, s[0]);
+        action_utf8_22(term, s[1]);
+        return 2;
     }
 
-    return anywhere(term, data);
-}
+    else if (c >= 0xe0 && c <= 0xef) {
+        if (len < 3 || (s[1] & 0xc0) != 0x80 || (s[2] & 0xc0) != 0x80)
+            return 0;
 
-static enum state
-state_dcs_intermediate_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_DCS_INTERMEDIATE;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_DCS_INTERMEDIATE;
-    case 0x30 ... 0x3f:                                                                                                    return STATE_DCS_IGNORE;
-    case 0x40 ... 0x7e:                                                                   action_hook(term, data);         return STATE_DCS_PASSTHROUGH;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_INTERMEDIATE;
+        action_utf8_31(term, s[0]);
+        action_utf8_32(term, s[1]);
+        action_utf8_33(term, s[2]);
+        return 3;
     }
 
-    return anywhere(term, data);
-}
+    else if (c >= 0xf0 && c <= 0xf4) {
+        if (len < 4 ||
+            (s[1] & 0xc0) != 0x80 ||
+            (s[2] & 0xc0) != 0x80 ||
+            (s[3] & 0xc0) != 0x80)
+        {
+            return 0;
+        }
 
-static enum state
-state_dcs_ignore_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:
-    case 0x20 ... 0x7f:                                  action_ignore(term);                                              return STATE_DCS_IGNORE;
+        action_utf8_41(term, s[0]);
+        action_utf8_42(term, s[1]);
+        action_utf8_43(term, s[2]);
+        action_utf8_44(term, s[3]);
+        return 4;
     }
 
-    return anywhere(term, data);
+    return 0;
 }
 
-static enum state
-state_dcs_passthrough_switch(struct terminal *term, uint8_t data)
+/*
+ * Accumulates a run of decimal digits into the current CSI parameter.
+ * Returns the number of bytes consumed, or 0 if the digits cannot be
+ * handled here (i.e. there is no current parameter yet, or the
+ * current parameter has sub-parameters).
+ */
+static inline size_t
+csi_param_digits(struct terminal *term, const uint8_t *s, size_t len)
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x7e:                                  action_put(term, data);                                           return STATE_DCS_PASSTHROUGH;
+    if (unlikely(term->vt.params.idx == 0))
+        return 0;
 
-    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_PASSTHROUGH;
+    struct vt_param *param = &term->vt.params.v[term->vt.params.idx - 1];
+    if (unlikely(param->sub.idx > 0))
+        return 0;
 
-    /* Anywhere */
-    case 0x18:          action_unhook(term, data);       action_execute(term, data);                                       return STATE_GROUND;
-    case 0x1a:          action_unhook(term, data);       action_execute(term, data);                                       return STATE_GROUND;
-    case 0x1b:          action_unhook(term, data);                                        action_clear(term);              return STATE_ESCAPE;
+    unsigned value = param->value;
+    size_t i = 0;
 
-    /* 8-bit C1 control characters (not supported) */
-    case 0x80 ... 0x9f: action_unhook(term, data);                                                                         return STATE_GROUND;
-
-    default:                                                                                                               return STATE_DCS_PASSTHROUGH;
+    for (; i < len && s[i] >= '0' && s[i] <= '9'; i++) {
+        value *= 10;
+        value += s[i] - '0';
     }
-}
 
-static enum state
-state_sos_pm_apc_string_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x7f:                                  action_ignore(term);                                              return STATE_SOS_PM_APC_STRING;
-    }
-
-    return anywhere(term, data);
+    param->value = value;
+    return i;
 }
 
-static enum state
-state_utf8_21_switch(struct terminal *term, uint8_t data)
+void
+vt_from_slave(struct terminal *term, const uint8_t *data, size_t len)
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_22(term, data);                                       return STATE_GROUND;
-    default:                                                                                                               return STATE_GROUND;
-    }
-}
+    enum state current_state = term->vt.state;
 
-static enum state
-state_utf8_31_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_32(term, data);                                       return STATE_UTF8_32;
-    default:                                                                                                               return STATE_GROUND;
-    }
-}
+    const uint8_t *p = data;
+    const uint8_t *const end = data + len;
+
+#if defined(FOOT_VT_STATS)
+    /* Bytes consumed since the last state change start here */
+    const uint8_t *segment = p;
+    struct timespec segment_start;
+    if (stats != NULL)
+        clock_gettime(CLOCK_MONOTONIC, &segment_start);
+#endif
 
-static enum state
-state_utf8_32_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_33(term, data);                                       return STATE_GROUND;
-    default:                                                                                                               return STATE_GROUND;
-    }
-}
+    while (p < end) {
+        /*
+         * Fast paths for the most common byte sequences. These all
+         * do exactly what the state machine would have done, but
+         * for many bytes at a time.
+         */
+        if (current_state == STATE_GROUND) {
+            if (*p >= 0x20 && *p <= 0x7e) {
+                /*
+                 * Hand the whole run of printable ASCII to the
+                 * printer in one go (the state machine would only
+                 * call action_print() and stay in STATE_GROUND
+                 * anyway). The printer fills entire row segments at
+                 * once.
+                 */
+                const size_t count = ascii_printable_run_length(p, end - p);
+                xassert(count > 0);
 
-static enum state
-state_utf8_41_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_42(term, data);                                       return STATE_UTF8_42;
-    default:                                                                                                               return STATE_GROUND;
-    }
-}
+                action_print_run(term, p, count);
+                p += count;
+                continue;
+            }
 
-static enum state
-state_utf8_42_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_43(term, data);                                       return STATE_UTF8_43;
-    default:                                                                                                               return STATE_GROUND;
-    }
-}
+            if (*p >= 0xc2) {
+                const size_t count = utf8_sequence(term, p, end - p);
+                if (count > 0) {
+                    p += count;
+                    continue;
+                }
+            }
+        }
 
-static enum state
-state_utf8_43_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_44(term, data);                                       return STATE_GROUND;
-    default:                                                                                                               return STATE_GROUND;
-    }
-}
+        else if (current_state == STATE_CSI_PARAM &&
+                 *p >= '0' && *p <= '9')
+        {
+            const size_t count = csi_param_digits(term, p, end - p);
+            if (count > 0) {
+                p += count;
+                continue;
+            }
+        }
 
-UNIGNORE_WARNINGS
+        const uint8_t c = *p++;
+        const struct transition t = transitions[current_state][c];
 
-void
-vt_from_slave(struct terminal *term, const uint8_t *data, size_t len)
-{
-    enum state current_state = term->vt.state;
+        perform_action(term, t.action, c);
 
-    const uint8_t *p = data;
-    for (size_t i = 0; i < len; i++, p++) {
-        switch (current_state) {
-        case STATE_GROUND:              current_state = state_ground_switch(term, *p); break;
-        case STATE_ESCAPE:              current_state = state_escape_switch(term, *p); break;
-        case STATE_ESCAPE_INTERMEDIATE: current_state = state_escape_intermediate_switch(term, *p); break;
-        case STATE_CSI_ENTRY:           current_state = state_csi_entry_switch(term, *p); break;
-        case STATE_CSI_PARAM:           current_state = state_csi_param_switch(term, *p); break;
-        case STATE_CSI_INTERMEDIATE:    current_state = state_csi_intermediate_switch(term, *p); break;
-        case STATE_CSI_IGNORE:          current_state = state_csi_ignore_switch(term, *p); break;
-        case STATE_OSC_STRING:          current_state = state_osc_string_switch(term, *p); break;
-        case STATE_DCS_ENTRY:           current_state = state_dcs_entry_switch(term, *p); break;
-        case STATE_DCS_PARAM:           current_state = state_dcs_param_switch(term, *p); break;
-        case STATE_DCS_INTERMEDIATE:    current_state = state_dcs_intermediate_switch(term, *p); break;
-        case STATE_DCS_IGNORE:          current_state = state_dcs_ignore_switch(term, *p); break;
-        case STATE_DCS_PASSTHROUGH:     current_state = state_dcs_passthrough_switch(term, *p); break;
-        case STATE_SOS_PM_APC_STRING:   current_state = state_sos_pm_apc_string_switch(term, *p); break;
-
-        case STATE_UTF8_21:             current_state = state_utf8_21_switch(term, *p); break;
-        case STATE_UTF8_31:             current_state = state_utf8_31_switch(term, *p); break;
-        case STATE_UTF8_32:             current_state = state_utf8_32_switch(term, *p); break;
-        case STATE_UTF8_41:             current_state = state_utf8_41_switch(term, *p); break;
-        case STATE_UTF8_42:             current_state = state_utf8_42_switch(term, *p); break;
-        case STATE_UTF8_43:             current_state = state_utf8_43_switch(term, *p); break;
+#if defined(FOOT_VT_STATS)
+        if (stats != NULL && t.state != current_state) {
+            stats_account(current_state, p - segment, &segment_start);
+            segment = p;
         }
+#endif
 
-        term->vt.state = current_state;
+        current_state = t.state;
     }
+
+#if defined(FOOT_VT_STATS)
+    if (stats != NULL && p > segment)
+        stats_account(current_state, p - segment, &segment_start);
+#endif
+
+    term->vt.state = current_state;
 }
@@ -26,3 +26,18 @@ vt_param_get(const struct terminal *term, size_t idx, int default_value)
 
     return default_value;
 }
+
+#if defined(FOOT_VT_STATS)
+/* Number of parser states, see ‘enum state’ in vt.c */
+#define VT_STATE_COUNT 20
+
+struct vt_stats {
+    uint64_t bytes[VT_STATE_COUNT];     /* Bytes consumed, per state */
+    uint64_t ns[VT_STATE_COUNT];        /* Time spent, per state */
+    uint64_t segments[VT_STATE_COUNT];  /* Number of times a state was entered */
+    uint64_t printed;                   /* Printed characters */
+};
+
+void vt_stats_enable(struct vt_stats *stats);
+const char *vt_state_name(int state);
+#endif
@@ -1186,6 +1186,7 @@ fdm_hook(struct fdm *fdm, void *data)
 {
     struct wayland *wayl = data;
     wayl_flush(wayl);
+    term_ptmx_budget_reset(&wayl->ptmx_budget);
 }
 
 static bool
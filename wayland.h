@@ -86,6 +86,7 @@ enum bind_action_search {
     BIND_ACTION_SEARCH_EXTEND_WORD_WS,
     BIND_ACTION_SEARCH_CLIPBOARD_PASTE,
     BIND_ACTION_SEARCH_PRIMARY_PASTE,
+    BIND_ACTION_SEARCH_TOGGLE_REGEX,
     BIND_ACTION_SEARCH_COUNT,
 };
 
@@ -452,6 +453,17 @@ struct wl_window {
 
 struct config;
 struct terminal;
+/*
+ * Limits how much client output is read and parsed in a single FDM
+ * loop iteration, across all terminals. See fdm_ptmx().
+ */
+struct ptmx_budget {
+    size_t bytes_left;
+    struct timespec start;   /* Time of first read this iteration */
+    size_t busy;             /* Terminals throttled this iteration */
+    size_t busy_prev;        /* Terminals throttled in the previous (busy) iteration */
+};
+
 struct wayland {
     const struct config *conf;
     struct fdm *fdm;
@@ -488,6 +500,7 @@ struct wayland {
     tll(struct seat) seats;
 
     tll(struct terminal *) terms;
+    struct ptmx_budget ptmx_budget;
 };
 
 struct wayland *wayl_init(const struct config *conf, struct fdm *fdm);